@@ -1,5 +1,6 @@
 #include "alignment.hpp"
 #include "stream.hpp"
+#include <sys/stat.h>
 
 namespace vg {
 
@@ -23,6 +24,11 @@ int hts_for_each(string& filename, function<void(Alignment&)> lambda) {
 }
 
 int hts_for_each_parallel(string& filename, function<void(Alignment&)> lambda) {
+    function<void(Alignment&, uint64_t)> numbered = [&lambda](Alignment& aln, uint64_t) { lambda(aln); };
+    return hts_for_each_parallel(filename, numbered);
+}
+
+int hts_for_each_parallel(string& filename, function<void(Alignment&, uint64_t)> lambda) {
 
     samFile *in = hts_open(filename.c_str(), "r");
     if (in == NULL) return 0;
@@ -37,18 +43,22 @@ int hts_for_each_parallel(string& filename, function<void(Alignment&)> lambda) {
     }
 
     bool more_data = true;
-#pragma omp parallel shared(in, hdr, more_data, rg_sample)
+    uint64_t records = 0;
+#pragma omp parallel shared(in, hdr, more_data, rg_sample, records)
     {
         int tid = omp_get_thread_num();
         while (more_data) {
             bam1_t* b = bs[tid];
+            bool got_anything = false;
+            uint64_t number;
 #pragma omp critical (hts_input)
             if (more_data) {
-                more_data = sam_read1(in, hdr, b) >= 0;
+                got_anything = more_data = sam_read1(in, hdr, b) >= 0;
+                number = records++;
             }
-            if (more_data) {
+            if (got_anything) {
                 Alignment a = bam_to_alignment(b, rg_sample);
-                lambda(a);
+                lambda(a, number);
             }
         }
     }
@@ -141,116 +151,318 @@ bool get_next_alignment_pair_from_fastqs(gzFile fp1, gzFile fp2, char* buffer, s
 
 
 size_t fastq_unpaired_for_each_parallel(string& filename, function<void(Alignment&)> lambda) {
-    gzFile fp = (filename != "-") ? gzopen(filename.c_str(), "r") : gzdopen(fileno(stdin), "r");
-    size_t len = 2 << 18; // 256k
-    size_t nLines = 0;
-    int thread_count = get_thread_count();
-    //vector<Alignment> alns; alns.resize(thread_count);
-    vector<char*> bufs; bufs.resize(thread_count);
-    for (auto& buf : bufs) {
-        buf = new char[len];
-    }
-    bool more_data = true;
-#pragma omp parallel shared(fp, more_data, bufs)
-    {
-        int tid = omp_get_thread_num();
-        while (more_data) {
-            Alignment aln;
-            char* buf = bufs[tid];
-            bool got_anything = false;
-#pragma omp critical (fastq_input)
-            {
-                if (more_data) {
-                    got_anything = more_data = get_next_alignment_from_fastq(fp, buf, len, aln);
-                    nLines++;
-                }
-            }
-            if (got_anything) {
-                lambda(aln);
+    function<void(Alignment&, uint64_t)> numbered = [&lambda](Alignment& aln, uint64_t) { lambda(aln); };
+    return fastq_unpaired_for_each_parallel(filename, numbered);
+}
+
+FastqReader::FastqReader(const string& filename) {
+    if (filename == "-") {
+        fp = gzdopen(fileno(stdin), "r");
+    } else {
+        // sniff the first gzip header for the BGZF extra subfield, which we can
+        // only do on a regular file: pipes (and process substitutions) can't
+        // be rewound or reopened to get back what we read
+        struct stat file_stat;
+        if (stat(filename.c_str(), &file_stat) == 0 && S_ISREG(file_stat.st_mode)) {
+            raw = fopen(filename.c_str(), "rb");
+        }
+        bool bgzf = false;
+        if (raw != nullptr) {
+            unsigned char header[18];
+            bgzf = fread(header, 1, sizeof(header), raw) == sizeof(header)
+                && header[0] == 31 && header[1] == 139 && header[2] == 8 && (header[3] & 4)
+                && header[12] == 'B' && header[13] == 'C' && header[14] == 2 && header[15] == 0;
+        }
+        if (bgzf) {
+            rewind(raw);
+        } else {
+            if (raw != nullptr) {
+                fclose(raw);
+                raw = nullptr;
             }
+            fp = gzopen(filename.c_str(), "r");
         }
     }
-    for (auto& buf : bufs) {
-        delete[] buf;
+    if (raw == nullptr && fp == nullptr) {
+        cerr << "[vg::alignment] could not open " << filename << endl;
+        exit(1);
     }
-    gzclose(fp);
-    return nLines;
 }
 
-size_t fastq_paired_interleaved_for_each_parallel(string& filename, function<void(Alignment&, Alignment&)> lambda) {
-    gzFile fp = (filename != "-") ? gzopen(filename.c_str(), "r") : gzdopen(fileno(stdin), "r");
-    size_t len = 2 << 18; // 256k
-    size_t nLines = 0;
-    int thread_count = get_thread_count();
-    //vector<Alignment> alns; alns.resize(thread_count);
-    vector<char*> bufs; bufs.resize(thread_count);
-    for (auto& buf : bufs) {
-        buf = new char[len];
+FastqReader::~FastqReader(void) {
+    if (fp != nullptr) gzclose(fp);
+    if (raw != nullptr) fclose(raw);
+}
+
+bool FastqReader::fill(void) {
+    if (at_end) {
+        return false;
     }
-    bool more_data = true;
-#pragma omp parallel shared(fp, more_data, bufs)
+    if (raw != nullptr) {
+        at_end = !fill_bgzf();
+        return !at_end;
+    }
+    // about as much text as a batch of BGZF blocks inflates to
+    const size_t len = 4 << 20;
+    size_t old_size = buffer.size();
+    buffer.resize(old_size + len);
+    int got = gzread(fp, &buffer[old_size], len);
+    if (got < 0) {
+        int errnum;
+        cerr << "[vg::alignment.cpp] error: could not read fastq input: " << gzerror(fp, &errnum) << endl;
+        exit(1);
+    }
+    buffer.resize(old_size + got);
+    at_end = got == 0;
+    return !at_end;
+}
+
+bool FastqReader::fill_bgzf(void) {
+    // read this many compressed blocks, then inflate them all at once
+    const size_t batch_size = 64;
+    vector<string> blocks;
+    blocks.reserve(batch_size);
+    unsigned char header[18];
+    while (blocks.size() < batch_size && fread(header, 1, sizeof(header), raw) == sizeof(header)) {
+        if (!(header[0] == 31 && header[1] == 139 && (header[3] & 4) && header[12] == 'B' && header[13] == 'C')) {
+            cerr << "[vg::alignment.cpp] error: malformed BGZF block in fastq input" << endl;
+            exit(1);
+        }
+        size_t size = (header[16] | (header[17] << 8)) + 1;
+        blocks.emplace_back(size, '\0');
+        string& block = blocks.back();
+        memcpy(&block[0], header, sizeof(header));
+        if (size < sizeof(header) + 8
+            || fread(&block[sizeof(header)], 1, size - sizeof(header), raw) != size - sizeof(header)) {
+            cerr << "[vg::alignment.cpp] error: truncated BGZF block in fastq input" << endl;
+            exit(1);
+        }
+    }
+    if (blocks.empty()) {
+        return false;
+    }
+
+    vector<string> text(blocks.size());
+    // wait for just the inflating, not for any chunks of reads the caller has
+    // handed out in tasks of their own
+#pragma omp taskgroup
     {
-        int tid = omp_get_thread_num();
-        while (more_data) {
-            Alignment mate1, mate2;
-            char* buf = bufs[tid];
-            bool got_anything = false;
-#pragma omp critical (fastq_input)
+        for (size_t i = 0; i < blocks.size(); ++i) {
+#pragma omp task firstprivate(i) shared(blocks, text)
             {
-                if (more_data) {
-                    got_anything = more_data = get_next_interleaved_alignment_pair_from_fastq(fp, buf, len, mate1, mate2);
-                    nLines++;
+                string& block = blocks[i];
+                // the inflated size is the last four bytes of the block
+                const unsigned char* isize = (const unsigned char*) &block[block.size() - 4];
+                text[i].resize(isize[0] | (isize[1] << 8) | (isize[2] << 16) | ((uint32_t) isize[3] << 24));
+                z_stream zs;
+                memset(&zs, 0, sizeof(zs));
+                zs.next_in = (Bytef*) &block[0];
+                zs.avail_in = block.size();
+                zs.next_out = (Bytef*) &text[i][0];
+                zs.avail_out = text[i].size();
+                if (inflateInit2(&zs, 31) != Z_OK || inflate(&zs, Z_FINISH) != Z_STREAM_END) {
+#pragma omp critical (cerr)
+                    cerr << "[vg::alignment.cpp] error: could not inflate BGZF block in fastq input" << endl;
+                    exit(1);
                 }
-            }
-            if (got_anything) {
-                lambda(mate1, mate2);
+                inflateEnd(&zs);
             }
         }
     }
-    for (auto& buf : bufs) {
-        delete buf;
+
+    for (auto& t : text) {
+        buffer.append(t);
     }
-    gzclose(fp);
-    return nLines;
+    return true;
 }
 
-size_t fastq_paired_two_files_for_each_parallel(string& file1, string& file2, function<void(Alignment&, Alignment&)> lambda) {
-    gzFile fp1 = (file1 != "-") ? gzopen(file1.c_str(), "r") : gzdopen(fileno(stdin), "r");
-    gzFile fp2 = (file2 != "-") ? gzopen(file2.c_str(), "r") : gzdopen(fileno(stdin), "r");
-    size_t len = 2 << 18; // 256k
-    size_t nLines = 0;
-    int thread_count = get_thread_count();
-    //vector<Alignment> alns; alns.resize(thread_count);
-    vector<char*> bufs; bufs.resize(thread_count);
-    for (auto& buf : bufs) {
-        buf = new char[len];
+size_t FastqReader::read_records(size_t n, string& chunk) {
+    size_t records = 0;
+    while (records < n) {
+        // skip any blank lines between records
+        while (pos < buffer.size() && buffer[pos] == '\n') ++pos;
+        // find the end of the record, four lines on
+        size_t end = pos;
+        int lines = 0;
+        while (lines < 4 && end < buffer.size()) {
+            const char* newline = (const char*) memchr(&buffer[end], '\n', buffer.size() - end);
+            if (newline == nullptr) break;
+            end = newline - buffer.data() + 1;
+            ++lines;
+        }
+        if (lines == 4) {
+            chunk.append(buffer, pos, end - pos);
+            pos = end;
+            ++records;
+            continue;
+        }
+        // the record runs past the text we have, so get some more
+        buffer.erase(0, pos);
+        pos = 0;
+        if (!fill()) {
+            if (buffer.empty()) {
+                break;
+            }
+            if (lines == 3 && buffer.back() != '\n') {
+                // the last line is missing its newline
+                buffer.push_back('\n');
+                continue;
+            }
+            cerr << "[vg::alignment.cpp] error: incomplete fastq record" << endl;
+            exit(1);
+        }
     }
-    bool more_data = true;
-#pragma omp parallel shared(fp1, fp2, more_data, bufs)
+    return records;
+}
+
+size_t parse_fastq_record(const string& text, size_t pos, Alignment& alignment) {
+
+    alignment.Clear();
+
+    // handle name
+    size_t end = text.find('\n', pos);
+    // trim off leading @, and keep trailing /1 /2
+    alignment.set_name(text.substr(pos + 1, end - pos - 1));
+    pos = end + 1;
+    // handle sequence
+    end = text.find('\n', pos);
+    alignment.set_sequence(text.substr(pos, end - pos));
+    pos = end + 1;
+    // handle "+" sep
+    pos = text.find('\n', pos) + 1;
+    // handle quality
+    end = text.find('\n', pos);
+    alignment.set_quality(string_quality_char_to_short(text.substr(pos, end - pos)));
+
+    return end + 1;
+
+}
+
+// shared by the parallel FASTQ readers
+// the calling thread only reads the text of whole records, in chunks of many
+// reads (or pairs), and hands each chunk to an OpenMP task that parses it and
+// runs the lambda on the reads. if in2 is given the second mates come from it,
+// otherwise pairs are interleaved in in1.
+static size_t fastq_for_each_parallel_impl(FastqReader& in1, FastqReader* in2, bool pairs,
+                                           const function<void(Alignment&, uint64_t)>& lambda,
+                                           const function<void(Alignment&, Alignment&, uint64_t)>& lambda_pair) {
+
+    // reads (or pairs) are handed to worker threads in chunks of this many
+    const size_t chunk_size = 2048;
+    // and we hold at most this many chunks in memory at once
+    const uint64_t max_chunks_outstanding = 4 * get_thread_count();
+    uint64_t chunks_outstanding = 0;
+    size_t count = 0;
+
+    auto process_chunk = [&lambda, &lambda_pair, pairs](const string& text1, const string& text2,
+                                                        size_t n, uint64_t first) {
+        size_t pos1 = 0, pos2 = 0;
+        if (pairs) {
+            Alignment mate1, mate2;
+            for (size_t i = 0; i < n; ++i) {
+                pos1 = parse_fastq_record(text1, pos1, mate1);
+                if (text2.empty()) {
+                    pos1 = parse_fastq_record(text1, pos1, mate2);
+                } else {
+                    pos2 = parse_fastq_record(text2, pos2, mate2);
+                }
+                lambda_pair(mate1, mate2, first + i);
+            }
+        } else {
+            Alignment aln;
+            for (size_t i = 0; i < n; ++i) {
+                pos1 = parse_fastq_record(text1, pos1, aln);
+                lambda(aln, first + i);
+            }
+        }
+    };
+
+#pragma omp parallel shared(in1, in2, count, chunks_outstanding, process_chunk)
+#pragma omp single
     {
-        int tid = omp_get_thread_num();
+        bool more_data = true;
         while (more_data) {
-            Alignment mate1, mate2;
-            char* buf = bufs[tid];
-            bool got_anything = false;
-#pragma omp critical (fastq_input)
-            {
-                if (more_data) {
-                    got_anything = more_data = get_next_alignment_pair_from_fastqs(fp1, fp2, buf, len, mate1, mate2);
-                    nLines++;
+            string* text1 = new string();
+            string* text2 = new string();
+            size_t n;
+            if (in2 != nullptr) {
+                size_t n1 = in1.read_records(chunk_size, *text1);
+                size_t n2 = in2->read_records(chunk_size, *text2);
+                if (n1 != n2) {
+                    cerr << "[vg::alignment.cpp] warning: paired fastq files have different numbers of reads, "
+                         << "ignoring the unpaired reads" << endl;
+                }
+                n = min(n1, n2);
+                more_data = n == chunk_size;
+            } else if (pairs) {
+                size_t records = in1.read_records(2 * chunk_size, *text1);
+                if (records % 2) {
+                    cerr << "[vg::alignment.cpp] warning: interleaved fastq file has an odd number of reads, "
+                         << "ignoring the unpaired read" << endl;
                 }
+                n = records / 2;
+                more_data = n == chunk_size;
+            } else {
+                n = in1.read_records(chunk_size, *text1);
+                more_data = n == chunk_size;
             }
-            if (got_anything) {
-                lambda(mate1, mate2);
+            uint64_t first = count;
+            count += n;
+
+            uint64_t c;
+#pragma omp atomic capture
+            c = ++chunks_outstanding;
+            if (c >= max_chunks_outstanding) {
+                // the workers are behind, so do this chunk ourselves rather
+                // than reading further ahead
+                process_chunk(*text1, *text2, n, first);
+                delete text1;
+                delete text2;
+#pragma omp atomic update
+                --chunks_outstanding;
+            } else {
+#pragma omp task default(none) firstprivate(text1, text2, n, first) shared(chunks_outstanding, process_chunk)
+                {
+                    process_chunk(*text1, *text2, n, first);
+                    delete text1;
+                    delete text2;
+#pragma omp atomic update
+                    --chunks_outstanding;
+                }
             }
         }
     }
-    for (auto& buf : bufs) {
-        delete buf;
-    }
-    gzclose(fp1);
-    gzclose(fp2);
-    return nLines;
+
+    return count;
+}
+
+size_t fastq_unpaired_for_each_parallel(string& filename, function<void(Alignment&, uint64_t)> lambda) {
+    FastqReader in(filename);
+    function<void(Alignment&, Alignment&, uint64_t)> no_pairs = [](Alignment&, Alignment&, uint64_t) { };
+    return fastq_for_each_parallel_impl(in, nullptr, false, lambda, no_pairs);
+}
+
+size_t fastq_paired_interleaved_for_each_parallel(string& filename, function<void(Alignment&, Alignment&)> lambda) {
+    function<void(Alignment&, Alignment&, uint64_t)> numbered = [&lambda](Alignment& aln1, Alignment& aln2, uint64_t) { lambda(aln1, aln2); };
+    return fastq_paired_interleaved_for_each_parallel(filename, numbered);
+}
+
+size_t fastq_paired_interleaved_for_each_parallel(string& filename, function<void(Alignment&, Alignment&, uint64_t)> lambda) {
+    FastqReader in(filename);
+    function<void(Alignment&, uint64_t)> no_singles = [](Alignment&, uint64_t) { };
+    return fastq_for_each_parallel_impl(in, nullptr, true, no_singles, lambda);
+}
+
+size_t fastq_paired_two_files_for_each_parallel(string& file1, string& file2, function<void(Alignment&, Alignment&)> lambda) {
+    function<void(Alignment&, Alignment&, uint64_t)> numbered = [&lambda](Alignment& aln1, Alignment& aln2, uint64_t) { lambda(aln1, aln2); };
+    return fastq_paired_two_files_for_each_parallel(file1, file2, numbered);
+}
+
+size_t fastq_paired_two_files_for_each_parallel(string& file1, string& file2, function<void(Alignment&, Alignment&, uint64_t)> lambda) {
+    FastqReader in1(file1);
+    FastqReader in2(file2);
+    function<void(Alignment&, uint64_t)> no_singles = [](Alignment&, uint64_t) { };
+    return fastq_for_each_parallel_impl(in1, &in2, true, no_singles, lambda);
 }
 
 
@@ -304,28 +516,13 @@ size_t fastq_paired_two_files_for_each(string& file1, string& file2, function<vo
 }
 
 void gam_paired_interleaved_for_each_parallel(ifstream& in, function<void(Alignment&, Alignment&)> lambda) {
-    vector<Alignment> aln_buf;
-    std::function<void(Alignment&)> handler = [&](Alignment& aln) {
-        bool got_pair = false;
-        Alignment aln1;
-        Alignment aln2;
-#pragma omp critical(input)
-        {
-            if (aln_buf.size() == 1) {
-                aln1 = aln_buf.front();
-                aln2 = aln;
-                aln_buf.clear();
-                got_pair = true;
-            } else if (aln_buf.size() == 0) {
-                aln_buf.push_back(aln);
-            }
-        }
-        // now align
-        if (got_pair) {
-            lambda(aln1, aln2);
-        }
-    };
-    stream::for_each_parallel(in, handler);
+    // batches handed out by the stream reader keep consecutive records together,
+    // so the mates arrive side by side without any shared pairing buffer
+    stream::for_each_interleaved_pair_parallel(in, lambda);
+}
+
+void gam_paired_interleaved_for_each_parallel(ifstream& in, function<void(Alignment&, Alignment&, uint64_t)> lambda) {
+    stream::for_each_interleaved_pair_parallel_numbered(in, lambda);
 }
 
 void parse_rg_sample_map(char* hts_header, map<string, string>& rg_sample) {
@@ -20,6 +20,9 @@ const char* const BAM_DNA_LOOKUP = "=ACMGRSVTWYHKDBN";
 
 int hts_for_each(string& filename, function<void(Alignment&)> lambda);
 int hts_for_each_parallel(string& filename, function<void(Alignment&)> lambda);
+// the numbered versions of the parallel readers also pass the number of each
+// read (or pair) in the input, for keeping output in input order
+int hts_for_each_parallel(string& filename, function<void(Alignment&, uint64_t)> lambda);
 int fastq_for_each(string& filename, function<void(Alignment&)> lambda);
 bool get_next_alignment_from_fastq(gzFile fp, char* buffer, size_t len, Alignment& alignment);
 bool get_next_interleaved_alignment_pair_from_fastq(gzFile fp, char* buffer, size_t len, Alignment& mate1, Alignment& mate2);
@@ -33,6 +36,38 @@ size_t fastq_unpaired_for_each_parallel(string& filename, function<void(Alignmen
 size_t fastq_paired_interleaved_for_each_parallel(string& filename, function<void(Alignment&, Alignment&)> lambda);
 size_t fastq_paired_two_files_for_each_parallel(string& file1, string& file2, function<void(Alignment&, Alignment&)> lambda);
 void gam_paired_interleaved_for_each_parallel(ifstream& in, function<void(Alignment&, Alignment&)> lambda);
+size_t fastq_unpaired_for_each_parallel(string& filename, function<void(Alignment&, uint64_t)> lambda);
+size_t fastq_paired_interleaved_for_each_parallel(string& filename, function<void(Alignment&, Alignment&, uint64_t)> lambda);
+size_t fastq_paired_two_files_for_each_parallel(string& file1, string& file2, function<void(Alignment&, Alignment&, uint64_t)> lambda);
+void gam_paired_interleaved_for_each_parallel(ifstream& in, function<void(Alignment&, Alignment&, uint64_t)> lambda);
+
+// reads the text of whole FASTQ records in large chunks, so that one thread can
+// feed many parsers. plain and gzipped input are inflated with zlib as they're
+// read; block-gzipped (BGZF) files are inflated a batch of blocks at a time in
+// OpenMP tasks.
+class FastqReader {
+public:
+    // "-" reads from stdin; only regular files are checked for BGZF and
+    // inflated in parallel
+    FastqReader(const string& filename);
+    ~FastqReader(void);
+    // append the text of up to n whole records to chunk, and return the number
+    // of records appended; fewer than n means we're at the end of the input
+    size_t read_records(size_t n, string& chunk);
+private:
+    // append more decompressed text to the buffer, false if there is no more
+    bool fill(void);
+    bool fill_bgzf(void);
+    gzFile fp = nullptr;
+    // BGZF input is read raw and inflated by us
+    FILE* raw = nullptr;
+    string buffer;
+    size_t pos = 0;
+    bool at_end = false;
+};
+// parse the record starting at pos in text read by a FastqReader into the
+// alignment, and return the position of the next record
+size_t parse_fastq_record(const string& text, size_t pos, Alignment& alignment);
 
 bam_hdr_t* hts_file_header(string& filename, string& header);
 bam_hdr_t* hts_string_header(string& header,
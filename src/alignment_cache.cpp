@@ -0,0 +1,65 @@
+#include <functional>
+#include "alignment_cache.hpp"
+
+namespace vg {
+
+using namespace std;
+
+AlignmentCache::AlignmentCache(size_t capacity, size_t shard_count)
+    : shards(capacity, shard_count) {
+    for (auto& shard : shards) {
+        shard.cache = new LRUCache<string, Entry>(shards.shard_capacity());
+    }
+}
+
+AlignmentCache::~AlignmentCache(void) {
+    for (auto& shard : shards) {
+        delete shard.cache;
+    }
+}
+
+AlignmentCache::Shard& AlignmentCache::shard_of(const string& key) {
+    return shards.shard_of(hash<string>()(key));
+}
+
+bool AlignmentCache::retrieve(const string& key, vector<Alignment>& first, vector<Alignment>& second) {
+    Shard& shard = shard_of(key);
+    omp_set_lock(&shard.lock);
+    pair<Entry, bool> cached = shard.cache->retrieve(key);
+    if (cached.second) {
+        ++shard.hits;
+    } else {
+        ++shard.misses;
+    }
+    omp_unset_lock(&shard.lock);
+    if (cached.second) {
+        first = std::move(cached.first.first);
+        second = std::move(cached.first.second);
+    }
+    return cached.second;
+}
+
+void AlignmentCache::put(const string& key, const vector<Alignment>& first, const vector<Alignment>& second) {
+    Shard& shard = shard_of(key);
+    Entry entry = make_pair(first, second);
+    omp_set_lock(&shard.lock);
+    shard.cache->put(key, entry);
+    omp_unset_lock(&shard.lock);
+}
+
+size_t AlignmentCache::hits(void) {
+    return shards.hits();
+}
+
+size_t AlignmentCache::misses(void) {
+    return shards.misses();
+}
+
+void AlignmentCache::copy_read_fields(const Alignment& read, Alignment& aln) {
+    aln.set_name(read.name());
+    aln.set_quality(read.quality());
+    aln.set_sample_name(read.sample_name());
+    aln.set_read_group(read.read_group());
+}
+
+}
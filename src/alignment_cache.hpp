@@ -0,0 +1,54 @@
+#ifndef VG_ALIGNMENT_CACHE_HPP
+#define VG_ALIGNMENT_CACHE_HPP
+// alignment_cache.hpp: a cache of the alignments made for reads (and pairs of
+// reads) by sequence, so that duplicate reads only need to be mapped once
+//
+// the cache is shared by all the threads of a mapping run, so it is split into
+// shards by the hash of the key (see sharded_cache.hpp), each an LRU cache.
+
+#include <vector>
+#include <string>
+#include "sharded_cache.hpp"
+#include "lru_cache.h"
+#include "vg.pb.h"
+
+namespace vg {
+
+using namespace std;
+
+class AlignmentCache {
+public:
+
+    // hold the results for up to about capacity reads or pairs
+    AlignmentCache(size_t capacity = 100000, size_t shards = 64);
+    ~AlignmentCache(void);
+
+    // get the alignments of the first and (for pairs) second read stored
+    // under the key, if there are any
+    bool retrieve(const string& key, vector<Alignment>& first, vector<Alignment>& second);
+    void put(const string& key, const vector<Alignment>& first, const vector<Alignment>& second);
+
+    // lookups that did and didn't find the key, so far
+    size_t hits(void);
+    size_t misses(void);
+
+    // give the alignments the fields that come from the read that was
+    // aligned rather than from its sequence
+    static void copy_read_fields(const Alignment& read, Alignment& aln);
+
+private:
+
+    typedef pair<vector<Alignment>, vector<Alignment> > Entry;
+
+    struct Shard : public CacheShard {
+        LRUCache<string, Entry>* cache;
+    };
+
+    ShardedCache<Shard> shards;
+
+    Shard& shard_of(const string& key);
+};
+
+}
+
+#endif
@@ -7,6 +7,8 @@
 
 #include "banded_global_aligner.hpp"
 #include "json2pb.h"
+#include "simd_ops.hpp"
+#include <cstring>
 
 //#define debug_banded_aligner_objects
 //#define debug_banded_aligner_graph_processing
@@ -16,6 +18,240 @@
 
 using namespace vg;
 
+// SIMD kernels for the inner loop of the DP. within a column of a band, matches and column
+// insertions only depend on the previous column, so a whole run of them can be filled at once.
+// row insertions depend on the cell above, so they are filled with a running max down the column
+// (a prefix scan in log steps within each vector). 8- and 16-bit scores are vectorized, with AVX2
+// if the CPU has it and otherwise SSE4.1, which we always build with; 32-bit scores are only needed
+// for very long reads and are filled one cell at a time. all arithmetic saturates at the range of
+// the score type.
+
+template <class IntType>
+static inline IntType saturate(int64_t value) {
+    return max<int64_t>(numeric_limits<IntType>::min(), min<int64_t>(numeric_limits<IntType>::max(), value));
+}
+
+// the penalty for a row gap to extend over some number of cells, which we subtract in two steps
+// so that it can exceed the range of the score type (past twice that, anything it's subtracted from
+// saturates and the step can be skipped)
+template <class IntType>
+struct ScanPenalty {
+    ScanPenalty(int64_t penalty = 0) {
+        skip = penalty > 2 * (int64_t) numeric_limits<IntType>::max();
+        first = min<int64_t>(penalty, numeric_limits<IntType>::max());
+        second = min<int64_t>(penalty - first, numeric_limits<IntType>::max());
+    }
+    IntType first;
+    IntType second;
+    bool skip;
+};
+
+template <class IntType>
+static void fill_diagonal_moves_scalar(const IntType* prev_match, const IntType* prev_insert_row,
+                                       const IntType* prev_insert_col, const IntType* match_scores,
+                                       IntType* match, IntType* insert_col, int64_t begin, int64_t end,
+                                       int8_t gap_open, int8_t gap_extend) {
+    for (int64_t k = begin; k < end; k++) {
+        match[k] = saturate<IntType>((int64_t) match_scores[k] + max(max(prev_match[k], prev_insert_row[k]), prev_insert_col[k]));
+        insert_col[k] = saturate<IntType>(max<int64_t>((int64_t) max(prev_match[k + 1], prev_insert_row[k + 1]) - gap_open,
+                                                       (int64_t) prev_insert_col[k + 1] - gap_extend));
+    }
+}
+
+template <class IntType>
+static void fill_insert_row_scalar(const IntType* match, const IntType* insert_col, IntType* insert_row,
+                                   int64_t begin, int64_t end, int8_t gap_open, int8_t gap_extend) {
+    for (int64_t k = begin; k < end; k++) {
+        insert_row[k] = saturate<IntType>(max<int64_t>((int64_t) max(match[k - 1], insert_col[k - 1]) - gap_open,
+                                                       (int64_t) insert_row[k - 1] - gap_extend));
+    }
+}
+
+// move the lanes of a vector up by some number of lanes, shifting in -inf
+template <class IntType, int lanes>
+static inline __m128i shift_up_sse41(__m128i x, __m128i neg_inf) {
+    return _mm_alignr_epi8(x, neg_inf, 16 - lanes * sizeof(IntType));
+}
+
+// one step of the running max of row gaps down a vector: extend the gaps lanes cells further
+template <class IntType, int lanes>
+static inline __m128i scan_step_sse41(__m128i x, __m128i neg_inf, const ScanPenalty<IntType>& penalty) {
+    typedef Sse41Ops<IntType> Ops;
+    if (lanes >= Ops::lanes || penalty.skip) {
+        return x;
+    }
+    __m128i shifted = Ops::subs(Ops::subs(shift_up_sse41<IntType, lanes % Ops::lanes>(x, neg_inf), Ops::set1(penalty.first)),
+                                Ops::set1(penalty.second));
+    return Ops::max(x, shifted);
+}
+
+template <class IntType>
+static void fill_diagonal_moves_sse41(const IntType* prev_match, const IntType* prev_insert_row,
+                                      const IntType* prev_insert_col, const IntType* match_scores,
+                                      IntType* match, IntType* insert_col, int64_t length,
+                                      int8_t gap_open, int8_t gap_extend) {
+    typedef Sse41Ops<IntType> Ops;
+    __m128i open = Ops::set1(gap_open);
+    __m128i extend = Ops::set1(gap_extend);
+    int64_t k = 0;
+    for (; k + Ops::lanes <= length; k += Ops::lanes) {
+        __m128i diag = Ops::max(Ops::max(_mm_loadu_si128((const __m128i*) (prev_match + k)),
+                                         _mm_loadu_si128((const __m128i*) (prev_insert_row + k))),
+                                _mm_loadu_si128((const __m128i*) (prev_insert_col + k)));
+        _mm_storeu_si128((__m128i*) (match + k),
+                         Ops::adds(diag, _mm_loadu_si128((const __m128i*) (match_scores + k))));
+        
+        __m128i left = Ops::max(_mm_loadu_si128((const __m128i*) (prev_match + k + 1)),
+                                _mm_loadu_si128((const __m128i*) (prev_insert_row + k + 1)));
+        _mm_storeu_si128((__m128i*) (insert_col + k),
+                         Ops::max(Ops::subs(left, open),
+                                  Ops::subs(_mm_loadu_si128((const __m128i*) (prev_insert_col + k + 1)), extend)));
+    }
+    fill_diagonal_moves_scalar(prev_match, prev_insert_row, prev_insert_col, match_scores, match, insert_col,
+                               k, length, gap_open, gap_extend);
+}
+
+template <class IntType>
+static void fill_insert_row_sse41(const IntType* match, const IntType* insert_col, IntType* insert_row,
+                                  int64_t length, int8_t gap_open, int8_t gap_extend) {
+    typedef Sse41Ops<IntType> Ops;
+    __m128i open = Ops::set1(gap_open);
+    __m128i neg_inf = Ops::set1(numeric_limits<IntType>::min());
+    ScanPenalty<IntType> one(gap_extend), two(2 * gap_extend), four(4 * gap_extend), eight(8 * gap_extend);
+    int64_t k = 0;
+    for (; k + Ops::lanes <= length; k += Ops::lanes) {
+        // open a gap from the cell above each, or extend the one coming into this run of cells
+        __m128i x = Ops::subs(Ops::max(_mm_loadu_si128((const __m128i*) (match + k - 1)),
+                                       _mm_loadu_si128((const __m128i*) (insert_col + k - 1))), open);
+        x = Ops::max(x, Ops::set_first(neg_inf, saturate<IntType>((int64_t) insert_row[k - 1] - gap_extend)));
+        // then extend the gaps down the run
+        x = scan_step_sse41<IntType, 1>(x, neg_inf, one);
+        x = scan_step_sse41<IntType, 2>(x, neg_inf, two);
+        x = scan_step_sse41<IntType, 4>(x, neg_inf, four);
+        x = scan_step_sse41<IntType, 8>(x, neg_inf, eight);
+        _mm_storeu_si128((__m128i*) (insert_row + k), x);
+    }
+    fill_insert_row_scalar(match, insert_col, insert_row, k, length, gap_open, gap_extend);
+}
+
+template <class IntType, int lanes>
+__attribute__((target("avx2")))
+static inline __m256i shift_up_avx2(__m256i x, __m256i neg_inf) {
+    // the shift has to cross between the two 128-bit halves, so line up the low half of x
+    // behind -inf and shift the pair within each half
+    __m256i behind = _mm256_permute2x128_si256(x, neg_inf, 0x02);
+    return _mm256_alignr_epi8(x, behind, 16 - lanes * sizeof(IntType));
+}
+
+template <class IntType, int lanes>
+__attribute__((target("avx2")))
+static inline __m256i scan_step_avx2(__m256i x, __m256i neg_inf, const ScanPenalty<IntType>& penalty) {
+    typedef Avx2Ops<IntType> Ops;
+    if (lanes >= Ops::lanes || penalty.skip) {
+        return x;
+    }
+    __m256i shifted = Ops::subs(Ops::subs(shift_up_avx2<IntType, lanes % Ops::lanes>(x, neg_inf), Ops::set1(penalty.first)),
+                                Ops::set1(penalty.second));
+    return Ops::max(x, shifted);
+}
+
+template <class IntType>
+__attribute__((target("avx2")))
+static void fill_diagonal_moves_avx2(const IntType* prev_match, const IntType* prev_insert_row,
+                                     const IntType* prev_insert_col, const IntType* match_scores,
+                                     IntType* match, IntType* insert_col, int64_t length,
+                                     int8_t gap_open, int8_t gap_extend) {
+    typedef Avx2Ops<IntType> Ops;
+    __m256i open = Ops::set1(gap_open);
+    __m256i extend = Ops::set1(gap_extend);
+    int64_t k = 0;
+    for (; k + Ops::lanes <= length; k += Ops::lanes) {
+        __m256i diag = Ops::max(Ops::max(_mm256_loadu_si256((const __m256i*) (prev_match + k)),
+                                         _mm256_loadu_si256((const __m256i*) (prev_insert_row + k))),
+                                _mm256_loadu_si256((const __m256i*) (prev_insert_col + k)));
+        _mm256_storeu_si256((__m256i*) (match + k),
+                            Ops::adds(diag, _mm256_loadu_si256((const __m256i*) (match_scores + k))));
+        
+        __m256i left = Ops::max(_mm256_loadu_si256((const __m256i*) (prev_match + k + 1)),
+                                _mm256_loadu_si256((const __m256i*) (prev_insert_row + k + 1)));
+        _mm256_storeu_si256((__m256i*) (insert_col + k),
+                            Ops::max(Ops::subs(left, open),
+                                     Ops::subs(_mm256_loadu_si256((const __m256i*) (prev_insert_col + k + 1)), extend)));
+    }
+    fill_diagonal_moves_sse41(prev_match + k, prev_insert_row + k, prev_insert_col + k, match_scores + k,
+                              match + k, insert_col + k, length - k, gap_open, gap_extend);
+}
+
+template <class IntType>
+__attribute__((target("avx2")))
+static void fill_insert_row_avx2(const IntType* match, const IntType* insert_col, IntType* insert_row,
+                                 int64_t length, int8_t gap_open, int8_t gap_extend) {
+    typedef Avx2Ops<IntType> Ops;
+    __m256i open = Ops::set1(gap_open);
+    __m256i neg_inf = Ops::set1(numeric_limits<IntType>::min());
+    ScanPenalty<IntType> one(gap_extend), two(2 * gap_extend), four(4 * gap_extend), eight(8 * gap_extend),
+                         sixteen(16 * gap_extend);
+    int64_t k = 0;
+    for (; k + Ops::lanes <= length; k += Ops::lanes) {
+        __m256i x = Ops::subs(Ops::max(_mm256_loadu_si256((const __m256i*) (match + k - 1)),
+                                       _mm256_loadu_si256((const __m256i*) (insert_col + k - 1))), open);
+        x = Ops::max(x, Ops::set_first(neg_inf, saturate<IntType>((int64_t) insert_row[k - 1] - gap_extend)));
+        x = scan_step_avx2<IntType, 1>(x, neg_inf, one);
+        x = scan_step_avx2<IntType, 2>(x, neg_inf, two);
+        x = scan_step_avx2<IntType, 4>(x, neg_inf, four);
+        x = scan_step_avx2<IntType, 8>(x, neg_inf, eight);
+        x = scan_step_avx2<IntType, 16>(x, neg_inf, sixteen);
+        _mm256_storeu_si256((__m256i*) (insert_row + k), x);
+    }
+    fill_insert_row_sse41(match + k, insert_col + k, insert_row + k, length - k, gap_open, gap_extend);
+}
+
+// fill match and insert_col for length cells of a column from the same cells of the previous column
+// (which must have one more cell below for the column insertions), given the scores of matching
+// each cell's read base
+template <class IntType>
+static void fill_diagonal_moves(const IntType* prev_match, const IntType* prev_insert_row,
+                                const IntType* prev_insert_col, const IntType* match_scores,
+                                IntType* match, IntType* insert_col, int64_t length,
+                                int8_t gap_open, int8_t gap_extend) {
+    if (have_avx2()) {
+        fill_diagonal_moves_avx2(prev_match, prev_insert_row, prev_insert_col, match_scores, match, insert_col,
+                                 length, gap_open, gap_extend);
+    }
+    else {
+        fill_diagonal_moves_sse41(prev_match, prev_insert_row, prev_insert_col, match_scores, match, insert_col,
+                                  length, gap_open, gap_extend);
+    }
+}
+
+template <>
+void fill_diagonal_moves<int32_t>(const int32_t* prev_match, const int32_t* prev_insert_row,
+                                  const int32_t* prev_insert_col, const int32_t* match_scores,
+                                  int32_t* match, int32_t* insert_col, int64_t length,
+                                  int8_t gap_open, int8_t gap_extend) {
+    fill_diagonal_moves_scalar(prev_match, prev_insert_row, prev_insert_col, match_scores, match, insert_col,
+                               0, length, gap_open, gap_extend);
+}
+
+// fill insert_row for length cells of a column whose matches and column insertions are already
+// filled, continuing from the cell above the first
+template <class IntType>
+static void fill_insert_row(const IntType* match, const IntType* insert_col, IntType* insert_row,
+                            int64_t length, int8_t gap_open, int8_t gap_extend) {
+    if (have_avx2()) {
+        fill_insert_row_avx2(match, insert_col, insert_row, length, gap_open, gap_extend);
+    }
+    else {
+        fill_insert_row_sse41(match, insert_col, insert_row, length, gap_open, gap_extend);
+    }
+}
+
+template <>
+void fill_insert_row<int32_t>(const int32_t* match, const int32_t* insert_col, int32_t* insert_row,
+                              int64_t length, int8_t gap_open, int8_t gap_extend) {
+    fill_insert_row_scalar(match, insert_col, insert_row, 0, length, gap_open, gap_extend);
+}
+
 BandedGlobalAligner::BABuilder::BABuilder(Alignment& alignment) :
                                           alignment(alignment),
                                           matrix_state(Match),
@@ -174,19 +410,23 @@ void BandedGlobalAligner::BABuilder::finalize_alignment() {
 #endif
 }
 
-BandedGlobalAligner::BAMatrix::BAMatrix(Alignment& alignment, Node* node, int64_t top_diag,
-                                        int64_t bottom_diag, BAMatrix** seeds, int64_t num_seeds,
-                                        int64_t cumulative_seq_len) :
-                                        node(node),
-                                        top_diag(top_diag),
-                                        bottom_diag(bottom_diag),
-                                        seeds(seeds),
-                                        alignment(alignment),
-                                        num_seeds(num_seeds),
-                                        cumulative_seq_len(cumulative_seq_len),
-                                        match(nullptr),
-                                        insert_col(nullptr),
-                                        insert_row(nullptr)
+template <class IntType>
+BandedGlobalAligner::BAMatrix<IntType>::BAMatrix(Alignment& alignment, Node* node, int64_t top_diag,
+                                                 int64_t bottom_diag, BAMatrix** seeds, int64_t num_seeds,
+                                                 int64_t cumulative_seq_len) :
+                                                 node(node),
+                                                 top_diag(top_diag),
+                                                 bottom_diag(bottom_diag),
+                                                 seeds(seeds),
+                                                 alignment(alignment),
+                                                 num_seeds(num_seeds),
+                                                 cumulative_seq_len(cumulative_seq_len),
+                                                 match(nullptr),
+                                                 insert_col(nullptr),
+                                                 insert_row(nullptr),
+                                                 final_match(nullptr),
+                                                 final_insert_col(nullptr),
+                                                 final_insert_row(nullptr)
 {
     // nothing to do
 #ifdef debug_banded_aligner_objects
@@ -194,7 +434,8 @@ BandedGlobalAligner::BAMatrix::BAMatrix(Alignment& alignment, Node* node, int64_
 #endif
 }
 
-BandedGlobalAligner::BAMatrix::~BAMatrix() {
+template <class IntType>
+BandedGlobalAligner::BAMatrix<IntType>::~BAMatrix() {
 #ifdef debug_banded_aligner_objects
     if (node != nullptr) {
         cerr << "[BAMatrix::~BAMatrix] destructing matrix for node " << node->id() << endl;
@@ -206,11 +447,16 @@ BandedGlobalAligner::BAMatrix::~BAMatrix() {
     free(match);
     free(insert_row);
     free(insert_col);
+    free(final_match);
+    free(final_insert_row);
+    free(final_insert_col);
     free(seeds);
 }
 
-void BandedGlobalAligner::BAMatrix::fill_matrix(int8_t* score_mat, int8_t* nt_table, int8_t gap_open,
-                                                int8_t gap_extend, bool qual_adjusted, int8_t min_inf) {
+template <class IntType>
+void BandedGlobalAligner::BAMatrix<IntType>::fill_matrix(int8_t* score_mat, int8_t* nt_table, int8_t gap_open,
+                                                         int8_t gap_extend, bool qual_adjusted, IntType min_inf,
+                                                         const IntType* score_profile) {
     
 #ifdef debug_banded_aligner_fill_matrix
     cerr << "[BAMatrix::fill_matrix] beginning DP on matrix for node " << node->id() << endl;;
@@ -225,9 +471,9 @@ void BandedGlobalAligner::BAMatrix::fill_matrix(int8_t* score_mat, int8_t* nt_ta
     const string& read = alignment.sequence();
     const string& base_quality = alignment.quality();
     
-    match = (int8_t*) malloc(sizeof(int8_t) * band_size);
-    insert_col = (int8_t*) malloc(sizeof(int8_t) * band_size);
-    insert_row = (int8_t*) malloc(sizeof(int8_t) * band_size);
+    match = (IntType*) malloc(sizeof(IntType) * band_size);
+    insert_col = (IntType*) malloc(sizeof(IntType) * band_size);
+    insert_row = (IntType*) malloc(sizeof(IntType) * band_size);
     /* these represent a band in a matrix, but we store it as a rectangle with chopped
      * corners
      *
@@ -246,6 +492,9 @@ void BandedGlobalAligner::BAMatrix::fill_matrix(int8_t* score_mat, int8_t* nt_ta
      * also note that the internal structure of each column is preserved and each row
      * in the rectangularized band corresponds to a diagonal in the original matrix
      *
+     * the rectangle is stored column by column, so that the cells of a column (which can be
+     * computed together) are adjacent in memory
+     *
      * the initial row and column can be reached via an implied row or column insertion
      * that is not represented in the matrix (this requires a number of edge cases)
      */
@@ -267,7 +516,7 @@ void BandedGlobalAligner::BAMatrix::fill_matrix(int8_t* score_mat, int8_t* nt_ta
         
         // find position of the first cell in the rectangularized band
         int64_t iter_start = -top_diag;
-        idx = iter_start * ncols;
+        idx = iter_start;
         
         // cap stop index if last diagonal is below bottom of matrix
         int64_t iter_stop = bottom_diag > (int64_t) read.length() ? band_height + (int64_t) read.length() - bottom_diag - 1 : band_height;
@@ -288,12 +537,12 @@ void BandedGlobalAligner::BAMatrix::fill_matrix(int8_t* score_mat, int8_t* nt_ta
 
         
         // only way to end an alignment in a gap here is to row and column gap
-        insert_col[idx] = -2 * gap_open;
-        insert_row[idx] = -2 * gap_open;
+        insert_col[idx] = saturate<IntType>(-2 * gap_open);
+        insert_row[idx] = saturate<IntType>(-2 * gap_open);
         
         for (int64_t i = iter_start + 1; i < iter_stop; i++) {
-            idx = i * ncols;
-            up_idx = (i - 1) * ncols;
+            idx = i;
+            up_idx = i - 1;
             // score of a match in this cell
             int8_t match_score;
             if (qual_adjusted) {
@@ -303,12 +552,12 @@ void BandedGlobalAligner::BAMatrix::fill_matrix(int8_t* score_mat, int8_t* nt_ta
                 match_score = score_mat[5 * nt_table[node_seq[0]] + nt_table[read[top_diag + i]]];
             }
             // must take one lead gap to get into first column
-            match[idx] = match_score - gap_open - (top_diag + i - 1) * gap_extend;
+            match[idx] = saturate<IntType>(match_score - gap_open - (top_diag + i - 1) * gap_extend);
             // normal iteration along column
-            insert_row[idx] = max(max(match[up_idx] - gap_open, insert_row[up_idx] - gap_extend),
-                                  insert_col[up_idx] - gap_open);
+            insert_row[idx] = saturate<IntType>(max(max(match[up_idx] - gap_open, insert_row[up_idx] - gap_extend),
+                                                    insert_col[up_idx] - gap_open));
             // must take two gaps to get into first column
-            insert_col[idx] = -2 * gap_open - (top_diag + i) * gap_extend;
+            insert_col[idx] = saturate<IntType>(-2 * gap_open - (top_diag + i) * gap_extend);
 
 #ifdef debug_banded_aligner_fill_matrix
             cerr << "[BAMatrix::fill_matrix]: on left edge of matrix at rectangle coords (" << i << ", " << 0 << "), match score of node char " << 0 << " (" << node_seq[0] << ") and read char " << i + top_diag << " (" << read[i + top_diag] << ") is " << (int) match_score << ", leading gap length is " << top_diag + i << " for total match matrix score of " << (int) match[idx] << endl;
@@ -334,7 +583,7 @@ void BandedGlobalAligner::BAMatrix::fill_matrix(int8_t* score_mat, int8_t* nt_ta
         int64_t iter_stop = bottom_diag_outside ? band_height + (int64_t) read.length() - bottom_diag - 1 : band_height;
         
         // handle special logic for lead column insertions
-        idx = iter_start * ncols;
+        idx = iter_start;
         
         int8_t match_score;
         if (qual_adjusted) {
@@ -348,7 +597,7 @@ void BandedGlobalAligner::BAMatrix::fill_matrix(int8_t* score_mat, int8_t* nt_ta
             cerr << "[BAMatrix::fill_matrix]: node still at top of matrix, adding implied gap to match of length " << cumulative_seq_len << "and initializing rest of column to -inf" << endl;
 #endif
             // match after implied gap along top edge
-            match[idx] = match_score - gap_open - (cumulative_seq_len - 1) * gap_extend;
+            match[idx] = saturate<IntType>(match_score - gap_open - (cumulative_seq_len - 1) * gap_extend);
         }
         else {
 #ifdef debug_banded_aligner_fill_matrix
@@ -360,7 +609,7 @@ void BandedGlobalAligner::BAMatrix::fill_matrix(int8_t* score_mat, int8_t* nt_ta
         
         if (top_diag_outside) {
             // gap open after implied gap along top edge
-            insert_row[idx] = -2 * gap_open - cumulative_seq_len * gap_extend;
+            insert_row[idx] = saturate<IntType>(-2 * gap_open - cumulative_seq_len * gap_extend);
         }
         else {
             // no lead gaps possible so seed with identity of max function to prepare for POA
@@ -371,7 +620,7 @@ void BandedGlobalAligner::BAMatrix::fill_matrix(int8_t* score_mat, int8_t* nt_ta
         
         // start with each cell in the leftmost column as identity of max function to prepare for POA
         for (int64_t i = iter_start + 1; i < iter_stop; i++) {
-            idx = i * ncols;
+            idx = i;
             match[idx] = min_inf;
             insert_col[idx] = min_inf;
         }
@@ -410,39 +659,39 @@ void BandedGlobalAligner::BAMatrix::fill_matrix(int8_t* score_mat, int8_t* nt_ta
             cerr << "[BAMatrix::fill_matrix]: this seed reaches diagonals " << seed_next_top_diag << " to " << seed_next_bottom_diag << " out of matrix range " << top_diag << " to " << bottom_diag << endl;
 #endif
             // special logic for first row
-            idx = (seed_next_top_diag_iter - top_diag) * ncols;
+            idx = seed_next_top_diag_iter - top_diag;
             
             // may not be able to extend a match if at top of matrix
             if (!beyond_top_of_matrix) {
-                diag_idx = (seed_next_top_diag_iter - seed_next_top_diag) * seed_node_seq_len + seed_node_seq_len - 1;
+                diag_idx = seed_next_top_diag_iter - seed_next_top_diag;
                 if (qual_adjusted) {
                     match_score = score_mat[25 * base_quality[seed_next_top_diag_iter] + 5 * nt_table[node_seq[0]] + nt_table[read[seed_next_top_diag_iter]]];
                 }
                 else {
                     match_score = score_mat[5 * nt_table[node_seq[0]] + nt_table[read[seed_next_top_diag_iter]]];
                 }
-                match[idx] = max<int8_t>(match_score + max<int8_t>(max<int8_t>(seed->match[diag_idx],
-                                                                               seed->insert_row[diag_idx]),
-                                                                   seed->insert_col[diag_idx]), match[idx]);
+                match[idx] = saturate<IntType>(max<int64_t>(match_score + max<int64_t>(max<int64_t>(seed->final_match[diag_idx],
+                                                                                                    seed->final_insert_row[diag_idx]),
+                                                                                       seed->final_insert_col[diag_idx]), match[idx]));
             }
             
             if (seed_next_top_diag_iter != seed_next_bottom_diag_iter) {
-                left_idx = (seed_next_top_diag_iter - seed_next_top_diag + 2) * seed_node_seq_len - 1;
-                insert_col[idx] = max<int8_t>(max<int8_t>(max<int8_t>(seed->match[left_idx] - gap_open,
-                                                                      seed->insert_row[left_idx] - gap_open),
-                                                          seed->insert_col[left_idx] - gap_extend), insert_col[idx]);
+                left_idx = seed_next_top_diag_iter - seed_next_top_diag + 1;
+                insert_col[idx] = saturate<IntType>(max<int64_t>(max<int64_t>(max<int64_t>(seed->final_match[left_idx] - gap_open,
+                                                                                           seed->final_insert_row[left_idx] - gap_open),
+                                                                              seed->final_insert_col[left_idx] - gap_extend), insert_col[idx]));
             }
             
             
             for (int64_t diag = seed_next_top_diag_iter + 1; diag < seed_next_bottom_diag_iter; diag++) {
-                idx = (diag - top_diag) * ncols;
+                idx = diag - top_diag;
                 
 #ifdef debug_banded_aligner_fill_matrix
                 cerr << "[BAMatrix::fill_matrix]: extending a match and column gap into matrix coord (" << diag << ", 0)" << ", rectangular coord coord (" << diag - top_diag << ", 0)" << endl;
 #endif
                 
                 // extend a match
-                diag_idx = (diag - seed_next_top_diag) * seed_node_seq_len + seed_node_seq_len - 1;
+                diag_idx = diag - seed_next_top_diag;
                 int8_t match_score;
                 if (qual_adjusted) {
                     match_score = score_mat[25 * base_quality[diag] + 5 * nt_table[node_seq[0]] + nt_table[read[diag]]];
@@ -452,23 +701,23 @@ void BandedGlobalAligner::BAMatrix::fill_matrix(int8_t* score_mat, int8_t* nt_ta
                 }
                 
 #ifdef debug_banded_aligner_fill_matrix
-                cerr << "[BAMatrix::fill_matrix]: extending match from rectangular coord (" << diag - seed_next_top_diag << ", " << seed_node_seq_len - 1 << ")" << " with match score " << (int) match_score << ", scores are " << (int) seed->match[diag_idx] << " (M), " << (int) seed->insert_row[diag_idx] << " (Ir), and " << (int) seed->insert_col[diag_idx] << " (Ic), current score is " << (int) match[idx] << endl;
+                cerr << "[BAMatrix::fill_matrix]: extending match from rectangular coord (" << diag - seed_next_top_diag << ", " << seed_node_seq_len - 1 << ")" << " with match score " << (int) match_score << ", scores are " << (int) seed->final_match[diag_idx] << " (M), " << (int) seed->final_insert_row[diag_idx] << " (Ir), and " << (int) seed->final_insert_col[diag_idx] << " (Ic), current score is " << (int) match[idx] << endl;
 #endif
                 
-                match[idx] = max<int8_t>(match_score + max<int8_t>(max<int8_t>(seed->match[diag_idx],
-                                                                               seed->insert_row[diag_idx]),
-                                                                   seed->insert_col[diag_idx]), match[idx]);
+                match[idx] = saturate<IntType>(max<int64_t>(match_score + max<int64_t>(max<int64_t>(seed->final_match[diag_idx],
+                                                                                                    seed->final_insert_row[diag_idx]),
+                                                                                       seed->final_insert_col[diag_idx]), match[idx]));
                 
                 
                 // extend a column gap
-                left_idx = (diag - seed_next_top_diag + 2) * seed_node_seq_len - 1;
+                left_idx = diag - seed_next_top_diag + 1;
                 
 #ifdef debug_banded_aligner_fill_matrix
-                cerr << "[BAMatrix::fill_matrix]: extending match from rectangular coord (" << diag - seed_next_top_diag + 1 << ", " << seed_node_seq_len - 1 << ")" << ", scores are " << (int) seed->match[left_idx] << " (M), " << (int) seed->insert_row[left_idx] << " (Ir), and " << (int) seed->insert_col[left_idx] << " (Ic), current score is " << (int) insert_col[idx] << endl;
+                cerr << "[BAMatrix::fill_matrix]: extending match from rectangular coord (" << diag - seed_next_top_diag + 1 << ", " << seed_node_seq_len - 1 << ")" << ", scores are " << (int) seed->final_match[left_idx] << " (M), " << (int) seed->final_insert_row[left_idx] << " (Ir), and " << (int) seed->final_insert_col[left_idx] << " (Ic), current score is " << (int) insert_col[idx] << endl;
 #endif
-                insert_col[idx] = max<int8_t>(max<int8_t>(max<int8_t>(seed->match[left_idx] - gap_open,
-                                                                      seed->insert_row[left_idx] - gap_open),
-                                                          seed->insert_col[left_idx] - gap_extend), insert_col[idx]);
+                insert_col[idx] = saturate<IntType>(max<int64_t>(max<int64_t>(max<int64_t>(seed->final_match[left_idx] - gap_open,
+                                                                                           seed->final_insert_row[left_idx] - gap_open),
+                                                                              seed->final_insert_col[left_idx] - gap_extend), insert_col[idx]));
                 
 #ifdef debug_banded_aligner_fill_matrix
                 cerr << "[BAMatrix::fill_matrix]: score is now " << (int) insert_col[idx] << endl;
@@ -483,8 +732,8 @@ void BandedGlobalAligner::BAMatrix::fill_matrix(int8_t* score_mat, int8_t* nt_ta
 #endif
                 
                 // may only be able to extend a match on last iteration
-                idx = (seed_next_bottom_diag_iter - top_diag) * ncols;
-                diag_idx = (seed_next_bottom_diag_iter - seed_next_top_diag) * seed_node_seq_len + seed_node_seq_len - 1;
+                idx = seed_next_bottom_diag_iter - top_diag;
+                diag_idx = seed_next_bottom_diag_iter - seed_next_top_diag;
                 if (qual_adjusted) {
                     match_score = score_mat[25 * base_quality[seed_next_bottom_diag_iter] + 5 * nt_table[node_seq[0]] + nt_table[read[seed_next_bottom_diag_iter]]];
                 }
@@ -493,11 +742,11 @@ void BandedGlobalAligner::BAMatrix::fill_matrix(int8_t* score_mat, int8_t* nt_ta
                 }
                 
 #ifdef debug_banded_aligner_fill_matrix
-                cerr << "[BAMatrix::fill_matrix]: extending match from rectangular coord (" << seed_next_bottom_diag_iter - seed_next_top_diag << ", " << seed_node_seq_len - 1 << ")" << " with match score " << (int) match_score << ", scores are " << (int) seed->match[diag_idx] << " (M), " << (int) seed->insert_row[diag_idx] << " (Ir), and " << (int) seed->insert_col[diag_idx] << " (Ic), current score is " << (int) match[idx] << endl;
+                cerr << "[BAMatrix::fill_matrix]: extending match from rectangular coord (" << seed_next_bottom_diag_iter - seed_next_top_diag << ", " << seed_node_seq_len - 1 << ")" << " with match score " << (int) match_score << ", scores are " << (int) seed->final_match[diag_idx] << " (M), " << (int) seed->final_insert_row[diag_idx] << " (Ir), and " << (int) seed->final_insert_col[diag_idx] << " (Ic), current score is " << (int) match[idx] << endl;
 #endif
-                match[idx] = max<int8_t>(match_score + max<int8_t>(max<int8_t>(seed->match[diag_idx],
-                                                                               seed->insert_row[diag_idx]),
-                                                                   seed->insert_col[diag_idx]), match[idx]);
+                match[idx] = saturate<IntType>(max<int64_t>(match_score + max<int64_t>(max<int64_t>(seed->final_match[diag_idx],
+                                                                                                    seed->final_insert_row[diag_idx]),
+                                                                                       seed->final_insert_col[diag_idx]), match[idx]));
 
                 
                 // can only extend column gap if the bottom of the matrix was hit in the last seed
@@ -505,10 +754,10 @@ void BandedGlobalAligner::BAMatrix::fill_matrix(int8_t* score_mat, int8_t* nt_ta
 #ifdef debug_banded_aligner_fill_matrix
                     cerr << "[BAMatrix::fill_matrix]: can also extend a column gap since already reached edge of matrix" << endl;
 #endif
-                    left_idx = (seed_next_bottom_diag_iter - seed_next_top_diag + 2) * seed_node_seq_len - 1;
-                    insert_col[idx] = max<int8_t>(max<int8_t>(max<int8_t>(seed->match[left_idx] - gap_open,
-                                                                          seed->insert_row[left_idx] - gap_open),
-                                                              seed->insert_col[left_idx] - gap_extend), insert_col[idx]);
+                    left_idx = seed_next_bottom_diag_iter - seed_next_top_diag + 1;
+                    insert_col[idx] = saturate<IntType>(max<int64_t>(max<int64_t>(max<int64_t>(seed->final_match[left_idx] - gap_open,
+                                                                                               seed->final_insert_row[left_idx] - gap_open),
+                                                                                  seed->final_insert_col[left_idx] - gap_extend), insert_col[idx]));
                 }
             }
 
@@ -518,12 +767,9 @@ void BandedGlobalAligner::BAMatrix::fill_matrix(int8_t* score_mat, int8_t* nt_ta
 #endif
         // compute the insert row scores (they can be computed after the POA iterations since they do not
         // cross node boundaries)
-        for (int64_t i = iter_start + 1; i < iter_stop; i++) {
-            idx = i * ncols;
-            up_idx = (i - 1) * ncols;
-            
-            insert_row[idx] = max(max(match[up_idx] - gap_open, insert_row[up_idx] - gap_extend),
-                                  insert_col[up_idx] - gap_open);
+        if (iter_stop - iter_start > 1) {
+            fill_insert_row(match + iter_start + 1, insert_col + iter_start + 1, insert_row + iter_start + 1,
+                            iter_stop - iter_start - 1, gap_open, gap_extend);
         }
     }
     
@@ -542,7 +788,11 @@ void BandedGlobalAligner::BAMatrix::fill_matrix(int8_t* score_mat, int8_t* nt_ta
         int64_t iter_start = top_diag_outside ? -(top_diag + j) : 0;
         int64_t iter_stop = bottom_diag_outside ? band_height + (int64_t) read.length() - bottom_diag - j - 1 : band_height;
         
-        idx = iter_start * ncols + j;
+        // the columns are laid out one after another
+        int64_t col = j * band_height;
+        int64_t prev_col = (j - 1) * band_height;
+        
+        idx = col + iter_start;
         
         int8_t match_score;
         if (qual_adjusted) {
@@ -553,21 +803,21 @@ void BandedGlobalAligner::BAMatrix::fill_matrix(int8_t* score_mat, int8_t* nt_ta
         }
         if (top_diag_outside || top_diag_abutting) {
             // match after implied gap along top edge
-            match[idx] = match_score - gap_open - (cumulative_seq_len + j - 1) * gap_extend;
+            match[idx] = saturate<IntType>(match_score - gap_open - (cumulative_seq_len + j - 1) * gap_extend);
             
 #ifdef debug_banded_aligner_fill_matrix
             cerr << "[BAMatrix::fill_matrix]: on upper edge of matrix at rectangle coords (" << iter_start << ", " << j << "), match score of node char " << j << " (" << node_seq[j] << ") and read char " << iter_start + top_diag + j << " (" << read[iter_start + top_diag + j] << ") is " << (int) match_score << ", leading gap length is " << cumulative_seq_len + j << " for total match matrix score of " << (int) match[idx] << endl;
 #endif
         }
         else {
-            diag_idx = iter_start * ncols + (j - 1);
+            diag_idx = prev_col + iter_start;
             // cells should be present to do normal diagonal iteration
-            match[idx] = match_score + max(max(match[diag_idx], insert_row[diag_idx]), insert_col[diag_idx]);
+            match[idx] = saturate<IntType>(match_score + max(max(match[diag_idx], insert_row[diag_idx]), insert_col[diag_idx]));
         }
         
         if (top_diag_outside) {
             // gap open after implied gap along top edge
-            insert_row[idx] = -2 * gap_open - (cumulative_seq_len + j) * gap_extend;
+            insert_row[idx] = saturate<IntType>(-2 * gap_open - (cumulative_seq_len + j) * gap_extend);
         }
         else {
             // cannot reach this node with row insert (outside the diagonal)
@@ -576,49 +826,30 @@ void BandedGlobalAligner::BAMatrix::fill_matrix(int8_t* score_mat, int8_t* nt_ta
         
         // normal iteration along row unless band height is 1
         if (band_height != 1) {
-            int64_t left_idx = (iter_start + 1) * ncols + (j - 1);
-            insert_col[idx] = max(max(match[left_idx] - gap_open, insert_row[left_idx] - gap_open),
-                                  insert_col[left_idx] - gap_extend);
+            int64_t left_idx = prev_col + iter_start + 1;
+            insert_col[idx] = saturate<IntType>(max(max(match[left_idx] - gap_open, insert_row[left_idx] - gap_open),
+                                                    insert_col[left_idx] - gap_extend));
         }
         else {
             insert_col[idx] = min_inf;
         }
         
-        
-        for (int64_t i = iter_start + 1; i < iter_stop - 1; i++) {
-            // indices of the current and previous cells in the rectangularized band
-            idx = i * ncols + j;
-            up_idx = (i - 1) * ncols + j;
-            diag_idx = i * ncols + (j - 1);
-            left_idx = (i + 1) * ncols + (j - 1);
-            
-            if (qual_adjusted) {
-                match_score = score_mat[25 * base_quality[i + top_diag + j] + 5 * nt_table[node_seq[j]] + nt_table[read[i + top_diag + j]]];
-            }
-            else {
-                match_score = score_mat[5 * nt_table[node_seq[j]] + nt_table[read[i + top_diag + j]]];
-            }
-            
-            match[idx] = match_score + max(max(match[diag_idx], insert_row[diag_idx]), insert_col[diag_idx]);
-            
-            insert_row[idx] = max(max(match[up_idx] - gap_open, insert_row[up_idx] - gap_extend),
-                                  insert_col[up_idx] - gap_open);
-            
-            insert_col[idx] = max(max(match[left_idx] - gap_open, insert_row[left_idx] - gap_open),
-                                  insert_col[left_idx] - gap_extend);
-            
-#ifdef debug_banded_aligner_fill_matrix
-            cerr << "[BAMatrix::fill_matrix]: in interior of matrix at rectangle coords (" << i << ", " << j << "), match score of node char " << j << " (" << node_seq[j] << ") and read char " << i + top_diag + j << " (" << read[i + top_diag + j] << ") is " << (int) match_score << ", leading gap length is " << cumulative_seq_len + j << " for total match matrix score of " << (int) match[idx] << endl;
-#endif
+        // the matches and column insertions of the interior of the column only depend on
+        // the previous column, so they can be filled all at once
+        if (iter_stop - iter_start > 2) {
+            int64_t begin = iter_start + 1;
+            fill_diagonal_moves(match + prev_col + begin, insert_row + prev_col + begin, insert_col + prev_col + begin,
+                                score_profile + nt_table[node_seq[j]] * (int64_t) read.length() + begin + top_diag + j,
+                                match + col + begin, insert_col + col + begin, iter_stop - iter_start - 2,
+                                gap_open, gap_extend);
         }
         
         // stop iteration one cell early to handle logic on bottom edge of band
         
         // skip this step in edge case where read length is 1
         if (iter_stop - 1 > iter_start) {
-            idx = (iter_stop - 1) * ncols + j;
-            up_idx = (iter_stop - 2) * ncols + j;
-            diag_idx = (iter_stop - 1) * ncols + (j - 1);
+            idx = col + iter_stop - 1;
+            diag_idx = prev_col + iter_stop - 1;
             
             if (qual_adjusted) {
                 match_score = score_mat[25 * base_quality[iter_stop + top_diag + j - 1] + 5 * nt_table[node_seq[j]] + nt_table[read[iter_stop + top_diag + j - 1]]];
@@ -627,41 +858,68 @@ void BandedGlobalAligner::BAMatrix::fill_matrix(int8_t* score_mat, int8_t* nt_ta
                 match_score = score_mat[5 * nt_table[node_seq[j]] + nt_table[read[iter_stop + top_diag + j - 1]]];
             }
             
-            match[idx] = match_score + max(max(match[diag_idx], insert_row[diag_idx]), insert_col[diag_idx]);
-            
-            insert_row[idx] = max(max(match[up_idx] - gap_open, insert_row[up_idx] - gap_extend),
-                                  insert_col[up_idx] - gap_open);
+            match[idx] = saturate<IntType>(match_score + max(max(match[diag_idx], insert_row[diag_idx]), insert_col[diag_idx]));
             
             if (bottom_diag_outside) {
                 // along the bottom edge of the matrix, so the cell to the right is still there
-                left_idx = iter_stop * ncols + (j - 1);
-                insert_col[idx] = max(max(match[left_idx] - gap_open, insert_row[left_idx] - gap_open),
-                                      insert_col[left_idx] - gap_extend);
+                left_idx = prev_col + iter_stop;
+                insert_col[idx] = saturate<IntType>(max(max(match[left_idx] - gap_open, insert_row[left_idx] - gap_open),
+                                                        insert_col[left_idx] - gap_extend));
                 
             }
             else {
                 // cell to the right is outside the band
                 insert_col[idx] = min_inf;
             }
+            
+            // row insertions run down the column, so they go last
+            fill_insert_row(match + col + iter_start + 1, insert_col + col + iter_start + 1,
+                            insert_row + col + iter_start + 1, iter_stop - iter_start - 1, gap_open, gap_extend);
         }
+        
+#ifdef debug_banded_aligner_fill_matrix
+        cerr << "[BAMatrix::fill_matrix]: filled column " << j << " from rectangle row " << iter_start << " to " << iter_stop << endl;
+#endif
     }
     
+    // keep the last column for the successor nodes
+    if (final_match == nullptr) {
+        final_match = (IntType*) malloc(sizeof(IntType) * band_height);
+        final_insert_col = (IntType*) malloc(sizeof(IntType) * band_height);
+        final_insert_row = (IntType*) malloc(sizeof(IntType) * band_height);
+    }
+    int64_t last_col = (ncols - 1) * band_height;
+    memcpy(final_match, match + last_col, sizeof(IntType) * band_height);
+    memcpy(final_insert_col, insert_col + last_col, sizeof(IntType) * band_height);
+    memcpy(final_insert_row, insert_row + last_col, sizeof(IntType) * band_height);
+    
 #ifdef debug_banded_aligner_print_matrices
     print_full_matrices();
     print_rectangularized_bands();
 #endif
 }
 
-void BandedGlobalAligner::BAMatrix::traceback(BABuilder& builder, AltTracebackStack& traceback_stack, matrix_t start_mat,
-                                              int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend,
-                                              bool qual_adjusted, int8_t min_inf) {
+template <class IntType>
+void BandedGlobalAligner::BAMatrix<IntType>::discard_band() {
+    free(match);
+    free(insert_col);
+    free(insert_row);
+    match = nullptr;
+    insert_col = nullptr;
+    insert_row = nullptr;
+}
+
+template <class IntType>
+void BandedGlobalAligner::BAMatrix<IntType>::traceback(BABuilder& builder, AltTracebackStack<IntType>& traceback_stack, matrix_t start_mat,
+                                                       int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend,
+                                                       bool qual_adjusted, IntType min_inf,
+                                                       const IntType* score_profile) {
     
     // get coordinates of bottom right corner
     const string& read = alignment.sequence();
     int64_t ncols = node->sequence().length();
     int64_t row = bottom_diag + ncols > (int64_t) read.length() ? (int64_t) read.length() - top_diag - ncols : bottom_diag - top_diag;
     int64_t col = ncols - 1;
-    int64_t idx = row * ncols + col;
     
     
 #ifdef debug_banded_aligner_traceback
@@ -669,13 +927,14 @@ void BandedGlobalAligner::BAMatrix::traceback(BABuilder& builder, AltTracebackSt
 #endif
     
     traceback_internal(builder, traceback_stack, row, col, start_mat, false, score_mat, nt_table, gap_open, gap_extend,
-                       qual_adjusted, min_inf);
+                       qual_adjusted, min_inf, score_profile);
 }
 
-void BandedGlobalAligner::BAMatrix::traceback_internal(BABuilder& builder, AltTracebackStack& traceback_stack, int64_t start_row,
-                                                       int64_t start_col, matrix_t start_mat, bool in_lead_gap, int8_t* score_mat,
-                                                       int8_t* nt_table, int8_t gap_open, int8_t gap_extend, bool qual_adjusted,
-                                                       int8_t min_inf) {
+template <class IntType>
+void BandedGlobalAligner::BAMatrix<IntType>::traceback_internal(BABuilder& builder, AltTracebackStack<IntType>& traceback_stack, int64_t start_row,
+                                                                int64_t start_col, matrix_t start_mat, bool in_lead_gap, int8_t* score_mat,
+                                                                int8_t* nt_table, int8_t gap_open, int8_t gap_extend, bool qual_adjusted,
+                                                                IntType min_inf, const IntType* score_profile) {
     
 #ifdef debug_banded_aligner_traceback
     cerr << "[BAMatrix::traceback_internal] starting traceback back through node " << node->id() << " from rectangular coordinates (" << start_row << ", " << start_col << "), currently " << (in_lead_gap ? "" : "not ") << "in a lead gap" << endl;
@@ -683,6 +942,16 @@ void BandedGlobalAligner::BAMatrix::traceback_internal(BABuilder& builder, AltTr
     
     //cerr << "node " << node->id() << endl;
     
+    // if we only kept the last column of the band, we have to recompute the rest of it, and we can
+    // let it go again once we've passed through
+    bool recomputed = match == nullptr;
+    if (recomputed) {
+#ifdef debug_banded_aligner_traceback
+        cerr << "[BAMatrix::traceback_internal] recomputing band for node " << node->id() << endl;
+#endif
+        fill_matrix(score_mat, nt_table, gap_open, gap_extend, qual_adjusted, min_inf, score_profile);
+    }
+    
     const string& read = alignment.sequence();
     const string& base_quality = alignment.quality();
     
@@ -694,11 +963,11 @@ void BandedGlobalAligner::BAMatrix::traceback_internal(BABuilder& builder, AltTr
     int64_t idx, next_idx;
     int64_t i = start_row, j = start_col;
     matrix_t curr_mat = start_mat;
-    int8_t curr_score;
-    int8_t source_score;
-    int8_t score_diff;
-    int8_t alt_score;
-    int8_t curr_traceback_score = traceback_stack.current_traceback_score();
+    IntType curr_score;
+    IntType source_score;
+    int64_t score_diff;
+    int64_t alt_score;
+    IntType curr_traceback_score = traceback_stack.current_traceback_score();
     
     // do node traceback unless we are in the lead gap implied at the edge of the DP matrix or we
     // are already at a node boundary trying to get across
@@ -749,7 +1018,7 @@ void BandedGlobalAligner::BAMatrix::traceback_internal(BABuilder& builder, AltTr
         }
         
         // find optimal traceback
-        idx = i * ncols + j;
+        idx = j * band_height + i;
         bool found_trace = false;
         switch (curr_mat) {
             case Match:
@@ -766,7 +1035,7 @@ void BandedGlobalAligner::BAMatrix::traceback_internal(BABuilder& builder, AltTr
                 }
                 
                 curr_score = match[idx];
-                next_idx = i * ncols + j - 1;
+                next_idx = (j - 1) * band_height + i;
                 
                 int8_t match_score;
                 if (qual_adjusted) {
@@ -791,7 +1060,7 @@ void BandedGlobalAligner::BAMatrix::traceback_internal(BABuilder& builder, AltTr
                 }
                 else {
                     alt_score = curr_traceback_score - score_diff;
-                    traceback_stack.propose_deflection(alt_score, node_id, i, j, node_id, Match);
+                    traceback_stack.propose_deflection(saturate<IntType>(alt_score), node_id, i, j, node_id, Match);
                 }
                 
                 source_score = insert_row[next_idx];
@@ -806,7 +1075,7 @@ void BandedGlobalAligner::BAMatrix::traceback_internal(BABuilder& builder, AltTr
                     }
                     else {
                         alt_score = curr_traceback_score - score_diff;
-                        traceback_stack.propose_deflection(alt_score, node_id, i, j, node_id, InsertRow);
+                        traceback_stack.propose_deflection(saturate<IntType>(alt_score), node_id, i, j, node_id, InsertRow);
                     }
                 }
                 
@@ -822,7 +1091,7 @@ void BandedGlobalAligner::BAMatrix::traceback_internal(BABuilder& builder, AltTr
                     }
                     else {
                         alt_score = curr_traceback_score - score_diff;
-                        traceback_stack.propose_deflection(alt_score, node_id, i, j, node_id, InsertCol);
+                        traceback_stack.propose_deflection(saturate<IntType>(alt_score), node_id, i, j, node_id, InsertCol);
                     }
 
                 }
@@ -853,7 +1122,7 @@ void BandedGlobalAligner::BAMatrix::traceback_internal(BABuilder& builder, AltTr
                 }
                 
                 curr_score = insert_row[idx];
-                next_idx = (i - 1) * ncols + j;
+                next_idx = j * band_height + i - 1;
                 
                 source_score = match[next_idx];
                 score_diff = curr_score - (source_score - gap_open);
@@ -863,7 +1132,7 @@ void BandedGlobalAligner::BAMatrix::traceback_internal(BABuilder& builder, AltTr
                 }
                 else {
                     alt_score = curr_traceback_score - score_diff;
-                    traceback_stack.propose_deflection(alt_score, node_id, i, j, node_id, Match);
+                    traceback_stack.propose_deflection(saturate<IntType>(alt_score), node_id, i, j, node_id, Match);
                 }
                 
                 source_score = insert_row[next_idx];
@@ -875,7 +1144,7 @@ void BandedGlobalAligner::BAMatrix::traceback_internal(BABuilder& builder, AltTr
                     }
                     else {
                         alt_score = curr_traceback_score - score_diff;
-                        traceback_stack.propose_deflection(alt_score, node_id, i, j, node_id, InsertRow);
+                        traceback_stack.propose_deflection(saturate<IntType>(alt_score), node_id, i, j, node_id, InsertRow);
                     }
                 }
                 
@@ -888,7 +1157,7 @@ void BandedGlobalAligner::BAMatrix::traceback_internal(BABuilder& builder, AltTr
                     }
                     else {
                         alt_score = curr_traceback_score - score_diff;
-                        traceback_stack.propose_deflection(alt_score, node_id, i, j, node_id, InsertCol);
+                        traceback_stack.propose_deflection(saturate<IntType>(alt_score), node_id, i, j, node_id, InsertCol);
                     }
                 }
                 
@@ -912,7 +1181,7 @@ void BandedGlobalAligner::BAMatrix::traceback_internal(BABuilder& builder, AltTr
                 }
                 
                 curr_score = insert_col[idx];
-                next_idx = (i + 1) * ncols + j - 1;
+                next_idx = (j - 1) * band_height + i + 1;
 
                 source_score = match[next_idx];
                 score_diff = curr_score - (source_score - gap_open);
@@ -922,7 +1191,7 @@ void BandedGlobalAligner::BAMatrix::traceback_internal(BABuilder& builder, AltTr
                 }
                 else {
                     alt_score = curr_traceback_score - score_diff;
-                    traceback_stack.propose_deflection(alt_score, node_id, i, j, node_id, Match);
+                    traceback_stack.propose_deflection(saturate<IntType>(alt_score), node_id, i, j, node_id, Match);
                 }
                 
                 source_score = insert_row[next_idx];
@@ -934,7 +1203,7 @@ void BandedGlobalAligner::BAMatrix::traceback_internal(BABuilder& builder, AltTr
                     }
                     else {
                         alt_score = curr_traceback_score - score_diff;
-                        traceback_stack.propose_deflection(alt_score, node_id, i, j, node_id, InsertRow);
+                        traceback_stack.propose_deflection(saturate<IntType>(alt_score), node_id, i, j, node_id, InsertRow);
                     }
                 }
                 
@@ -947,7 +1216,7 @@ void BandedGlobalAligner::BAMatrix::traceback_internal(BABuilder& builder, AltTr
                     }
                     else {
                         alt_score = curr_traceback_score - score_diff;
-                        traceback_stack.propose_deflection(alt_score, node_id, i, j, node_id, InsertCol);
+                        traceback_stack.propose_deflection(saturate<IntType>(alt_score), node_id, i, j, node_id, InsertCol);
                     }
                 }
                 
@@ -1051,9 +1320,14 @@ void BandedGlobalAligner::BAMatrix::traceback_internal(BABuilder& builder, AltTr
                 cerr << "[BAMatrix::traceback_internal] taking node boundary deflection to " << (deflect_matrix == Match ? "match" : (deflect_matrix == InsertCol ? "insert column" : "insert row")) << " in node " << deflect_node_id << ", will start at coordinates (" << traceback_seed_row << ", " << traceback_seed_col << ")" << endl;
 #endif
                 
+                if (recomputed) {
+                    discard_band();
+                }
+                
                 // continue traceback in the next node
                 seed->traceback_internal(builder, traceback_stack, traceback_seed_row, traceback_seed_col, deflect_matrix,
-                                         in_lead_gap, score_mat, nt_table, gap_open, gap_extend, qual_adjusted, min_inf);
+                                         in_lead_gap, score_mat, nt_table, gap_open, gap_extend, qual_adjusted, min_inf,
+                                         score_profile);
                 return;
             }
             
@@ -1065,7 +1339,7 @@ void BandedGlobalAligner::BAMatrix::traceback_internal(BABuilder& builder, AltTr
             switch (curr_mat) {
                 case Match:
                 {
-                    curr_score = match[i * ncols];
+                    curr_score = match[i];
                     if (qual_adjusted) {
                         match_score = score_mat[25 * base_quality[i + top_diag] + 5 * nt_table[node_seq[j]] + nt_table[read[i + top_diag]]];
                     }
@@ -1077,7 +1351,7 @@ void BandedGlobalAligner::BAMatrix::traceback_internal(BABuilder& builder, AltTr
                     
                 case InsertCol:
                 {
-                    curr_score = insert_col[i * ncols];
+                    curr_score = insert_col[i];
                     break;
                 }
                     
@@ -1135,7 +1409,7 @@ void BandedGlobalAligner::BAMatrix::traceback_internal(BABuilder& builder, AltTr
                 
                 int64_t seed_col = seed_ncols - 1;
                 int64_t seed_row = curr_diag - seed_extended_top_diag + (curr_mat == InsertCol);
-                next_idx = seed_row * seed_ncols + seed_col;
+                next_idx = seed_row;
                 
 #ifdef debug_banded_aligner_traceback
                 cerr << "[BAMatrix::traceback_internal] checking seed rectangular coordinates (" << seed_row << ", " << seed_col << ")" << endl;
@@ -1144,7 +1418,7 @@ void BandedGlobalAligner::BAMatrix::traceback_internal(BABuilder& builder, AltTr
                 switch (curr_mat) {
                     case Match:
                     {
-                        source_score = seed->match[next_idx];
+                        source_score = seed->final_match[next_idx];
                         score_diff = curr_score - (source_score + match_score);
                         if (score_diff == 0 && !found_trace) {
                             curr_mat = Match;
@@ -1153,20 +1427,20 @@ void BandedGlobalAligner::BAMatrix::traceback_internal(BABuilder& builder, AltTr
                             traceback_seed_col = seed_col;
                             found_trace = true;
 #ifdef debug_banded_aligner_traceback
-                            cerr << "[BAMatrix::traceback_internal] hit found in match matrix with score " << (int) seed->match[next_idx] << endl;
+                            cerr << "[BAMatrix::traceback_internal] hit found in match matrix with score " << (int) seed->final_match[next_idx] << endl;
 #endif
                         }
                         else {
                             alt_score = curr_traceback_score - score_diff;
-                            traceback_stack.propose_deflection(alt_score, node_id, i, j, seed_node_id, Match);
+                            traceback_stack.propose_deflection(saturate<IntType>(alt_score), node_id, i, j, seed_node_id, Match);
                         }
                         
-                        source_score = seed->insert_col[next_idx];
+                        source_score = seed->final_insert_col[next_idx];
                         if (source_score > min_inf) {
                             score_diff = curr_score - (source_score + match_score);
                             if (score_diff == 0 && !found_trace) {
 #ifdef debug_banded_aligner_traceback
-                                cerr << "[BAMatrix::traceback_internal] hit found in insert column matrix  with score " << (int) seed->insert_col[next_idx] << endl;
+                                cerr << "[BAMatrix::traceback_internal] hit found in insert column matrix  with score " << (int) seed->final_insert_col[next_idx] << endl;
 #endif
                                 curr_mat = InsertCol;
                                 traceback_seed = seed;
@@ -1176,16 +1450,16 @@ void BandedGlobalAligner::BAMatrix::traceback_internal(BABuilder& builder, AltTr
                             }
                             else {
                                 alt_score = curr_traceback_score - score_diff;
-                                traceback_stack.propose_deflection(alt_score, node_id, i, j, seed_node_id, InsertCol);
+                                traceback_stack.propose_deflection(saturate<IntType>(alt_score), node_id, i, j, seed_node_id, InsertCol);
                             }
                         }
                         
-                        source_score = seed->insert_row[next_idx];
+                        source_score = seed->final_insert_row[next_idx];
                         if (source_score > min_inf) {
                             score_diff = curr_score - (source_score + match_score);
                             if (score_diff == 0 && !found_trace) {
 #ifdef debug_banded_aligner_traceback
-                                cerr << "[BAMatrix::traceback_internal] hit found in insert row matrix  with score " << (int) seed->insert_row[next_idx] << endl;
+                                cerr << "[BAMatrix::traceback_internal] hit found in insert row matrix  with score " << (int) seed->final_insert_row[next_idx] << endl;
 #endif
                                 curr_mat = InsertRow;
                                 traceback_seed = seed;
@@ -1195,7 +1469,7 @@ void BandedGlobalAligner::BAMatrix::traceback_internal(BABuilder& builder, AltTr
                             }
                             else {
                                 alt_score = curr_traceback_score - score_diff;
-                                traceback_stack.propose_deflection(alt_score, node_id, i, j, seed_node_id, InsertRow);
+                                traceback_stack.propose_deflection(saturate<IntType>(alt_score), node_id, i, j, seed_node_id, InsertRow);
                             }
                         }
                         
@@ -1204,7 +1478,7 @@ void BandedGlobalAligner::BAMatrix::traceback_internal(BABuilder& builder, AltTr
                         
                     case InsertCol:
                     {
-                        source_score = seed->match[next_idx];
+                        source_score = seed->final_match[next_idx];
                         score_diff = curr_score - (source_score - gap_open);
                         if (score_diff == 0 && !found_trace) {
                             curr_mat = Match;
@@ -1215,10 +1489,10 @@ void BandedGlobalAligner::BAMatrix::traceback_internal(BABuilder& builder, AltTr
                         }
                         else {
                             alt_score = curr_traceback_score - score_diff;
-                            traceback_stack.propose_deflection(alt_score, node_id, i, j, seed_node_id, Match);
+                            traceback_stack.propose_deflection(saturate<IntType>(alt_score), node_id, i, j, seed_node_id, Match);
                         }
                         
-                        source_score = seed->insert_col[next_idx];
+                        source_score = seed->final_insert_col[next_idx];
                         if (source_score > min_inf) {
                             score_diff = curr_score - (source_score - gap_extend);
                             if (score_diff == 0 && !found_trace) {
@@ -1230,11 +1504,11 @@ void BandedGlobalAligner::BAMatrix::traceback_internal(BABuilder& builder, AltTr
                             }
                             else {
                                 alt_score = curr_traceback_score - score_diff;
-                                traceback_stack.propose_deflection(alt_score, node_id, i, j, seed_node_id, InsertCol);
+                                traceback_stack.propose_deflection(saturate<IntType>(alt_score), node_id, i, j, seed_node_id, InsertCol);
                             }
                         }
                         
-                        source_score = seed->insert_row[next_idx];
+                        source_score = seed->final_insert_row[next_idx];
                         if (source_score > min_inf) {
                             score_diff = curr_score - (source_score - gap_open);
                             if (score_diff == 0 && !found_trace) {
@@ -1246,7 +1520,7 @@ void BandedGlobalAligner::BAMatrix::traceback_internal(BABuilder& builder, AltTr
                             }
                             else {
                                 alt_score = curr_traceback_score - score_diff;
-                                traceback_stack.propose_deflection(alt_score, node_id, i, j, seed_node_id, InsertRow);
+                                traceback_stack.propose_deflection(saturate<IntType>(alt_score), node_id, i, j, seed_node_id, InsertRow);
                             }
                         }
                         
@@ -1275,9 +1549,14 @@ void BandedGlobalAligner::BAMatrix::traceback_internal(BABuilder& builder, AltTr
             }
         }
         
+        if (recomputed) {
+            discard_band();
+        }
+        
         // continue traceback in the next node
         traceback_seed->traceback_internal(builder, traceback_stack, traceback_seed_row, traceback_seed_col, curr_mat,
-                                           in_lead_gap, score_mat, nt_table, gap_open, gap_extend, qual_adjusted, min_inf);
+                                           in_lead_gap, score_mat, nt_table, gap_open, gap_extend, qual_adjusted, min_inf,
+                                           score_profile);
     }
     else {
         // this is the first node in the alignment, finish off the alignment and return
@@ -1329,10 +1608,15 @@ void BandedGlobalAligner::BAMatrix::traceback_internal(BABuilder& builder, AltTr
                 i--;
             }
         }
+        
+        if (recomputed) {
+            discard_band();
+        }
     }
 }
 
-void BandedGlobalAligner::BAMatrix::print_full_matrices() {
+template <class IntType>
+void BandedGlobalAligner::BAMatrix<IntType>::print_full_matrices() {
     if (match == nullptr) {
         cerr << "error:[BandedGlobalAligner] cannot print matrix before performing dynamic programming" << endl;
         assert(0);
@@ -1346,7 +1630,8 @@ void BandedGlobalAligner::BAMatrix::print_full_matrices() {
 
 }
 
-void BandedGlobalAligner::BAMatrix::print_rectangularized_bands() {
+template <class IntType>
+void BandedGlobalAligner::BAMatrix<IntType>::print_rectangularized_bands() {
     if (match == nullptr) {
         cerr << "error:[BandedGlobalAligner] cannot print band before performing dynamic programming" << endl;
         assert(0);
@@ -1359,12 +1644,13 @@ void BandedGlobalAligner::BAMatrix::print_rectangularized_bands() {
     }
 }
 
-void BandedGlobalAligner::BAMatrix::print_matrix(matrix_t which_mat) {
+template <class IntType>
+void BandedGlobalAligner::BAMatrix<IntType>::print_matrix(matrix_t which_mat) {
 
     const string& read = alignment.sequence();
     const string& node_seq = node->sequence();
     
-    int8_t* band_rect;
+    IntType* band_rect;
     switch (which_mat) {
         case Match:
             cout << "match:" << endl;
@@ -1392,6 +1678,7 @@ void BandedGlobalAligner::BAMatrix::print_matrix(matrix_t which_mat) {
     }
     cout << endl;
     
+    int64_t band_height = bottom_diag - top_diag + 1;
     int64_t ncols = node_seq.length();
     
     for (int64_t i = 0; i < (int64_t) read.length(); i++) {
@@ -1402,19 +1689,20 @@ void BandedGlobalAligner::BAMatrix::print_matrix(matrix_t which_mat) {
                 cout << "\t.";
             }
             else {
-                cout << "\t" << (int) band_rect[(diag - top_diag) * ncols + j];
+                cout << "\t" << (int) band_rect[j * band_height + diag - top_diag];
             }
         }
         cout << endl;
     }
 }
 
-void BandedGlobalAligner::BAMatrix::print_band(matrix_t which_mat) {
+template <class IntType>
+void BandedGlobalAligner::BAMatrix<IntType>::print_band(matrix_t which_mat) {
     
     const string& read = alignment.sequence();
     const string& node_seq = node->sequence();
     
-    int8_t* band_rect;
+    IntType* band_rect;
     switch (which_mat) {
         case Match:
             cout << "match:" << endl;
@@ -1455,7 +1743,7 @@ void BandedGlobalAligner::BAMatrix::print_band(matrix_t which_mat) {
                 cout << "\t.";
             }
             else {
-                cout << "\t" << (int) band_rect[i * ncols + j];
+                cout << "\t" << (int) band_rect[j * band_height + i];
             }
         }
         cout << endl;
@@ -1508,7 +1796,8 @@ BandedGlobalAligner::BandedGlobalAligner(Alignment& alignment, Graph& g,
                                          alignment(alignment),
                                          alt_alignments(alt_alignments),
                                          max_multi_alns(max_multi_alns),
-                                         adjust_for_base_quality(adjust_for_base_quality)
+                                         adjust_for_base_quality(adjust_for_base_quality),
+                                         max_band_bytes(64 << 20)
 {
     if (adjust_for_base_quality) {
         if (alignment.quality().empty()) {
@@ -1533,7 +1822,6 @@ BandedGlobalAligner::BandedGlobalAligner(Alignment& alignment, Graph& g,
 #endif
     
     // convert the graph into lists of ids indicating incoming or outgoing edges
-    vector<vector<int64_t>> node_edges_in;
     vector<vector<int64_t>> node_edges_out;
     graph_edge_lists(g, true, node_edges_out);
     graph_edge_lists(g, false, node_edges_in);
@@ -1569,8 +1857,6 @@ BandedGlobalAligner::BandedGlobalAligner(Alignment& alignment, Graph& g,
     
     // figure out what the bands need to be for alignment and which nodes cannot complete a
     // global alignment within the band
-    vector<bool> node_masked;
-    vector<pair<int64_t, int64_t>> band_ends;
     find_banded_paths(alignment.sequence(), permissive_banding, node_edges_in, node_edges_out, band_padding, node_masked, band_ends);
     
 #ifdef debug_banded_aligner_objects
@@ -1579,70 +1865,12 @@ BandedGlobalAligner::BandedGlobalAligner(Alignment& alignment, Graph& g,
     
     // find the shortest sequence leading to each node so we can infer the length
     // of lead deletions
-    vector<int64_t> shortest_seqs;
     shortest_seq_paths(node_edges_out, shortest_seqs);
     
-#ifdef debug_banded_aligner_objects
-    cerr << "[BandedGlobalAligner]: constructing banded matrix objects" << endl;
-#endif
-    
-    // initialize DP matrices for each node
-    banded_matrices.resize(g.node_size());
-    for (int64_t i = 0; i < g.node_size(); i++) {
-        
-#ifdef debug_banded_aligner_objects
-        cerr << "[BandedGlobalAligner]: creating matrix object for node " << g.mutable_node(i)->id() << " at index " << i << endl;
-#endif
-        
-        if (node_masked[i]) {
-#ifdef debug_banded_aligner_objects
-            cerr << "[BandedGlobalAligner]: node is masked, creating dummy matrix object" << endl;
-#endif
-            
-            banded_matrices[i] = nullptr;
-        }
-        else {
-            Node* node = g.mutable_node(i);
-            int64_t node_seq_len = node->sequence().length();
-            
-#ifdef debug_banded_aligner_objects
-            cerr << "[BandedGlobalAligner]: establishing seed list for node " << node->id() << " at index " << i << endl;
-#endif
-            
-            // POA predecessor matrices
-            BAMatrix** seeds;
-            vector<int64_t>& edges_in = node_edges_in[i];
-            if (edges_in.empty()) {
-                
-#ifdef debug_banded_aligner_objects
-                cerr << "[BandedGlobalAligner]: no seeds, setting array to null" << endl;
-#endif
-                
-                seeds = nullptr;
-            }
-            else {
-                seeds = (BAMatrix**) malloc(sizeof(BAMatrix**) * edges_in.size());
-                for (int64_t j = 0; j < edges_in.size(); j++) {
-                    // add sentinel for masked nodes
-                    seeds[j] = node_masked[edges_in[j]] ? nullptr : banded_matrices[edges_in[j]];
-                }
-            }
-            
-            banded_matrices[i] = new BAMatrix(alignment,
-                                                           node,
-                                                           band_ends[i].first,
-                                                           band_ends[i].second,
-                                                           seeds,
-                                                           edges_in.size(),
-                                                           shortest_seqs[i]);
-            
-        }
-    }
-    
     if (!permissive_banding) {
         bool sinks_masked = true;
         for (Node* node : sink_nodes) {
-            if (banded_matrices[node_id_to_idx[node->id()]] != nullptr) {
+            if (!node_masked[node_id_to_idx[node->id()]]) {
                 sinks_masked = false;
                 break;
             }
@@ -1657,11 +1885,7 @@ BandedGlobalAligner::BandedGlobalAligner(Alignment& alignment, Graph& g,
 }
 
 BandedGlobalAligner::~BandedGlobalAligner() {
-    
-    for (BAMatrix* banded_matrix : banded_matrices) {
-        delete banded_matrix;
-    }
-    
+    // nothing to do
 }
 
 // fills a vector with vectors ids that have edges to/from each node
@@ -1913,63 +2137,213 @@ void BandedGlobalAligner::shortest_seq_paths(vector<vector<int64_t>>& node_edges
 }
 
 void BandedGlobalAligner::align(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend) {
-    
-    // small enough number to never be accepted in alignment but also not trigger underflow
+    align_any_width(score_mat, nt_table, gap_open, gap_extend, false);
+}
+
+void BandedGlobalAligner::score(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend) {
+    align_any_width(score_mat, nt_table, gap_open, gap_extend, true);
+}
+
+void BandedGlobalAligner::set_max_band_bytes(int64_t bytes) {
+    max_band_bytes = bytes;
+}
+
+void BandedGlobalAligner::align_any_width(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend,
+                                          bool score_only) {
+
+    // the highest score an alignment of the read could get, which bounds the scores in the matrices
+    const string& read = alignment.sequence();
+    const string& base_quality = alignment.quality();
+    int64_t max_score = 0;
+    for (int64_t i = 0; i < (int64_t) read.length(); i++) {
+        int8_t best_score = 0;
+        for (int64_t c = 0; c < 5; c++) {
+            if (adjust_for_base_quality) {
+                best_score = max<int8_t>(best_score, score_mat[25 * base_quality[i] + 5 * c + nt_table[read[i]]]);
+            }
+            else {
+                best_score = max<int8_t>(best_score, score_mat[5 * c + nt_table[read[i]]]);
+            }
+        }
+        max_score += best_score;
+    }
+
+    // use the narrowest scores that we can, and widen them if they overflow
+    if (max_score <= numeric_limits<int8_t>::max()) {
+        if (align_internal<int8_t>(score_mat, nt_table, gap_open, gap_extend, max_score, score_only)) {
+            return;
+        }
+#ifdef debug_banded_aligner_fill_matrix
+        cerr << "[BandedGlobalAligner::align] 8-bit scores overflowed, redoing alignment with 16-bit scores" << endl;
+#endif
+    }
+    if (max_score <= numeric_limits<int16_t>::max()) {
+        if (align_internal<int16_t>(score_mat, nt_table, gap_open, gap_extend, max_score, score_only)) {
+            return;
+        }
+#ifdef debug_banded_aligner_fill_matrix
+        cerr << "[BandedGlobalAligner::align] 16-bit scores overflowed, redoing alignment with 32-bit scores" << endl;
+#endif
+    }
+    align_internal<int32_t>(score_mat, nt_table, gap_open, gap_extend, max_score, score_only);
+}
+
+template <class IntType>
+bool BandedGlobalAligner::align_internal(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend,
+                                         int64_t max_score, bool score_only) {
+
+    // small enough number to never be accepted in alignment but also not trigger underflow (with 32 bit
+    // scores, we also leave room to do the arithmetic on the edges of the bands in int)
     int8_t max_mismatch = numeric_limits<int8_t>::max();
     for (int i = 0; i < 25; i++) {
         max_mismatch = min<int8_t>(max_mismatch, score_mat[i]);
     }
-    int8_t min_inf = numeric_limits<int8_t>::min() + max<int8_t>((int8_t) -max_mismatch, max<int8_t>(gap_open, gap_extend));
-    
+    int64_t lowest = sizeof(IntType) < sizeof(int32_t) ? numeric_limits<IntType>::min() : numeric_limits<IntType>::min() / 2;
+    IntType min_inf = lowest + max<int64_t>(-max_mismatch, max<int8_t>(gap_open, gap_extend));
+
+    // score of each node base against each read base, laid out so that the scores down a
+    // column of a band are contiguous
+    const string& read = alignment.sequence();
+    const string& base_quality = alignment.quality();
+    vector<IntType> score_profile(5 * read.length());
+    for (int64_t c = 0; c < 5; c++) {
+        for (int64_t i = 0; i < (int64_t) read.length(); i++) {
+            if (adjust_for_base_quality) {
+                score_profile[c * read.length() + i] = score_mat[25 * base_quality[i] + 5 * c + nt_table[read[i]]];
+            }
+            else {
+                score_profile[c * read.length() + i] = score_mat[5 * c + nt_table[read[i]]];
+            }
+        }
+    }
+
+    // if the bands would take up too much memory, we only keep the last column of each one while
+    // filling, and recompute the bands from them a node at a time during the traceback
+    bool discard_bands = score_only;
+    if (!discard_bands) {
+        int64_t band_bytes = 0;
+        for (int64_t i = 0; i < topological_order.size(); i++) {
+            int64_t node_idx = node_id_to_idx.at(topological_order[i]->id());
+            if (!node_masked[node_idx]) {
+                band_bytes += 3 * sizeof(IntType) * (band_ends[node_idx].second - band_ends[node_idx].first + 1)
+                              * topological_order[i]->sequence().length();
+            }
+        }
+        discard_bands = band_bytes > max_band_bytes;
+    }
     
-    // fill each nodes matrix in topological order
-    //for (Node* node : topological_order) {
+    // make and fill each node's matrix in topological order, so that its seeds are ready before it
+    vector<BAMatrix<IntType>*> banded_matrices(node_edges_in.size(), nullptr);
     for (int64_t i = 0; i < topological_order.size(); i++) {
         Node* node = topological_order[i];
         int64_t node_idx = node_id_to_idx.at(node->id());
-        BAMatrix* band_matrix = banded_matrices[node_idx];
 #ifdef debug_banded_aligner_fill_matrix
-        cerr << "[BandedGlobalAligner::align] checking node " << node->id() << " at index " << node_idx << " with sequence " << node->sequence() << " and topological position " << i << endl;
+        cerr << "[BandedGlobalAligner::align_internal] checking node " << node->id() << " at index " << node_idx << " with sequence " << node->sequence() << " and topological position " << i << endl;
 #endif
-        
+
         // skip masked nodes
-        if (band_matrix == nullptr) {
+        if (node_masked[node_idx]) {
 #ifdef debug_banded_aligner_fill_matrix
-            cerr << "[BandedGlobalAligner::align] node is masked, skipping" << endl;
+            cerr << "[BandedGlobalAligner::align_internal] node is masked, skipping" << endl;
 #endif
             continue;
         }
+
+        // POA predecessor matrices
+        BAMatrix<IntType>** seeds = nullptr;
+        vector<int64_t>& edges_in = node_edges_in[node_idx];
+        if (!edges_in.empty()) {
+            seeds = (BAMatrix<IntType>**) malloc(sizeof(BAMatrix<IntType>*) * edges_in.size());
+            for (int64_t j = 0; j < edges_in.size(); j++) {
+                // masked nodes have null matrices, which act as sentinels
+                seeds[j] = banded_matrices[edges_in[j]];
+            }
+        }
+
+        BAMatrix<IntType>* band_matrix = new BAMatrix<IntType>(alignment,
+                                                               node,
+                                                               band_ends[node_idx].first,
+                                                               band_ends[node_idx].second,
+                                                               seeds,
+                                                               edges_in.size(),
+                                                               shortest_seqs[node_idx]);
+        banded_matrices[node_idx] = band_matrix;
+
 #ifdef debug_banded_aligner_fill_matrix
-        cerr << "[BandedGlobalAligner::align] node is not masked, filling matrix" << endl;
+        cerr << "[BandedGlobalAligner::align_internal] node is not masked, filling matrix" << endl;
 #endif
-        band_matrix->fill_matrix(score_mat, nt_table, gap_open, gap_extend, adjust_for_base_quality, min_inf);
+        band_matrix->fill_matrix(score_mat, nt_table, gap_open, gap_extend, adjust_for_base_quality, min_inf,
+                                 score_profile.data());
+        if (discard_bands) {
+            band_matrix->discard_band();
+        }
     }
-    
-    traceback(score_mat, nt_table, gap_open, gap_extend, min_inf);
-}
 
-void BandedGlobalAligner::traceback(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend, int8_t min_inf) {
-    
     // get the sink node matrices for alignment stack
-    vector<BAMatrix*> sink_node_matrices;
+    vector<BAMatrix<IntType>*> sink_node_matrices;
     sink_node_matrices.reserve(sink_nodes.size());
     for (Node* node : sink_nodes) {
         sink_node_matrices.push_back(banded_matrices[node_id_to_idx[node->id()]]);
     }
-    
+
     // find the optimal alignment(s) and initialize stack
-    AltTracebackStack traceback_stack(max_multi_alns, sink_node_matrices);
-    
+    AltTracebackStack<IntType> traceback_stack(score_only ? 1 : max_multi_alns, sink_node_matrices);
+
+    // the scores along a traceback can't be less than its score minus the most the rest of the read
+    // could add, so if a traceback scores above this, none of its cells can have been clipped
+    int64_t min_score = min_inf + max_score;
+    bool complete;
+    if (score_only) {
+        complete = traceback_stack.current_traceback_score() > min_score;
+        if (complete) {
+            alignment.set_score(traceback_stack.current_traceback_score());
+        }
+    }
+    else {
+        complete = traceback<IntType>(banded_matrices, traceback_stack, score_mat, nt_table, gap_open,
+                                      gap_extend, min_inf, score_profile.data(), min_score);
+    }
+
+    for (BAMatrix<IntType>* banded_matrix : banded_matrices) {
+        delete banded_matrix;
+    }
+
+    if (!complete && sizeof(IntType) < sizeof(int32_t)) {
+        // throw out any alignments we made so we can start over with wider scores
+        if (alt_alignments) {
+            alt_alignments->clear();
+        }
+        return false;
+    }
+
+    // at 32 bits, anything below the minimum score is an artifact of the -inf sentinels
+    return true;
+}
+
+template <class IntType>
+bool BandedGlobalAligner::traceback(vector<BAMatrix<IntType>*>& banded_matrices,
+                                    AltTracebackStack<IntType>& traceback_stack, int8_t* score_mat,
+                                    int8_t* nt_table, int8_t gap_open, int8_t gap_extend, IntType min_inf,
+                                    const IntType* score_profile, int64_t min_score) {
+
     for (; traceback_stack.has_next(); traceback_stack.next()) {
+
+        if (traceback_stack.current_traceback_score() <= min_score) {
+#ifdef debug_banded_aligner_traceback
+            cerr << "[BandedGlobalAligner::traceback] traceback score " << (int64_t) traceback_stack.current_traceback_score() << " is too low to be trusted" << endl;
+#endif
+            return false;
+        }
+
         int64_t end_node_id;
         matrix_t end_matrix;
         traceback_stack.get_alignment_start(end_node_id, end_matrix);
         int64_t end_node_idx = node_id_to_idx[end_node_id];
-        
+
 #ifdef debug_banded_aligner_traceback
         cerr << "[BandedGlobalAligner::traceback] beginning traceback ending at node " << end_node_id << " in matrix " << (end_matrix == Match ? "match" : (end_matrix == InsertCol ? "insert column" : "insert row")) << endl;
 #endif
-        
+
         Alignment* next_alignment;
         if (!alt_alignments) {
             next_alignment = &alignment;
@@ -1985,18 +2359,18 @@ void BandedGlobalAligner::traceback(int8_t* score_mat, int8_t* nt_table, int8_t
             next_alignment->set_sequence(alignment.sequence());
             next_alignment->set_quality(alignment.quality());
         }
-        
+
         // add score to alignment
         next_alignment->set_score(traceback_stack.current_traceback_score());
-        
+
         // do traceback
         BABuilder builder(*next_alignment);
         banded_matrices[end_node_idx]->traceback(builder, traceback_stack, end_matrix, score_mat, nt_table,
-                                                 gap_open, gap_extend, adjust_for_base_quality, min_inf);
-        
+                                                 gap_open, gap_extend, adjust_for_base_quality, min_inf, score_profile);
+
         // construct the alignment path
         builder.finalize_alignment();
-        
+
         if (alt_alignments) {
             if (alt_alignments->empty()) {
                 // copy the primary into the alternates
@@ -2004,20 +2378,23 @@ void BandedGlobalAligner::traceback(int8_t* score_mat, int8_t* nt_table, int8_t
             }
         }
     }
+
+    return true;
 }
 
 // TODO: should find a way to initialize it with the optimal alignments from the sink nodes in the constructor
-BandedGlobalAligner::AltTracebackStack::AltTracebackStack(int64_t max_multi_alns,
-                                                          vector<BAMatrix*> sink_node_matrices) :
-                                                          max_multi_alns(max_multi_alns)
+template <class IntType>
+BandedGlobalAligner::AltTracebackStack<IntType>::AltTracebackStack(int64_t max_multi_alns,
+                                                                   vector<BAMatrix<IntType>*> sink_node_matrices) :
+                                                                   max_multi_alns(max_multi_alns)
 {
     
     // an empty trace back prefix for the initial tracebacks
     vector<Deflection> null_prefix;
     
     // check tracebacks for alignments ending in all sink nodes
-    for (BAMatrix* band_matrix : sink_node_matrices) {
-        if (band_matrix->match == nullptr) {
+    for (BAMatrix<IntType>* band_matrix : sink_node_matrices) {
+        if (band_matrix->final_match == nullptr) {
             cerr << "error:[BandedGlobalAligner] must fill dynamic programming matrices before finding optimal score" << endl;
             assert(0);
         }
@@ -2033,14 +2410,12 @@ BandedGlobalAligner::AltTracebackStack::AltTracebackStack(int64_t max_multi_alns
         int64_t final_col = ncols - 1;
         int64_t final_row = band_matrix->bottom_diag + ncols > (int64_t) read.length() ? (int64_t) read.length() - band_matrix->top_diag - ncols : band_matrix->bottom_diag - band_matrix->top_diag;
         
-        int64_t final_idx = final_row * ncols + final_col;
-        
         // let the insert routine figure out which one is the best and which ones to keep in the stack
-        insert_traceback(null_prefix, band_matrix->match[final_idx],
+        insert_traceback(null_prefix, band_matrix->final_match[final_row],
                          node_id, final_row, final_col, node_id, Match);
-        insert_traceback(null_prefix, band_matrix->insert_row[final_idx],
+        insert_traceback(null_prefix, band_matrix->final_insert_row[final_row],
                          node_id, final_row, final_col, node_id, InsertRow);
-        insert_traceback(null_prefix, band_matrix->insert_col[final_idx],
+        insert_traceback(null_prefix, band_matrix->final_insert_col[final_row],
                          node_id, final_row, final_col, node_id, InsertCol);
     }
     
@@ -2049,11 +2424,13 @@ BandedGlobalAligner::AltTracebackStack::AltTracebackStack(int64_t max_multi_alns
     curr_deflxn = (*curr_traceback).first.begin();
 }
 
-BandedGlobalAligner::AltTracebackStack::~AltTracebackStack() {
+template <class IntType>
+BandedGlobalAligner::AltTracebackStack<IntType>::~AltTracebackStack() {
     // nothing to do
 }
 
-inline void BandedGlobalAligner::AltTracebackStack::get_alignment_start(int64_t& node_id, matrix_t& matrix) {
+template <class IntType>
+inline void BandedGlobalAligner::AltTracebackStack<IntType>::get_alignment_start(int64_t& node_id, matrix_t& matrix) {
     
     // move to next traceback
     if (curr_traceback != alt_tracebacks.end()) {
@@ -2071,7 +2448,8 @@ inline void BandedGlobalAligner::AltTracebackStack::get_alignment_start(int64_t&
     }
 }
 
-inline void BandedGlobalAligner::AltTracebackStack::next() {
+template <class IntType>
+inline void BandedGlobalAligner::AltTracebackStack<IntType>::next() {
     if (curr_deflxn != (*curr_traceback).first.end()) {
         cerr << "warning:[BandedGlobalAligner] moving on to next alternate alignment without taking all deflections" << endl;
     }
@@ -2079,13 +2457,15 @@ inline void BandedGlobalAligner::AltTracebackStack::next() {
     curr_traceback++;
 }
 
-inline bool BandedGlobalAligner::AltTracebackStack::has_next() {
+template <class IntType>
+inline bool BandedGlobalAligner::AltTracebackStack<IntType>::has_next() {
     return (curr_traceback != alt_tracebacks.end());
 }
 
-inline void BandedGlobalAligner::AltTracebackStack::propose_deflection(const int8_t score, const int64_t from_node_id,
-                                                                       const int64_t row_idx, const int64_t col_idx,
-                                                                       const int64_t to_node_id, const matrix_t to_matrix) {
+template <class IntType>
+inline void BandedGlobalAligner::AltTracebackStack<IntType>::propose_deflection(const IntType score, const int64_t from_node_id,
+                                                                                const int64_t row_idx, const int64_t col_idx,
+                                                                                const int64_t to_node_id, const matrix_t to_matrix) {
     // only propose deflections if we're going through a new untraversed section of the traceback
     if (curr_deflxn != (*curr_traceback).first.end()) {
         return;
@@ -2099,21 +2479,19 @@ inline void BandedGlobalAligner::AltTracebackStack::propose_deflection(const int
     insert_traceback((*curr_traceback).first, score, from_node_id, row_idx, col_idx, to_node_id, to_matrix);
 }
 
-inline void BandedGlobalAligner::AltTracebackStack::insert_traceback(const vector<Deflection>& traceback_prefix,
-                                                                     const int8_t score, const int64_t from_node_id,
-                                                                     const int64_t row_idx, const int64_t col_idx,
-                                                                     const int64_t to_node_id, const matrix_t to_matrix) {
+template <class IntType>
+inline void BandedGlobalAligner::AltTracebackStack<IntType>::insert_traceback(const vector<Deflection>& traceback_prefix,
+                                                                              const IntType score, const int64_t from_node_id,
+                                                                              const int64_t row_idx, const int64_t col_idx,
+                                                                              const int64_t to_node_id, const matrix_t to_matrix) {
 #ifdef debug_banded_aligner_traceback
     cerr << "[AltTracebackStack::insert_traceback] adding traceback with score " << (int) score << ", new deflection at (" << row_idx << ", " << col_idx << ") on node " << from_node_id << " to " << (to_matrix == Match ? "match" : (to_matrix == InsertRow ? "insert row" : "insert column")) << " matrix on node " << to_node_id << endl;
 #endif
     
     // find position in stack where this should go
     auto insert_after = alt_tracebacks.rbegin();
-    while (score > (*insert_after).second) {
+    while (insert_after != alt_tracebacks.rend() && score > (*insert_after).second) {
         insert_after++;
-        if (insert_after == alt_tracebacks.rend()) {
-            break;
-        }
     }
     
     // insert if score is high enough or stack is not full yet
@@ -2141,19 +2519,21 @@ inline void BandedGlobalAligner::AltTracebackStack::insert_traceback(const vecto
     
 #ifdef debug_banded_aligner_traceback
     cerr << "[AltTracebackStack::insert_traceback] scores in alt traceback stack currently ";
-    for (pair<vector<Deflection>, int8_t> trace : alt_tracebacks) {
+    for (pair<vector<Deflection>, IntType> trace : alt_tracebacks) {
         cerr << (int) trace.second << " -> ";
     }
     cerr << endl;
 #endif
 }
 
-inline int8_t BandedGlobalAligner::AltTracebackStack::current_traceback_score() {
+template <class IntType>
+inline IntType BandedGlobalAligner::AltTracebackStack<IntType>::current_traceback_score() {
     return (*curr_traceback).second;
 }
 
-inline bool BandedGlobalAligner::AltTracebackStack::at_next_deflection(int64_t node_id, int64_t row_idx,
-                                                                       int64_t col_idx) {
+template <class IntType>
+inline bool BandedGlobalAligner::AltTracebackStack<IntType>::at_next_deflection(int64_t node_id, int64_t row_idx,
+                                                                                int64_t col_idx) {
     // taken all deflections already?
     if (curr_deflxn == (*curr_traceback).first.end()) {
         return false;
@@ -2171,34 +2551,38 @@ inline bool BandedGlobalAligner::AltTracebackStack::at_next_deflection(int64_t n
     return true;
 }
 
-inline BandedGlobalAligner::matrix_t BandedGlobalAligner::AltTracebackStack::deflect_to_matrix() {
+template <class IntType>
+inline BandedGlobalAligner::matrix_t BandedGlobalAligner::AltTracebackStack<IntType>::deflect_to_matrix() {
     matrix_t mat = (*curr_deflxn).to_matrix;
     curr_deflxn++;
     return mat;
 }
 
-inline BandedGlobalAligner::matrix_t BandedGlobalAligner::AltTracebackStack::deflect_to_matrix(int64_t& to_node_id) {
+template <class IntType>
+inline BandedGlobalAligner::matrix_t BandedGlobalAligner::AltTracebackStack<IntType>::deflect_to_matrix(int64_t& to_node_id) {
     matrix_t mat = (*curr_deflxn).to_matrix;
     to_node_id = (*curr_deflxn).to_node_id;
     curr_deflxn++;
     return mat;
 }
 
-BandedGlobalAligner::AltTracebackStack::Deflection::Deflection(const int64_t from_node_id,
-                                                               const int64_t row_idx,
-                                                               const int64_t col_idx,
-                                                               const int64_t to_node_id,
-                                                               const matrix_t to_matrix) :
-                                                               from_node_id(from_node_id),
-                                                               row_idx(row_idx),
-                                                               col_idx(col_idx),
-                                                               to_node_id(to_node_id),
-                                                               to_matrix(to_matrix)
+template <class IntType>
+BandedGlobalAligner::AltTracebackStack<IntType>::Deflection::Deflection(const int64_t from_node_id,
+                                                                        const int64_t row_idx,
+                                                                        const int64_t col_idx,
+                                                                        const int64_t to_node_id,
+                                                                        const matrix_t to_matrix) :
+                                                                        from_node_id(from_node_id),
+                                                                        row_idx(row_idx),
+                                                                        col_idx(col_idx),
+                                                                        to_node_id(to_node_id),
+                                                                        to_matrix(to_matrix)
 {
     // only set values
 }
 
-BandedGlobalAligner::AltTracebackStack::Deflection::~Deflection() {
+template <class IntType>
+BandedGlobalAligner::AltTracebackStack<IntType>::Deflection::~Deflection() {
     // nothing to do
 }
 
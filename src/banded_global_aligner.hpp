@@ -15,6 +15,7 @@
 #include <unordered_set>
 #include <unordered_map>
 #include <list>
+#include <limits>
 #include "vg.pb.h"
 
 
@@ -77,13 +78,30 @@ namespace vg {
          *  gap_extend  gap extension penalty from Algner (if performing base quality adjusted alignment,
          *              use QualAdjAligner's scaled penalty)
          *
+         * The DP is done with 8-bit scores if a perfect match of the read fits in them, and is redone
+         * with 16-bit and then 32-bit scores if the scores overflow, so reads of any length can be
+         * aligned in one pass.
          */
         void align(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend);
         
+        /*
+         * Adds only the score of the optimal alignment to the alignment object given in the constructor,
+         * without a path or any alternate alignments. Only the final column of each node's band is kept,
+         * so memory use doesn't grow with the length of the nodes. Takes the same arguments as align.
+         */
+        void score(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend);
+        
+        /*
+         * Sets how many bytes the DP bands may take up before align saves memory by keeping only the
+         * final column of each node's band, and recomputes the others one node at a time during the
+         * traceback (default 64 MB). With 0, memory is always saved this way.
+         */
+        void set_max_band_bytes(int64_t bytes);
+        
     private:
-        class BAMatrix;
+        template <class IntType> class BAMatrix;
         class BABuilder;
-        class AltTracebackStack;
+        template <class IntType> class AltTracebackStack;
         
         // matrices used in Smith-Waterman-Gotoh alignment algorithm
         enum matrix_t {Match, InsertCol, InsertRow};
@@ -95,22 +113,44 @@ namespace vg {
         int64_t max_multi_alns;
         // perform quality adjusted alignments
         bool adjust_for_base_quality;
-        
-        vector<BAMatrix*> banded_matrices;
+        // more than this much memory in bands and we recompute them for the traceback
+        int64_t max_band_bytes;
         
         unordered_map<int64_t, int64_t> node_id_to_idx;
         vector<Node*> topological_order;
         unordered_set<Node*> source_nodes;
         unordered_set<Node*> sink_nodes;
         
+        // the shape of the DP for each node (by index), from which we make the matrices for
+        // whichever score width we align with
+        vector<vector<int64_t>> node_edges_in;
+        vector<bool> node_masked;
+        vector<pair<int64_t, int64_t>> band_ends;
+        vector<int64_t> shortest_seqs;
+        
         // internal constructor that the others funnel into
         BandedGlobalAligner(Alignment& alignment, Graph& g,
                             vector<Alignment>* alt_alignments, int64_t max_multi_alns,
                             int64_t band_padding, bool permissive_banding = false,
                             bool adjust_for_base_quality = false);
         
-        // traceback an alignment
-        void traceback(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend, int8_t min_inf);
+        // align or score with the narrowest scores that don't overflow
+        void align_any_width(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend,
+                             bool score_only);
+        
+        // fill the DP matrices with scores of the given width and trace back the alignment(s) (or just
+        // find the score), unless the scores overflow, in which case return false without changing the
+        // alignment
+        template <class IntType>
+        bool align_internal(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend,
+                            int64_t max_score, bool score_only);
+        
+        // traceback the alignment(s) scoring above min_score, returning false if there were more to
+        // traceback below it
+        template <class IntType>
+        bool traceback(vector<BAMatrix<IntType>*>& banded_matrices, AltTracebackStack<IntType>& traceback_stack,
+                       int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend, IntType min_inf,
+                       const IntType* score_profile, int64_t min_score);
         
         // construction functions
         void graph_edge_lists(Graph& g, bool outgoing_edges, vector<vector<int64_t>>& out_edge_list);
@@ -123,7 +163,8 @@ namespace vg {
         void shortest_seq_paths(vector<vector<int64_t>>& node_edges_out, vector<int64_t>& seq_lens_out);
     };
 
-    // the band from the DP matrix for one node in the graph
+    // the band from the DP matrix for one node in the graph, with scores of type IntType
+    template <class IntType>
     class BandedGlobalAligner::BAMatrix {
     private:
 
@@ -142,14 +183,21 @@ namespace vg {
         BAMatrix** seeds;
         int64_t num_seeds;
         
-        int8_t* match;
-        int8_t* insert_col;
-        int8_t* insert_row;
+        // bands are stored column by column, with the diagonals of each column consecutive
+        IntType* match;
+        IntType* insert_col;
+        IntType* insert_row;
+        
+        // a copy of the last column of the band, which is all that the successor nodes need, so that
+        // the rest of the band can be discarded and recomputed from the seeds when it's needed again
+        IntType* final_match;
+        IntType* final_insert_col;
+        IntType* final_insert_row;
         
-        void traceback_internal(BABuilder& builder, AltTracebackStack& traceback_stack, int64_t start_row,
+        void traceback_internal(BABuilder& builder, AltTracebackStack<IntType>& traceback_stack, int64_t start_row,
                                 int64_t start_col, matrix_t start_mat, bool in_lead_gap, int8_t* score_mat,
                                 int8_t* nt_table, int8_t gap_open, int8_t gap_extend, bool qual_adjusted,
-                                int8_t min_inf);
+                                IntType min_inf, const IntType* score_profile);
         
         void print_matrix(matrix_t which_mat);
         void print_band(matrix_t which_mat);
@@ -159,25 +207,31 @@ namespace vg {
                  BAMatrix** seeds, int64_t num_seeds, int64_t cumulative_seq_len);
         ~BAMatrix();
         
-        // use DP to fill the band with alignment scores
+        // use DP to fill the band with alignment scores, given the scores of each node base
+        // against the read as laid out by BandedGlobalAligner::align
         void fill_matrix(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend, bool qual_adjusted,
-                         int8_t min_inf);
+                         IntType min_inf, const IntType* score_profile);
+        
+        // free all of the band but its last column, which the traceback will refill if it needs it
+        void discard_band();
         
-        void traceback(BABuilder& builder, AltTracebackStack& traceback_stack, matrix_t start_mat, int8_t* score_mat,
-                       int8_t* nt_table, int8_t gap_open, int8_t gap_extend, bool qual_adjusted, int8_t min_inf);
+        void traceback(BABuilder& builder, AltTracebackStack<IntType>& traceback_stack, matrix_t start_mat, int8_t* score_mat,
+                       int8_t* nt_table, int8_t gap_open, int8_t gap_extend, bool qual_adjusted, IntType min_inf,
+                       const IntType* score_profile);
         
         // debugging functions
         void print_full_matrices();
         void print_rectangularized_bands();
         
         friend class BABuilder;
-        friend class AltTracebackStack; // not a fan of this one, but constructor ugly without it
+        friend class AltTracebackStack<IntType>; // not a fan of this one, but constructor ugly without it
     };
     
     // maintains a stack of directions to find the top scoring tracebacks
+    template <class IntType>
     class BandedGlobalAligner::AltTracebackStack {
     public:
-        AltTracebackStack(int64_t max_multi_alns, vector<BAMatrix*> sink_node_matrices);
+        AltTracebackStack(int64_t max_multi_alns, vector<BAMatrix<IntType>*> sink_node_matrices);
         ~AltTracebackStack();
         
         // get the start position of the current alignment and advance to the first deflection
@@ -188,11 +242,11 @@ namespace vg {
         inline bool has_next();
         
         // check if a deflection from the current traceback
-        inline void propose_deflection(const int8_t score, const int64_t from_node_id, const int64_t row_idx,
+        inline void propose_deflection(const IntType score, const int64_t from_node_id, const int64_t row_idx,
                                        const int64_t col_idx, const int64_t to_node_id, const matrix_t to_matrix);
         
         // score of the current traceback
-        inline int8_t current_traceback_score();
+        inline IntType current_traceback_score();
         
         // are these the coordinates of the next deflection?
         inline bool at_next_deflection(int64_t node_id, int64_t row_idx, int64_t col_idx);
@@ -207,18 +261,19 @@ namespace vg {
         
         int64_t max_multi_alns;
         // pairs contain scores of alignments and the places where their traceback differs from the optimum
-        list<pair<vector<Deflection>, int8_t>> alt_tracebacks;
+        list<pair<vector<Deflection>, IntType>> alt_tracebacks;
         
-        list<pair<vector<Deflection>, int8_t>>::iterator curr_traceback;
-        vector<Deflection>::iterator curr_deflxn;
+        typename list<pair<vector<Deflection>, IntType>>::iterator curr_traceback;
+        typename vector<Deflection>::iterator curr_deflxn;
         
-        inline void insert_traceback(const vector<Deflection>& traceback_prefix, const int8_t score,
+        inline void insert_traceback(const vector<Deflection>& traceback_prefix, const IntType score,
                                      const int64_t from_node_id, const int64_t row_idx,
                                      const int64_t col_idx, const int64_t to_node_id, const matrix_t to_matrix);
     };
     
     
-    class BandedGlobalAligner::AltTracebackStack::Deflection {
+    template <class IntType>
+    class BandedGlobalAligner::AltTracebackStack<IntType>::Deflection {
     public:
         Deflection(const int64_t from_node_id, const int64_t row_idx, const int64_t col_idx,
                    const int64_t to_node_id, const matrix_t to_matrix);
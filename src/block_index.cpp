@@ -0,0 +1,167 @@
+#include "block_index.hpp"
+#include <limits>
+
+namespace vg {
+
+using namespace std;
+
+const string BlockIndex::EXTENSION = ".bi";
+
+// written at the start of index files
+static const char BLOCK_INDEX_MAGIC[4] = { 'V', 'G', 'B', 'I' };
+static const uint32_t BLOCK_INDEX_VERSION = 1;
+
+bool BlockIndex::index_alignments(istream& in) {
+    return index_blocks(in, [](const string& block, uint64_t& count, id_t& min_id, id_t& max_id) {
+            function<void(Alignment&)> lambda = [&](Alignment& aln) {
+                ++count;
+                for (size_t i = 0; i < aln.path().mapping_size(); ++i) {
+                    id_t id = aln.path().mapping(i).position().node_id();
+                    min_id = min(min_id, id);
+                    max_id = max(max_id, id);
+                }
+            };
+            stream::for_each_in_block(block, lambda);
+        });
+}
+
+bool BlockIndex::index_graphs(istream& in) {
+    return index_blocks(in, [](const string& block, uint64_t& count, id_t& min_id, id_t& max_id) {
+            function<void(Graph&)> lambda = [&](Graph& graph) {
+                ++count;
+                for (size_t i = 0; i < graph.node_size(); ++i) {
+                    id_t id = graph.node(i).id();
+                    min_id = min(min_id, id);
+                    max_id = max(max_id, id);
+                }
+            };
+            stream::for_each_in_block(block, lambda);
+        });
+}
+
+bool BlockIndex::index_blocks(istream& in,
+                              const function<void(const string&, uint64_t&, id_t&, id_t&)>& describe_block) {
+    blocks.clear();
+
+    // we read blocks in batches on this thread and inflate them all at once
+    const size_t batch_size = 1024;
+    vector<string> batch;
+    batch.reserve(batch_size);
+    uint64_t offset = 0;
+    uint64_t records = 0;
+    bool more_input = true;
+    bool any_blocks = false;
+    string block;
+
+    while (more_input) {
+        batch.clear();
+        size_t first_block = blocks.size();
+        while (batch.size() < batch_size && (more_input = stream::read_block(in, block))) {
+            Block b;
+            b.offset = offset;
+            b.size = block.size();
+            offset += block.size();
+            blocks.push_back(b);
+            batch.emplace_back(move(block));
+            any_blocks = true;
+        }
+
+#pragma omp parallel for schedule(dynamic,1)
+        for (size_t i = 0; i < batch.size(); ++i) {
+            Block& b = blocks[first_block + i];
+            b.min_id = numeric_limits<id_t>::max();
+            b.max_id = numeric_limits<id_t>::min();
+            describe_block(batch[i], b.count, b.min_id, b.max_id);
+        }
+
+        for (size_t i = first_block; i < blocks.size(); ++i) {
+            blocks[i].first_record = records;
+            records += blocks[i].count;
+        }
+    }
+
+    if (!block.empty()) {
+        // we stopped on something other than the end of the stream
+        if (stream::is_block_header(block.data(), block.size())) {
+            cerr << "[vg::BlockIndex] error: block at offset " << offset << " is truncated" << endl;
+            exit(1);
+        }
+        if (!any_blocks) {
+            // nothing we could read, so this must be an old-style stream
+            return false;
+        }
+        cerr << "[vg::BlockIndex] error: data at offset " << offset << " after the last block is not a block" << endl;
+        exit(1);
+    }
+    return true;
+}
+
+void BlockIndex::save(ostream& out) const {
+    out.write(BLOCK_INDEX_MAGIC, sizeof(BLOCK_INDEX_MAGIC));
+    out.write((const char*) &BLOCK_INDEX_VERSION, sizeof(BLOCK_INDEX_VERSION));
+    uint64_t n = blocks.size();
+    out.write((const char*) &n, sizeof(n));
+    for (auto& b : blocks) {
+        out.write((const char*) &b.offset, sizeof(b.offset));
+        out.write((const char*) &b.size, sizeof(b.size));
+        out.write((const char*) &b.first_record, sizeof(b.first_record));
+        out.write((const char*) &b.count, sizeof(b.count));
+        out.write((const char*) &b.min_id, sizeof(b.min_id));
+        out.write((const char*) &b.max_id, sizeof(b.max_id));
+    }
+}
+
+bool BlockIndex::load(istream& in) {
+    blocks.clear();
+    char magic[sizeof(BLOCK_INDEX_MAGIC)];
+    uint32_t version = 0;
+    uint64_t n = 0;
+    in.read(magic, sizeof(magic));
+    in.read((char*) &version, sizeof(version));
+    in.read((char*) &n, sizeof(n));
+    if (!in || !equal(magic, magic + sizeof(magic), BLOCK_INDEX_MAGIC) || version != BLOCK_INDEX_VERSION) {
+        return false;
+    }
+    blocks.resize(n);
+    for (auto& b : blocks) {
+        in.read((char*) &b.offset, sizeof(b.offset));
+        in.read((char*) &b.size, sizeof(b.size));
+        in.read((char*) &b.first_record, sizeof(b.first_record));
+        in.read((char*) &b.count, sizeof(b.count));
+        in.read((char*) &b.min_id, sizeof(b.min_id));
+        in.read((char*) &b.max_id, sizeof(b.max_id));
+    }
+    if (!in) {
+        blocks.clear();
+        return false;
+    }
+    return true;
+}
+
+const BlockIndex::Block* BlockIndex::find_record(uint64_t n) const {
+    // blocks are sorted by first_record
+    auto it = upper_bound(blocks.begin(), blocks.end(), n,
+                          [](uint64_t n, const Block& b) { return n < b.first_record; });
+    if (it == blocks.begin()) {
+        return nullptr;
+    }
+    --it;
+    if (n >= it->first_record + it->count) {
+        return nullptr;
+    }
+    return &(*it);
+}
+
+vector<const BlockIndex::Block*> BlockIndex::find_id_range(id_t min_id, id_t max_id) const {
+    // blocks aren't sorted by id (a GAM may not be), so we scan them all;
+    // the index is small compared to the stream it describes
+    vector<const Block*> found;
+    for (auto& b : blocks) {
+        if (b.min_id <= max_id && b.max_id >= min_id) {
+            found.push_back(&b);
+        }
+    }
+    return found;
+}
+
+}
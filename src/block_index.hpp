@@ -0,0 +1,98 @@
+#ifndef VG_BLOCK_INDEX_HPP
+#define VG_BLOCK_INDEX_HPP
+// block_index.hpp: a sidecar index over the independently compressed blocks of
+// a GAM or VG stream, so we can jump to a record or to the blocks covering a
+// range of node ids without inflating everything in front of them
+
+#include <iostream>
+#include <functional>
+#include <vector>
+#include <string>
+#include "vg.pb.h"
+#include "types.hpp"
+#include "stream.hpp"
+
+namespace vg {
+
+using namespace std;
+
+class BlockIndex {
+public:
+
+    struct Block {
+        // where the compressed block starts in the stream, and its size
+        uint64_t offset = 0;
+        uint64_t size = 0;
+        // the number of records in front of this block, and in it
+        uint64_t first_record = 0;
+        uint64_t count = 0;
+        // the range of node ids touched by the records in the block
+        // (min_id > max_id if they touch none)
+        id_t min_id = 0;
+        id_t max_id = 0;
+    };
+
+    // index files are called <stream>.bi
+    static const string EXTENSION;
+
+    vector<Block> blocks;
+
+    // index a stream of alignments (GAM) or graph chunks (VG)
+    // returns false if the stream isn't made of blocks (it was written by an
+    // older vg), in which case there is nothing to index; a stream of blocks
+    // that is cut short or followed by anything else is an error
+    bool index_alignments(istream& in);
+    bool index_graphs(istream& in);
+
+    void save(ostream& out) const;
+    // returns false if the input isn't a block index
+    bool load(istream& in);
+
+    // the block holding the nth record of the stream, or nullptr
+    const Block* find_record(uint64_t n) const;
+    // the blocks that may hold records touching nodes in [min_id, max_id]
+    vector<const Block*> find_id_range(id_t min_id, id_t max_id) const;
+
+    // run the lambda, in parallel, on the objects in the blocks that may touch
+    // nodes in [min_id, max_id]; the stream must be seekable
+    template <typename T>
+    void for_each_in_id_range_parallel(istream& in, id_t min_id, id_t max_id,
+                                       const function<void(T&)>& lambda) const;
+
+private:
+
+    // shared by index_alignments and index_graphs
+    // describe_block is called on each block to count its records and get
+    // their node id range
+    bool index_blocks(istream& in,
+                      const function<void(const string&, uint64_t&, id_t&, id_t&)>& describe_block);
+
+};
+
+template <typename T>
+void BlockIndex::for_each_in_id_range_parallel(istream& in, id_t min_id, id_t max_id,
+                                               const function<void(T&)>& lambda) const {
+    vector<const Block*> todo = find_id_range(min_id, max_id);
+#pragma omp parallel for schedule(dynamic,1)
+    for (size_t i = 0; i < todo.size(); ++i) {
+        string block;
+        bool ok;
+#pragma omp critical (block_index_read)
+        {
+            in.clear();
+            in.seekg(todo[i]->offset);
+            ok = stream::read_block(in, block);
+        }
+        if (!ok) {
+#pragma omp critical (cerr)
+            cerr << "[vg::BlockIndex] error: could not read block at offset " << todo[i]->offset << endl;
+            exit(1);
+        }
+        // inflate and parse in this thread
+        stream::for_each_in_block(block, lambda);
+    }
+}
+
+}
+
+#endif
@@ -0,0 +1,404 @@
+#include "compact_graph.hpp"
+#include "stream.hpp"
+#include <algorithm>
+#include <numeric>
+
+namespace vg {
+
+using namespace std;
+
+// everything we read from the graph chunks, in the order we read it
+struct CompactGraph::Builder {
+    vector<id_t> ids;
+    // sequence of the nth node read starts at seq_start[n] in seq_bits
+    vector<uint64_t> seq_start;
+    vector<uint64_t> seq_bits;
+    uint64_t length = 0;
+    vector<BaseRun> base_runs;
+    // node sides by id (2 * id + (1 if it's the end)) joined by each edge
+    vector<pair<uint64_t, uint64_t>> edges;
+};
+
+// 2-bit codes for ACGT, -1 for anything else
+static inline int base_code(char c) {
+    switch (c) {
+    case 'A': return 0;
+    case 'C': return 1;
+    case 'G': return 2;
+    case 'T': return 3;
+    default: return -1;
+    }
+}
+
+static const char code_base[4] = { 'A', 'C', 'G', 'T' };
+
+static inline void set_code(vector<uint64_t>& bits, uint64_t i, uint64_t code) {
+    if (i / 32 >= bits.size()) {
+        bits.resize(i / 32 + 1, 0);
+    }
+    bits[i / 32] |= code << (2 * (i % 32));
+}
+
+static inline uint64_t get_code(const vector<uint64_t>& bits, uint64_t i) {
+    return (bits[i / 32] >> (2 * (i % 32))) & 3;
+}
+
+CompactGraph::CompactGraph(istream& in) {
+    Builder builder;
+    function<void(Graph&)> lambda = [this, &builder](Graph& graph) {
+        add_graph(graph, builder);
+    };
+    stream::for_each(in, lambda);
+    build(builder);
+}
+
+CompactGraph::CompactGraph(const Graph& graph) {
+    Builder builder;
+    add_graph(graph, builder);
+    build(builder);
+}
+
+void CompactGraph::add_graph(const Graph& graph, Builder& builder) {
+    for (size_t i = 0; i < graph.node_size(); ++i) {
+        const Node& node = graph.node(i);
+        if (node.id() == 0) {
+            // not allowed, and VG skips them too
+            continue;
+        }
+        builder.ids.push_back(node.id());
+        builder.seq_start.push_back(builder.length);
+        const string& seq = node.sequence();
+        for (size_t j = 0; j < seq.size(); ++j, ++builder.length) {
+            int code = base_code(seq[j]);
+            if (code >= 0) {
+                set_code(builder.seq_bits, builder.length, code);
+                continue;
+            }
+            set_code(builder.seq_bits, builder.length, 0);
+            auto& runs = builder.base_runs;
+            if (j > 0 && !runs.empty() && runs.back().base == seq[j]
+                && runs.back().start + runs.back().length == builder.length) {
+                ++runs.back().length;
+            } else {
+                runs.push_back({builder.length, 1, seq[j]});
+            }
+        }
+    }
+    for (size_t i = 0; i < graph.edge_size(); ++i) {
+        const Edge& edge = graph.edge(i);
+        // an edge leaves the end of from (or its start if from_start) and
+        // enters the start of to (or its end if to_end)
+        builder.edges.emplace_back(2 * (uint64_t) edge.from() + !edge.from_start(),
+                                   2 * (uint64_t) edge.to() + edge.to_end());
+    }
+}
+
+void CompactGraph::build(Builder& builder) {
+    builder.seq_start.push_back(builder.length);
+
+    // rank the nodes by id, keeping the first copy of any repeated id
+    vector<uint64_t> order(builder.ids.size());
+    iota(order.begin(), order.end(), 0);
+    stable_sort(order.begin(), order.end(), [&](uint64_t a, uint64_t b) {
+            return builder.ids[a] < builder.ids[b];
+        });
+    order.erase(unique(order.begin(), order.end(), [&](uint64_t a, uint64_t b) {
+                return builder.ids[a] == builder.ids[b];
+            }), order.end());
+    num_nodes = order.size();
+    ids.resize(num_nodes);
+    for (size_t r = 0; r < num_nodes; ++r) {
+        ids[r] = builder.ids[order[r]];
+    }
+    min_id = num_nodes ? ids.front() : 0;
+    if (num_nodes && ids.back() - ids.front() + 1 == num_nodes) {
+        // dense ids, so ranks are just offsets
+        vector<id_t>().swap(ids);
+    }
+    vector<id_t>().swap(builder.ids);
+
+    // lay the sequences out again in rank order
+    vector<uint64_t> rank_of_read(builder.seq_start.size() - 1, num_nodes);
+    seq_start.resize(num_nodes + 1);
+    uint64_t length = 0;
+    for (size_t r = 0; r < num_nodes; ++r) {
+        rank_of_read[order[r]] = r;
+        seq_start[r] = length;
+        length += builder.seq_start[order[r] + 1] - builder.seq_start[order[r]];
+    }
+    seq_start[num_nodes] = length;
+    seq_bits.assign((length + 31) / 32, 0);
+    for (size_t r = 0; r < num_nodes; ++r) {
+        uint64_t from = builder.seq_start[order[r]];
+        uint64_t to = seq_start[r];
+        for (uint64_t i = 0; i < seq_start[r + 1] - seq_start[r]; ++i) {
+            set_code(seq_bits, to + i, get_code(builder.seq_bits, from + i));
+        }
+    }
+    vector<uint64_t>().swap(builder.seq_bits);
+    for (auto& run : builder.base_runs) {
+        // find the node the run was read in
+        uint64_t read = upper_bound(builder.seq_start.begin(), builder.seq_start.end(), run.start)
+            - builder.seq_start.begin() - 1;
+        uint64_t r = rank_of_read[read];
+        if (r == num_nodes) {
+            // in a repeated node we dropped
+            continue;
+        }
+        base_runs.push_back({seq_start[r] + run.start - builder.seq_start[read], run.length, run.base});
+    }
+    sort(base_runs.begin(), base_runs.end(), [](const BaseRun& a, const BaseRun& b) {
+            return a.start < b.start;
+        });
+    vector<BaseRun>().swap(builder.base_runs);
+
+    // put the sides of each edge in a canonical order and drop the repeats;
+    // like VG we count edges touching missing nodes, but then we drop those
+    // too, as they have nowhere to go
+    auto& edges = builder.edges;
+    for (auto& edge : edges) {
+        if (edge.first > edge.second) {
+            swap(edge.first, edge.second);
+        }
+    }
+    sort(edges.begin(), edges.end());
+    edges.erase(unique(edges.begin(), edges.end()), edges.end());
+    num_edges = edges.size();
+    size_t kept = 0;
+    for (auto& edge : edges) {
+        uint64_t from_rank = rank_of(edge.first / 2);
+        uint64_t to_rank = rank_of(edge.second / 2);
+        if (from_rank == num_nodes || to_rank == num_nodes) {
+            continue;
+        }
+        uint64_t a = 2 * from_rank + edge.first % 2;
+        uint64_t b = 2 * to_rank + edge.second % 2;
+        edges[kept++] = make_pair(min(a, b), max(a, b));
+    }
+    edges.resize(kept);
+
+    // and index them by side
+    edge_start.assign(2 * num_nodes + 1, 0);
+    for (auto& edge : edges) {
+        ++edge_start[edge.first + 1];
+        if (edge.second != edge.first) {
+            ++edge_start[edge.second + 1];
+        }
+    }
+    partial_sum(edge_start.begin(), edge_start.end(), edge_start.begin());
+    edge_targets.resize(edge_start.back());
+    vector<uint64_t> filled(edge_start.begin(), edge_start.end() - 1);
+    for (auto& edge : edges) {
+        edge_targets[filled[edge.first]++] = edge.second;
+        if (edge.second != edge.first) {
+            edge_targets[filled[edge.second]++] = edge.first;
+        }
+    }
+    vector<pair<uint64_t, uint64_t>>().swap(edges);
+}
+
+size_t CompactGraph::rank_of(id_t id) const {
+    if (ids.empty()) {
+        return (id >= min_id && id - min_id < num_nodes) ? id - min_id : num_nodes;
+    }
+    auto found = lower_bound(ids.begin(), ids.end(), id);
+    return (found != ids.end() && *found == id) ? found - ids.begin() : num_nodes;
+}
+
+size_t CompactGraph::checked_rank(id_t id) const {
+    size_t r = rank_of(id);
+    if (r == num_nodes) {
+        throw runtime_error("No node " + to_string(id) + " in graph");
+    }
+    return r;
+}
+
+id_t CompactGraph::id_of(size_t rank) const {
+    return ids.empty() ? min_id + rank : ids[rank];
+}
+
+char CompactGraph::base_at(uint64_t i) const {
+    auto run = upper_bound(base_runs.begin(), base_runs.end(), i, [](uint64_t i, const BaseRun& run) {
+            return i < run.start;
+        });
+    if (run != base_runs.begin() && i < (run - 1)->start + (run - 1)->length) {
+        return (run - 1)->base;
+    }
+    return code_base[get_code(seq_bits, i)];
+}
+
+size_t CompactGraph::node_count(void) const {
+    return num_nodes;
+}
+
+size_t CompactGraph::edge_count(void) const {
+    return num_edges;
+}
+
+size_t CompactGraph::total_length_of_nodes(void) const {
+    return seq_start.back();
+}
+
+bool CompactGraph::has_node(id_t id) const {
+    return rank_of(id) != num_nodes;
+}
+
+size_t CompactGraph::node_length(id_t id) const {
+    size_t r = checked_rank(id);
+    return seq_start[r + 1] - seq_start[r];
+}
+
+string CompactGraph::node_sequence(id_t id) const {
+    size_t r = checked_rank(id);
+    string seq(seq_start[r + 1] - seq_start[r], 'N');
+    for (uint64_t i = 0; i < seq.size(); ++i) {
+        seq[i] = base_at(seq_start[r] + i);
+    }
+    return seq;
+}
+
+void CompactGraph::sides_to_nodes(uint64_t side, bool relative_to_end, vector<pair<id_t, bool>>& nodes) const {
+    for (uint64_t i = edge_start[side]; i < edge_start[side + 1]; ++i) {
+        uint64_t other = edge_targets[i];
+        nodes.emplace_back(id_of(other / 2), (other % 2 == 1) == relative_to_end);
+    }
+}
+
+void CompactGraph::edges_start(id_t id, vector<pair<id_t, bool>>& nodes) const {
+    // an edge from our start reverses orientation if it goes to another start
+    sides_to_nodes(2 * checked_rank(id), false, nodes);
+}
+
+void CompactGraph::edges_end(id_t id, vector<pair<id_t, bool>>& nodes) const {
+    sides_to_nodes(2 * checked_rank(id) + 1, true, nodes);
+}
+
+size_t CompactGraph::start_degree(id_t id) const {
+    uint64_t side = 2 * checked_rank(id);
+    return edge_start[side + 1] - edge_start[side];
+}
+
+size_t CompactGraph::end_degree(id_t id) const {
+    uint64_t side = 2 * checked_rank(id) + 1;
+    return edge_start[side + 1] - edge_start[side];
+}
+
+void CompactGraph::nodes_prev(id_t id, bool backward, vector<pair<id_t, bool>>& nodes) const {
+    // we come in from the end of a node read forward
+    sides_to_nodes(2 * checked_rank(id) + backward, false, nodes);
+}
+
+void CompactGraph::nodes_next(id_t id, bool backward, vector<pair<id_t, bool>>& nodes) const {
+    // and go out into the end of a node read backward
+    sides_to_nodes(2 * checked_rank(id) + !backward, true, nodes);
+}
+
+void CompactGraph::for_each_node(const function<void(id_t)>& lambda) const {
+    for (size_t r = 0; r < num_nodes; ++r) {
+        lambda(id_of(r));
+    }
+}
+
+void CompactGraph::for_each_node_parallel(const function<void(id_t)>& lambda) const {
+#pragma omp parallel for schedule(dynamic, 1024)
+    for (size_t r = 0; r < num_nodes; ++r) {
+        lambda(id_of(r));
+    }
+}
+
+void CompactGraph::head_nodes(vector<id_t>& nodes) const {
+    for (size_t r = 0; r < num_nodes; ++r) {
+        if (edge_start[2 * r + 1] == edge_start[2 * r]) {
+            nodes.push_back(id_of(r));
+        }
+    }
+}
+
+void CompactGraph::tail_nodes(vector<id_t>& nodes) const {
+    for (size_t r = 0; r < num_nodes; ++r) {
+        if (edge_start[2 * r + 2] == edge_start[2 * r + 1]) {
+            nodes.push_back(id_of(r));
+        }
+    }
+}
+
+void CompactGraph::dfs(const function<void(id_t, bool)>& node_begin_fn,
+                       const function<void(id_t, bool)>& node_end_fn,
+                       const function<bool(void)>& break_fn) const {
+
+    // oriented nodes are numbered 2 * rank + (1 if backward), and conveniently
+    // the one we reach through side s is numbered s, while we leave oriented
+    // node t through side t ^ 1
+    enum SearchState { PRE = 0, CURR, POST };
+    vector<uint8_t> state(2 * num_nodes, PRE);
+
+    struct Frame {
+        uint64_t trav;
+        uint64_t next_edge;
+    };
+    vector<Frame> todo;
+
+    for (uint64_t root = 0; root < 2 * num_nodes; ++root) {
+        if (state[root] != PRE) {
+            continue;
+        }
+        state[root] = CURR;
+        node_begin_fn(id_of(root / 2), root % 2);
+        if (break_fn()) {
+            return;
+        }
+        todo.push_back({root, edge_start[root ^ 1]});
+        while (!todo.empty()) {
+            Frame& frame = todo.back();
+            if (frame.next_edge == edge_start[(frame.trav ^ 1) + 1]) {
+                state[frame.trav] = POST;
+                node_end_fn(id_of(frame.trav / 2), frame.trav % 2);
+                todo.pop_back();
+                continue;
+            }
+            uint64_t target = edge_targets[frame.next_edge++];
+            if (state[target] == PRE) {
+                state[target] = CURR;
+                node_begin_fn(id_of(target / 2), target % 2);
+                if (break_fn()) {
+                    return;
+                }
+                todo.push_back({target, edge_start[target ^ 1]});
+            }
+        }
+    }
+}
+
+bool CompactGraph::is_acyclic(void) const {
+    // a node with an edge between its own sides is a cycle
+    for (uint64_t side = 0; side < 2 * num_nodes; ++side) {
+        for (uint64_t i = edge_start[side]; i < edge_start[side + 1]; ++i) {
+            if (edge_targets[i] / 2 == side / 2) {
+                return false;
+            }
+        }
+    }
+    // otherwise look for an edge back to an oriented node on the DFS stack
+    vector<bool> on_stack(2 * num_nodes, false);
+    vector<pair<id_t, bool>> next;
+    bool acyclic = true;
+    dfs([&](id_t id, bool backward) {
+            next.clear();
+            nodes_next(id, backward, next);
+            for (auto& n : next) {
+                if (on_stack[2 * rank_of(n.first) + n.second]) {
+                    acyclic = false;
+                }
+            }
+            on_stack[2 * checked_rank(id) + backward] = true;
+        },
+        [&](id_t id, bool backward) {
+            on_stack[2 * checked_rank(id) + backward] = false;
+        },
+        [&](void) {
+            return !acyclic;
+        });
+    return acyclic;
+}
+
+}
@@ -0,0 +1,110 @@
+#ifndef VG_COMPACT_GRAPH_HPP
+#define VG_COMPACT_GRAPH_HPP
+// compact_graph.hpp: a read-only, struct-of-arrays representation of a graph's
+// nodes and edges, for when a whole-genome VG won't fit in memory
+//
+// nodes are stored by rank in id order. sequences are packed two bits to the
+// base (with runs of other characters kept on the side), and the edges on each
+// side of each node are kept in one compressed sparse row array. it costs a few
+// tens of bytes per node, where VG's protobuf objects and hash maps cost
+// hundreds. paths are not kept.
+
+#include <iostream>
+#include <functional>
+#include <vector>
+#include <string>
+#include "vg.pb.h"
+#include "types.hpp"
+
+namespace vg {
+
+using namespace std;
+
+class CompactGraph {
+public:
+
+    // build from a stream of graph chunks, as written by VG::serialize_to_ostream,
+    // without ever holding the protobuf objects for more than one chunk
+    CompactGraph(istream& in);
+    CompactGraph(const Graph& graph);
+
+    size_t node_count(void) const;
+    // edges between the same two node sides are only counted once; edges
+    // touching nodes that aren't in the graph are counted, as in VG, but
+    // otherwise ignored
+    size_t edge_count(void) const;
+    size_t total_length_of_nodes(void) const;
+
+    bool has_node(id_t id) const;
+    size_t node_length(id_t id) const;
+    string node_sequence(id_t id) const;
+
+    // the nodes attached to the start or end of a node, and whether we reverse
+    // orientation to get to them, as in VG::edges_start and VG::edges_end
+    void edges_start(id_t id, vector<pair<id_t, bool>>& nodes) const;
+    void edges_end(id_t id, vector<pair<id_t, bool>>& nodes) const;
+    size_t start_degree(id_t id) const;
+    size_t end_degree(id_t id) const;
+
+    // the oriented nodes (id and backward flag) attached to the left or right
+    // of an oriented node, as in VG::nodes_prev and VG::nodes_next
+    void nodes_prev(id_t id, bool backward, vector<pair<id_t, bool>>& nodes) const;
+    void nodes_next(id_t id, bool backward, vector<pair<id_t, bool>>& nodes) const;
+
+    // nodes are visited in id order
+    void for_each_node(const function<void(id_t)>& lambda) const;
+    void for_each_node_parallel(const function<void(id_t)>& lambda) const;
+    void head_nodes(vector<id_t>& nodes) const;
+    void tail_nodes(vector<id_t>& nodes) const;
+
+    // a bidirected DFS over oriented nodes, like VG::dfs, rooted at each node
+    // in id order in turn
+    void dfs(const function<void(id_t, bool)>& node_begin_fn,
+             const function<void(id_t, bool)>& node_end_fn,
+             const function<bool(void)>& break_fn) const;
+    bool is_acyclic(void) const;
+
+private:
+
+    // the first id, and the ids of all nodes by rank unless they are dense
+    // (min_id, min_id + 1, ...), in which case this is empty
+    id_t min_id = 0;
+    vector<id_t> ids;
+    size_t num_nodes = 0;
+
+    // node sequences by rank, two bits a base, node i starting at base
+    // seq_start[i]; seq_start has one entry past the last node
+    vector<uint64_t> seq_bits;
+    vector<uint64_t> seq_start;
+    // runs of characters that aren't ACGT, sorted by position
+    struct BaseRun {
+        uint64_t start;
+        uint64_t length;
+        char base;
+    };
+    vector<BaseRun> base_runs;
+
+    // the node sides at the other ends of the edges on each node side, which
+    // are numbered 2 * rank + (1 if it's the end); the edges on side s are
+    // edge_targets[edge_start[s]] to edge_targets[edge_start[s+1]]
+    vector<uint64_t> edge_start;
+    vector<uint64_t> edge_targets;
+    size_t num_edges = 0;
+
+    // accumulated from graph chunks until we build the arrays
+    struct Builder;
+    void add_graph(const Graph& graph, Builder& builder);
+    void build(Builder& builder);
+
+    // ranks are dense from 0 to node_count() - 1, and rank_of gives
+    // node_count() for ids not in the graph, where checked_rank throws
+    size_t rank_of(id_t id) const;
+    size_t checked_rank(id_t id) const;
+    id_t id_of(size_t rank) const;
+    char base_at(uint64_t i) const;
+    void sides_to_nodes(uint64_t side, bool relative_to_end, vector<pair<id_t, bool>>& nodes) const;
+};
+
+}
+
+#endif
@@ -0,0 +1,113 @@
+#include <cmath>
+#include <string>
+#include <sstream>
+#include "fragment_length_model.hpp"
+
+namespace vg {
+
+using namespace std;
+
+FragmentLengthModel::FragmentLengthModel(int64_t max_length, int64_t bin_width)
+    : bin_width(max(bin_width, (int64_t) 1))
+    , bins(max(max_length, (int64_t) 1) / max(bin_width, (int64_t) 1) + 1, 0)
+    , total(0)
+    , length_sum(0)
+    , squares_sum(0) {
+}
+
+void FragmentLengthModel::add(size_t bin, uint64_t c) {
+    double middle = bin * bin_width + (bin_width - 1) / 2.0;
+    double lengths = c * middle;
+    double squares = lengths * middle;
+    uint64_t& counter = bins[bin];
+#pragma omp atomic update
+    counter += c;
+#pragma omp atomic update
+    total += c;
+#pragma omp atomic update
+    length_sum += lengths;
+#pragma omp atomic update
+    squares_sum += squares;
+}
+
+void FragmentLengthModel::record(int64_t length) {
+    if (length < 0) return;
+    size_t bin = length / bin_width;
+    if (bin >= bins.size()) return;
+    add(bin, 1);
+}
+
+uint64_t FragmentLengthModel::count(void) const {
+    uint64_t sum;
+#pragma omp atomic read
+    sum = total;
+    return sum;
+}
+
+void FragmentLengthModel::snapshot(vector<uint64_t>& counts, uint64_t& sum) const {
+    // other threads may be adding as we go, so total up what we see rather
+    // than trusting total to match it
+    counts.resize(bins.size());
+    sum = 0;
+    for (size_t i = 0; i < bins.size(); ++i) {
+        const uint64_t& counter = bins[i];
+        uint64_t c;
+#pragma omp atomic read
+        c = counter;
+        counts[i] = c;
+        sum += c;
+    }
+}
+
+double FragmentLengthModel::mean(void) const {
+    // the sums may each be a few lengths ahead of the others while threads
+    // are recording, which hardly matters for an estimate
+    uint64_t n = count();
+    if (n == 0) return 0;
+    double lengths;
+#pragma omp atomic read
+    lengths = length_sum;
+    return lengths / n;
+}
+
+double FragmentLengthModel::stdev(void) const {
+    uint64_t n = count();
+    if (n == 0) return 0;
+    double lengths, squares;
+#pragma omp atomic read
+    lengths = length_sum;
+#pragma omp atomic read
+    squares = squares_sum;
+    double m = lengths / n;
+    return sqrt(max(squares / n - m * m, 0.0));
+}
+
+void FragmentLengthModel::save(ostream& out) const {
+    vector<uint64_t> counts;
+    uint64_t sum;
+    snapshot(counts, sum);
+    for (size_t i = 0; i < counts.size(); ++i) {
+        if (counts[i]) {
+            out << i * bin_width << "\t" << counts[i] << "\n";
+        }
+    }
+}
+
+bool FragmentLengthModel::load(istream& in) {
+    string line;
+    while (getline(in, line)) {
+        if (line.empty()) continue;
+        stringstream fields(line);
+        int64_t length;
+        uint64_t c;
+        if (!(fields >> length >> c) || length < 0) {
+            return false;
+        }
+        size_t bin = length / bin_width;
+        if (bin >= bins.size()) continue;
+        add(bin, c);
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,61 @@
+#ifndef VG_FRAGMENT_LENGTH_MODEL_HPP
+#define VG_FRAGMENT_LENGTH_MODEL_HPP
+// fragment_length_model.hpp: a histogram of the fragment lengths of properly
+// paired reads, which all the threads of a mapping run can add to at once
+//
+// lengths are counted in fixed width bins with atomic increments, so
+// recording a length never waits on another thread. running sums of the
+// lengths and their squares are kept beside the bins, so the moments can be
+// asked for as often as we like without going over the histogram. the histogram can be
+// written out at the end of a run and read back in to seed the next one, so
+// that pairing can use a good estimate from the first read.
+
+#include <vector>
+#include <iostream>
+#include <cstdint>
+
+namespace vg {
+
+using namespace std;
+
+class FragmentLengthModel {
+public:
+
+    // count lengths up to max_length, in bins of bin_width
+    FragmentLengthModel(int64_t max_length = 1e5, int64_t bin_width = 1);
+
+    // add a length to the histogram; thread safe
+    void record(int64_t length);
+
+    // the number of lengths in the histogram, and their moments, taking each
+    // length to be in the middle of its bin
+    uint64_t count(void) const;
+    double mean(void) const;
+    double stdev(void) const;
+
+    // write the nonempty bins as lines of the bin start and count, separated
+    // by a tab
+    void save(ostream& out) const;
+    // add the counts in a histogram written by save; false if it can't be
+    // parsed
+    bool load(istream& in);
+
+private:
+
+    int64_t bin_width;
+    vector<uint64_t> bins;
+    uint64_t total;
+    // of the lengths counted, taking each to be in the middle of its bin
+    double length_sum;
+    double squares_sum;
+
+    // count c more lengths in a bin; thread safe
+    void add(size_t bin, uint64_t c);
+
+    // the count of each bin and their total as they are when we read them
+    void snapshot(vector<uint64_t>& counts, uint64_t& sum) const;
+};
+
+}
+
+#endif
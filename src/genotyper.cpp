@@ -2,6 +2,7 @@
 #include "genotyper.hpp"
 #include "bubbles.hpp"
 #include "distributions.hpp"
+#include "prepared_graph.hpp"
 
 namespace vg {
 
@@ -1163,6 +1164,72 @@ map<Alignment*, vector<Genotyper::Affinity>>
         surrounding.add_edges(graph.edges_of(graph.get_node(id)));
     }
     
+    // We need a way to get graph node sizes to reverse alignments
+    auto get_node_size = [&](id_t id) {
+        return graph.get_node(id)->sequence().size();
+    };
+    
+    // Which reads can tell us about the internal status of the superbubble?
+    // That doesn't depend on the allele, so work it out once.
+    vector<Alignment*> informative_reads;
+    // And what will we realign to each allele? Each read goes in both
+    // orientations, forward at 2*i and reverse at 2*i+1.
+    vector<Alignment> to_align;
+    size_t max_read_length = 0;
+    
+    for(auto& name : relevant_read_names) {
+        // For every read that touched the superbubble, grab its original
+        // Alignment pointer.
+        Alignment* read = reads_by_name.at(name);
+        
+        // Look to make sure it touches more than one node actually in the
+        // superbubble, or a non-start, non-end node. If it just touches the
+        // start or just touches the end, it can't be informative.
+        set<id_t> touched_set;
+        // Will this read be informative?
+        bool informative = false;            
+        for(size_t i = 0; i < read->path().mapping_size(); i++) {
+            // Look at every node the read touches
+            id_t touched = read->path().mapping(i).position().node_id();
+            if(site.contents.count(touched)) {
+                // If it's in the superbubble, keep it
+                touched_set.insert(touched);
+            }
+        }
+        
+        if(touched_set.size() >= 2) {
+            // We touch both the start and end, or an internal node.
+            informative = true;
+        } else {
+            // Throw out the start and end nodes, if we touched them.
+            touched_set.erase(site.start.node->id());
+            touched_set.erase(site.end.node->id());
+            if(!touched_set.empty()) {
+                // We touch an internal node
+                informative = true;
+            }
+        }
+        
+        if(!informative) {
+            // We only touch one of the start and end nodes, and can say nothing about the superbubble. Try the next read.
+            // TODO: mark these as ambiguous/consistent with everything (but strand?)
+            continue;
+        }
+        
+        informative_reads.push_back(read);
+        // Re-align copies of the read in both orientations. Reads with and
+        // without the right number of quality scores both get un-adjusted
+        // alignment for now.
+        // TODO: actually use quality-adjusted alignment
+        to_align.push_back(*read);
+        to_align.push_back(reverse_complement_alignment(*read, get_node_size));
+        max_read_length = max(max_read_length, read->sequence().size());
+    }
+    
+    // One aligner does all the realignment for this site (we're probably
+    // already running in parallel over sites).
+    Aligner aligner;
+    
     for(auto& path : superbubble_paths) {
         // Now for each superbubble path, make a copy of that graph with it in
         VG allele_graph(surrounding);
@@ -1205,64 +1272,51 @@ map<Alignment*, vector<Genotyper::Affinity>>
         // read.
         auto path_seq = traversals_to_string(path);
         
-        for(auto& name : relevant_read_names) {
-            // For every read that touched the superbubble, grab its original
-            // Alignment pointer.
-            Alignment* read = reads_by_name.at(name);
+        // Prepare the allele graph once and score all the reads against it
+        // together. We only need to work out the alignments of some of them.
+        PreparedGraph prepared_graph(allele_graph, max_read_length);
+        vector<int32_t> scores = prepared_graph.score(to_align, aligner);
+        
+        for(size_t i = 0; i < informative_reads.size(); i++) {
+            // For every read that is informative as to the internal status of
+            // this superbubble, grab its original Alignment pointer.
+            Alignment* read = informative_reads[i];
             
-            // Look to make sure it touches more than one node actually in the
-            // superbubble, or a non-start, non-end node. If it just touches the
-            // start or just touches the end, it can't be informative.
-            set<id_t> touched_set;
-            // Will this read be informative?
-            bool informative = false;            
-            for(size_t i = 0; i < read->path().mapping_size(); i++) {
-                // Look at every node the read touches
-                id_t touched = read->path().mapping(i).position().node_id();
-                if(site.contents.count(touched)) {
-                    // If it's in the superbubble, keep it
-                    touched_set.insert(touched);
-                }
-            }
+            // Pick the best orientation
+            int32_t score_fwd = scores[2 * i];
+            int32_t score_rev = scores[2 * i + 1];
+            int32_t score = max(score_fwd, score_rev);
             
-            if(touched_set.size() >= 2) {
-                // We touch both the start and end, or an internal node.
-                informative = true;
+            // Compute the score per base. TODO: is this at all comparable
+            // between quality-adjusted and non-quality-adjusted reads?
+            double score_per_base = (double)score / read->sequence().size();
+            
+            // Save the score (normed per read base) and orientation
+            // We'll normalize the affinities later to enforce the max of 1.0.
+            Affinity affinity(score_per_base, score_rev > score_fwd);
+            
+            // Compute the unnormalized likelihood of the read given the allele graph.
+            if(read->sequence().size() == read->quality().size()) {
+                // Use the quality-adjusted default scoring system
+                affinity.likelihood_ln = quality_aligner.score_to_unnormalized_likelihood_ln(score);
             } else {
-                // Throw out the start and end nodes, if we touched them.
-                touched_set.erase(site.start.node->id());
-                touched_set.erase(site.end.node->id());
-                if(!touched_set.empty()) {
-                    // We touch an internal node
-                    informative = true;
-                }
+                // We will have aligned without quality adjustment, so interpret
+                // score in terms of the normal scoring parameters.
+                affinity.likelihood_ln = normal_aligner.score_to_unnormalized_likelihood_ln(score);
             }
             
-            if(!informative) {
-                // We only touch one of the start and end nodes, and can say nothing about the superbubble. Try the next read.
-                // TODO: mark these as ambiguous/consistent with everything (but strand?)
+            if(score_per_base < min_score_per_base) {
+                // Say we can't really be consistent with this if we have such a
+                // terrible score. We don't need the alignment to tell.
+                affinity.consistent = false;
+                to_return[read].push_back(affinity);
                 continue;
             }
             
-            // If we get here, we know this read is informative as to the internal status of this superbubble.
-            Alignment aligned_fwd;
-            Alignment aligned_rev;
-            // We need a way to get graph node sizes to reverse these alignments
-            auto get_node_size = [&](id_t id) {
-                return graph.get_node(id)->sequence().size();
-            };
-            if(read->sequence().size() == read->quality().size()) {
-                // Re-align a copy to this graph (using quality-adjusted alignment).
-                // TODO: actually use quality-adjusted alignment
-                aligned_fwd = allele_graph.align(*read);
-                aligned_rev = allele_graph.align(reverse_complement_alignment(*read, get_node_size));
-            } else {
-                // If we don't have the right number of quality scores, use un-adjusted alignment instead.
-                aligned_fwd = allele_graph.align(*read);
-                aligned_rev = allele_graph.align(reverse_complement_alignment(*read, get_node_size));
-            }
-            // Pick the best alignment, and emit in original orientation
-            Alignment aligned = (aligned_rev.score() > aligned_fwd.score()) ? reverse_complement_alignment(aligned_rev, get_node_size) : aligned_fwd;
+            // Align the read in its best orientation, and emit in original orientation
+            Alignment aligned = affinity.is_reverse ?
+                reverse_complement_alignment(prepared_graph.align(to_align[2 * i + 1], aligner), get_node_size) :
+                prepared_graph.align(to_align[2 * i], aligner);
             
 #ifdef debug
             #pragma omp critical (cerr)
@@ -1274,24 +1328,6 @@ map<Alignment*, vector<Genotyper::Affinity>>
             #pragma omp critical (cerr)
             cerr << "\t" << pb2json(aligned) << endl;
 #endif
-
-            // Compute the score per base. TODO: is this at all comparable
-            // between quality-adjusted and non-quality-adjusted reads?
-            double score_per_base = (double)aligned.score() / aligned.sequence().size();
-            
-            // Save the score (normed per read base) and orientation
-            // We'll normalize the affinities later to enforce the max of 1.0.
-            Affinity affinity(score_per_base, aligned_rev.score() > aligned_fwd.score());
-            
-            // Compute the unnormalized likelihood of the read given the allele graph.
-            if(read->sequence().size() == read->quality().size()) {
-                // Use the quality-adjusted default scoring system
-                affinity.likelihood_ln = quality_aligner.score_to_unnormalized_likelihood_ln(aligned.score());
-            } else {
-                // We will have aligned without quality adjustment, so interpret
-                // score in terms of the normal scoring parameters.
-                affinity.likelihood_ln = normal_aligner.score_to_unnormalized_likelihood_ln(aligned.score());
-            }
             
             // Get the NodeTraversals for the winning alignment through the site.
             auto read_traversal = get_traversal_of_site(graph, site, aligned.path());
@@ -1338,12 +1374,6 @@ map<Alignment*, vector<Genotyper::Affinity>>
                 cerr << "Warning: realigned read " << aligned.sequence() << " doesn't touch either end of its site!" << endl;
                 affinity.consistent = true;
             }
-            
-            if(score_per_base < min_score_per_base) {
-                // Say we can't really be consistent with this if we have such a
-                // terrible score.
-                affinity.consistent = false;
-            }
 
             // Grab the identity and save it for this read and superbubble path
             to_return[read].push_back(affinity);
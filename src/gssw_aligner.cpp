@@ -42,34 +42,45 @@ Aligner::Aligner(int32_t _match,
 gssw_graph* Aligner::create_gssw_graph(Graph& g, int64_t pinned_node_id, gssw_node** gssw_pinned_node_out) {
     
     gssw_graph* graph = gssw_graph_create(g.node_size());
-    unordered_map<int64_t, gssw_node*> nodes;
+    gssw_nodes_by_id.clear();
 
     for (int i = 0; i < g.node_size(); ++i) {
         Node* n = g.mutable_node(i);
-        // switch any non-ATGCN characters from the node sequence to N
-        auto cleaned_seq = nonATGCNtoN(n->sequence());
+        // switch any non-ATGCN characters from the node sequence to N, copying
+        // it only if there are any (gssw makes its own copy in any case)
+        const char* seq = n->sequence().c_str();
+        if (!allATGCN(n->sequence())) {
+            cleaned_seq = nonATGCNtoN(n->sequence());
+            seq = cleaned_seq.c_str();
+        }
         gssw_node* node = (gssw_node*)gssw_node_create(n, n->id(),
-                                                       cleaned_seq.c_str(),
+                                                       seq,
                                                        nt_table,
                                                        score_matrix);
         if (pinned_node_id == n->id()) {
             *gssw_pinned_node_out = node;
         }
-        nodes[n->id()] = node;
+        gssw_nodes_by_id.emplace_back(n->id(), node);
         gssw_graph_add_node(graph, node);
     }
+    sort(gssw_nodes_by_id.begin(), gssw_nodes_by_id.end());
+    auto nodes = [&](int64_t id) -> gssw_node* {
+        auto found = lower_bound(gssw_nodes_by_id.begin(), gssw_nodes_by_id.end(),
+                                 make_pair(id, (gssw_node*) nullptr));
+        return (found != gssw_nodes_by_id.end() && found->first == id) ? found->second : nullptr;
+    };
 
     for (int i = 0; i < g.edge_size(); ++i) {
         // Convert all the edges
         Edge* e = g.mutable_edge(i);
         if(!e->from_start() && !e->to_end()) {
             // This is a normal end to start edge.
-            gssw_nodes_add_edge(nodes[e->from()], nodes[e->to()]);
+            gssw_nodes_add_edge(nodes(e->from()), nodes(e->to()));
         } else if(e->from_start() && e->to_end()) {
             // This is a start to end edge, but isn't reversing and can be converted to a normal end to start edge.
 
             // Flip the start and end
-            gssw_nodes_add_edge(nodes[e->to()], nodes[e->from()]);
+            gssw_nodes_add_edge(nodes(e->to()), nodes(e->from()));
         } else {
             // TODO: It's a reversing edge, which gssw doesn't support yet. What
             // we should really do is do a topological sort to break cycles, and
@@ -117,10 +128,9 @@ void Aligner::align_internal(Alignment& alignment, vector<Alignment>* multi_alig
     // alignment pinning algorithm is based on pinning in bottom right corner, if pinning in top
     // left we need to reverse all the sequences first and translate the alignment back later
     
-    // create reversed objects if necessary
-    Graph reversed_graph;
-    string reversed_sequence;
+    // create reversed objects if necessary (in scratch space kept from the last alignment)
     if (pin_left) {
+        reversed_graph.Clear();
         reversed_sequence.resize(alignment.sequence().length());
         
         reverse_copy(alignment.sequence().begin(), alignment.sequence().end(), reversed_sequence.begin());
@@ -71,6 +71,17 @@ namespace vg {
         // log of the base of the logarithm underlying the log-odds interpretation of the scores
         double log_base;
         
+        // scratch space kept between alignments so that the hot loop doesn't go back to the
+        // allocator for every read; the Mapper keeps an Aligner per thread, and an Aligner
+        // must not be used by more than one thread at once
+        // gssw nodes by id for hooking up edges, sorted by id once all nodes are added
+        vector<pair<int64_t, gssw_node*>> gssw_nodes_by_id;
+        // a node sequence with its non-ATGCN characters replaced, when it has any
+        string cleaned_seq;
+        // the reversed read and graph for left-pinned alignment
+        string reversed_sequence;
+        Graph reversed_graph;
+        
     public:
         
         Aligner(int32_t _match = default_match,
@@ -0,0 +1,68 @@
+#include "kmer_range_table.hpp"
+
+namespace vg {
+
+using namespace std;
+
+static const char KMER_RANGE_BASES[4] = { 'A', 'C', 'G', 'T' };
+
+KmerRangeTable::KmerRangeTable(gcsa::GCSA* gcsa, int k) : k(k) {
+    ranges.resize((size_t) 1 << (2 * k));
+    if (k == 0) {
+        ranges[0] = gcsa::range_type(0, gcsa->size() - 1);
+        return;
+    }
+    // the last two bases give 16 independent subtrees (or 4, for k of 1)
+    int prefix_length = min(k, 2);
+    size_t subtrees = (size_t) 1 << (2 * prefix_length);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < subtrees; ++i) {
+        gcsa::range_type range(0, gcsa->size() - 1);
+        // step back through the suffix, last base first
+        for (int j = 0; j < prefix_length; ++j) {
+            size_t base = (i >> (2 * j)) & 3;
+            range = gcsa->LF(range, gcsa->alpha.char2comp[KMER_RANGE_BASES[base]]);
+        }
+        fill(gcsa, range, i, prefix_length);
+    }
+}
+
+void KmerRangeTable::fill(gcsa::GCSA* gcsa, const gcsa::range_type& range, size_t code, int suffix_length) {
+    if (suffix_length == k) {
+        ranges[code] = range;
+    } else if (gcsa::Range::empty(range)) {
+        // everything with this suffix is empty too
+        size_t stride = (size_t) 1 << (2 * suffix_length);
+        for (size_t c = code; c < ranges.size(); c += stride) {
+            ranges[c] = range;
+        }
+    } else {
+        for (size_t base = 0; base < 4; ++base) {
+            fill(gcsa, gcsa->LF(range, gcsa->alpha.char2comp[KMER_RANGE_BASES[base]]),
+                 code | (base << (2 * suffix_length)), suffix_length + 1);
+        }
+    }
+}
+
+int KmerRangeTable::kmer_size(void) const {
+    return k;
+}
+
+bool KmerRangeTable::lookup(string::const_iterator begin, gcsa::range_type& range) const {
+    size_t code = 0;
+    for (int i = 0; i < k; ++i) {
+        size_t base;
+        switch (*(begin + i)) {
+        case 'A': base = 0; break;
+        case 'C': base = 1; break;
+        case 'G': base = 2; break;
+        case 'T': base = 3; break;
+        default: return false;
+        }
+        code |= base << (2 * (k - 1 - i));
+    }
+    range = ranges[code];
+    return true;
+}
+
+}
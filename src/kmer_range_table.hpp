@@ -0,0 +1,44 @@
+#ifndef VG_KMER_RANGE_TABLE_HPP
+#define VG_KMER_RANGE_TABLE_HPP
+// kmer_range_table.hpp: the GCSA ranges of every k-mer over ACGT, precomputed
+// so that the first k steps of a backward search can be taken in one lookup
+//
+// the table takes 16 * 4^k bytes, so k of 10 to 12 is about as far as it makes
+// sense to go
+
+#include <vector>
+#include <string>
+#include "gcsa.h"
+
+namespace vg {
+
+using namespace std;
+
+class KmerRangeTable {
+public:
+
+    // run the backward search for all k-mers against the index, in parallel
+    KmerRangeTable(gcsa::GCSA* gcsa, int k);
+
+    int kmer_size(void) const;
+
+    // get the range of the k characters starting at begin, which is what
+    // backward searching them from the full range would give
+    // returns false if they aren't all ACGT, as we don't keep those
+    bool lookup(string::const_iterator begin, gcsa::range_type& range) const;
+
+private:
+
+    int k;
+    // ranges by k-mer code, two bits a base, with the first base in the high
+    // bits
+    vector<gcsa::range_type> ranges;
+
+    // fill in the ranges of all the k-mers ending in a suffix of length
+    // suffix_length with the given code, whose range is range
+    void fill(gcsa::GCSA* gcsa, const gcsa::range_type& range, size_t code, int suffix_length);
+};
+
+}
+
+#endif
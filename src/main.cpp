@@ -31,6 +31,8 @@
 #include "bubbles.hpp"
 #include "translator.hpp"
 #include "readfilter.hpp"
+#include "block_index.hpp"
+#include "compact_graph.hpp"
 #include "distributions.hpp"
 #include "unittest/driver.hpp"
 
@@ -2464,7 +2466,9 @@ int main_msga(int argc, char** argv) {
             mapper->clear_aligners(); // number of aligners per mapper depends on thread count
                                       // we have to reset this here to re-init scores to the right number
             mapper->set_alignment_scores(match, mismatch, gap_open, gap_extend);
-            mapper->init_node_cache();
+            // and so do the per-thread caches
+            mapper->init_match_count_cache();
+            mapper->init_subgraph_cache();
 
             mapper->mem_threading = true;
         }
@@ -2686,7 +2690,9 @@ void help_surject(char** argv) {
         << "    -b, --bam-output        write BAM to stdout" << endl
         << "    -s, --sam-output        write SAM to stdout" << endl
         << "    -C, --compression N     level for compression [0-9]" << endl
-        << "    -w, --window N          use N nodes on either side of the alignment to surject (default 5)" << endl;
+        << "    -w, --window N          use N nodes on either side of the alignment to surject (default 5)" << endl
+        << "    -R, --realign           realign each read to the path, rather than following its alignment along it" << endl
+        << "    -k, --keep-order        write GAM output in the order of the input alignments" << endl;
 }
 
 int main_surject(int argc, char** argv) {
@@ -2707,6 +2713,8 @@ int main_surject(int argc, char** argv) {
     int window = 5;
     string fasta_filename;
     int context_depth = 3;
+    bool keep_order = false;
+    bool realign = false;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -2727,11 +2735,13 @@ int main_surject(int argc, char** argv) {
             {"compress", required_argument, 0, 'C'},
             {"window", required_argument, 0, 'w'},
             {"context-depth", required_argument, 0, 'n'},
+            {"keep-order", no_argument, 0, 'k'},
+            {"realign", no_argument, 0, 'R'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hx:p:i:P:cbsH:C:t:w:f:n:",
+        c = getopt_long (argc, argv, "hx:p:i:P:cbsH:C:t:w:f:n:kR",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -2794,6 +2804,14 @@ int main_surject(int argc, char** argv) {
             context_depth = atoi(optarg);
             break;
 
+        case 'k':
+            keep_order = true;
+            break;
+
+        case 'R':
+            realign = true;
+            break;
+
         case 'h':
         case '?':
             help_surject(argv);
@@ -2845,15 +2863,15 @@ int main_surject(int argc, char** argv) {
         Mapper* m = new Mapper;
         m->xindex = xgidx;
         m->context_depth = context_depth;
+        m->surject_by_projection = !realign;
         mapper[i] = m;
     }
 
     if (input_type == "gam") {
         if (output_type == "gam") {
-            int thread_count = get_thread_count();
-            vector<vector<Alignment> > buffer;
-            buffer.resize(thread_count);
-            function<void(Alignment&)> lambda = [&xgidx, &path_names, &buffer, &window, &mapper](Alignment& src) {
+            // the surjecting threads compress their own output
+            stream::ParallelWriter<Alignment> writer(cout, 100, keep_order);
+            function<void(Alignment&, uint64_t)> lambda = [&xgidx, &path_names, &writer, &window, &mapper](Alignment& src, uint64_t number) {
                 int tid = omp_get_thread_num();
                 Alignment surj;
                 // Since we're outputting full GAM, we ignore all this info
@@ -2862,19 +2880,18 @@ int main_surject(int argc, char** argv) {
                 string path_name;
                 int64_t path_pos;
                 bool path_reverse;
-                buffer[tid].push_back(mapper[tid]->surject_alignment(src, path_names,path_name, path_pos, path_reverse, window));
-                stream::write_buffered(cout, buffer[tid], 100);
+                vector<Alignment> surjected;
+                surjected.push_back(mapper[tid]->surject_alignment(src, path_names,path_name, path_pos, path_reverse, window));
+                writer.write(number, surjected);
             };
             if (file_name == "-") {
-                stream::for_each_parallel(std::cin, lambda);
+                stream::for_each_parallel_numbered(std::cin, lambda, keep_order);
             } else {
                 ifstream in;
                 in.open(file_name.c_str());
-                stream::for_each_parallel(in, lambda);
-            }
-            for (int i = 0; i < thread_count; ++i) {
-                stream::write_buffered(cout, buffer[i], 0); // flush
+                stream::for_each_parallel_numbered(in, lambda, keep_order);
             }
+            writer.flush();
         } else {
             char out_mode[5];
             string out_format = "";
@@ -3221,6 +3238,8 @@ void help_mod(char** argv) {
          << "    -B, --bluntify          bluntify the graph, making nodes for duplicated sequences in overlaps" << endl
          << "    -a, --cactus            convert to cactus graph representation" << endl
          << "    -v, --sample-vcf FILE   for a graph with allele paths, compute the sample graph from the given VCF" << endl 
+         << "    -I, --id-range N:M      only load the nodes with ids from N to M, the edges between them and the" << endl
+         << "                            path mappings on them, and modify that part of the graph" << endl
          << "    -t, --threads N         for tasks that can be done in parallel, use this many threads" << endl;
 }
 
@@ -3271,6 +3290,7 @@ int main_mod(int argc, char** argv) {
     bool flip_doubly_reversed_edges = false;
     bool cactus = false;
     string vcf_filename;
+    string id_range;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -3321,11 +3341,12 @@ int main_mod(int argc, char** argv) {
             {"unreverse-edges", required_argument, 0, 'E'},
             {"cactus", no_argument, 0, 'a'},
             {"sample-vcf", required_argument, 0, 'v'},
+            {"id-range", required_argument, 0, 'I'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hk:oi:q:Q:cpl:e:mt:SX:KPsunzNf:CDFr:g:x:RTU:Bbd:Ow:L:y:Z:Eav:",
+        c = getopt_long (argc, argv, "hk:oi:q:Q:cpl:e:mt:SX:KPsunzNf:CDFr:g:x:RTU:Bbd:Ow:L:y:Z:Eav:I:",
                 long_options, &option_index);
 
 
@@ -3501,6 +3522,10 @@ int main_mod(int argc, char** argv) {
             vcf_filename = optarg;
             break;
 
+        case 'I':
+            id_range = optarg;
+            break;
+
         case 'h':
         case '?':
             help_mod(argv);
@@ -3512,14 +3537,22 @@ int main_mod(int argc, char** argv) {
         }
     }
 
+    vg::id_t min_id = numeric_limits<vg::id_t>::min();
+    vg::id_t max_id = numeric_limits<vg::id_t>::max();
+    if (!id_range.empty()) {
+        vector<string> parts = split_delims(id_range, ":");
+        convert(parts.front(), min_id);
+        convert(parts.back(), max_id);
+    }
+
     VG* graph;
     string file_name = argv[optind];
     if (file_name == "-") {
-        graph = new VG(std::cin);
+        graph = new VG(std::cin, min_id, max_id);
     } else {
         ifstream in;
         in.open(file_name.c_str());
-        graph = new VG(in);
+        graph = new VG(in, min_id, max_id);
     }
 
     if (!vcf_filename.empty()) {
@@ -4704,8 +4737,71 @@ int main_stats(int argc, char** argv) {
         }
     }
 
-    VG* graph;
     string file_name = argv[optind];
+
+    if (!(stats_subgraphs || superbubbles || cactus || show_sibs || show_components
+          || distance_to_head || distance_to_tail || !alignments_filename.empty())) {
+        // everything asked for can be answered from the compact representation,
+        // which lets us load graphs far bigger than a VG would fit in memory
+        CompactGraph* graph;
+        if (file_name == "-") {
+            graph = new CompactGraph(std::cin);
+        } else {
+            ifstream in;
+            in.open(file_name.c_str());
+            graph = new CompactGraph(in);
+        }
+
+        if (stats_size) {
+            cout << "nodes" << "\t" << graph->node_count() << endl
+                << "edges" << "\t" << graph->edge_count() << endl;
+        }
+
+        if (node_count) {
+            cout << graph->node_count() << endl;
+        }
+
+        if (edge_count) {
+            cout << graph->edge_count() << endl;
+        }
+
+        if (stats_length) {
+            cout << "length" << "\t" << graph->total_length_of_nodes() << endl;
+        }
+
+        if (stats_heads) {
+            vector<vg::id_t> heads;
+            graph->head_nodes(heads);
+            cout << "heads" << "\t";
+            for (auto id : heads) {
+                cout << id << " ";
+            }
+            cout << endl;
+        }
+
+        if (stats_tails) {
+            vector<vg::id_t> tails;
+            graph->tail_nodes(tails);
+            cout << "tails" << "\t";
+            for (auto id : tails) {
+                cout << id << " ";
+            }
+            cout << endl;
+        }
+
+        if (is_acyclic) {
+            if (graph->is_acyclic()) {
+                cout << "acyclic" << endl;
+            } else {
+                cout << "cyclic" << endl;
+            }
+        }
+
+        delete graph;
+        return 0;
+    }
+
+    VG* graph;
     if (file_name == "-") {
         graph = new VG(std::cin);
     } else {
@@ -5381,6 +5477,8 @@ void help_find(char** argv) {
          << "    -P, --position-in PATH find the position of the node (specified by -n) in the given path" << endl
          << "    -r, --node-range N:M   get nodes from N to M" << endl
          << "    -G, --gam GAM          accumulate the graph touched by the alignments in the GAM" << endl
+         << "    -R, --gam-range N:M    with -G, only use alignments touching nodes N to M, reading just the" << endl
+         << "                           GAM blocks that hold them (requires GAM" << BlockIndex::EXTENSION << " from vg index -B)" << endl
          << "alignments: (rocksdb only)" << endl
          << "    -a, --alignments       writes alignments from index, sorted by node id" << endl
          << "    -i, --alns-in N:M      writes alignments whose start nodes is between N and M (inclusive)" << endl
@@ -5433,6 +5531,7 @@ int main_find(int argc, char** argv) {
     bool pairwise_distance = false;
     string haplotype_alignments;
     string gam_file;
+    string gam_id_range;
     int max_mem_length = 0;
 
     int c;
@@ -5466,11 +5565,12 @@ int main_find(int argc, char** argv) {
                 {"distance", no_argument, 0, 'D'},
                 {"haplotypes", required_argument, 0, 'H'},
                 {"gam", required_argument, 0, 'G'},
+                {"gam-range", required_argument, 0, 'R'},
                 {0, 0, 0, 0}
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "d:x:n:e:s:o:k:hc:LS:z:j:CTp:P:r:amg:M:i:DH:G:",
+        c = getopt_long (argc, argv, "d:x:n:e:s:o:k:hc:LS:z:j:CTp:P:r:amg:M:i:DH:G:R:",
                          long_options, &option_index);
 
         // Detect the end of the options.
@@ -5580,6 +5680,10 @@ int main_find(int argc, char** argv) {
             gam_file = optarg;
             break;
 
+        case 'R':
+            gam_id_range = optarg;
+            break;
+
         case 'h':
         case '?':
             help_find(argv);
@@ -5786,15 +5890,35 @@ int main_find(int argc, char** argv) {
         }
         if (!gam_file.empty()) {
             set<vg::id_t> nodes;
-            function<void(Alignment&)> lambda = [&nodes](Alignment& aln) {
+            vg::id_t range_start = 0;
+            vg::id_t range_end = 0;
+            if (!gam_id_range.empty()) {
+                vector<string> parts = split_delims(gam_id_range, ":");
+                convert(parts.front(), range_start);
+                convert(parts.back(), range_end);
+            }
+            function<void(Alignment&)> lambda = [&](Alignment& aln) {
                 // accumulate nodes matched by the path
                 auto& path = aln.path();
+                if (!gam_id_range.empty()) {
+                    bool in_range = false;
+                    for (int i = 0; i < path.mapping_size() && !in_range; ++i) {
+                        auto id = path.mapping(i).position().node_id();
+                        in_range = id >= range_start && id <= range_end;
+                    }
+                    if (!in_range) return;
+                }
+#pragma omp critical (nodes)
                 for (int i = 0; i < path.mapping_size(); ++i) {
                     nodes.insert(path.mapping(i).position().node_id());
                 }
             };
             if (gam_file == "-") {
-                stream::for_each(std::cin, lambda);
+                if (!gam_id_range.empty()) {
+                    cerr << "[vg find] error: -R needs a GAM file, not stdin" << endl;
+                    exit(1);
+                }
+                stream::for_each_parallel(std::cin, lambda);
             } else {
                 ifstream in;
                 in.open(gam_file.c_str());
@@ -5802,7 +5926,18 @@ int main_find(int argc, char** argv) {
                     cerr << "[vg find] error: could not open alignments file " << gam_file << endl;
                     exit(1);
                 }
-                stream::for_each(in, lambda);
+                if (!gam_id_range.empty()) {
+                    BlockIndex block_index;
+                    ifstream index_in(gam_file + BlockIndex::EXTENSION);
+                    if (!index_in || !block_index.load(index_in)) {
+                        cerr << "[vg find] error: could not load block index " << gam_file + BlockIndex::EXTENSION
+                             << ", make it with vg index -B" << endl;
+                        exit(1);
+                    }
+                    block_index.for_each_in_id_range_parallel(in, range_start, range_end, lambda);
+                } else {
+                    stream::for_each_parallel(in, lambda);
+                }
             }
             // now we have the nodes to get
             VG graph;
@@ -6029,6 +6164,9 @@ void help_index(char** argv) {
          << "    -t, --threads N        number of threads to use" << endl
          << "    -p, --progress         show progress" << endl
          << "    -V, --verify-index     validate the GCSA2 index using the input kmers (important for testing)" << endl
+         << "block index options:" << endl
+         << "    -B, --block-index      write an index of the compressed blocks of each input .vg or .gam" << endl
+         << "                           to <input>" << BlockIndex::EXTENSION << ", for seeking by record or node id range" << endl
          << "rocksdb options (ignored with -g):" << endl
          << "    -s, --store-graph      store graph as xg" << endl
          << "    -m, --store-mappings   input is .gam format, store the mappings in alignments by node" << endl
@@ -6083,6 +6221,7 @@ int main_index(int argc, char** argv) {
     bool forward_only = false;
     size_t size_limit = 200; // in gigabytes
     bool store_threads = false; // use gPBWT to store paths
+    bool block_index = false;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -6118,11 +6257,12 @@ int main_index(int argc, char** argv) {
             {"store-threads", no_argument, 0, 'T'},
             {"node-alignments", no_argument, 0, 'N'},
             {"dbg-in", required_argument, 0, 'i'},
+            {"block-index", no_argument, 0, 'B'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "d:k:j:pDshMt:b:e:SP:LmaCnAQg:X:x:v:VFZ:Oi:TN",
+        c = getopt_long (argc, argv, "d:k:j:pDshMt:b:e:SP:LmaCnAQg:X:x:v:VFZ:Oi:TNB",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -6247,6 +6387,10 @@ int main_index(int argc, char** argv) {
             store_node_alignments = true;
             break;
 
+        case 'B':
+            block_index = true;
+            break;
+
         case 'h':
         case '?':
             help_index(argv);
@@ -6288,6 +6432,29 @@ int main_index(int argc, char** argv) {
         return 1;
     }
 
+    if (block_index) {
+        // index the blocks of each stream; this is all we do
+        for (auto& file_name : file_names) {
+            ifstream in(file_name);
+            if (!in) {
+                cerr << "error:[vg index] could not open " << file_name << endl;
+                return 1;
+            }
+            if (show_progress) {
+                cerr << "Indexing blocks of " << file_name << endl;
+            }
+            BlockIndex index;
+            bool is_gam = file_name.size() > 4 && file_name.substr(file_name.size() - 4) == ".gam";
+            if (!(is_gam ? index.index_alignments(in) : index.index_graphs(in))) {
+                cerr << "error:[vg index] " << file_name << " was not written in blocks, rewrite it with this version of vg to index it" << endl;
+                return 1;
+            }
+            ofstream out(file_name + BlockIndex::EXTENSION);
+            index.save(out);
+        }
+        return 0;
+    }
+
     if (!xg_name.empty()) {
         // We need to build an xg index
 
@@ -7019,6 +7186,7 @@ void help_map(char** argv) {
          << "output:" << endl
          << "    -J, --output-json     output JSON rather than an alignment stream (helpful for debugging)" << endl
          << "    -Z, --buffer-size N   buffer this many alignments together before outputting in GAM (default: 100)" << endl
+         << "    -3, --keep-order      write GAM output in the order of the input reads (costs some buffering)" << endl
          << "    -w, --compare         if using GAM input (-G), write a comparison of before/after alignments to stdout" << endl
          << "    -D, --debug           print debugging information about alignment to stderr" << endl
          << "local alignment parameters:" << endl
@@ -7033,6 +7201,8 @@ void help_map(char** argv) {
          << "    -p, --pair-window N        maximum distance between properly paired reads in node ID space" << endl
          << "    -u, --pairing-multimaps N  examine N extra mappings looking for a consistent read pairing (default: 4)" << endl
          << "    -U, --always-rescue        rescue each imperfectly-mapped read in a pair off the other" << endl
+         << "    -9, --load-frag-model FILE seed the fragment length distribution with one saved by --save-frag-model" << endl
+         << "    -0, --save-frag-model FILE write the fragment length distribution learned from this run to FILE" << endl
          << "generic mapping parameters:" << endl
          << "    -B, --band-width N        for very long sequences, align in chunks then merge paths, no mapping quality (default 1000bp)" << endl
          << "    -P, --min-identity N      accept alignment only if the alignment identity to ref is >= N (default: 0)" << endl
@@ -7049,11 +7219,20 @@ void help_map(char** argv) {
          << "    -A, --max-attempts N      try to improve sensitivity and align this many times (default: 7)" << endl
          << "    -v  --map-qual-method OPT mapping quality method: 0 - none, 1 - fast approximation, 2 - exact (default 1)" << endl
          << "    -S, --sens-step N     decrease maximum MEM size or kmer size by N bp until alignment succeeds (default: 5)" << endl
+         << "        --dup-cache N     remember the alignments of up to N distinct reads (or pairs) and reuse them for" << endl
+         << "                          reads with the same sequences (default: 0/unset)" << endl
          << "maximal exact match (MEM) mapper:" << endl
          << "  This algorithm is used when --kmer-size is not specified and a GCSA index is given" << endl
          << "    -L, --min-mem-length N   ignore MEMs shorter than this length (default: 0/unset)" << endl
          << "    -Y, --max-mem-length N   ignore MEMs longer than this length by stopping backward search (default: 0/unset)" << endl
          << "    -a, --mem-threading      use the MEM-threading alingment algorithm" << endl
+         << "    -4, --mem-kmer-table N   precompute the GCSA ranges of all N-mers (N <= 14; 16*4^N bytes) to speed" << endl
+         << "                             up the start of each MEM search (default: 0/unset; 10-12 is reasonable)" << endl
+         << "    -5, --node-cache N       cache the sequences of up to N nodes from the xg index, shared across threads (default: 65536)" << endl
+         << "    -6, --no-ungapped        always align with DP, even when a MEM extends over the read without gaps" << endl
+         << "    -7, --reseed-length N    when a read has no unique MEM, look for seeds within MEMs at least this long (default: 28; unset: 0)" << endl
+         << "    -8, --mem-hit-budget N   locate at most N MEM hits for each read, sampling the hits of MEMs with more than" << endl
+         << "                             --hit-max when there is no unique MEM (default: 1000; unset: 0)" << endl
          << "kmer-based mapper:" << endl
          << "  This algorithm is used when --kmer-size is specified or a rocksdb index is given" << endl
          << "    -k, --kmer-size N     use this kmer size, it must be < kmer size in db (default: from index)" << endl
@@ -7125,6 +7304,17 @@ int main_map(int argc, char** argv) {
     bool compare_gam = false;
     int fragment_max = 1e5;
     double fragment_sigma = 10;
+    bool keep_order = false;
+    int mem_kmer_table_size = 0;
+    int node_cache_size = 65536;
+    bool ungapped_extension = true;
+    int mem_reseed_length = 28;
+    int mem_hit_budget = 1000;
+    string fragment_model_in;
+    string fragment_model_out;
+    int dup_cache_size = 0;
+    // options without a short form
+    const int OPT_DUP_CACHE = 1000;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -7187,11 +7377,20 @@ int main_map(int argc, char** argv) {
                 {"compare", no_argument, 0, 'w'},
                 {"fragment-max", required_argument, 0, 'W'},
                 {"fragment-sigma", required_argument, 0, '2'},
+                {"keep-order", no_argument, 0, '3'},
+                {"mem-kmer-table", required_argument, 0, '4'},
+                {"node-cache", required_argument, 0, '5'},
+                {"no-ungapped", no_argument, 0, '6'},
+                {"reseed-length", required_argument, 0, '7'},
+                {"mem-hit-budget", required_argument, 0, '8'},
+                {"load-frag-model", required_argument, 0, '9'},
+                {"save-frag-model", required_argument, 0, '0'},
+                {"dup-cache", required_argument, 0, OPT_DUP_CACHE},
                 {0, 0, 0, 0}
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "s:I:j:hd:x:g:c:r:m:k:M:t:DX:FS:Jb:KR:N:if:p:B:h:G:C:A:E:Q:n:P:Ul:e:T:VL:Y:H:OZ:q:z:o:y:1u:v:wW:a2:",
+        c = getopt_long (argc, argv, "s:I:j:hd:x:g:c:r:m:k:M:t:DX:FS:Jb:KR:N:if:p:B:h:G:C:A:E:Q:n:P:Ul:e:T:VL:Y:H:OZ:q:z:o:y:1u:v:wW:a2:34:5:67:8:9:0:",
                          long_options, &option_index);
 
 
@@ -7416,6 +7615,50 @@ int main_map(int argc, char** argv) {
             fragment_sigma = atof(optarg);
             break;
 
+        case '3':
+            keep_order = true;
+            break;
+
+        case '4':
+            mem_kmer_table_size = atoi(optarg);
+            if (mem_kmer_table_size < 0 || mem_kmer_table_size > 14) {
+                cerr << "error:[vg map] the MEM k-mer table size must be between 0 and 14" << endl;
+                return 1;
+            }
+            break;
+
+        case '5':
+            node_cache_size = atoi(optarg);
+            if (node_cache_size < 1) {
+                cerr << "error:[vg map] the node cache must hold at least one node" << endl;
+                return 1;
+            }
+            break;
+
+        case '6':
+            ungapped_extension = false;
+            break;
+
+        case '7':
+            mem_reseed_length = atoi(optarg);
+            break;
+
+        case '8':
+            mem_hit_budget = atoi(optarg);
+            break;
+
+        case '9':
+            fragment_model_in = optarg;
+            break;
+
+        case '0':
+            fragment_model_out = optarg;
+            break;
+
+        case OPT_DUP_CACHE:
+            dup_cache_size = atoi(optarg);
+            break;
+
         case 'h':
         case '?':
             /* getopt_long already printed an error message. */
@@ -7551,14 +7794,41 @@ int main_map(int argc, char** argv) {
 
     thread_count = get_thread_count();
 
+    // one table is shared by all the mappers
+    KmerRangeTable* kmer_ranges = nullptr;
+    if (gcsa && mem_kmer_table_size > 0) {
+        if(debug) {
+            cerr << "Building GCSA ranges of all " << mem_kmer_table_size << "-mers..." << endl;
+        }
+        kmer_ranges = new KmerRangeTable(gcsa, mem_kmer_table_size);
+    }
+
+    // and so is the cache of node sequences we walk MEMs along
+    NodeCache node_cache(node_cache_size);
+
+    // and, if we're asked to keep it, the alignments of reads we've seen
+    AlignmentCache* dup_cache = dup_cache_size > 0 ? new AlignmentCache(dup_cache_size) : nullptr;
+
+    // and the fragment length distribution, which we may already know
+    FragmentLengthModel fragment_model(fragment_max);
+    if (!fragment_model_in.empty()) {
+        ifstream model_in(fragment_model_in);
+        if (!model_in || !fragment_model.load(model_in)) {
+            cerr << "error:[vg map] could not read a fragment length model from " << fragment_model_in << endl;
+            return 1;
+        }
+    }
+
     vector<Mapper*> mapper;
     mapper.resize(thread_count);
-    vector<vector<Alignment> > output_buffer;
-    output_buffer.resize(thread_count);
-
-    // We have one function to dump alignments into
-    // Make sure to flush the buffer at the end of the program!
-    auto output_alignments = [&output_buffer, &output_json, &buffer_size](vector<Alignment>& alignments) {
+    // GAM output is compressed by the mapping threads and, if asked, put back
+    // into input order
+    stream::ParallelWriter<Alignment> writer(cout, buffer_size, keep_order);
+
+    // We have one function to dump alignments into, along with the number of
+    // the read (or pair) in the input that they came from
+    // Make sure to flush the writer at the end of the program!
+    auto output_alignments = [&writer, &output_json](vector<Alignment>& alignments, uint64_t input_number) {
         // for(auto& alignment : alignments){
         //     cerr << "This is in output_alignments" << alignment.DebugString() << endl;
         // }
@@ -7571,14 +7841,47 @@ int main_map(int argc, char** argv) {
                 cout << json << "\n";
             }
         } else {
-            // Otherwise write them through the buffer for our thread
-            int tid = omp_get_thread_num();
-            auto& output_buf = output_buffer[tid];
-
-            // Copy all the alignments over to the output buffer
-            copy(alignments.begin(), alignments.end(), back_inserter(output_buf));
+            writer.write(input_number, alignments);
+        }
+    };
 
-            stream::write_buffered(cout, output_buf, buffer_size);
+    // pairs that are queued for later resolution keep their input numbers here
+    vector<vector<uint64_t> > retry_numbers(thread_count);
+
+    // align the pairs a mapper queued until it knew the fragment size, if it
+    // now does, which it may from the pairs of the other threads. when keeping
+    // the input order, every later read waits in the writer for the queued
+    // ones, so we don't let more than a batch of them wait: then, as at the end
+    // of the input, we take the fragment size to be its maximum to align them.
+    const size_t max_queued_pairs = 2048;
+    auto retry_queued_pairs = [&](int tid, bool at_end,
+                                  const function<void(Alignment&, Alignment&, pair<vector<Alignment>, vector<Alignment>>&, uint64_t)>& output_func) {
+        auto our_mapper = mapper[tid];
+        if (our_mapper->imperfect_pairs_to_retry.empty()) return;
+        if (our_mapper->fragment_size == 0) {
+            our_mapper->update_fragment_length_estimate();
+        }
+        bool estimated = our_mapper->fragment_size != 0;
+        if (!estimated) {
+            if (!at_end && !(keep_order && our_mapper->imperfect_pairs_to_retry.size() >= max_queued_pairs)) return;
+            our_mapper->fragment_size = fragment_max;
+        }
+        int i = 0;
+        for (auto p : our_mapper->imperfect_pairs_to_retry) {
+            bool queued_resolve_later = false;
+            auto alnp = our_mapper->align_paired_multi(p.first, p.second,
+                                                       queued_resolve_later, kmer_size,
+                                                       kmer_stride, max_mem_length,
+                                                       band_width, pair_window);
+            output_func(p.first, p.second, alnp, retry_numbers[tid][i++]);
+        }
+        our_mapper->imperfect_pairs_to_retry.clear();
+        retry_numbers[tid].clear();
+        if (!estimated && !at_end) {
+            // keep queueing imperfect pairs until we have an estimate, which
+            // the pairs we just aligned may have given us
+            our_mapper->fragment_size = 0;
+            our_mapper->update_fragment_length_estimate();
         }
     };
     
@@ -7617,6 +7920,13 @@ int main_map(int argc, char** argv) {
         m->always_rescue = always_rescue;
         m->fragment_max = fragment_max;
         m->fragment_sigma = fragment_sigma;
+        m->set_fragment_length_model(&fragment_model);
+        m->alignment_cache = dup_cache;
+        m->kmer_ranges = kmer_ranges;
+        m->set_node_cache(&node_cache);
+        m->ungapped_extension = ungapped_extension;
+        m->mem_reseed_length = mem_reseed_length;
+        m->mem_hit_budget = mem_hit_budget;
         mapper[i] = m;
     }
 
@@ -7644,21 +7954,26 @@ int main_map(int argc, char** argv) {
         }
         
         // Output the alignments in JSON or protobuf as appropriate.
-        output_alignments(alignments);
+        output_alignments(alignments, 0);
     }
 
     if (!read_file.empty()) {
         ifstream in(read_file);
         bool more_data = in.good();
-#pragma omp parallel shared(in)
+        uint64_t lines_read = 0;
+#pragma omp parallel shared(in, lines_read)
         {
             string line;
             int tid = omp_get_thread_num();
             while (in.good()) {
                 line.clear();
+                uint64_t number;
 #pragma omp critical (readq)
                 {
                     std::getline(in,line);
+                    if (!line.empty()) {
+                        number = lines_read++;
+                    }
                 }
                 if (!line.empty()) {
                     // Make an alignment
@@ -7678,14 +7993,14 @@ int main_map(int argc, char** argv) {
 
 
                     // Output the alignments in JSON or protobuf as appropriate.
-                    output_alignments(alignments);
+                    output_alignments(alignments, number);
                 }
             }
         }
     }
 
     if (!hts_file.empty()) {
-        function<void(Alignment&)> lambda =
+        function<void(Alignment&, uint64_t)> lambda =
             [&mapper,
              &output_alignments,
              &keep_secondary,
@@ -7693,10 +8008,13 @@ int main_map(int argc, char** argv) {
              &kmer_stride,
              &max_mem_length,
              &band_width]
-                (Alignment& alignment) {
+                (Alignment& alignment, uint64_t number) {
 
                     if(alignment.is_secondary() && !keep_secondary) {
                         // Skip over secondary alignments in the input; we don't want several output mappings for each input *mapping*.
+                        // We still report nothing for it, so ordered output doesn't wait on it.
+                        vector<Alignment> none;
+                        output_alignments(none, number);
                         return;
                     }
 
@@ -7707,7 +8025,7 @@ int main_map(int argc, char** argv) {
                     }
 
                     // Output the alignments in JSON or protobuf as appropriate.
-                    output_alignments(alignments);
+                    output_alignments(alignments, number);
                 };
         // run
         hts_for_each_parallel(hts_file, lambda);
@@ -7716,16 +8034,19 @@ int main_map(int argc, char** argv) {
     if (!fastq1.empty()) {
         if (interleaved_input) {
             // paired interleaved
-            auto output_func = [&output_alignments,
-                                &compare_gam]
+            function<void(Alignment&, Alignment&, pair<vector<Alignment>, vector<Alignment>>&, uint64_t)> output_func =
+                [&output_alignments,
+                 &compare_gam]
                 (Alignment& aln1,
                  Alignment& aln2,
-                 pair<vector<Alignment>, vector<Alignment>>& alnp) {
+                 pair<vector<Alignment>, vector<Alignment>>& alnp,
+                 uint64_t number) {
                 // Output the alignments in JSON or protobuf as appropriate.
-                output_alignments(alnp.first);
-                output_alignments(alnp.second);
+                // Both mates go out together, under the number of the pair.
+                move(alnp.second.begin(), alnp.second.end(), back_inserter(alnp.first));
+                output_alignments(alnp.first, number);
             };
-            function<void(Alignment&,Alignment&)> lambda =
+            function<void(Alignment&,Alignment&,uint64_t)> lambda =
                 [&mapper,
                  &output_alignments,
                  &keep_secondary,
@@ -7734,53 +8055,36 @@ int main_map(int argc, char** argv) {
                  &max_mem_length,
                  &band_width,
                  &pair_window,
-                 &output_func](Alignment& aln1, Alignment& aln2) {
-                auto our_mapper = mapper[omp_get_thread_num()];
+                 &retry_numbers,
+                 &retry_queued_pairs,
+                 &output_func](Alignment& aln1, Alignment& aln2, uint64_t number) {
+                int tid = omp_get_thread_num();
+                auto our_mapper = mapper[tid];
                 bool queued_resolve_later = false;
                 auto alnp = our_mapper->align_paired_multi(aln1, aln2, queued_resolve_later, kmer_size, kmer_stride, max_mem_length, band_width, pair_window);
-                if (!queued_resolve_later) {
-                    output_func(aln1, aln2, alnp);
-                    // check if we should try to align the queued alignments
-                    if (our_mapper->fragment_size != 0
-                        && !our_mapper->imperfect_pairs_to_retry.empty()) {
-                        int i = 0;
-                        for (auto p : our_mapper->imperfect_pairs_to_retry) {
-                            auto alnp = our_mapper->align_paired_multi(p.first, p.second,
-                                                                       queued_resolve_later, kmer_size,
-                                                                       kmer_stride, max_mem_length,
-                                                                       band_width, pair_window);
-                            output_func(p.first, p.second, alnp);
-                        }
-                        our_mapper->imperfect_pairs_to_retry.clear();
-                    }
+                if (queued_resolve_later) {
+                    retry_numbers[tid].push_back(number);
+                } else {
+                    output_func(aln1, aln2, alnp, number);
                 }
+                // check if we should try to align the queued alignments
+                retry_queued_pairs(tid, false, output_func);
             };
             fastq_paired_interleaved_for_each_parallel(fastq1, lambda);
 #pragma omp parallel
             { // clean up buffered alignments that weren't perfect
-                auto our_mapper = mapper[omp_get_thread_num()];
-                // if we haven't yet computed these, assume we couldn't get an estimate for fragment size
-                our_mapper->fragment_size = fragment_max;
-                for (auto p : our_mapper->imperfect_pairs_to_retry) {
-                    bool queued_resolve_later = false;
-                    auto alnp = our_mapper->align_paired_multi(p.first, p.second,
-                                                               queued_resolve_later, kmer_size,
-                                                               kmer_stride, max_mem_length,
-                                                               band_width, pair_window);
-                    output_func(p.first, p.second, alnp);
-                }
-                our_mapper->imperfect_pairs_to_retry.clear();
+                retry_queued_pairs(omp_get_thread_num(), true, output_func);
             }
         } else if (fastq2.empty()) {
             // single
-            function<void(Alignment&)> lambda =
+            function<void(Alignment&, uint64_t)> lambda =
                 [&mapper,
                  &output_alignments,
                  &kmer_size,
                  &kmer_stride,
                  &max_mem_length,
                  &band_width]
-                    (Alignment& alignment) {
+                    (Alignment& alignment, uint64_t number) {
 
                         int tid = omp_get_thread_num();
                         vector<Alignment> alignments = mapper[tid]->align_multi(alignment, kmer_size, kmer_stride, max_mem_length, band_width);
@@ -7791,21 +8095,24 @@ int main_map(int argc, char** argv) {
                         }
 
                         //cerr << "This is just before output_alignments" << alignment.DebugString() << endl;
-                        output_alignments(alignments);
+                        output_alignments(alignments, number);
                     };
             fastq_unpaired_for_each_parallel(fastq1, lambda);
         } else {
             // paired two-file
-            auto output_func = [&output_alignments]
+            function<void(Alignment&, Alignment&, pair<vector<Alignment>, vector<Alignment>>&, uint64_t)> output_func =
+                [&output_alignments]
                 (Alignment& aln1,
                  Alignment& aln2,
-                 pair<vector<Alignment>, vector<Alignment>>& alnp) {
+                 pair<vector<Alignment>, vector<Alignment>>& alnp,
+                 uint64_t number) {
                 // Make sure we have unaligned "alignments" for things that don't align.
                 // Output the alignments in JSON or protobuf as appropriate.
-                output_alignments(alnp.first);
-                output_alignments(alnp.second);
+                // Both mates go out together, under the number of the pair.
+                move(alnp.second.begin(), alnp.second.end(), back_inserter(alnp.first));
+                output_alignments(alnp.first, number);
             };
-            function<void(Alignment&,Alignment&)> lambda =
+            function<void(Alignment&,Alignment&,uint64_t)> lambda =
                 [&mapper,
                  &output_alignments,
                  &keep_secondary,
@@ -7814,41 +8121,25 @@ int main_map(int argc, char** argv) {
                  &max_mem_length,
                  &band_width,
                  &pair_window,
-                 &output_func](Alignment& aln1, Alignment& aln2) {
-                auto our_mapper = mapper[omp_get_thread_num()];
+                 &retry_numbers,
+                 &retry_queued_pairs,
+                 &output_func](Alignment& aln1, Alignment& aln2, uint64_t number) {
+                int tid = omp_get_thread_num();
+                auto our_mapper = mapper[tid];
                 bool queued_resolve_later = false;
                 auto alnp = our_mapper->align_paired_multi(aln1, aln2, queued_resolve_later, kmer_size, kmer_stride, max_mem_length, band_width, pair_window);
-                if (!queued_resolve_later) {
-                    output_func(aln1, aln2, alnp);
-                    // check if we should try to align the queued alignments
-                    if (our_mapper->fragment_size != 0
-                        && !our_mapper->imperfect_pairs_to_retry.empty()) {
-                        int i = 0;
-                        for (auto p : our_mapper->imperfect_pairs_to_retry) {
-                            auto alnp = our_mapper->align_paired_multi(p.first, p.second,
-                                                                       queued_resolve_later, kmer_size,
-                                                                       kmer_stride, max_mem_length,
-                                                                       band_width, pair_window);
-                            output_func(p.first, p.second, alnp);
-                        }
-                        our_mapper->imperfect_pairs_to_retry.clear();
-                    }
+                if (queued_resolve_later) {
+                    retry_numbers[tid].push_back(number);
+                } else {
+                    output_func(aln1, aln2, alnp, number);
                 }
+                // check if we should try to align the queued alignments
+                retry_queued_pairs(tid, false, output_func);
             };
             fastq_paired_two_files_for_each_parallel(fastq1, fastq2, lambda);
 #pragma omp parallel
-            {
-                auto our_mapper = mapper[omp_get_thread_num()];
-                our_mapper->fragment_size = fragment_max;
-                for (auto p : our_mapper->imperfect_pairs_to_retry) {
-                    bool queued_resolve_later = false;
-                    auto alnp = our_mapper->align_paired_multi(p.first, p.second,
-                                                               queued_resolve_later, kmer_size,
-                                                               kmer_stride, max_mem_length,
-                                                               band_width, pair_window);
-                    output_func(p.first, p.second, alnp);
-                }
-                our_mapper->imperfect_pairs_to_retry.clear();
+            { // clean up buffered alignments that weren't perfect
+                retry_queued_pairs(omp_get_thread_num(), true, output_func);
             }
         }
     }
@@ -7856,11 +8147,13 @@ int main_map(int argc, char** argv) {
     if (!gam_input.empty()) {
         ifstream gam_in(gam_input);
         if (interleaved_input) {
-            auto output_func = [&output_alignments,
-                                &compare_gam]
+            function<void(Alignment&, Alignment&, pair<vector<Alignment>, vector<Alignment>>&, uint64_t)> output_func =
+                [&output_alignments,
+                 &compare_gam]
                 (Alignment& aln1,
                  Alignment& aln2,
-                 pair<vector<Alignment>, vector<Alignment>>& alnp) {
+                 pair<vector<Alignment>, vector<Alignment>>& alnp,
+                 uint64_t number) {
                 if (compare_gam) {
 #pragma omp critical (cout)
                     {
@@ -7869,11 +8162,12 @@ int main_map(int argc, char** argv) {
                     }
                 } else {
                     // Output the alignments in JSON or protobuf as appropriate.
-                    output_alignments(alnp.first);
-                    output_alignments(alnp.second);
+                    // Both mates go out together, under the number of the pair.
+                    move(alnp.second.begin(), alnp.second.end(), back_inserter(alnp.first));
+                    output_alignments(alnp.first, number);
                 }
             };
-            function<void(Alignment&,Alignment&)> lambda =
+            function<void(Alignment&,Alignment&,uint64_t)> lambda =
                 [&mapper,
                  &output_alignments,
                  &keep_secondary,
@@ -7883,44 +8177,28 @@ int main_map(int argc, char** argv) {
                  &band_width,
                  &compare_gam,
                  &pair_window,
-                 &output_func](Alignment& aln1, Alignment& aln2) {
-                auto our_mapper = mapper[omp_get_thread_num()];
+                 &retry_numbers,
+                 &retry_queued_pairs,
+                 &output_func](Alignment& aln1, Alignment& aln2, uint64_t number) {
+                int tid = omp_get_thread_num();
+                auto our_mapper = mapper[tid];
                 bool queued_resolve_later = false;
                 auto alnp = our_mapper->align_paired_multi(aln1, aln2, queued_resolve_later, kmer_size, kmer_stride, max_mem_length, band_width, pair_window);
-                if (!queued_resolve_later) {
-                    output_func(aln1, aln2, alnp);
-                    // check if we should try to align the queued alignments
-                    if (our_mapper->fragment_size != 0
-                        && !our_mapper->imperfect_pairs_to_retry.empty()) {
-                        int i = 0;
-                        for (auto p : our_mapper->imperfect_pairs_to_retry) {
-                            auto alnp = our_mapper->align_paired_multi(p.first, p.second,
-                                                                       queued_resolve_later, kmer_size,
-                                                                       kmer_stride, max_mem_length,
-                                                                       band_width, pair_window);
-                            output_func(p.first, p.second, alnp);
-                        }
-                        our_mapper->imperfect_pairs_to_retry.clear();
-                    }
+                if (queued_resolve_later) {
+                    retry_numbers[tid].push_back(number);
+                } else {
+                    output_func(aln1, aln2, alnp, number);
                 }
+                // check if we should try to align the queued alignments
+                retry_queued_pairs(tid, false, output_func);
             };
             gam_paired_interleaved_for_each_parallel(gam_in, lambda);
 #pragma omp parallel
-            {
-                auto our_mapper = mapper[omp_get_thread_num()];
-                our_mapper->fragment_size = fragment_max;
-                for (auto p : our_mapper->imperfect_pairs_to_retry) {
-                    bool queued_resolve_later = false;
-                    auto alnp = our_mapper->align_paired_multi(p.first, p.second,
-                                                               queued_resolve_later, kmer_size,
-                                                               kmer_stride, max_mem_length,
-                                                               band_width, pair_window);
-                    output_func(p.first, p.second, alnp);
-                }
-                our_mapper->imperfect_pairs_to_retry.clear();
+            { // clean up buffered alignments that weren't perfect
+                retry_queued_pairs(omp_get_thread_num(), true, output_func);
             }
         } else {
-            function<void(Alignment&)> lambda =
+            function<void(Alignment&, uint64_t)> lambda =
                 [&mapper,
                  &output_alignments,
                  &keep_secondary,
@@ -7929,7 +8207,7 @@ int main_map(int argc, char** argv) {
                  &max_mem_length,
                  &band_width,
                  &compare_gam]
-                (Alignment& alignment) {
+                (Alignment& alignment, uint64_t number) {
                 int tid = omp_get_thread_num();
                 vector<Alignment> alignments = mapper[tid]->align_multi(alignment, kmer_size, kmer_stride, max_mem_length, band_width);
                 if(alignments.empty()) {
@@ -7940,20 +8218,56 @@ int main_map(int argc, char** argv) {
                     cout << alignment.name() << "\t" << overlap(alignment.path(), alignments.front().path()) << endl;
                 } else {
                     // Output the alignments in JSON or protobuf as appropriate.
-                    output_alignments(alignments);
+                    output_alignments(alignments, number);
                 }
             };
-            stream::for_each_parallel(gam_in, lambda);
+            stream::for_each_parallel_numbered(gam_in, lambda, keep_order);
         }
         gam_in.close();
     }
 
+    if (debug && xindex) {
+        size_t budget_spent = 0;
+        size_t budget_overruns = 0;
+        size_t subgraph_hits = 0;
+        size_t subgraph_misses = 0;
+        for (int i = 0; i < thread_count; ++i) {
+            budget_spent += mapper[i]->mem_budget_spent;
+            budget_overruns += mapper[i]->mem_budget_overruns;
+            subgraph_hits += mapper[i]->subgraph_cache_hits;
+            subgraph_misses += mapper[i]->subgraph_cache_misses;
+        }
+        cerr << "MEM hits located: " << budget_spent << ", "
+             << budget_overruns << " reads over budget" << endl;
+        cerr << "subgraphs reused from the cache: " << subgraph_hits << " of "
+             << subgraph_hits + subgraph_misses << endl;
+    }
+
     // clean up
     for (int i = 0; i < thread_count; ++i) {
         delete mapper[i];
-        auto& output_buf = output_buffer[i];
-        if (!output_json) {
-            stream::write_buffered(cout, output_buf, 0);
+    }
+    writer.flush();
+
+    if (debug && xindex) {
+        cerr << "Node cache: " << node_cache.hits() << " hits, "
+             << node_cache.misses() << " misses" << endl;
+    }
+
+    if (dup_cache) {
+        if (debug) {
+            cerr << "Duplicate read cache: " << dup_cache->hits() << " hits, "
+                 << dup_cache->misses() << " misses" << endl;
+        }
+        delete dup_cache;
+    }
+
+    if (!fragment_model_out.empty()) {
+        ofstream model_out(fragment_model_out);
+        fragment_model.save(model_out);
+        if (!model_out) {
+            cerr << "error:[vg map] could not write the fragment length model to " << fragment_model_out << endl;
+            return 1;
         }
     }
 
@@ -7961,6 +8275,10 @@ int main_map(int argc, char** argv) {
         delete idx;
         idx = nullptr;
     }
+    if(kmer_ranges) {
+        delete kmer_ranges;
+        kmer_ranges = nullptr;
+    }
     if(gcsa) {
         delete gcsa;
         gcsa = nullptr;
@@ -7984,6 +8302,8 @@ void help_view(char** argv) {
 
          << "    -v, --vg             output VG format" << endl
          << "    -V, --vg-in          input VG format (default)" << endl
+         << "    -R, --id-range N:M   with VG input, only load the nodes with ids from N to M, the" << endl
+         << "                         edges between them and the path mappings on them" << endl
 
          << "    -j, --json           output JSON format" << endl
          << "    -J, --json-in        input JSON format" << endl
@@ -8071,6 +8391,7 @@ int main_view(int argc, char** argv) {
     bool superbubble_labeling = false;
     bool cactusbubble_labeling = false;
     bool skip_missing_nodes = false;
+    string id_range;
 
     int c;
     optind = 2; // force optind past "view" argument
@@ -8113,11 +8434,12 @@ int main_view(int argc, char** argv) {
                 {"locus-in", no_argument, 0, 'q'},
                 {"loci", no_argument, 0, 'Q'},
                 {"locus-out", no_argument, 0, 'z'},
+                {"id-range", required_argument, 0, 'R'},
                 {0, 0, 0, 0}
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "dgFjJhvVpaGbifA:s:wnlLIMcTtr:SCZBYmqQ:z",
+        c = getopt_long (argc, argv, "dgFjJhvVpaGbifA:s:wnlLIMcTtr:SCZBYmqQ:zR:",
                          long_options, &option_index);
 
         /* Detect the end of the options. */
@@ -8287,6 +8609,10 @@ int main_view(int argc, char** argv) {
             loci_file = optarg;
             break;
 
+        case 'R':
+            id_range = optarg;
+            break;
+
         case 'h':
         case '?':
             /* getopt_long already printed an error message. */
@@ -8342,12 +8668,19 @@ int main_view(int argc, char** argv) {
             }
             return 0;
         } else {
+            vg::id_t min_id = numeric_limits<vg::id_t>::min();
+            vg::id_t max_id = numeric_limits<vg::id_t>::max();
+            if (!id_range.empty()) {
+                vector<string> parts = split_delims(id_range, ":");
+                convert(parts.front(), min_id);
+                convert(parts.back(), max_id);
+            }
             if (file_name == "-") {
-                graph = new VG(std::cin);
+                graph = new VG(std::cin, min_id, max_id);
             } else {
                 ifstream in;
                 in.open(file_name.c_str());
-                graph = new VG(in);
+                graph = new VG(in, min_id, max_id);
             }
         }
         // VG can convert to any of the graph formats, so keep going
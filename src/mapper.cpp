@@ -3,6 +3,19 @@
 
 namespace vg {
 
+// the runs of consecutive ids in a set, for pulling out with get_id_range
+static vector<pair<id_t, id_t> > id_ranges_of(const set<id_t>& ids) {
+    vector<pair<id_t, id_t> > ranges;
+    for (auto& id : ids) {
+        if (!ranges.empty() && ranges.back().second + 1 == id) {
+            ranges.back().second = id;
+        } else {
+            ranges.push_back(make_pair(id, id));
+        }
+    }
+    return ranges;
+}
+
 Mapper::Mapper(Index* idex,
                xg::XG* xidex,
                gcsa::GCSA* g,
@@ -11,6 +24,14 @@ Mapper::Mapper(Index* idex,
     , xindex(xidex)
     , gcsa(g)
     , lcp(a)
+    , kmer_ranges(nullptr)
+    , node_cache(nullptr)
+    , node_cache_owned(false)
+    , subgraph_cache_hits(0)
+    , subgraph_cache_misses(0)
+    , fragment_length_model(nullptr)
+    , fragment_length_model_owned(false)
+    , alignment_cache(nullptr)
     , best_clusters(0)
     , cluster_min(1)
     , hit_max(0)
@@ -33,8 +54,14 @@ Mapper::Mapper(Index* idex,
     , alignment_threads(1)
     , min_mem_length(0)
     , mem_threading(false)
+    , ungapped_extension(true)
+    , mem_reseed_length(0)
+    , mem_hit_budget(0)
+    , mem_budget_spent(0)
+    , mem_budget_overruns(0)
     , max_target_factor(128)
     , max_query_graph_ratio(128)
+    , surject_by_projection(true)
     , extra_pairing_multimaps(4)
     , always_rescue(false)
     , fragment_size(0)
@@ -42,14 +69,15 @@ Mapper::Mapper(Index* idex,
     , fragment_sigma(10)
     , mapping_quality_method(Approx)
     , adjust_alignments_for_base_quality(false)
-    , fragment_length_cache_size(1000)
     , cached_fragment_length_mean(0)
     , cached_fragment_length_stdev(0)
-    , since_last_fragment_length_estimate(0)
+    , fragment_length_count_at_estimate(0)
     , fragment_length_estimate_interval(100)
 {
     init_aligner(default_match, default_mismatch, default_gap_open, default_gap_extension);
-    init_node_cache();
+    init_match_count_cache();
+    init_subgraph_cache();
+    init_fragment_length_model();
 }
 
 Mapper::Mapper(Index* idex, gcsa::GCSA* g, gcsa::LCPArray* a) : Mapper(idex, nullptr, g, a)
@@ -94,8 +122,17 @@ Mapper::~Mapper(void) {
     for (auto& aligner : regular_aligners) {
         delete aligner;
     }
-    for (auto& nc : node_cache) {
-        delete nc;
+    if (node_cache_owned) {
+        delete node_cache;
+    }
+    if (fragment_length_model_owned) {
+        delete fragment_length_model;
+    }
+    for (auto& mc : match_count_cache) {
+        delete mc;
+    }
+    for (auto& sc : subgraph_cache) {
+        delete sc;
     }
 }
     
@@ -119,13 +156,68 @@ double Mapper::estimate_gc_content() {
     return ((double) gc) / (at + gc);
 }
 
-void Mapper::init_node_cache(void) {
-    for (auto& nc : node_cache) {
-        delete nc;
+void Mapper::init_node_cache(size_t capacity) {
+    if (node_cache_owned) {
+        delete node_cache;
+    }
+    node_cache = new NodeCache(capacity);
+    node_cache_owned = true;
+}
+
+void Mapper::set_node_cache(NodeCache* shared) {
+    if (node_cache_owned) {
+        delete node_cache;
+    }
+    node_cache = shared;
+    node_cache_owned = false;
+}
+
+NodeCache* Mapper::get_node_cache(void) {
+    if (!node_cache) {
+#pragma omp critical (node_cache)
+        if (!node_cache) {
+            init_node_cache();
+        }
+    }
+    return node_cache;
+}
+
+void Mapper::init_fragment_length_model(void) {
+    if (fragment_length_model_owned) {
+        delete fragment_length_model;
+    }
+    fragment_length_model = new FragmentLengthModel(fragment_max);
+    fragment_length_model_owned = true;
+    fragment_length_count_at_estimate = 0;
+}
+
+void Mapper::set_fragment_length_model(FragmentLengthModel* shared) {
+    if (fragment_length_model_owned) {
+        delete fragment_length_model;
+    }
+    fragment_length_model = shared;
+    fragment_length_model_owned = false;
+    // a model seeded from an earlier run can be used right away
+    update_fragment_length_estimate();
+}
+
+void Mapper::init_match_count_cache(void) {
+    for (auto& mc : match_count_cache) {
+        delete mc;
     }
-    node_cache.clear();
+    match_count_cache.clear();
     for (int i = 0; i < alignment_threads; ++i) {
-        node_cache.push_back(new LRUCache<id_t, Node>(100));
+        match_count_cache.push_back(new LRUCache<gcsa::range_type, size_t>(1000));
+    }
+}
+
+void Mapper::init_subgraph_cache(void) {
+    for (auto& sc : subgraph_cache) {
+        delete sc;
+    }
+    subgraph_cache.clear();
+    for (int i = 0; i < alignment_threads; ++i) {
+        subgraph_cache.push_back(new LRUCache<string, Graph>(16));
     }
 }
 
@@ -198,6 +290,9 @@ Alignment Mapper::align(const string& seq, int kmer_size, int stride, int max_me
 // align read2 near read1's mapping location
 void Mapper::align_mate_in_window(const Alignment& read1, Alignment& read2, int pair_window) {
     if (read1.score() == 0) return; // bail out if we haven't aligned the first
+    // once we know the fragment length distribution, only look where it says
+    // the mate should be
+    if (align_mate_in_path_window(read1, read2)) return;
     // try to recover in region
     auto& path = read1.path();
     int64_t idf = path.mapping(0).position().node_id();
@@ -235,11 +330,9 @@ void Mapper::align_mate_in_window(const Alignment& read1, Alignment& read2, int
     // edges. How we do this depends on what indexing structures we have.
     if(xindex) {
         // should have callback here
-        xindex->get_id_range(first, idf, graph->graph);
-        xindex->get_id_range(idl, last, graph->graph);
-        
         // don't get the paths (this isn't yet threadsafe in sdsl-lite)
-        xindex->expand_context(graph->graph, context_depth, false);
+        cached_subgraph({ make_pair(first, idf), make_pair(idl, last) },
+                        context_depth, false, true, graph->graph);
         graph->rebuild_indexes();
     } else if(index) {
         index->get_range(first, idf, *graph);
@@ -264,6 +357,87 @@ void Mapper::align_mate_in_window(const Alignment& read1, Alignment& read2, int
     delete graph;
 }
 
+bool Mapper::align_mate_in_path_window(const Alignment& read1, Alignment& read2) {
+    if (!xindex || !xindex->max_path_rank() || cached_fragment_length_mean <= 0) return false;
+    auto& anchor_pos = read1.path().mapping(0).position();
+    auto path_positions = xindex->node_positions_in_paths(anchor_pos.node_id());
+    if (path_positions.empty()) return false;
+
+    // the mate's center is within a few standard deviations of the mean
+    // fragment length of the read, on either side
+    int64_t radius = cached_fragment_length_mean + 3 * cached_fragment_length_stdev
+        + read2.sequence().size();
+
+    // find where the mate best fits along the paths in the window with the
+    // striped aligner, only asking for the ends of the hit
+    auto aligner = get_regular_aligner();
+    StripedSmithWaterman::Aligner ssw(aligner->match, aligner->mismatch,
+                                      aligner->gap_open, aligner->gap_extension);
+    StripedSmithWaterman::Filter filter(true, false, 0, 32767);
+    int32_t best_score = 0;
+    set<id_t> best_ids;
+    for (auto& ref : path_positions) {
+        auto& path_name = ref.first;
+        int64_t path_length = xindex->path_length(path_name);
+        for (auto node_path_pos : ref.second) {
+            int64_t anchor = node_path_pos + anchor_pos.offset();
+            int64_t window_end = min(path_length, anchor + radius);
+            // lay the path out over the window, starting at the beginning of
+            // the node the window starts in
+            int64_t pos = max((int64_t) 0, anchor - radius);
+            id_t first_id = xindex->mapping_at_path_position(path_name, pos).position().node_id();
+            for (int64_t p : xindex->node_positions_in_path(first_id, path_name)) {
+                if (p <= pos && pos < p + get_node_length(first_id)) {
+                    pos = p;
+                    break;
+                }
+            }
+            string sequence;
+            // where each node starts in the sequence
+            vector<pair<int64_t, id_t> > node_starts;
+            while (pos < window_end) {
+                auto mapping = xindex->mapping_at_path_position(path_name, pos);
+                id_t id = mapping.position().node_id();
+                string node_sequence = xindex->node_sequence(id);
+                if (node_sequence.empty()) break;
+                node_starts.push_back(make_pair((int64_t) sequence.size(), id));
+                sequence += mapping.position().is_reverse() ? reverse_complement(node_sequence) : node_sequence;
+                pos += node_sequence.size();
+            }
+            if (sequence.empty()) continue;
+
+            StripedSmithWaterman::Alignment hit;
+            ssw.Align(read2.sequence().c_str(), sequence.c_str(), sequence.size(), filter, &hit);
+            if (hit.sw_score <= best_score) continue;
+            best_score = hit.sw_score;
+            best_ids.clear();
+            for (size_t i = 0; i < node_starts.size(); ++i) {
+                int64_t node_end = i + 1 < node_starts.size() ? node_starts[i+1].first : sequence.size();
+                if (node_starts[i].first <= hit.ref_end && node_end > hit.ref_begin) {
+                    best_ids.insert(node_starts[i].second);
+                }
+            }
+        }
+    }
+
+    read2.clear_path();
+    read2.set_score(0);
+    if (best_ids.empty()) return true;
+
+    if(debug) {
+        cerr << "Rescuing on paths around " << *best_ids.begin() << "-" << *best_ids.rbegin() << endl;
+    }
+
+    // and align to the graph right around there, so we pick up variation
+    // off the paths
+    VG graph;
+    cached_subgraph(id_ranges_of(best_ids), context_depth, false, true, graph.graph);
+    graph.rebuild_indexes();
+    graph.remove_orphan_edges();
+    read2 = align_to_graph(read2, graph, max_query_graph_ratio);
+    return true;
+}
+
 map<string, double> Mapper::alignment_mean_path_positions(const Alignment& aln) {
     map<string, double> mean_pos;
     // Alignments are consistent if their median node id positions are within the fragment_size
@@ -327,6 +501,21 @@ bool Mapper::alignments_consistent(const map<string, double>& pos1,
     return false;
 }            
 
+string Mapper::alignment_cache_key(const Alignment& aln, int kmer_size, int stride,
+                                   int max_mem_length, int band_width) {
+    string key = aln.sequence();
+    key.push_back('\t');
+    // the qualities only change the alignment if we use them to score it
+    if (adjust_alignments_for_base_quality) {
+        key += aln.quality();
+        key.push_back('\t');
+    }
+    for (int param : { kmer_size, stride, max_mem_length, band_width }) {
+        key.append((const char*) &param, sizeof(param));
+    }
+    return key;
+}
+
 pair<vector<Alignment>, vector<Alignment>> Mapper::align_paired_multi(
     const Alignment& read1,
     const Alignment& read2,
@@ -337,6 +526,62 @@ pair<vector<Alignment>, vector<Alignment>> Mapper::align_paired_multi(
     int band_width,
     int pair_window) {
 
+    // until we know the fragment size, how a pair maps depends on what we've
+    // seen before it, so only remember pairs after that
+    if (!alignment_cache || !fragment_size) {
+        return align_paired_multi_uncached(read1, read2, queued_resolve_later, kmer_size, stride,
+                                           max_mem_length, band_width, pair_window);
+    }
+
+    string key = alignment_cache_key(read1, kmer_size, stride, max_mem_length, band_width);
+    key.push_back('\n');
+    key += alignment_cache_key(read2, kmer_size, stride, max_mem_length, band_width);
+    key.append((const char*) &pair_window, sizeof(pair_window));
+
+    pair<vector<Alignment>, vector<Alignment>> results;
+    if (alignment_cache->retrieve(key, results.first, results.second)) {
+        for (auto& aln : results.first) {
+            AlignmentCache::copy_read_fields(read1, aln);
+            if (aln.has_fragment_next()) aln.mutable_fragment_next()->set_name(read2.name());
+        }
+        for (auto& aln : results.second) {
+            AlignmentCache::copy_read_fields(read2, aln);
+            if (aln.has_fragment_prev()) aln.mutable_fragment_prev()->set_name(read1.name());
+        }
+        // a duplicate pair counts towards the fragment length distribution
+        // just as it would have if we had aligned it again
+        if (results.first.size() == 1
+            && results.second.size() == 1
+            && results.first.front().identity() == 1
+            && results.second.front().identity() == 1) {
+            for (auto& fragment : results.first.front().fragment()) {
+                if (fragment.length() < fragment_max) {
+                    record_fragment_length(fragment.length());
+                }
+            }
+        }
+        queued_resolve_later = false;
+        return results;
+    }
+
+    results = align_paired_multi_uncached(read1, read2, queued_resolve_later, kmer_size, stride,
+                                          max_mem_length, band_width, pair_window);
+    if (!queued_resolve_later) {
+        alignment_cache->put(key, results.first, results.second);
+    }
+    return results;
+}
+
+pair<vector<Alignment>, vector<Alignment>> Mapper::align_paired_multi_uncached(
+    const Alignment& read1,
+    const Alignment& read2,
+    bool& queued_resolve_later,
+    int kmer_size,
+    int stride,
+    int max_mem_length,
+    int band_width,
+    int pair_window) {
+
     // what we *really* should be doing is using paired MEM seeding, so we
     // don't have to make loads of full alignments of each read to search for
     // good pairs.
@@ -372,9 +617,9 @@ pair<vector<Alignment>, vector<Alignment>> Mapper::align_paired_multi(
     
     // find the MEMs for the alignments
     vector<MaximalExactMatch> mems1 = find_smems(read1.sequence(), max_mem_length);
-    for (auto& mem : mems1) { get_mem_hits_if_under_max(mem); }
+    get_mem_hits_within_budget(mems1);
     vector<MaximalExactMatch> mems2 = find_smems(read2.sequence(), max_mem_length);
-    for (auto& mem : mems2) { get_mem_hits_if_under_max(mem); }
+    get_mem_hits_within_budget(mems2);
     //cerr << "mems before " << mems1.size() << " " << mems2.size() << endl;
     // Do the initial alignments, making sure to get some extras if we're going to check consistency.
 
@@ -396,14 +641,25 @@ pair<vector<Alignment>, vector<Alignment>> Mapper::align_paired_multi(
     // find the MEMs for the alignments
     if (fragment_size) {
         vector<MaximalExactMatch> mems1 = find_smems(read1.sequence(), max_mem_length);
-        for (auto& mem : mems1) { get_mem_hits_if_under_max(mem); }
+        get_mem_hits_within_budget(mems1);
         vector<MaximalExactMatch> mems2 = find_smems(read2.sequence(), max_mem_length);
-        for (auto& mem : mems2) { get_mem_hits_if_under_max(mem); }
+        get_mem_hits_within_budget(mems2);
         
-        // use pair resolution filterings on the SMEMs to constrain the candidates
-        set<MaximalExactMatch*> pairable_mems = resolve_paired_mems(mems1, mems2);
-        for (auto& mem : mems1) if (pairable_mems.count(&mem)) pairable_mems1.push_back(mem);
-        for (auto& mem : mems2) if (pairable_mems.count(&mem)) pairable_mems2.push_back(mem);
+        auto located = [](const vector<MaximalExactMatch>& mems) {
+            for (auto& mem : mems) if (!mem.nodes.empty()) return true;
+            return false;
+        };
+        if (located(mems1) && located(mems2)) {
+            // use pair resolution filterings on the SMEMs to constrain the candidates
+            set<MaximalExactMatch*> pairable_mems = resolve_paired_mems(mems1, mems2);
+            for (auto& mem : mems1) if (pairable_mems.count(&mem)) pairable_mems1.push_back(mem);
+            for (auto& mem : mems2) if (pairable_mems.count(&mem)) pairable_mems2.push_back(mem);
+        } else {
+            // a read with no hits can't pair with anything, so keep all the
+            // hits of its mate, which we can then rescue it off of
+            pairable_mems1 = mems1;
+            pairable_mems2 = mems2;
+        }
         pairable_mems_ptr_1 = &pairable_mems1;
         pairable_mems_ptr_2 = &pairable_mems2;
     } else {
@@ -847,101 +1103,70 @@ Mapper::mems_pos_clusters_to_alignments(const Alignment& aln, vector<MaximalExac
 
     int total_multimaps = max_multimaps + additional_multimaps;
     
-    // sort by position, make the SMEM node list only contain the matched position
-    map<pair<string, bool>, map<int, vector<pair<MaximalExactMatch*, gcsa::node_type> > > > by_start_pos;
+    // make a hit for each place each MEM lands on each path strand, which
+    // we chain with the others on the same path strand
+    map<pair<string, bool>, int64_t> path_groups;
+    vector<ChainHit> hits;
+    vector<pair<MaximalExactMatch*, gcsa::node_type> > hit_mems;
 
     // run through the mems
     // collecting their positions relative to the forward path
     for (auto& mem : mems) {
-        size_t len = mem.begin - mem.end;
         for (auto& node : mem.nodes) {
             id_t id = gcsa::Node::id(node);
             size_t offset = gcsa::Node::offset(node);
             bool is_rev = gcsa::Node::rc(node);
             for (auto& ref : xindex->node_positions_in_paths(id, is_rev)) {
                 auto& name = ref.first;
+                auto chrom = make_pair(name, is_rev);
+                if (!path_groups.count(chrom)) {
+                    int64_t group = path_groups.size();
+                    path_groups[chrom] = group;
+                }
                 for (auto pos : ref.second) {
-                    auto chrom = make_pair(name, is_rev);
-                    by_start_pos[chrom][pos+offset].push_back(make_pair(&mem, node));
+                    ChainHit hit;
+                    hit.read_begin = mem.begin - aln.sequence().begin();
+                    hit.read_end = mem.end - aln.sequence().begin();
+                    hit.ref_begin = pos + offset;
+                    hit.ref_group = path_groups[chrom];
+                    hits.push_back(hit);
+                    hit_mems.push_back(make_pair(&mem, node));
                 }
             }
         }
     }
 
+    // chain over at most 3x the length of the read, best chains first
+    auto chains = colinear_chains(hits, aln.sequence().size() * 3);
+
     if (debug) {
-        cerr << "SMEMs by start pos: " << endl;
-        for (auto& seq : by_start_pos) {
-            stringstream seqn;
-            seqn << seq.first.first << ":";
-            if (seq.first.second) seqn << "-"; else seqn << "+";
-            for (auto& pos : seq.second) {
-                cerr << seqn.str() << ":" << pos.first << " ";
-                for (auto& mem : pos.second) {
-                    cerr << mem.first->sequence() << " ";                    
-                }
-                cerr << endl;
+        cerr << "SMEM chains: " << endl;
+        for (auto& chain : chains) {
+            cerr << chain.score << ": ";
+            for (auto& h : chain.hits) {
+                cerr << hits[h].ref_group << ":" << hits[h].ref_begin << " "
+                     << hit_mems[h].first->sequence() << " ";
             }
+            cerr << endl;
         }
     }
 
     // we cluster up the SMEMs here, then convert the clusters to partial alignments
     vector<vector<MaximalExactMatch> > clusters;
-    for (auto& b : by_start_pos) {
-        auto& seq_map = b.second;
-        for (auto& p : seq_map) {
-            auto& pos = p.first;
-            clusters.emplace_back();
-            auto& cluster = clusters.back();
-            set<MaximalExactMatch*> in_cluster;
-            auto x = seq_map.find(pos);
-            // extend until we hit the end of the chrom or exceed 3x the length of the alignment
-            while (x != seq_map.end() && x->first - pos < aln.sequence().size()*3) {
-                // greedy heuristic: use the longest SMEM at the position
-                // TODO don't just pick the biggest; for each of the MEMs, start a chain
-                MaximalExactMatch* mem = nullptr;
-                gcsa::node_type node;
-                for (auto& m : x->second) {
-                    auto& nmem = m.first;
-                    if (mem == nullptr
-                        || nmem->length() > mem->length()) {
-                        mem = nmem;
-                        node = m.second;
-                    }
-                }
-                assert(mem != nullptr);
-                //cerr << x->first << " " << mem->sequence() << " @ " << mem->begin - aln.sequence().begin() << endl;
-                if (!cluster.empty() && cluster.back().end > mem->begin
-                    || in_cluster.count(mem)) {
-                    ++x; // step to the next position
-                } else {
-                    auto new_mem = *mem;
-                    new_mem.nodes.clear();
-                    new_mem.nodes.push_back(node);
-                    cluster.push_back(new_mem);
-                    in_cluster.insert(mem);
-                    // get the thing at least one past the end of this MEM
-                    x = seq_map.upper_bound(x->first+mem->length());
-                }
-            }
+    for (auto& chain : chains) {
+        clusters.emplace_back();
+        auto& cluster = clusters.back();
+        for (auto& h : chain.hits) {
+            auto& mem = hit_mems[h].first;
+            // the exact match alignment can't have MEMs overlapping in the read
+            if (!cluster.empty() && cluster.back().end > mem->begin) continue;
+            auto new_mem = *mem;
+            new_mem.nodes.clear();
+            new_mem.nodes.push_back(hit_mems[h].second);
+            cluster.push_back(new_mem);
         }
     }
 
-    auto mem_len_sum = [&](const vector<MaximalExactMatch>& cluster) {
-        int i = 0;
-        for (auto& mem : cluster) {
-            i += mem.length();
-        }
-        return i;
-    };
-
-    // sort the threads by their coverage of the read
-    // descending sort, so that the best clusters are at the front
-    std::sort(clusters.begin(), clusters.end(),
-              [&](const vector<MaximalExactMatch>& c1,
-                  const vector<MaximalExactMatch>& c2) {
-                  return mem_len_sum(c1) > mem_len_sum(c2);
-              });
-
     // remove duplicates by building up a reverse map from MEM to cluster
     // and adding new clusters by following the reverse map and checking for
     // containment within the found clusters
@@ -1062,10 +1287,8 @@ VG Mapper::alignment_subgraph(const Alignment& aln, int context_size) {
         nodes.insert(path.mapping(i).position().node_id());
     }
     VG graph;
-    for (auto& node : nodes) {
-        *graph.graph.add_node() = xindex->node(node);
-    }
-    xindex->expand_context(graph.graph, max(1, context_size)); // get connected edges
+    // get connected edges
+    cached_subgraph(id_ranges_of(nodes), max(1, context_size), true, true, graph.graph);
     graph.rebuild_indexes();
     return graph;
 }
@@ -1085,27 +1308,30 @@ map<string, int> Mapper::approx_pair_fragment_length(const Alignment& aln1, cons
 }
 
 void Mapper::record_fragment_length(int length) {
-    fragment_lengths.push_front(length);
-    if (fragment_lengths.size() > fragment_length_cache_size) {
-        auto last = fragment_lengths.back();
-        fragment_lengths.pop_back();
-    }
-    if (++since_last_fragment_length_estimate > fragment_length_estimate_interval) {
-        cached_fragment_length_mean = fragment_length_mean();
-        cached_fragment_length_stdev = fragment_length_stdev();
-        // set our fragment size cap to the cached mean + 10x the standard deviation
-        fragment_size = cached_fragment_length_mean + fragment_sigma * cached_fragment_length_stdev;
-        since_last_fragment_length_estimate = 1;
+    fragment_length_model->record(length);
+    // go by the model's count rather than our own, so a shared model's
+    // estimate reaches every mapper as soon as enough pairs are in
+    if (fragment_length_model->count() >= fragment_length_count_at_estimate + fragment_length_estimate_interval) {
+        update_fragment_length_estimate();
     }
 }
 
+void Mapper::update_fragment_length_estimate(void) {
+    uint64_t count = fragment_length_model->count();
+    if (count < fragment_length_estimate_interval) return;
+    fragment_length_count_at_estimate = count;
+    cached_fragment_length_mean = fragment_length_mean();
+    cached_fragment_length_stdev = fragment_length_stdev();
+    // set our fragment size cap to the cached mean + 10x the standard deviation
+    fragment_size = cached_fragment_length_mean + fragment_sigma * cached_fragment_length_stdev;
+}
+
 double Mapper::fragment_length_stdev(void) {
-    return stdev(fragment_lengths);
+    return fragment_length_model->stdev();
 }
 
 double Mapper::fragment_length_mean(void) {
-    double sum = std::accumulate(fragment_lengths.begin(), fragment_lengths.end(), 0.0);
-    return sum / fragment_lengths.size();
+    return fragment_length_model->mean();
 }
 
 set<MaximalExactMatch*> Mapper::resolve_paired_mems(vector<MaximalExactMatch>& mems1,
@@ -1214,8 +1440,9 @@ set<MaximalExactMatch*> Mapper::resolve_paired_mems(vector<MaximalExactMatch>& m
 // alignments somehow?
 int64_t Mapper::get_node_length(int64_t node_id) {
     if(xindex) {
-        // Grab the node sequence only from the XG index and get its size.
-        return xindex->node_sequence(node_id).size();
+        // Grab the node sequence only from the XG index (or our cache of it)
+        // and get its size.
+        return get_node_cache()->node_length(node_id, xindex);
     } else if(index) {
         // Get a 1-element range from the index and then use that.
         VG one_node_graph;
@@ -1590,9 +1817,52 @@ Aligner* Mapper::get_regular_aligner(void) {
     return regular_aligners[tid];
 }
 
-LRUCache<id_t, Node>& Mapper::get_node_cache(void) {
-    int tid = node_cache.size() > 1 ? omp_get_thread_num() : 0;
-    return *node_cache[tid];
+LRUCache<gcsa::range_type, size_t>& Mapper::get_match_count_cache(void) {
+    int tid = match_count_cache.size() > 1 ? omp_get_thread_num() : 0;
+    return *match_count_cache[tid];
+}
+
+LRUCache<string, Graph>& Mapper::get_subgraph_cache(void) {
+    int tid = subgraph_cache.size() > 1 ? omp_get_thread_num() : 0;
+    return *subgraph_cache[tid];
+}
+
+size_t Mapper::cached_match_count(const gcsa::range_type& range) {
+    auto& cache = get_match_count_cache();
+    pair<size_t, bool> cached = cache.retrieve(range);
+    if (!cached.second) {
+        cached.first = gcsa->count(range);
+        cache.put(range, cached.first);
+    }
+    return cached.first;
+}
+
+void Mapper::cached_subgraph(const vector<pair<id_t, id_t> >& id_ranges,
+                             int context, bool use_steps, bool add_paths,
+                             Graph& graph) {
+    string key;
+    key.reserve(sizeof(id_t) * 2 * id_ranges.size() + sizeof(int) + 2);
+    for (auto& range : id_ranges) {
+        key.append((const char*) &range.first, sizeof(id_t));
+        key.append((const char*) &range.second, sizeof(id_t));
+    }
+    key.append((const char*) &context, sizeof(int));
+    key.push_back(use_steps);
+    key.push_back(add_paths);
+
+    auto& cache = get_subgraph_cache();
+    pair<Graph, bool> cached = cache.retrieve(key);
+    if (cached.second) {
+        ++subgraph_cache_hits;
+        graph.Swap(&cached.first);
+        return;
+    }
+    ++subgraph_cache_misses;
+    for (auto& range : id_ranges) {
+        xindex->get_id_range(range.first, range.second, graph);
+    }
+    xindex->expand_context(graph, context, use_steps, add_paths);
+    cache.put(key, graph);
 }
 
 void Mapper::compute_mapping_qualities(vector<Alignment>& alns) {
@@ -1684,7 +1954,21 @@ void Mapper::filter_and_process_multimaps(vector<Alignment>& sorted_unique_align
 }
     
 vector<Alignment> Mapper::align_multi(const Alignment& aln, int kmer_size, int stride, int max_mem_length, int band_width) {
-    return align_multi_internal(true, aln, kmer_size, stride, max_mem_length, band_width, 0, nullptr);
+    if (!alignment_cache) {
+        return align_multi_internal(true, aln, kmer_size, stride, max_mem_length, band_width, 0, nullptr);
+    }
+    string key = alignment_cache_key(aln, kmer_size, stride, max_mem_length, band_width);
+    vector<Alignment> alignments;
+    vector<Alignment> no_mate;
+    if (alignment_cache->retrieve(key, alignments, no_mate)) {
+        for (auto& alignment : alignments) {
+            AlignmentCache::copy_read_fields(aln, alignment);
+        }
+        return alignments;
+    }
+    alignments = align_multi_internal(true, aln, kmer_size, stride, max_mem_length, band_width, 0, nullptr);
+    alignment_cache->put(key, alignments, no_mate);
+    return alignments;
 }
     
 vector<Alignment> Mapper::align_multi_internal(bool compute_unpaired_quality, const Alignment& aln,
@@ -1728,7 +2012,7 @@ vector<Alignment> Mapper::align_multi_internal(bool compute_unpaired_quality, co
             
             // query mem hits
             if (debug) cerr << "mems before filtering " << mems_to_json(mems) << endl;
-            for (auto& mem : mems) { get_mem_hits_if_under_max(mem); }
+            get_mem_hits_within_budget(mems);
             if (debug) cerr << "mems after filtering " << mems_to_json(mems) << endl;
 
             alignments = align_mem_multi(aln, mems, additional_multimaps_for_quality);
@@ -1807,15 +2091,28 @@ vector<Alignment> Mapper::align_multi_kmers(const Alignment& aln, int kmer_size,
     int kmer_count_f = 0;
     int kmer_count_r = 0;
 
+    // With GCSA and xg we can get the kmer hits for both strands from a single
+    // round of lookups, as GCSA reports the reverse strand hits of each kmer.
+    bool both_strands = gcsa && xindex;
+    vector<map<int64_t, vector<int32_t> > > positions_f;
+    vector<map<int64_t, vector<int32_t> > > positions_r;
+
     while (!(best_f.identity() > min_identity
              || best_r.identity() > min_identity)
            && attempt < max_attempts) {
 
+        if (both_strands) {
+            find_kmer_positions(balanced_kmers(sequence, kmer_size, stride),
+                                positions_f, kmer_count_f,
+                                &positions_r, &kmer_count_r);
+        }
+
         {
             std::chrono::time_point<std::chrono::system_clock> start, end;
             if (debug) start = std::chrono::system_clock::now();
             // Go get all the forward alignments, putting the best one in best_f.
-            alignments_f = align_threaded(best_f, kmer_count_f, kmer_size, stride, attempt);
+            alignments_f = align_threaded(best_f, kmer_count_f, kmer_size, stride, attempt,
+                                          both_strands ? &positions_f : nullptr);
             if (debug) {
                 end = std::chrono::system_clock::now();
                 std::chrono::duration<double> elapsed_seconds = end-start;
@@ -1828,7 +2125,8 @@ vector<Alignment> Mapper::align_multi_kmers(const Alignment& aln, int kmer_size,
             // If we need to look on the reverse strand, do that too.
             std::chrono::time_point<std::chrono::system_clock> start, end;
             if (debug) start = std::chrono::system_clock::now();
-            auto alns =  align_threaded(best_r, kmer_count_r, kmer_size, stride, attempt);
+            auto alns =  align_threaded(best_r, kmer_count_r, kmer_size, stride, attempt,
+                                        both_strands ? &positions_r : nullptr);
             alignments_r = reverse_complement_alignments(alns,
                                                          (function<int64_t(int64_t)>) ([&](int64_t id) { return get_node_length(id); }));
             if (debug) {
@@ -1949,7 +2247,29 @@ Mapper::find_smems(const string& seq, int max_mem_length) {
     MaximalExactMatch match(cursor, cursor, full_range);
     gcsa::range_type last_range = match.range;
     --cursor; // start off looking at the last character in the query
+    // we can only jump ahead with the table when k steps can't run past the
+    // length limits
+    int table_k = kmer_ranges ? kmer_ranges->kmer_size() : 0;
+    bool use_table = table_k > 0
+        && (!max_mem_length || table_k <= max_mem_length)
+        && table_k <= gcsa->order();
     while (cursor >= string_begin) {
+        if (use_table
+            && match.range == full_range
+            && match.end == cursor + 1
+            && cursor - string_begin + 1 >= table_k) {
+            // we are starting a new MEM from scratch; if the k-mer ending here
+            // occurs at all, none of the next k steps can fail, so take them
+            // all at once
+            gcsa::range_type kmer_range;
+            if (kmer_ranges->lookup(cursor + 1 - table_k, kmer_range)
+                && !gcsa::Range::empty(kmer_range)) {
+                match.range = kmer_range;
+                match.begin = cursor + 1 - table_k;
+                cursor -= table_k;
+                continue;
+            }
+        }
         // hold onto our previous range
         last_range = match.range;
         // execute one step of LF mapping
@@ -2111,11 +2431,11 @@ const string mems_to_json(const vector<MaximalExactMatch>& mems) {
 }
 
 char Mapper::pos_char(pos_t pos) {
-    return xg_cached_pos_char(pos, xindex, get_node_cache());
+    return get_node_cache()->pos_char(pos, xindex);
 }
 
 map<pos_t, char> Mapper::next_pos_chars(pos_t pos) {
-    return xg_cached_next_pos_chars(pos, xindex, get_node_cache());
+    return get_node_cache()->next_pos_chars(pos, xindex);
 }
 
 Alignment Mapper::walk_match(const string& seq, pos_t pos) {
@@ -2243,6 +2563,136 @@ vector<Alignment> Mapper::mem_to_alignments(MaximalExactMatch& mem) {
     return alns;
 }
 
+bool Mapper::extend_ungapped(const string& seq, const map<pos_t, char>& starts,
+                             int32_t match, int32_t mismatch, int32_t xdrop,
+                             int32_t& score, vector<pair<pos_t, char> >& extension) {
+    // depth first through the branches, keeping the best scoring prefix we've
+    // seen on any of them and dropping branches that fall too far behind it
+    score = 0;
+    extension.clear();
+    vector<pair<pos_t, char> > path;
+    size_t steps = 0;
+    size_t max_steps = 16 * seq.size();
+    function<bool(const pos_t&, char, size_t, int32_t)> extend =
+        [&](const pos_t& pos, char base, size_t i, int32_t running) {
+        if (++steps > max_steps) {
+            return false;
+        }
+        running += (base == seq[i] ? match : -mismatch);
+        path.push_back(make_pair(pos, base));
+        if (running > score) {
+            score = running;
+            extension = path;
+        }
+        if (i + 1 < seq.size() && running > score - xdrop) {
+            for (auto& next : next_pos_chars(pos)) {
+                if (!extend(next.first, next.second, i + 1, running)) {
+                    return false;
+                }
+            }
+        }
+        path.pop_back();
+        return true;
+    };
+    for (auto& start : starts) {
+        if (!extend(start.first, start.second, 0, 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Mapper::ungapped_alignment(const Alignment& read, const MaximalExactMatch& mem,
+                                gcsa::node_type node, Alignment& aln) {
+    const string& seq = read.sequence();
+    // we'd score N and quality the same way the aligners do
+    if (!allATGC(seq) || (adjust_alignments_for_base_quality && !read.quality().empty())) {
+        return false;
+    }
+    auto aligner = get_regular_aligner();
+    int32_t match = aligner->match;
+    int32_t mismatch = aligner->mismatch;
+    int32_t xdrop = aligner->gap_open;
+
+    size_t begin = mem.begin - seq.begin();
+    pos_t start = make_pos_t(gcsa::Node::id(node), gcsa::Node::rc(node), gcsa::Node::offset(node));
+
+    // forward from the start of the MEM
+    int32_t right_score;
+    vector<pair<pos_t, char> > right;
+    map<pos_t, char> right_starts;
+    right_starts[start] = pos_char(start);
+    if (!extend_ungapped(seq.substr(begin), right_starts, match, mismatch, xdrop, right_score, right)
+        || right.size() < seq.size() - begin) {
+        return false;
+    }
+
+    // and backward from it, by going forward on the other strand
+    int32_t left_score = 0;
+    vector<pair<pos_t, char> > left;
+    if (begin > 0) {
+        size_t length = get_node_length(id(start));
+        pos_t flipped = make_pos_t(id(start), !is_rev(start), length - offset(start) - 1);
+        if (!extend_ungapped(reverse_complement(seq.substr(0, begin)), next_pos_chars(flipped),
+                             match, mismatch, xdrop, left_score, left)
+            || left.size() < begin) {
+            return false;
+        }
+    }
+
+    int32_t score = left_score + right_score;
+    if ((int32_t) seq.size() * match - score >= aligner->gap_open) {
+        return false;
+    }
+
+    // lay out the graph bases under the read, in read order
+    vector<pair<pos_t, char> > bases;
+    for (auto b = left.rbegin(); b != left.rend(); ++b) {
+        size_t length = get_node_length(id(b->first));
+        bases.push_back(make_pair(make_pos_t(id(b->first), !is_rev(b->first), length - offset(b->first) - 1),
+                                  reverse_complement(b->second)));
+    }
+    bases.insert(bases.end(), right.begin(), right.end());
+
+    aln = read;
+    aln.clear_path();
+    Path* path = aln.mutable_path();
+    Mapping* mapping = nullptr;
+    for (size_t i = 0; i < bases.size(); ++i) {
+        const pos_t& pos = bases[i].first;
+        if (mapping == nullptr
+            || id(pos) != id(bases[i-1].first)
+            || is_rev(pos) != is_rev(bases[i-1].first)
+            || offset(pos) != offset(bases[i-1].first) + 1) {
+            mapping = path->add_mapping();
+            *mapping->mutable_position() = make_position(pos);
+            mapping->set_rank(path->mapping_size());
+        }
+        if (bases[i].second == seq[i]) {
+            // extend the last match, or start a new one
+            int last = mapping->edit_size() - 1;
+            if (last >= 0 && mapping->edit(last).sequence().empty()) {
+                Edit* edit = mapping->mutable_edit(last);
+                edit->set_from_length(edit->from_length() + 1);
+                edit->set_to_length(edit->to_length() + 1);
+            } else {
+                Edit* edit = mapping->add_edit();
+                edit->set_from_length(1);
+                edit->set_to_length(1);
+            }
+        } else {
+            Edit* edit = mapping->add_edit();
+            edit->set_from_length(1);
+            edit->set_to_length(1);
+            edit->set_sequence(seq.substr(i, 1));
+        }
+    }
+    aln.set_score(score);
+    aln.set_query_position(0);
+    aln.set_identity(identity(aln.path()));
+    return true;
+}
+
 Alignment Mapper::patch_alignment(const Alignment& aln) {
     if (debug) {
         cerr << "patching " << pb2json(aln) << endl;
@@ -2749,7 +3199,7 @@ bool Mapper::get_mem_hits_if_under_max(MaximalExactMatch& mem) {
     if (mem.end-mem.begin == 0
         || mem.end-mem.begin < min_mem_length) return false;
     // use the counting interface to determine the number of hits
-    mem.fill_match_count(gcsa);
+    mem.match_count = cached_match_count(mem.range);
     // if we aren't filtering on hit count, or if we have up to the max allowed hits
     if (mem.match_count > 0 && (!hit_max || mem.match_count <= hit_max)) {
         // extract the graph positions matching the range
@@ -2759,6 +3209,130 @@ bool Mapper::get_mem_hits_if_under_max(MaximalExactMatch& mem) {
     return filled;
 }
 
+void Mapper::get_mem_hits_within_budget(vector<MaximalExactMatch>& mems) {
+    size_t budget = mem_hit_budget > 0 ? mem_hit_budget : numeric_limits<size_t>::max();
+    size_t spent = 0;
+    // did we leave any hits unlocated for want of budget?
+    bool over_budget = false;
+    auto usable = [&](const MaximalExactMatch& mem) {
+        return mem.end-mem.begin > 0 && mem.end-mem.begin >= min_mem_length;
+    };
+    // locate the hits of the MEMs with the fewest hits first, so that a
+    // repetitive MEM can't use up the budget of the informative ones
+    vector<MaximalExactMatch*> by_count;
+    for (auto& mem : mems) {
+        if (!usable(mem)) continue;
+        mem.match_count = cached_match_count(mem.range);
+        if (mem.match_count > 0) by_count.push_back(&mem);
+    }
+    std::stable_sort(by_count.begin(), by_count.end(),
+                     [](const MaximalExactMatch* a, const MaximalExactMatch* b) {
+                         return a->match_count < b->match_count;
+                     });
+    bool have_unique = false;
+    for (auto mem : by_count) {
+        if (hit_max && mem->match_count > hit_max) break;
+        if (spent + mem->match_count > budget) {
+            over_budget = true;
+            break;
+        }
+        mem->fill_nodes(gcsa);
+        spent += mem->nodes.size();
+        if (mem->match_count == 1) have_unique = true;
+    }
+
+    // a unique seed will anchor the read; otherwise, spend what's left on
+    // the MEMs we passed over and on shorter seeds
+    if (!have_unique) {
+        // take an even sample of the hits of each MEM we skipped, at most
+        // as many as we would have taken of an ordinary one
+        for (auto mem : by_count) {
+            if (!mem->nodes.empty()) continue;
+            size_t wanted = hit_max ? min((size_t) hit_max, mem->match_count) : mem->match_count;
+            size_t samples = min(wanted, budget - spent);
+            if (samples < wanted) over_budget = true;
+            if (samples == 0) break;
+            subsample_mem_hits(*mem, samples);
+            spent += mem->nodes.size();
+        }
+        // look for seeds inside long MEMs that occur more often than the
+        // MEMs themselves, as BWA-MEM does; the true hit of a read with a
+        // repeat may be hidden by a MEM that runs through a difference
+        if (mem_reseed_length > 0) {
+            vector<MaximalExactMatch> reseeds;
+            for (auto mem : by_count) {
+                if (mem->nodes.empty() || mem->match_count == 1
+                    || mem->end - mem->begin < mem_reseed_length) continue;
+                reseed_mem(*mem, reseeds);
+            }
+            for (auto& reseed : reseeds) {
+                if (spent >= budget) {
+                    over_budget = true;
+                    break;
+                }
+                reseed.match_count = cached_match_count(reseed.range);
+                if (reseed.match_count == 0
+                    || hit_max && reseed.match_count > hit_max) continue;
+                if (spent + reseed.match_count > budget) {
+                    over_budget = true;
+                    continue;
+                }
+                reseed.fill_nodes(gcsa);
+                spent += reseed.nodes.size();
+                mems.push_back(reseed);
+            }
+            // keep the matches in natural order
+            std::stable_sort(mems.begin(), mems.end(),
+                             [](const MaximalExactMatch& a, const MaximalExactMatch& b) {
+                                 return a.begin < b.begin || a.begin == b.begin && a.end < b.end;
+                             });
+        }
+    }
+
+    mem_budget_spent += spent;
+    if (over_budget) ++mem_budget_overruns;
+}
+
+void Mapper::subsample_mem_hits(MaximalExactMatch& mem, size_t samples) {
+    // locate single suffixes spread evenly over the range
+    size_t range_length = gcsa::Range::length(mem.range);
+    samples = min(samples, range_length);
+    std::vector<gcsa::node_type> located;
+    mem.nodes.clear();
+    for (size_t i = 0; i < samples; ++i) {
+        size_t suffix = mem.range.first + i * range_length / samples;
+        gcsa->locate(gcsa::range_type(suffix, suffix), located);
+        mem.nodes.insert(mem.nodes.end(), located.begin(), located.end());
+    }
+    std::sort(mem.nodes.begin(), mem.nodes.end());
+    mem.nodes.erase(std::unique(mem.nodes.begin(), mem.nodes.end()), mem.nodes.end());
+}
+
+void Mapper::reseed_mem(const MaximalExactMatch& mem, vector<MaximalExactMatch>& reseeds) {
+    auto full_range = gcsa::range_type(0, gcsa->size() - 1);
+    size_t mem_range_length = gcsa::Range::length(mem.range);
+    // the longest matches within the MEM ending at its middle and at its end
+    // that still have more hits than it does
+    string::const_iterator middle = mem.begin + (mem.end - mem.begin) / 2 + 1;
+    for (auto end : { middle, mem.end }) {
+        MaximalExactMatch seed(end, end, full_range);
+        string::const_iterator cursor = end - 1;
+        while (cursor >= mem.begin) {
+            gcsa::range_type range = gcsa->LF(seed.range, gcsa->alpha.char2comp[*cursor]);
+            if (gcsa::Range::empty(range) || gcsa::Range::length(range) <= mem_range_length) break;
+            seed.range = range;
+            seed.begin = cursor;
+            if (cursor == mem.begin) break;
+            --cursor;
+        }
+        // drop seeds too short to be informative, taking the reseed length
+        // to be a multiple of the minimum useful seed length as BWA-MEM does
+        if (seed.end - seed.begin < max(min_mem_length, mem_reseed_length / 2)) continue;
+        if (!reseeds.empty() && reseeds.back().begin == seed.begin && reseeds.back().end == seed.end) continue;
+        reseeds.push_back(seed);
+    }
+}
+
 vector<Alignment> Mapper::align_mem_multi(const Alignment& alignment, vector<MaximalExactMatch>& mems, int additional_multimaps) {
 
     if (debug) cerr << "aligning " << pb2json(alignment) << endl;
@@ -2778,106 +3352,46 @@ vector<Alignment> Mapper::align_mem_multi(const Alignment& alignment, vector<Max
 vector<Alignment>
 Mapper::mems_id_clusters_to_alignments(const Alignment& alignment, vector<MaximalExactMatch>& mems, int additional_multimaps) {
 
-    struct StrandCounts {
-        uint32_t forward;
-        uint32_t reverse;
-    };
-    
     int total_multimaps = max_multimaps + additional_multimaps;
 
-    // we will use these to determine the alignment strand for each subgraph
-    map<id_t, StrandCounts> node_strands;
-    // records a mapping of id->MEMs, for cluster ranking
-    map<id_t, vector<MaximalExactMatch*> > id_to_mems;
-    // for clustering
-    vector<id_t> ids;
-
-    // run through the mems, generating a set of alignments for each
+    // lay each hit of each MEM out on the graph's sequence in id order, which
+    // is close to a topological order for constructed graphs, running backward
+    // for hits on the reverse strand so that they advance with the read
+    vector<ChainHit> hits;
+    vector<id_t> hit_ids;
+    vector<pair<MaximalExactMatch*, gcsa::node_type> > hit_mems;
     for (auto& mem : mems) {
-        //if (debug) cerr << "on mem " << mem.sequence() << endl;
-        size_t len = mem.begin - mem.end;
-        // collect ids and orientations of hits to them on the forward mem
         for (auto& node : mem.nodes) {
             id_t id = gcsa::Node::id(node);
-            id_to_mems[id].push_back(&mem);
-            ids.push_back(id);
+            int64_t offset = gcsa::Node::offset(node);
+            int64_t start = xindex->node_start(id);
+            ChainHit hit;
+            hit.read_begin = mem.begin - alignment.sequence().begin();
+            hit.read_end = mem.end - alignment.sequence().begin();
+            hit.ref_group = gcsa::Node::rc(node);
             if (gcsa::Node::rc(node)) {
-                node_strands[id].reverse++;
+                hit.ref_begin = -(start + get_node_length(id) - offset);
             } else {
-                node_strands[id].forward++;
+                hit.ref_begin = start + offset;
             }
+            hits.push_back(hit);
+            hit_ids.push_back(id);
+            hit_mems.push_back(make_pair(&mem, node));
         }
     }
 
-    std::sort(ids.begin(), ids.end());
-    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    // chain them, and only ever align to the best chains
+    auto chains = colinear_chains(hits, alignment.sequence().size() * 3);
 
-    // establish clusters using approximate distance metric based on ids
-    // we pick up ranges between successive nodes
-    // when these are below our thread_extension length
-    vector<vector<id_t> > clusters;
-    for (auto& id : ids) {
-        if (clusters.empty()) {
-            clusters.emplace_back();
-            auto& l = clusters.back();
-            l.push_back(id);
-        } else {
-            auto& prev = clusters.back().back();
-            if (id - prev <= thread_extension) {
-                clusters.back().push_back(id);
-            } else {
-                clusters.emplace_back();
-                auto& l = clusters.back();
-                l.push_back(id);
-            }
-        }
-    }
-
-    // rank the clusters by the fraction of the read that they cover
-    map<vector<id_t>*, int> cluster_query_coverage;
-    std::for_each(clusters.begin(), clusters.end(),
-                  [&cluster_query_coverage,
-                   &id_to_mems](vector<id_t>& cluster) {
-                      set<string::const_iterator> query_coverage;
-                      for (auto& id : cluster) {
-                          auto& mems = id_to_mems[id];
-                          std::for_each(mems.begin(), mems.end(),
-                                        [&](MaximalExactMatch* m) {
-                                            string::const_iterator c = m->begin;
-                                            while (c != m->end) query_coverage.insert(c++);
-                                        });
-                      }
-                      cluster_query_coverage[&cluster] = query_coverage.size();
-                  });
-
-    vector<vector<id_t>*> ranked_clusters;
-    std::for_each(clusters.begin(), clusters.end(),
-                  [&ranked_clusters](vector<id_t>& cluster) {
-                      ranked_clusters.push_back(&cluster); });
-
-    std::sort(ranked_clusters.begin(), ranked_clusters.end(),
-              [&cluster_query_coverage](vector<id_t>* a,
-                                        vector<id_t>* b) {
-                  auto len_a = cluster_query_coverage[a];
-                  auto len_b = cluster_query_coverage[b];
-                  // order by cluster coverage of query
-                  // break ties on number of MEMs (fewer better)
-                  if (len_a == len_b) {
-                      return a->size() < b->size();
-                  } else {
-                      return len_a > len_b;
-                  }
-              });
-
-
-    // generate an alignment for each subgraph/orientation combination for which we have hits
-    if (debug) cerr << "aligning to " << clusters.size() << " clusters" << endl;
     if (debug) {
-        for (auto cptr : ranked_clusters) {
-            auto& c = *cptr;
-            cerr << cluster_query_coverage[cptr] << ":"
-                 << c.size() << " "
-                 << c.front() << "-" << c.back() << endl;
+        cerr << "aligning to " << chains.size() << " chains" << endl;
+        for (auto& chain : chains) {
+            cerr << chain.score << ":" << chain.hits.size()
+                 << (hits[chain.hits.front()].ref_group ? " - " : " + ");
+            for (auto& h : chain.hits) {
+                cerr << hit_ids[h] << " ";
+            }
+            cerr << endl;
         }
     }
 
@@ -2892,28 +3406,63 @@ Mapper::mems_id_clusters_to_alignments(const Alignment& alignment, vector<Maxima
     
     int max_target_length = alignment.sequence().size() * max_target_factor;
 
+    // the nodes of the subgraphs we've aligned to on each strand, so that we
+    // don't align to the same place again for a lesser chain
+    set<id_t> aligned_nodes[2];
+
     size_t attempts = 0;
-    for (auto& cptr : ranked_clusters) {
-        auto& cluster = *cptr;
-        // skip if our cluster is too small
-        if (cluster.size() < cluster_min) continue;
+    for (auto& chain : chains) {
+        // skip if our chain is too small
+        if (chain.hits.size() < cluster_min) continue;
+        bool is_rev = hits[chain.hits.front()].ref_group;
+        set<id_t> cluster;
+        for (auto& h : chain.hits) {
+            cluster.insert(hit_ids[h]);
+        }
+        bool aligned = true;
+        for (auto& id : cluster) {
+            if (!aligned_nodes[is_rev].count(id)) {
+                aligned = false;
+                break;
+            }
+        }
+        if (aligned) continue;
         // record our attempt count
         ++attempts;
         // bail out if we've passed our maximum number of attempts
         if (attempts > max(max_attempts, total_multimaps)) break;
         if (debug) {
             cerr << "attempt " << attempts
-                 << " on cluster " << cluster.front() << "-" << cluster.back() << endl;
+                 << " on chain " << *cluster.begin() << "-" << *cluster.rbegin()
+                 << " scoring " << chain.score << endl;
         }
-        VG sub; // the subgraph we'll align against
-        set<id_t> seen;
-        for (auto& id : cluster) {
-            if (seen.count(id)) continue; // avoid double-gets
-            seen.insert(id);
-            xindex->get_id_range(id, id, sub.graph);
+        if (ungapped_extension) {
+            // if the longest MEM in the chain extends over the whole read
+            // without needing gaps, we don't need DP
+            size_t longest = chain.hits.front();
+            for (auto& h : chain.hits) {
+                if (hit_mems[h].first->length() > hit_mems[longest].first->length()) {
+                    longest = h;
+                }
+            }
+            Alignment aln;
+            if (ungapped_alignment(alignment, *hit_mems[longest].first, hit_mems[longest].second, aln)) {
+                if (debug) cerr << "ungapped extension scores " << aln.score() << endl;
+                for (auto& mapping : aln.path().mapping()) {
+                    aligned_nodes[is_rev].insert(mapping.position().node_id());
+                }
+                alns.push_back(aln);
+                if (attempts >= total_multimaps &&
+                    greedy_accept &&
+                    aln.identity() >= accept_identity) {
+                    break;
+                }
+                continue;
+            }
         }
+        VG sub; // the subgraph we'll align against
         // expand using our context depth
-        xindex->expand_context(sub.graph, context_depth, false);
+        cached_subgraph(id_ranges_of(cluster), context_depth, false, true, sub.graph);
         sub.rebuild_indexes();
         // if the graph is now too big to attempt, bail out
         if (max_target_factor && sub.length() > max_target_length) continue;
@@ -2921,38 +3470,26 @@ Mapper::mems_id_clusters_to_alignments(const Alignment& alignment, vector<Maxima
             cerr << "attempt " << attempts
                  << " on subgraph " << sub.min_node_id() << "-" << sub.max_node_id() << endl;
         }
-        // determine the likely orientation
-        uint32_t fw_mems = 0;
-        uint32_t rc_mems = 0;
         sub.for_each_node([&](Node* n) {
-                auto ns = node_strands.find(n->id());
-                if (ns != node_strands.end()) {
-                    fw_mems += ns->second.forward;
-                    rc_mems += ns->second.reverse;
-                }
+                aligned_nodes[is_rev].insert(n->id());
             });
-        if (debug) cerr << "got " << fw_mems << " forward and " << rc_mems << " reverse mems" << endl;
-        if (fw_mems) {
-            Alignment aln = align_to_graph(aln_fw, sub, max_query_graph_ratio);
+        // the chain tells us which strand to align
+        Alignment aln;
+        if (!is_rev) {
+            aln = align_to_graph(aln_fw, sub, max_query_graph_ratio);
             resolve_softclips(aln, sub);
             alns.push_back(aln);
-            if (attempts >= total_multimaps &&
-                greedy_accept &&
-                aln.identity() >= accept_identity) {
-                break;
-            }
-        }
-        if (rc_mems) {
-            Alignment aln = align_to_graph(aln_rc, sub, max_query_graph_ratio);
+        } else {
+            aln = align_to_graph(aln_rc, sub, max_query_graph_ratio);
             resolve_softclips(aln, sub);
             alns.push_back(reverse_complement_alignment(aln,
                                                         (function<int64_t(int64_t)>)
                                                         ([&](int64_t id) { return get_node_length(id); })));
-            if (attempts >= total_multimaps &&
-                greedy_accept &&
-                aln.identity() >= accept_identity) {
-                break;
-            }
+        }
+        if (attempts >= total_multimaps &&
+            greedy_accept &&
+            aln.identity() >= accept_identity) {
+            break;
         }
     }
     
@@ -3021,27 +3558,24 @@ void Mapper::resolve_softclips(Alignment& aln, VG& graph) {
     }
 }
 
-// core alignment algorithm that handles both kinds of sequence indexes
-vector<Alignment> Mapper::align_threaded(const Alignment& alignment, int& kmer_count, int kmer_size, int stride, int attempt) {
-
-    // parameters, some of which should probably be modifiable
-    // TODO -- move to Mapper object
-
-    if (index == nullptr && (xindex == nullptr || gcsa == nullptr)) {
-        cerr << "error:[vg::Mapper] index(es) missing, cannot map alignment!" << endl;
-        exit(1);
-    }
-
-    const string& sequence = alignment.sequence();
-
-    // Generate all the kmers we want to look up, with the correct stride.
-    auto kmers = balanced_kmers(sequence, kmer_size, stride);
+void Mapper::find_kmer_positions(const vector<string>& kmers,
+                                 vector<map<int64_t, vector<int32_t> > >& positions,
+                                 int& kmer_count,
+                                 vector<map<int64_t, vector<int32_t> > >* rc_positions,
+                                 int* rc_kmer_count) {
 
     //vector<uint64_t> sizes;
     //index->approx_sizes_of_kmer_matches(kmers, sizes);
 
-    // Holds the map from node ID to collection of start offsets, one per kmer we're searching for.
-    vector<map<int64_t, vector<int32_t> > > positions(kmers.size());
+    positions.clear();
+    positions.resize(kmers.size());
+    // The hits of each kept kmer on the reverse strand, which are hits of the
+    // same kmer of the reverse complement of the read on the forward strand
+    vector<map<int64_t, vector<int32_t> > > rc_found;
+    if (rc_positions) {
+        assert(gcsa && xindex);
+        rc_found.resize(kmers.size());
+    }
     int i = 0;
     for (auto& k : kmers) {
         if (!allATGC(k)) continue; // we can't handle Ns in this scheme
@@ -3084,9 +3618,17 @@ vector<Alignment> Mapper::align_threaded(const Alignment& alignment, int& kmer_c
 
             for(gcsa::node_type gcsa_node : gcsa_nodes) {
                 if(gcsa::Node::rc(gcsa_node)) {
-                    // We found a kmer on the reverse strand. The old index
-                    // didn't handle these, so we ignore them. TODO: figure out
-                    // how to account for them.
+                    // We found a kmer on the reverse strand. The threading
+                    // only follows the forward strand, so unless we're asked
+                    // to place it for the reverse complement of the read we
+                    // ignore it.
+                    if (rc_positions) {
+                        pos_t rc_start = kmer_rc_start(k, make_pos_t(gcsa::Node::id(gcsa_node), true,
+                                                                     gcsa::Node::offset(gcsa_node)));
+                        if (id(rc_start) && !is_rev(rc_start)) {
+                            rc_found.at(i)[id(rc_start)].push_back(offset(rc_start));
+                        }
+                    }
                     continue;
                 }
                 // Decode the result's ID and offset and record it
@@ -3107,9 +3649,74 @@ vector<Alignment> Mapper::align_threaded(const Alignment& alignment, int& kmer_c
         // Report the actual match count for the kmer
         if (debug) cerr << "\t=" << kmer_positions.size() << endl;
         kmer_count += kmer_positions.size();
+        if (rc_positions) {
+            auto& rc_kmer_positions = rc_found.at(i);
+            if (rc_kmer_positions.size() > hit_max) rc_kmer_positions.clear();
+            if (rc_kmer_count) *rc_kmer_count += rc_kmer_positions.size();
+        }
         ++i;
     }
 
+    if (rc_positions) {
+        // The kept kmers of the reverse complement of the read are these ones
+        // in reverse order
+        rc_positions->clear();
+        rc_positions->resize(kmers.size());
+        for (int j = 0; j < i; ++j) {
+            (*rc_positions)[i - j - 1] = std::move(rc_found[j]);
+        }
+    }
+}
+
+pos_t Mapper::kmer_rc_start(const string& kmer, pos_t start) {
+    // Where the kmer lies within its node on the reverse strand, its reverse
+    // complement starts at the mirrored offset on the forward strand
+    size_t length = get_node_length(id(start));
+    if (offset(start) + kmer.size() <= length) {
+        return make_pos_t(id(start), false, length - offset(start) - kmer.size());
+    }
+    // Otherwise follow the kmer out of the node to where it ends, and flip that
+    pos_t end = start;
+    for (size_t j = 1; j < kmer.size(); ++j) {
+        bool found = false;
+        for (auto& next : next_pos_chars(end)) {
+            if (next.second == kmer[j]) {
+                end = next.first;
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            return make_pos_t(0, false, 0);
+        }
+    }
+    return make_pos_t(id(end), !is_rev(end), get_node_length(id(end)) - offset(end) - 1);
+}
+
+// core alignment algorithm that handles both kinds of sequence indexes
+vector<Alignment> Mapper::align_threaded(const Alignment& alignment, int& kmer_count, int kmer_size, int stride, int attempt,
+                                         const vector<map<int64_t, vector<int32_t> > >* known_positions) {
+
+    // parameters, some of which should probably be modifiable
+    // TODO -- move to Mapper object
+
+    if (index == nullptr && (xindex == nullptr || gcsa == nullptr)) {
+        cerr << "error:[vg::Mapper] index(es) missing, cannot map alignment!" << endl;
+        exit(1);
+    }
+
+    const string& sequence = alignment.sequence();
+
+    // Holds the map from node ID to collection of start offsets, one per kmer we're searching for.
+    vector<map<int64_t, vector<int32_t> > > positions;
+    if (known_positions) {
+        positions = *known_positions;
+    } else {
+        // Generate all the kmers we want to look up, with the correct stride.
+        auto kmers = balanced_kmers(sequence, kmer_size, stride);
+        find_kmer_positions(kmers, positions, kmer_count);
+    }
+
     if (debug) cerr << "kept kmer hits " << kmer_count << endl;
 
     // make threads
@@ -3140,12 +3747,12 @@ vector<Alignment> Mapper::align_threaded(const Alignment& alignment, int& kmer_c
     int64_t max_subgraph_size = 0;
 
     // This is basically the index on this loop over kmers and their position maps coming up
-    i = 0;
+    int i = 0;
     for (auto& p : positions) {
         // For every map from node ID to collection of kmer starts, for kmer i...
 
-        // Grab the kmer and advance i for next loop iteration
-        auto& kmer = kmers.at(i++);
+        // Advance i for next loop iteration
+        ++i;
         for (auto& x : p) {
             // For each node ID and the offsets on that node at which this kmer appears...
             int64_t id = x.first;
@@ -3368,8 +3975,7 @@ vector<Alignment> Mapper::align_threaded(const Alignment& alignment, int& kmer_c
             // edges. How we do this depends on what indexing structures we have.
             // TODO: We're repeating this code. Break it out into a function or something.
             if(xindex) {
-                xindex->get_id_range(first, last, graph->graph);
-                xindex->expand_context(graph->graph, context_depth, false);
+                cached_subgraph({ make_pair(first, last) }, context_depth, false, true, graph->graph);
                 graph->rebuild_indexes();
             } else if(index) {
                 index->get_range(first, last, *graph);
@@ -3507,6 +4113,287 @@ vector<Alignment> Mapper::align_threaded(const Alignment& alignment, int& kmer_c
 }
 
 
+// steps along a path in the xg index, remembering which node it's on
+struct PathWalker {
+    xg::XG* xg;
+    string name;
+    int64_t path_length;
+    id_t id = 0;
+    bool is_reverse = false;
+    // where the node we're on starts in the path, and its length
+    int64_t start = 0;
+    int64_t length = 0;
+
+    PathWalker(xg::XG* xg, const string& name)
+        : xg(xg), name(name), path_length(xg->path_length(name)) { }
+
+    // move onto the node at the given path position; false if it's off the end
+    bool seek(int64_t pos) {
+        if (id && pos >= start && pos < start + length) return true;
+        if (pos < 0 || pos >= path_length) return false;
+        auto mapping = xg->mapping_at_path_position(name, pos);
+        id = mapping.position().node_id();
+        is_reverse = mapping.position().is_reverse();
+        length = xg->node_sequence(id).size();
+        start = pos;
+        for (int64_t p : xg->node_positions_in_path(id, name)) {
+            if (p <= pos && pos < p + length) {
+                start = p;
+                break;
+            }
+        }
+        return true;
+    }
+};
+
+// add an edit to the end of a list, merging it into the last one if they are
+// the same kind of edit
+static void append_edit(vector<Edit>& edits, const Edit& edit) {
+    if (edit.from_length() == 0 && edit.to_length() == 0) return;
+    if (!edits.empty()) {
+        Edit& last = edits.back();
+        if ((edit_is_match(last) && edit_is_match(edit))
+            || (edit_is_sub(last) && edit_is_sub(edit))
+            || (edit_is_insertion(last) && edit_is_insertion(edit))
+            || (edit_is_deletion(last) && edit_is_deletion(edit))) {
+            last.set_from_length(last.from_length() + edit.from_length());
+            last.set_to_length(last.to_length() + edit.to_length());
+            last.set_sequence(last.sequence() + edit.sequence());
+            return;
+        }
+    }
+    edits.push_back(edit);
+}
+
+bool Mapper::global_align_edits(const string& read, const string& ref, vector<Edit>& edits) {
+    // affine gap global alignment (Gotoh), with the scores of the aligner
+    auto aligner = get_regular_aligner();
+    int32_t match = aligner->match;
+    int32_t mismatch = aligner->mismatch;
+    int32_t gap_open = aligner->gap_open;
+    int32_t gap_extension = aligner->gap_extension;
+    size_t n = read.size();
+    size_t m = ref.size();
+    if ((n + 1) * (m + 1) > 1 << 22) return false;
+    const int32_t lowest = numeric_limits<int32_t>::min() / 2;
+    // best scores ending in a match/mismatch, a gap in the ref (an insertion)
+    // and a gap in the read (a deletion)
+    vector<int32_t> H((n + 1) * (m + 1), lowest);
+    vector<int32_t> I((n + 1) * (m + 1), lowest);
+    vector<int32_t> D((n + 1) * (m + 1), lowest);
+    auto at = [&](size_t i, size_t j) { return i * (m + 1) + j; };
+    H[at(0, 0)] = 0;
+    for (size_t i = 1; i <= n; ++i) {
+        I[at(i, 0)] = -gap_open - (int32_t) (i - 1) * gap_extension;
+    }
+    for (size_t j = 1; j <= m; ++j) {
+        D[at(0, j)] = -gap_open - (int32_t) (j - 1) * gap_extension;
+    }
+    for (size_t i = 1; i <= n; ++i) {
+        for (size_t j = 1; j <= m; ++j) {
+            int32_t diagonal = max(H[at(i-1, j-1)], max(I[at(i-1, j-1)], D[at(i-1, j-1)]));
+            H[at(i, j)] = diagonal + (read[i-1] == ref[j-1] ? match : -mismatch);
+            I[at(i, j)] = max(max(H[at(i-1, j)], D[at(i-1, j)]) - gap_open, I[at(i-1, j)] - gap_extension);
+            D[at(i, j)] = max(max(H[at(i, j-1)], I[at(i, j-1)]) - gap_open, D[at(i, j-1)] - gap_extension);
+        }
+    }
+    // trace back from the end of both, then put the edits in order
+    vector<Edit> reversed;
+    size_t i = n, j = m;
+    int state = 0; // 0 for H, 1 for I, 2 for D
+    {
+        int32_t h = H[at(i, j)], ins = I[at(i, j)], del = D[at(i, j)];
+        state = h >= ins && h >= del ? 0 : (ins >= del ? 1 : 2);
+    }
+    while (i > 0 || j > 0) {
+        // along the edges of the matrix there's only one way to go
+        if (i == 0) state = 2;
+        if (j == 0) state = 1;
+        Edit edit;
+        if (state == 0 && i > 0 && j > 0) {
+            int32_t diagonal = H[at(i, j)] - (read[i-1] == ref[j-1] ? match : -mismatch);
+            edit.set_from_length(1);
+            edit.set_to_length(1);
+            if (read[i-1] != ref[j-1]) edit.set_sequence(read.substr(i-1, 1));
+            --i; --j;
+            state = diagonal == H[at(i, j)] ? 0 : (diagonal == I[at(i, j)] ? 1 : 2);
+        } else if (state == 1 && i > 0) {
+            int32_t score = I[at(i, j)];
+            edit.set_to_length(1);
+            edit.set_sequence(read.substr(i-1, 1));
+            --i;
+            state = score == I[at(i, j)] - gap_extension ? 1 : (score == H[at(i, j)] - gap_open ? 0 : 2);
+        } else if (state == 2 && j > 0) {
+            int32_t score = D[at(i, j)];
+            edit.set_from_length(1);
+            --j;
+            state = score == D[at(i, j)] - gap_extension ? 2 : (score == H[at(i, j)] - gap_open ? 0 : 1);
+        } else {
+            return false;
+        }
+        reversed.push_back(edit);
+    }
+    for (auto e = reversed.rbegin(); e != reversed.rend(); ++e) {
+        append_edit(edits, *e);
+    }
+    return true;
+}
+
+bool Mapper::project_along_path(const Alignment& aln, const string& path_name, Path& projected) {
+    PathWalker walker(xindex, path_name);
+    const string& read = aln.sequence();
+    // the edits of the alignment along the path, from path_start on
+    vector<Edit> edits;
+    int64_t path_start = -1;
+    // where the last mapping on the path ended
+    int64_t expected = -1;
+    // the read bases of the mappings since then that are off the path
+    string off_path;
+    size_t read_pos = 0;
+    for (auto& mapping : aln.path().mapping()) {
+        int64_t from_length = mapping_from_length(mapping);
+        int64_t to_length = mapping_to_length(mapping);
+        // find where the mapping lies along the path, in the same orientation
+        int64_t pos = -1;
+        for (int64_t node_pos : xindex->node_positions_in_path(mapping.position().node_id(), path_name)) {
+            if (!walker.seek(node_pos) || walker.is_reverse != mapping.position().is_reverse()) continue;
+            int64_t candidate = node_pos + mapping.position().offset();
+            if (candidate >= expected) {
+                pos = candidate;
+                break;
+            }
+        }
+        if (pos < 0) {
+            // we have to start on the path
+            if (path_start < 0) return false;
+            off_path += read.substr(read_pos, to_length);
+            read_pos += to_length;
+            continue;
+        }
+        if (path_start < 0) {
+            path_start = pos;
+            expected = pos;
+        }
+        if (!off_path.empty() || pos > expected) {
+            // realign what we have of the read since we left the path to the
+            // path up to where we came back, as long as that's not far
+            if (pos - expected > 2 * (int64_t) off_path.size() + 32) return false;
+            string ref;
+            for (int64_t p = expected; p < pos; ++p) {
+                walker.seek(p);
+                ref.push_back(get_node_cache()->pos_char(make_pos_t(walker.id, walker.is_reverse, p - walker.start), xindex));
+            }
+            if (!global_align_edits(off_path, ref, edits)) return false;
+            off_path.clear();
+        }
+        for (auto& edit : mapping.edit()) {
+            // we only know how to split up simple edits
+            if (edit.from_length() && edit.to_length() && edit.from_length() != edit.to_length()) return false;
+            append_edit(edits, edit);
+        }
+        expected = pos + from_length;
+        read_pos += to_length;
+    }
+    // and to end on it
+    if (path_start < 0 || !off_path.empty()) return false;
+
+    // cut the edits up into mappings to the nodes of the path
+    projected.clear_mapping();
+    int64_t pos = path_start;
+    Mapping* mapping = nullptr;
+    auto next_mapping = [&](void) {
+        if (!walker.seek(pos)) return false;
+        mapping = projected.add_mapping();
+        mapping->mutable_position()->set_node_id(walker.id);
+        mapping->mutable_position()->set_is_reverse(walker.is_reverse);
+        mapping->mutable_position()->set_offset(pos - walker.start);
+        mapping->set_rank(projected.mapping_size());
+        return true;
+    };
+    for (auto& edit : edits) {
+        if (edit.from_length() == 0) {
+            if (!mapping && !next_mapping()) return false;
+            *mapping->add_edit() = edit;
+            continue;
+        }
+        int64_t done = 0;
+        while (done < edit.from_length()) {
+            if (!mapping || pos >= walker.start + walker.length) {
+                if (!next_mapping()) return false;
+            }
+            int64_t length = min((int64_t) edit.from_length() - done, walker.start + walker.length - pos);
+            Edit* piece = mapping->add_edit();
+            piece->set_from_length(length);
+            if (edit.to_length()) {
+                piece->set_to_length(length);
+                if (!edit.sequence().empty()) piece->set_sequence(edit.sequence().substr(done, length));
+            }
+            done += length;
+            pos += length;
+        }
+    }
+    return true;
+}
+
+int32_t Mapper::score_projection(const Path& path) {
+    auto aligner = get_regular_aligner();
+    vector<Edit> edits;
+    for (auto& mapping : path.mapping()) {
+        for (auto& edit : mapping.edit()) {
+            append_edit(edits, edit);
+        }
+    }
+    int32_t score = 0;
+    for (size_t i = 0; i < edits.size(); ++i) {
+        auto& edit = edits[i];
+        if (edit_is_match(edit)) {
+            score += aligner->match * edit.from_length();
+        } else if (edit_is_sub(edit)) {
+            score -= aligner->mismatch * edit.from_length();
+        } else if (edit_is_insertion(edit) && (i == 0 || i + 1 == edits.size())) {
+            // soft clips are free
+        } else {
+            int32_t length = max(edit.from_length(), edit.to_length());
+            score -= aligner->gap_open + (length - 1) * aligner->gap_extension;
+        }
+    }
+    return max(0, score);
+}
+
+bool Mapper::project_alignment(const Alignment& source, const set<string>& path_names,
+                               Alignment& projection, string& path_name) {
+    if (!xindex || source.path().mapping_size() == 0) return false;
+    // the alignment has to start on just one of the paths
+    auto& first = source.path().mapping(0).position();
+    path_name.clear();
+    for (auto& on_path : xindex->node_positions_in_paths(first.node_id())) {
+        if (path_names.count(on_path.first)) {
+            if (!path_name.empty()) return false;
+            path_name = on_path.first;
+        }
+    }
+    if (path_name.empty()) return false;
+
+    projection = source;
+    if (project_along_path(source, path_name, *projection.mutable_path())) {
+        // the alignment runs along the path
+    } else {
+        // it may run against it; if so, flip it around and back
+        function<int64_t(id_t)> node_length = [&](id_t node) { return get_node_length(node); };
+        Alignment flipped = reverse_complement_alignment(source, node_length);
+        Path projected;
+        if (!project_along_path(flipped, path_name, projected)) return false;
+        *flipped.mutable_path() = projected;
+        projection = reverse_complement_alignment(flipped, node_length);
+        projection.set_sequence(source.sequence());
+        projection.set_quality(source.quality());
+    }
+    projection.clear_mapping_quality();
+    projection.set_score(score_projection(projection.path()));
+    projection.set_identity(identity(projection.path()));
+    return true;
+}
+
 // transform the path into a path relative to another path (defined by path_name)
 // source -> surjection (in path_name coordinate space)
 // the product is equivalent to a pairwise alignment between this path and the other
@@ -3543,52 +4430,67 @@ Alignment Mapper::surject_alignment(const Alignment& source,
         return surjection;
     }
 
-    set<id_t> nodes;
-    for (int i = 0; i < source.path().mapping_size(); ++ i) {
-        nodes.insert(source.path().mapping(i).position().node_id());
-    }
     VG graph;
-    for (auto& node : nodes) {
-        *graph.graph.add_node() = xindex->node(node);
-    }
-    xindex->expand_context(graph.graph, context_depth, true); // get connected edges and path
-    graph.paths.append(graph.graph);
-    graph.rebuild_indexes();
-
     set<string> kept_paths;
-    graph.keep_paths(path_names, kept_paths);
-
     // We need this for inverting mappings to the correct strand
-    function<int64_t(id_t)> node_length = [&graph](id_t node) {
-        return graph.get_node(node)->sequence().size();
-    };
+    function<int64_t(id_t)> node_length;
+
+    string projected_path;
+    if (surject_by_projection
+        && project_alignment(source, path_names, surjection, projected_path)) {
+        // the alignment already runs along the path, save for a few
+        // realigned bits where it leaves it
+        kept_paths.insert(projected_path);
+        node_length = [&](id_t node) { return get_node_length(node); };
+    } else {
+        surjection = source;
+        surjection.clear_mapping_quality();
+        surjection.clear_score();
+        surjection.clear_identity();
+        surjection.clear_path();
+
+        set<id_t> nodes;
+        for (int i = 0; i < source.path().mapping_size(); ++ i) {
+            nodes.insert(source.path().mapping(i).position().node_id());
+        }
+        // get connected edges and path
+        cached_subgraph(id_ranges_of(nodes), context_depth, true, true, graph.graph);
+        graph.paths.append(graph.graph);
+        graph.rebuild_indexes();
+
+        graph.keep_paths(path_names, kept_paths);
+
+        node_length = [&graph](id_t node) {
+            return graph.get_node(node)->sequence().size();
+        };
     
-    // What is our alignment to surject spelled the other way around? We can't
-    // just use the normal alignment RC function because the mappings reference
-    // nonexistent nodes.
-    // Make sure to copy all the things about the alignment (name, etc.)
+        // What is our alignment to surject spelled the other way around? We can't
+        // just use the normal alignment RC function because the mappings reference
+        // nonexistent nodes.
+        // Make sure to copy all the things about the alignment (name, etc.)
 
-    Alignment surjection_rc = surjection;
-    surjection_rc.set_sequence(reverse_complement(surjection.sequence()));
+        Alignment surjection_rc = surjection;
+        surjection_rc.set_sequence(reverse_complement(surjection.sequence()));
     
-    // Align the old alignment to the graph in both orientations. Apparently
-    // align only does a single oriantation, and we have no idea, even looking
-    // at the mappings, which of the orientations will correspond to the one the
-    // alignment is actually in.
+        // Align the old alignment to the graph in both orientations. Apparently
+        // align only does a single oriantation, and we have no idea, even looking
+        // at the mappings, which of the orientations will correspond to the one the
+        // alignment is actually in.
 
-    auto surjection_forward = align_to_graph(surjection, graph, max_query_graph_ratio);
-    auto surjection_reverse = align_to_graph(surjection_rc, graph, max_query_graph_ratio);
+        auto surjection_forward = align_to_graph(surjection, graph, max_query_graph_ratio);
+        auto surjection_reverse = align_to_graph(surjection_rc, graph, max_query_graph_ratio);
 
 #ifdef debug
 #pragma omp critical (cerr)
-    cerr << surjection.name() << " " << surjection_forward.score() << " forward score, " << surjection_reverse.score() << " reverse score" << endl;
+        cerr << surjection.name() << " " << surjection_forward.score() << " forward score, " << surjection_reverse.score() << " reverse score" << endl;
 #endif
     
-    if(surjection_reverse.score() > surjection_forward.score()) {
-        // Even if we have to surject backwards, we have to send the same string out as we got in.
-        surjection = reverse_complement_alignment(surjection_reverse, node_length);
-    } else {
-        surjection = surjection_forward;
+        if(surjection_reverse.score() > surjection_forward.score()) {
+            // Even if we have to surject backwards, we have to send the same string out as we got in.
+            surjection = reverse_complement_alignment(surjection_reverse, node_length);
+        } else {
+            surjection = surjection_forward;
+        }
     }
     
     
@@ -17,6 +17,12 @@
 #include "json2pb.h"
 #include "entropy.hpp"
 #include "gssw_aligner.hpp"
+#include "ssw_aligner.hpp"
+#include "kmer_range_table.hpp"
+#include "node_cache.hpp"
+#include "mem_chainer.hpp"
+#include "fragment_length_model.hpp"
+#include "alignment_cache.hpp"
 
 namespace vg {
 
@@ -101,11 +107,35 @@ private:
     // max_multimaps. If the read does not map, the returned vector will be
     // empty. No alignments will be marked as secondary; the caller must do that
     // if they plan to produce GAM output.
+    // If known_positions is given, it holds the hits of the read's kmers
+    // (as from find_kmer_positions) and the index isn't queried again.
     vector<Alignment> align_threaded(const Alignment& read,
                                      int& hit_count,
                                      int kmer_size = 0,
                                      int stride = 0,
-                                     int attempt = 0);
+                                     int attempt = 0,
+                                     const vector<map<int64_t, vector<int32_t> > >* known_positions = nullptr);
+    // Look up the kmers in the index, filling in the map from node ID to the
+    // offsets of its hits for each informative kmer (packed to the front) and
+    // counting the hits. If rc_positions is given (which needs GCSA and xg),
+    // the reverse strand hits are used to fill it in the same way for the
+    // kmers of the reverse complement of the read.
+    void find_kmer_positions(const vector<string>& kmers,
+                             vector<map<int64_t, vector<int32_t> > >& positions,
+                             int& kmer_count,
+                             vector<map<int64_t, vector<int32_t> > >* rc_positions = nullptr,
+                             int* rc_kmer_count = nullptr);
+    // Where the reverse complement of a kmer that starts at the given
+    // position starts, or a position with ID 0 if we can't follow the kmer.
+    pos_t kmer_rc_start(const string& kmer, pos_t start);
+    // the path of an alignment laid along the named path in its own
+    // orientation, for project_alignment
+    bool project_along_path(const Alignment& aln, const string& path_name, Path& projected);
+    // append the edits of a global alignment of the read to the ref, false if
+    // they are too long to align this way
+    bool global_align_edits(const string& read, const string& ref, vector<Edit>& edits);
+    // the score of a path of edits, with soft clips free
+    int32_t score_projection(const Path& path);
     
 public:
     // Make a Mapper that pulls from a RocksDB index and optionally a GCSA2 kmer index.
@@ -121,6 +151,9 @@ public:
     // GCSA index and its LCP array
     gcsa::GCSA* gcsa;
     gcsa::LCPArray* lcp;
+    // optional table of the GCSA ranges of all short k-mers, which lets
+    // find_smems take the first steps of each backward search at once
+    KmerRangeTable* kmer_ranges;
     // GSSW aligner(s)
     vector<QualAdjAligner*> qual_adj_aligners;
     vector<Aligner*> regular_aligners;
@@ -128,22 +161,69 @@ public:
     QualAdjAligner* get_qual_adj_aligner(void);
     Aligner* get_regular_aligner(void);
 
-    // match walking support to prevent repeated calls to the xg index for the same node
-    vector<LRUCache<id_t, Node>* > node_cache;
-    LRUCache<id_t, Node>& get_node_cache(void);
-    void init_node_cache(void);
+    // match walking support to prevent repeated calls to the xg index for the
+    // same node; one can be shared by all the mappers in a run with
+    // set_node_cache, in which case it isn't ours to delete, and otherwise each
+    // mapper makes its own the first time it needs one
+    NodeCache* node_cache;
+    bool node_cache_owned;
+    void init_node_cache(size_t capacity = 65536);
+    void set_node_cache(NodeCache* shared);
+    NodeCache* get_node_cache(void);
+
+    // the same MEM ranges come up read after read (repeats, common k-mers), so
+    // remember what GCSA counted for them
+    vector<LRUCache<gcsa::range_type, size_t>* > match_count_cache;
+    LRUCache<gcsa::range_type, size_t>& get_match_count_cache(void);
+    void init_match_count_cache(void);
+    size_t cached_match_count(const gcsa::range_type& range);
+
+    // paired and repeated reads keep sending us back to the same places, so
+    // keep the last few subgraphs we pulled out of the xg index, by the id
+    // ranges and context expansion they came from
+    vector<LRUCache<string, Graph>* > subgraph_cache;
+    LRUCache<string, Graph>& get_subgraph_cache(void);
+    void init_subgraph_cache(void);
+    size_t subgraph_cache_hits; // subgraphs found in the cache so far
+    size_t subgraph_cache_misses; // and pulled out of the xg index
+    // fill the (empty) graph with the nodes in the id ranges, expanded as by
+    // XG::expand_context with the given flags
+    void cached_subgraph(const vector<pair<id_t, id_t> >& id_ranges,
+                         int context, bool use_steps, bool add_paths,
+                         Graph& graph);
+
+    // if set, align_multi and align_paired_multi reuse the alignments of
+    // earlier reads (or pairs) with the same sequences; the cache is usually
+    // shared by all the mappers in a run, and isn't ours to delete
+    AlignmentCache* alignment_cache;
+    // what we store the alignments of a read under, given the parameters it
+    // was aligned with
+    string alignment_cache_key(const Alignment& aln, int kmer_size, int stride,
+                               int max_mem_length, int band_width);
 
     // a collection of read pairs which we'd like to realign once we have estimated the fragment_size
     vector<pair<Alignment, Alignment> > imperfect_pairs_to_retry;
 
-    // running estimation of fragment length distribution
-    deque<double> fragment_lengths;
+    // running estimation of fragment length distribution; each mapper makes
+    // its own model, but one can be shared by all the mappers in a run (and
+    // seeded from an earlier one) with set_fragment_length_model, in which
+    // case it isn't ours to delete
+    FragmentLengthModel* fragment_length_model;
+    bool fragment_length_model_owned;
+    void init_fragment_length_model(void);
+    void set_fragment_length_model(FragmentLengthModel* shared);
     void record_fragment_length(int length);
+    // take the fragment length distribution and fragment_size from the model,
+    // if it has seen enough fragments
+    void update_fragment_length_estimate(void);
     double fragment_length_stdev(void);
     double fragment_length_mean(void);
     int cached_fragment_length_mean;
     int cached_fragment_length_stdev;
-    int since_last_fragment_length_estimate;
+    // the model's count when we last took the estimate from it; we take it
+    // again once the model has seen another interval's worth of fragments, from
+    // whichever mappers share it
+    uint64_t fragment_length_count_at_estimate;
     int fragment_length_estimate_interval;
 
     double estimate_gc_content();
@@ -161,15 +241,20 @@ public:
     // Align read2 to the subgraph near the alignment of read1.
     // TODO: support banded alignment and intelligently use orientation heuristics
     void align_mate_in_window(const Alignment& read1, Alignment& read2, int pair_window);
+    // Align read2 near read1's mapping location along the paths it is on,
+    // where the fragment length distribution says it should be; false if we
+    // don't know the distribution or read1 isn't on a path
+    bool align_mate_in_path_window(const Alignment& read1, Alignment& read2);
     
     vector<Alignment> resolve_banded_multi(vector<vector<Alignment>>& multi_alns);
     set<MaximalExactMatch*> resolve_paired_mems(vector<MaximalExactMatch>& mems1,
                                                 vector<MaximalExactMatch>& mems2);
 
-    // uses heuristic clustering based on node id ranges to find alignment targets, and aligns
+    // chains MEM hits laid out on the graph's sequence in id order to find alignment targets,
+    // and aligns to the best chains
     vector<Alignment> mems_id_clusters_to_alignments(const Alignment& alignment, vector<MaximalExactMatch>& mems, int additional_multimaps);
 
-    // uses approximate-positional clustering based on embedded paths in the xg index to find and align against alignment targets
+    // chains MEM hits by their positions in the embedded paths in the xg index to find and align against alignment targets
     vector<Alignment> mems_pos_clusters_to_alignments(const Alignment& aln, vector<MaximalExactMatch>& mems, int additional_multimaps);
 
     // takes the input alignment (with seq, etc) so we have reference to the base sequence
@@ -224,6 +309,16 @@ public:
                            int max_mem_length = 0,
                            int band_width = 1000,
                            int pair_window = 64);
+    // the same, without looking in the alignment cache
+    pair<vector<Alignment>, vector<Alignment>> 
+        align_paired_multi_uncached(const Alignment& read1,
+                                    const Alignment& read2,
+                                    bool& queued_resolve_later,
+                                    int kmer_size = 0,
+                                    int stride = 0,
+                                    int max_mem_length = 0,
+                                    int band_width = 1000,
+                                    int pair_window = 64);
     
     // Paired-end alignment ignoring multi-mapping. Returns either the two
     // highest-scoring reads if no rescue was required, or the highest-scoring
@@ -243,11 +338,28 @@ public:
                                 int64_t& path_pos,
                                 bool& path_reverse,
                                 int window);
+    // surject an alignment that starts on one of the paths by walking its
+    // mappings along it, realigning only the parts of the read where it leaves
+    // the path; false if it doesn't run along just one of them, in either
+    // orientation
+    bool project_alignment(const Alignment& source,
+                           const set<string>& path_names,
+                           Alignment& projection,
+                           string& path_name);
 
     // MEM-based mapping
     // finds absolute super-maximal exact matches
     vector<MaximalExactMatch> find_smems(const string& seq, int max_length);
     bool get_mem_hits_if_under_max(MaximalExactMatch& mem);
+    // get the hits of the MEMs of a read, locating no more than mem_hit_budget
+    // of them; if none of the MEMs is unique, sample the hits of those with
+    // too many and add seeds from within the long ones (see reseed_mem)
+    void get_mem_hits_within_budget(vector<MaximalExactMatch>& mems);
+    // fill in up to samples hits of the MEM, spread over its range
+    void subsample_mem_hits(MaximalExactMatch& mem, size_t samples);
+    // add the matches within the MEM that end at its middle and at its end
+    // and are as long as they can be while having more hits than it
+    void reseed_mem(const MaximalExactMatch& mem, vector<MaximalExactMatch>& reseeds);
     // debugging, checking of mems using find interface to gcsa
     void check_mems(const vector<MaximalExactMatch>& mems);
     // finds "forward" maximal exact matches of the sequence using the GCSA index
@@ -264,6 +376,19 @@ public:
     vector<Alignment> walk_match(const Alignment& base, const string& seq, pos_t pos);
     // convert the set of hits of a MEM into a set of alignments
     vector<Alignment> mem_to_alignments(MaximalExactMatch& mem);
+    // align the read without gaps by extending one hit of a MEM along the
+    // graph in both directions, stopping when the score drops by the gap open
+    // penalty; fails unless the result spans the read and loses less than a
+    // gap open to mismatches, in which case no gapped or clipped alignment
+    // through the hit could do better
+    bool ungapped_alignment(const Alignment& read, const MaximalExactMatch& mem,
+                            gcsa::node_type node, Alignment& aln);
+    // the best scoring ungapped extension of seq along the graph, where seq
+    // starts at one of the given positions (with the given bases), as the
+    // positions and bases it passes; false if there are too many branches
+    bool extend_ungapped(const string& seq, const map<pos_t, char>& starts,
+                         int32_t match, int32_t mismatch, int32_t xdrop,
+                         int32_t& score, vector<pair<pos_t, char> >& extension);
     // Use the GCSA index to look up the sequence
     set<pos_t> sequence_positions(const string& seq);
 
@@ -292,6 +417,11 @@ public:
     //int max_mem_length; // a mem must be <= this length
     int min_mem_length; // a mem must be >= this length
     int mem_threading; // whether to use the mem threading mapper or not
+    bool ungapped_extension; // try extending the best MEM of each chain without gaps before doing DP
+    int mem_reseed_length; // look for more seeds within MEMs this long when a read has no unique MEM (0 for never)
+    int mem_hit_budget; // locate at most this many MEM hits for each read (0 for no limit)
+    size_t mem_budget_spent; // MEM hits located so far
+    size_t mem_budget_overruns; // reads with MEM hits left unlocated for want of budget so far
 
     // general parameters, applying to both types of mapping
     //
@@ -303,6 +433,8 @@ public:
 
     size_t max_query_graph_ratio;
 
+    bool surject_by_projection; // surject by following the alignment along the path before realigning to it
+
     // multimapping
     int max_multimaps;
     // soft clip resolution
@@ -320,7 +452,6 @@ public:
     int fragment_size; // Used to bound clustering of MEMs during paired end mapping, also acts as sentinel to determine
                        // if consistent pairs should be reported; dynamically estimated at runtime
     double fragment_sigma; // the number of times the standard deviation above the mean to set the fragment_size
-    int fragment_length_cache_size;
 
 };
 
@@ -0,0 +1,106 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include "mem_chainer.hpp"
+
+namespace vg {
+
+using namespace std;
+
+vector<Chain> colinear_chains(const vector<ChainHit>& hits,
+                              int64_t max_gap,
+                              int max_lookback,
+                              int max_skips) {
+
+    vector<Chain> chains;
+    if (hits.empty()) {
+        return chains;
+    }
+
+    // visit the hits in reference order within each group
+    vector<size_t> order(hits.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            auto& ha = hits[a];
+            auto& hb = hits[b];
+            if (ha.ref_group != hb.ref_group) return ha.ref_group < hb.ref_group;
+            if (ha.ref_begin != hb.ref_begin) return ha.ref_begin < hb.ref_begin;
+            return ha.read_begin < hb.read_begin;
+        });
+
+    // gaps cost more when the hits are long, as they are less likely to be
+    // separated by chance
+    double average_length = 0;
+    for (auto& hit : hits) {
+        average_length += hit.read_end - hit.read_begin;
+    }
+    average_length /= hits.size();
+
+    // best score of a chain ending at each hit (by rank in order), and the
+    // previous hit in that chain
+    vector<double> score(order.size());
+    vector<int64_t> prev(order.size(), -1);
+    for (size_t i = 0; i < order.size(); ++i) {
+        auto& hit = hits[order[i]];
+        int64_t length = hit.read_end - hit.read_begin;
+        score[i] = length;
+        int skips = 0;
+        for (int64_t j = (int64_t) i - 1; j >= 0 && (int64_t) i - j <= max_lookback; --j) {
+            auto& other = hits[order[j]];
+            if (other.ref_group != hit.ref_group) break;
+            int64_t ref_distance = hit.ref_begin - other.ref_begin;
+            // everything further back is further away
+            if (ref_distance > max_gap) break;
+            int64_t read_distance = (int64_t) hit.read_begin - (int64_t) other.read_begin;
+            // we have to move forward in both
+            if (ref_distance <= 0 || read_distance <= 0 || other.read_end >= hit.read_end) continue;
+            int64_t gap = llabs(read_distance - ref_distance);
+            if (gap > max_gap) continue;
+            // don't count the bases we share with the other hit twice
+            double gain = min(min(read_distance, ref_distance), length);
+            double cost = gap ? 0.01 * average_length * gap + 0.5 * log2((double) gap) : 0;
+            double extended = score[j] + gain - cost;
+            if (extended > score[i]) {
+                score[i] = extended;
+                prev[i] = j;
+                skips = 0;
+            } else if (++skips > max_skips) {
+                break;
+            }
+        }
+    }
+
+    // take chains back from their best ends, stopping each where it runs
+    // into hits that have already been claimed by a better chain
+    vector<size_t> by_score(order.size());
+    for (size_t i = 0; i < by_score.size(); ++i) {
+        by_score[i] = i;
+    }
+    std::stable_sort(by_score.begin(), by_score.end(), [&](size_t a, size_t b) {
+            return score[a] > score[b];
+        });
+    vector<bool> used(order.size(), false);
+    for (auto end : by_score) {
+        if (used[end]) continue;
+        chains.emplace_back();
+        auto& chain = chains.back();
+        int64_t i = end;
+        while (i >= 0 && !used[i]) {
+            used[i] = true;
+            chain.hits.push_back(order[i]);
+            i = prev[i];
+        }
+        chain.score = score[end] - (i >= 0 ? score[i] : 0);
+        std::reverse(chain.hits.begin(), chain.hits.end());
+    }
+
+    std::stable_sort(chains.begin(), chains.end(), [](const Chain& a, const Chain& b) {
+            return a.score > b.score;
+        });
+
+    return chains;
+}
+
+}
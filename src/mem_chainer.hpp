@@ -0,0 +1,52 @@
+#ifndef VG_MEM_CHAINER_HPP
+#define VG_MEM_CHAINER_HPP
+// mem_chainer.hpp: colinear chaining of exact match hits
+//
+// each hit is an exact match between an interval of the read and an interval
+// of some linear reference coordinate (a path, or the graph's sequence laid out
+// in id order), which we think of as being on the same strand as the read. a
+// chain is a run of hits that advance together in both, and chains are scored
+// with a sparse dynamic program like that of minimap: every hit looks back at a
+// bounded number of the hits before it in reference order, takes the bases it
+// adds to the best chain it can extend, and pays for the difference between
+// the read and reference distances to it.
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace vg {
+
+using namespace std;
+
+struct ChainHit {
+    // the matched interval of the read
+    size_t read_begin;
+    size_t read_end;
+    // where the match starts in the reference coordinate
+    int64_t ref_begin;
+    // hits are only chained with others from the same group (strand, path...)
+    int64_t ref_group;
+};
+
+struct Chain {
+    double score;
+    // indexes of the hits in the chain, in read order
+    vector<size_t> hits;
+};
+
+// find the chains of the hits, best scoring first, with every hit in exactly
+// one chain
+//
+// hits more than max_gap apart in the reference, or whose read and reference
+// distances differ by more than max_gap, aren't chained. each hit considers at
+// most max_lookback predecessors, and gives up after max_skips of them in a
+// row don't improve its score.
+vector<Chain> colinear_chains(const vector<ChainHit>& hits,
+                              int64_t max_gap,
+                              int max_lookback = 50,
+                              int max_skips = 25);
+
+}
+
+#endif
@@ -0,0 +1,167 @@
+#include "node_cache.hpp"
+
+namespace vg {
+
+using namespace std;
+
+NodeCache::NodeCache(size_t capacity, size_t shard_count)
+    : shards(capacity, shard_count) {
+}
+
+size_t NodeCache::capacity(void) const {
+    return shards.capacity();
+}
+
+size_t NodeCache::hits(void) {
+    return shards.hits();
+}
+
+size_t NodeCache::misses(void) {
+    return shards.misses();
+}
+
+NodeCache::Shard& NodeCache::shard_of(id_t id) {
+    // neighboring nodes tend to be walked together, so spread them out
+    return shards.shard_of((size_t) id);
+}
+
+void NodeCache::make_record(id_t id, const string& sequence, Record& record) {
+    record.id = id;
+    record.length = sequence.size();
+    record.referenced = false;
+    record.packed = allATGC(sequence);
+    if (!record.packed) {
+        record.bases = sequence;
+        return;
+    }
+    record.bases.assign((sequence.size() + 3) / 4, 0);
+    for (size_t i = 0; i < sequence.size(); ++i) {
+        uint8_t code;
+        switch (sequence[i]) {
+        case 'A': code = 0; break;
+        case 'C': code = 1; break;
+        case 'G': code = 2; break;
+        default: code = 3; break;
+        }
+        record.bases[i / 4] |= code << (2 * (i % 4));
+    }
+}
+
+char NodeCache::base_at(const Record& record, bool is_rev, size_t offset) {
+    size_t i = is_rev ? record.length - offset - 1 : offset;
+    char base;
+    if (record.packed) {
+        static const char bases[4] = { 'A', 'C', 'G', 'T' };
+        base = bases[((uint8_t) record.bases[i / 4] >> (2 * (i % 4))) & 3];
+    } else {
+        base = record.bases[i];
+    }
+    return is_rev ? reverse_complement(base) : base;
+}
+
+size_t NodeCache::lookup(id_t id, bool is_rev, size_t offset, char& base, xg::XG* xgidx) {
+    Shard& shard = shard_of(id);
+    omp_set_lock(&shard.lock);
+    auto found = shard.slot_of.find(id);
+    if (found != shard.slot_of.end()) {
+        Record& record = shard.records[found->second];
+        record.referenced = true;
+        ++shard.hits;
+        size_t length = record.length;
+        if (offset < length) {
+            base = base_at(record, is_rev, offset);
+        }
+        omp_unset_lock(&shard.lock);
+        return length;
+    }
+    ++shard.misses;
+    omp_unset_lock(&shard.lock);
+
+    // fetch the node without holding the lock, as xg can be slow
+    Record record;
+    make_record(id, xgidx->node_sequence(id), record);
+    size_t length = record.length;
+    if (offset < length) {
+        base = base_at(record, is_rev, offset);
+    }
+
+    omp_set_lock(&shard.lock);
+    // another thread may have beaten us to it
+    if (shard.slot_of.find(id) == shard.slot_of.end()) {
+        size_t slot;
+        if (shard.records.size() < shards.shard_capacity()) {
+            slot = shard.records.size();
+            shard.records.emplace_back();
+        } else {
+            // give everything referenced since the hand last passed it another
+            // chance, and evict the first record that hasn't been
+            while (shard.records[shard.hand].referenced) {
+                shard.records[shard.hand].referenced = false;
+                shard.hand = (shard.hand + 1) % shard.records.size();
+            }
+            slot = shard.hand;
+            shard.hand = (shard.hand + 1) % shard.records.size();
+            shard.slot_of.erase(shard.records[slot].id);
+        }
+        shard.records[slot] = std::move(record);
+        shard.slot_of[id] = slot;
+    }
+    omp_unset_lock(&shard.lock);
+    return length;
+}
+
+size_t NodeCache::node_length(id_t id, xg::XG* xgidx) {
+    char base;
+    return lookup(id, false, numeric_limits<size_t>::max(), base, xgidx);
+}
+
+char NodeCache::pos_char(pos_t pos, xg::XG* xgidx) {
+    char base = 'N';
+    lookup(id(pos), is_rev(pos), offset(pos), base, xgidx);
+    return base;
+}
+
+map<pos_t, char> NodeCache::next_pos_chars(pos_t pos, xg::XG* xgidx) {
+
+    map<pos_t, char> nexts;
+    // one lookup tells us both whether we can stay on the node and what the
+    // next base on it is
+    char base;
+    size_t length = lookup(id(pos), is_rev(pos), offset(pos) + 1, base, xgidx);
+    // if we are still in the node, return the next position and character
+    if ((size_t) offset(pos) + 1 < length) {
+        ++get_offset(pos);
+        nexts[pos] = base;
+    } else {
+
+        auto is_inverting = [](const Edge& e) {
+            return !(e.from_start() == e.to_end())
+            && (e.from_start() || e.to_end());
+        };
+
+        // look at the next positions we could reach
+
+        if (!is_rev(pos)) {
+            // we are on the forward strand, the next things from this node come off the end
+            for (auto& edge : xgidx->edges_on_end(id(pos))) {
+                id_t nid = (edge.from() == id(pos) ?
+                            edge.to()
+                            : edge.from());
+                pos_t p = make_pos_t(nid, is_inverting(edge), 0);
+                nexts[p] = pos_char(p, xgidx);
+            }
+        } else {
+            // we are on the reverse strand, the next things from this node come off the start
+            for (auto& edge : xgidx->edges_on_start(id(pos))) {
+                id_t nid = (edge.to() == id(pos) ?
+                            edge.from()
+                            : edge.to());
+                pos_t p = make_pos_t(nid, !is_inverting(edge), 0);
+                nexts[p] = pos_char(p, xgidx);
+            }
+        }
+    }
+    return nexts;
+}
+
+}
@@ -0,0 +1,73 @@
+#ifndef VG_NODE_CACHE_HPP
+#define VG_NODE_CACHE_HPP
+// node_cache.hpp: a cache of node lengths and sequences pulled out of an xg
+// index, which can be shared by all the threads of a mapping run
+//
+// the cache is split into shards by node id (see sharded_cache.hpp). each
+// shard holds a fixed number of compact records (sequences are packed two bits
+// to the base where they are all ACGT) and evicts with the clock algorithm,
+// which only has to set a bit on a hit.
+
+#include <vector>
+#include <string>
+#include <map>
+#include <limits>
+#include "sharded_cache.hpp"
+#include "types.hpp"
+#include "hash_map.hpp"
+#include "position.hpp"
+#include "xg.hpp"
+
+namespace vg {
+
+using namespace std;
+
+class NodeCache {
+public:
+
+    // hold up to about capacity nodes, split over the given number of shards
+    NodeCache(size_t capacity = 65536, size_t shards = 64);
+
+    // the same as the xg_cached_ functions in position.hpp, with nodes that
+    // aren't cached fetched from xgidx
+    size_t node_length(id_t id, xg::XG* xgidx);
+    char pos_char(pos_t pos, xg::XG* xgidx);
+    map<pos_t, char> next_pos_chars(pos_t pos, xg::XG* xgidx);
+
+    size_t capacity(void) const;
+    // lookups that did and didn't find the node in the cache, so far
+    size_t hits(void);
+    size_t misses(void);
+
+private:
+
+    struct Record {
+        id_t id = 0;
+        size_t length = 0;
+        // four bases a byte if packed, else the sequence as it is
+        bool packed = false;
+        string bases;
+        // set on a hit, and cleared as the clock hand passes
+        bool referenced = false;
+    };
+
+    struct Shard : public CacheShard {
+        // slot in records of each cached node
+        hash_map<id_t, size_t> slot_of;
+        vector<Record> records;
+        size_t hand = 0;
+    };
+
+    ShardedCache<Shard> shards;
+
+    Shard& shard_of(id_t id);
+    // get the length of a node, and, if offset is on the node, the base at
+    // offset along the given strand
+    size_t lookup(id_t id, bool is_rev, size_t offset, char& base, xg::XG* xgidx);
+    static void make_record(id_t id, const string& sequence, Record& record);
+    static char base_at(const Record& record, bool is_rev, size_t offset);
+};
+
+}
+
+#endif
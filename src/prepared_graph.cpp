@@ -0,0 +1,306 @@
+#include <omp.h>
+#include <algorithm>
+#include <limits>
+#include "prepared_graph.hpp"
+#include "simd_ops.hpp"
+
+namespace vg {
+
+using namespace std;
+
+PreparedGraph::PreparedGraph(VG& graph, size_t max_read_length) {
+
+    unrolled = !graph.is_acyclic() || graph.has_inverting_edges();
+    if (!unrolled) {
+        // graph is a non-inverting DAG, so we just need to sort
+        dag = graph;
+    }
+    else {
+        map<id_t, pair<id_t, bool> > unfold_trans;
+        map<id_t, pair<id_t, bool> > dagify_trans;
+        size_t component_length_max = 100 * max_read_length; // hard coded to be 100x, as in VG::align
+
+        // dagify the graph by unfolding inversions and then applying dagify forward unroll
+        dag = graph.unfold(max_read_length, unfold_trans)
+            .dagify(max_read_length, dagify_trans, max_read_length, component_length_max);
+        translation = graph.overlay_node_translations(dagify_trans, unfold_trans);
+
+        graph.for_each_node([&](Node* node) {
+                node_length[node->id()] = node->sequence().size();
+            });
+    }
+
+    // join to a common root, so alignment covers the entire graph, and put the
+    // nodes in sort order. unlike VG::align we keep the root, since the DAG
+    // is our own.
+    dag.join_heads();
+    dag.sort();
+
+    unordered_map<id_t, size_t> node_index;
+    for (size_t i = 0; i < dag.graph.node_size(); i++) {
+        node_index[dag.graph.node(i).id()] = i;
+    }
+    predecessors.resize(dag.graph.node_size());
+    for (size_t i = 0; i < dag.graph.edge_size(); i++) {
+        const Edge& edge = dag.graph.edge(i);
+        if (!edge.from_start() && !edge.to_end()) {
+            predecessors[node_index.at(edge.to())].push_back(node_index.at(edge.from()));
+        }
+        else if (edge.from_start() && edge.to_end()) {
+            predecessors[node_index.at(edge.from())].push_back(node_index.at(edge.to()));
+        }
+    }
+}
+
+Alignment PreparedGraph::align(const Alignment& alignment, Aligner* aligner, QualAdjAligner* qual_adj_aligner) {
+
+    auto aln = alignment;
+
+    if (aligner && !qual_adj_aligner) {
+        aligner->align(aln, dag.graph);
+    }
+    else if (qual_adj_aligner && !aligner) {
+        qual_adj_aligner->align(aln, dag.graph);
+    }
+    else {
+        cerr << "error:[PreparedGraph] cannot both adjust and not adjust alignment for base quality" << endl;
+    }
+
+    if (unrolled) {
+        translate_nodes(aln, translation, [&](id_t node_id) {
+                return node_length.at(node_id);
+            });
+    }
+
+    // Copy back the not-case-corrected sequence
+    aln.set_sequence(alignment.sequence());
+
+    return aln;
+}
+
+Alignment PreparedGraph::align(const Alignment& alignment, Aligner& aligner) {
+    return align(alignment, &aligner, nullptr);
+}
+
+Alignment PreparedGraph::align_qual_adjusted(const Alignment& alignment, QualAdjAligner& qual_adj_aligner) {
+    return align(alignment, nullptr, &qual_adj_aligner);
+}
+
+vector<Alignment> PreparedGraph::align(const vector<Alignment>& alignments, const vector<Aligner*>& aligners) {
+
+    vector<Alignment> aligned(alignments.size());
+#pragma omp parallel for schedule(dynamic) num_threads(aligners.size()) if (aligners.size() > 1)
+    for (size_t i = 0; i < alignments.size(); i++) {
+        aligned[i] = align(alignments[i], aligners[omp_get_thread_num()], nullptr);
+    }
+    return aligned;
+}
+
+vector<Alignment> PreparedGraph::align_qual_adjusted(const vector<Alignment>& alignments,
+                                                     const vector<QualAdjAligner*>& qual_adj_aligners) {
+
+    vector<Alignment> aligned(alignments.size());
+#pragma omp parallel for schedule(dynamic) num_threads(qual_adj_aligners.size()) if (qual_adj_aligners.size() > 1)
+    for (size_t i = 0; i < alignments.size(); i++) {
+        aligned[i] = align(alignments[i], nullptr, qual_adj_aligners[omp_get_thread_num()]);
+    }
+    return aligned;
+}
+
+// scoring many reads at once: each lane of a vector holds a cell from a different read's local
+// alignment matrix, so a whole column of cells fills with plain vector operations and no shuffling
+// between lanes. the reads go in a profile of the score of each of their bases against each graph
+// base, a row of lanes for each read position, and rows past the end of a read score -inf, which
+// keeps them below the cells of the read above them. all arithmetic saturates.
+
+// fill the cells of the reads against the bases of a node, starting from the scores and deletions
+// in the column before it and leaving those of the node's last column in their place, and take the
+// max of every cell into best
+template <class IntType>
+static void fill_node_sse41(const IntType* profile, const int8_t* node_codes, int64_t node_length,
+                            int64_t rows, IntType* scores, IntType* deletions, IntType* best,
+                            int8_t gap_open, int8_t gap_extend) {
+    typedef Sse41Ops<IntType> Ops;
+    __m128i zero = _mm_setzero_si128();
+    __m128i neg_inf = Ops::set1(numeric_limits<IntType>::min());
+    __m128i open = Ops::set1(gap_open);
+    __m128i extend = Ops::set1(gap_extend);
+    __m128i max_score = _mm_loadu_si128((const __m128i*) best);
+    for (int64_t j = 0; j < node_length; j++) {
+        const IntType* base_profile = profile + node_codes[j] * rows * Ops::lanes;
+        // the row above the reads scores 0
+        __m128i diagonal = zero;
+        __m128i above = zero;
+        __m128i insertion = neg_inf;
+        for (int64_t i = 0; i < rows; i++) {
+            __m128i* score_cell = (__m128i*) (scores + i * Ops::lanes);
+            __m128i* deletion_cell = (__m128i*) (deletions + i * Ops::lanes);
+            __m128i left = _mm_loadu_si128(score_cell);
+            __m128i deletion = Ops::max(Ops::subs(_mm_loadu_si128(deletion_cell), extend), Ops::subs(left, open));
+            insertion = Ops::max(Ops::subs(insertion, extend), Ops::subs(above, open));
+            __m128i score = Ops::adds(diagonal, _mm_loadu_si128((const __m128i*) (base_profile + i * Ops::lanes)));
+            score = Ops::max(Ops::max(score, zero), Ops::max(deletion, insertion));
+            _mm_storeu_si128(score_cell, score);
+            _mm_storeu_si128(deletion_cell, deletion);
+            max_score = Ops::max(max_score, score);
+            diagonal = left;
+            above = score;
+        }
+    }
+    _mm_storeu_si128((__m128i*) best, max_score);
+}
+
+// the same with 256-bit vectors
+template <class IntType>
+__attribute__((target("avx2")))
+static void fill_node_avx2(const IntType* profile, const int8_t* node_codes, int64_t node_length,
+                           int64_t rows, IntType* scores, IntType* deletions, IntType* best,
+                           int8_t gap_open, int8_t gap_extend) {
+    typedef Avx2Ops<IntType> Ops;
+    __m256i zero = _mm256_setzero_si256();
+    __m256i neg_inf = Ops::set1(numeric_limits<IntType>::min());
+    __m256i open = Ops::set1(gap_open);
+    __m256i extend = Ops::set1(gap_extend);
+    __m256i max_score = _mm256_loadu_si256((const __m256i*) best);
+    for (int64_t j = 0; j < node_length; j++) {
+        const IntType* base_profile = profile + node_codes[j] * rows * Ops::lanes;
+        __m256i diagonal = zero;
+        __m256i above = zero;
+        __m256i insertion = neg_inf;
+        for (int64_t i = 0; i < rows; i++) {
+            __m256i* score_cell = (__m256i*) (scores + i * Ops::lanes);
+            __m256i* deletion_cell = (__m256i*) (deletions + i * Ops::lanes);
+            __m256i left = _mm256_loadu_si256(score_cell);
+            __m256i deletion = Ops::max(Ops::subs(_mm256_loadu_si256(deletion_cell), extend), Ops::subs(left, open));
+            insertion = Ops::max(Ops::subs(insertion, extend), Ops::subs(above, open));
+            __m256i score = Ops::adds(diagonal, _mm256_loadu_si256((const __m256i*) (base_profile + i * Ops::lanes)));
+            score = Ops::max(Ops::max(score, zero), Ops::max(deletion, insertion));
+            _mm256_storeu_si256(score_cell, score);
+            _mm256_storeu_si256(deletion_cell, deletion);
+            max_score = Ops::max(max_score, score);
+            diagonal = left;
+            above = score;
+        }
+    }
+    _mm256_storeu_si256((__m256i*) best, max_score);
+}
+
+// score the reads at the start of those left in order, lanes of them at a time, against the nodes of
+// a topologically sorted graph, returning how many of them were scored
+template <class IntType, int lanes>
+static size_t score_batch(const Graph& graph, const vector<vector<size_t>>& predecessors,
+                          const vector<vector<int8_t>>& node_codes, const vector<Alignment>& alignments,
+                          const vector<size_t>& order, size_t batch_begin, const Aligner& aligner,
+                          vector<int32_t>& read_scores,
+                          void (*fill_node)(const IntType*, const int8_t*, int64_t, int64_t, IntType*, IntType*,
+                                            IntType*, int8_t, int8_t)) {
+
+    IntType neg_inf = numeric_limits<IntType>::min();
+    size_t batch_size = min<size_t>(lanes, order.size() - batch_begin);
+    // the reads are longest first, so the first one sets the number of rows
+    int64_t rows = alignments[order[batch_begin]].sequence().size();
+
+    vector<IntType> profile(5 * rows * lanes, neg_inf);
+    for (size_t lane = 0; lane < batch_size; lane++) {
+        const string& read = alignments[order[batch_begin + lane]].sequence();
+        for (int64_t c = 0; c < 5; c++) {
+            for (int64_t i = 0; i < (int64_t) read.size(); i++) {
+                profile[(c * rows + i) * lanes + lane] = aligner.score_matrix[5 * c + aligner.nt_table[read[i]]];
+            }
+        }
+    }
+
+    // the last column of each node, which the nodes after it start from
+    vector<vector<IntType>> last_scores(graph.node_size());
+    vector<vector<IntType>> last_deletions(graph.node_size());
+    vector<IntType> best(lanes, 0);
+    for (size_t n = 0; n < graph.node_size(); n++) {
+        // start from the best of the columns coming into the node, or from nothing at a head
+        vector<IntType>& scores = last_scores[n];
+        vector<IntType>& deletions = last_deletions[n];
+        scores.assign(rows * lanes, 0);
+        deletions.assign(rows * lanes, neg_inf);
+        for (size_t prev : predecessors[n]) {
+            for (int64_t k = 0; k < rows * lanes; k++) {
+                scores[k] = max(scores[k], last_scores[prev][k]);
+                deletions[k] = max(deletions[k], last_deletions[prev][k]);
+            }
+        }
+        fill_node(profile.data(), node_codes[n].data(), node_codes[n].size(), rows, scores.data(),
+                  deletions.data(), best.data(), aligner.gap_open, aligner.gap_extension);
+    }
+
+    for (size_t lane = 0; lane < batch_size; lane++) {
+        read_scores[order[batch_begin + lane]] = best[lane];
+    }
+    return batch_size;
+}
+
+vector<int32_t> PreparedGraph::score(const vector<Alignment>& alignments, Aligner& aligner) {
+
+    vector<int32_t> read_scores(alignments.size(), 0);
+
+    // the node sequences as gssw sees them, with any non-ATGCN characters as N
+    vector<vector<int8_t>> node_codes(dag.graph.node_size());
+    for (size_t n = 0; n < dag.graph.node_size(); n++) {
+        const string& sequence = dag.graph.node(n).sequence();
+        node_codes[n].resize(sequence.size());
+        for (size_t j = 0; j < sequence.size(); j++) {
+            char base = sequence[j];
+            if (base != 'A' && base != 'T' && base != 'G' && base != 'C') {
+                base = 'N';
+            }
+            node_codes[n][j] = aligner.nt_table[base];
+        }
+    }
+
+    // longest reads first, so that reads of similar lengths share batches
+    vector<size_t> order(alignments.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return alignments[a].sequence().size() > alignments[b].sequence().size();
+        });
+
+    // each batch uses the narrowest scores that its longest read can't overflow, so the short reads
+    // after a long one still get the most lanes, and a read too long for any of them is aligned alone
+    int64_t max_match = *max_element(aligner.score_matrix, aligner.score_matrix + 25);
+    bool avx2 = have_avx2();
+    size_t next = 0;
+    while (next < order.size()) {
+        int64_t max_score = max_match * alignments[order[next]].sequence().size();
+        if (max_score <= numeric_limits<int8_t>::max()) {
+            if (avx2) {
+                next += score_batch<int8_t, Avx2Ops<int8_t>::lanes>(dag.graph, predecessors, node_codes, alignments,
+                                                                    order, next, aligner, read_scores,
+                                                                    fill_node_avx2<int8_t>);
+            }
+            else {
+                next += score_batch<int8_t, Sse41Ops<int8_t>::lanes>(dag.graph, predecessors, node_codes, alignments,
+                                                                     order, next, aligner, read_scores,
+                                                                     fill_node_sse41<int8_t>);
+            }
+        }
+        else if (max_score <= numeric_limits<int16_t>::max()) {
+            if (avx2) {
+                next += score_batch<int16_t, Avx2Ops<int16_t>::lanes>(dag.graph, predecessors, node_codes, alignments,
+                                                                      order, next, aligner, read_scores,
+                                                                      fill_node_avx2<int16_t>);
+            }
+            else {
+                next += score_batch<int16_t, Sse41Ops<int16_t>::lanes>(dag.graph, predecessors, node_codes, alignments,
+                                                                       order, next, aligner, read_scores,
+                                                                       fill_node_sse41<int16_t>);
+            }
+        }
+        else {
+            read_scores[order[next]] = align(alignments[order[next]], aligner).score();
+            next++;
+        }
+    }
+
+    return read_scores;
+}
+
+}
@@ -0,0 +1,72 @@
+#ifndef VG_PREPARED_GRAPH_HPP
+#define VG_PREPARED_GRAPH_HPP
+// prepared_graph.hpp: a graph made ready once for aligning many reads to it
+//
+// VG::align joins the heads of the graph and sorts it (or unrolls its cycles
+// and inversions into a DAG first) every time it's called. a PreparedGraph does
+// that work once, on its own copy of the graph, and then aligns as many reads
+// as we like to the result, optionally spreading a batch of them over threads.
+//
+// it can also just score reads, which for short reads is much faster: instead
+// of vectorizing within the DP matrix of one read as gssw does, we give each
+// lane of the vectors to a different read and fill their matrices together.
+
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include "vg.hpp"
+#include "gssw_aligner.hpp"
+#include "alignment.hpp"
+
+namespace vg {
+
+using namespace std;
+
+class PreparedGraph {
+public:
+    // prepare a copy of the graph, which isn't modified. cycles and inversions
+    // are unrolled far enough for reads of up to max_read_length bases.
+    PreparedGraph(VG& graph, size_t max_read_length);
+
+    // align a read to the graph, as VG::align and VG::align_qual_adjusted do
+    //
+    // several threads can align to the same prepared graph at once, as long as
+    // each of them has an aligner of its own
+    Alignment align(const Alignment& alignment, Aligner& aligner);
+    Alignment align_qual_adjusted(const Alignment& alignment, QualAdjAligner& qual_adj_aligner);
+
+    // align a batch of reads, returning the alignments in the same order. with
+    // more than one aligner, the reads are split over that many threads and
+    // thread i uses aligners[i].
+    vector<Alignment> align(const vector<Alignment>& alignments, const vector<Aligner*>& aligners);
+    vector<Alignment> align_qual_adjusted(const vector<Alignment>& alignments,
+                                          const vector<QualAdjAligner*>& qual_adj_aligners);
+
+    // the score of each read's optimal local alignment to the graph, the same
+    // as align would give it, without working out the alignments. the reads
+    // are scored in batches of similar lengths, each with the narrowest
+    // scores its longest read can't overflow, and reads whose scores can
+    // overflow 16 bits are aligned one at a time.
+    vector<int32_t> score(const vector<Alignment>& alignments, Aligner& aligner);
+
+private:
+    // funnel for the alignment functions, exactly one of the aligners is given
+    Alignment align(const Alignment& alignment, Aligner* aligner, QualAdjAligner* qual_adj_aligner);
+
+    // the sorted DAG, with a root joined to its heads, that reads are aligned to
+    VG dag;
+    // whether the DAG had to be unrolled from the graph, in which case we must
+    // translate alignments back to the graph's nodes
+    bool unrolled;
+    // from DAG node to graph node and whether it is reversed
+    map<id_t, pair<id_t, bool>> translation;
+    // sequence lengths of the graph's nodes, for the translation
+    unordered_map<id_t, size_t> node_length;
+    // indexes of the nodes in the DAG with edges into each node, as gssw
+    // hooks them up (they all come before it)
+    vector<vector<size_t>> predecessors;
+};
+
+}
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef VG_SHARDED_CACHE_HPP
+#define VG_SHARDED_CACHE_HPP
+// sharded_cache.hpp: the shards of a cache that is shared by all the threads
+// of a mapping run
+//
+// the cache is split into shards by the hash of the key, each with its own
+// lock, so that threads looking up different keys rarely wait on each other.
+// each shard also counts the lookups that did and didn't find their key. a
+// cache keeps what it stores in a shard type derived from CacheShard, and
+// holds the shard's lock while it looks in the shard or changes it.
+
+#include <vector>
+#include <algorithm>
+#include <omp.h>
+
+namespace vg {
+
+using namespace std;
+
+struct CacheShard {
+    omp_lock_t lock;
+    size_t hits = 0;
+    size_t misses = 0;
+};
+
+template <typename Shard>
+class ShardedCache {
+public:
+
+    // split room for about capacity entries over the given number of shards
+    ShardedCache(size_t capacity, size_t shard_count);
+    ~ShardedCache(void);
+    // the shards own locks, so we can't be copied
+    ShardedCache(const ShardedCache& other) = delete;
+    ShardedCache& operator=(const ShardedCache& other) = delete;
+
+    // the shard holding keys with the given hash
+    Shard& shard_of(size_t hash);
+
+    // the number of entries each shard has room for, and in all
+    size_t shard_capacity(void) const;
+    size_t capacity(void) const;
+
+    // lookups that did and didn't find the key, so far, over all the shards
+    size_t hits(void);
+    size_t misses(void);
+
+    // so that caches can set up and tear down what they keep in each shard
+    typename vector<Shard>::iterator begin(void);
+    typename vector<Shard>::iterator end(void);
+
+private:
+
+    vector<Shard> shards;
+    size_t entries_per_shard;
+
+    // sum one of the counters over the shards
+    size_t total(size_t CacheShard::*counter);
+};
+
+template <typename Shard>
+ShardedCache<Shard>::ShardedCache(size_t capacity, size_t shard_count) {
+    shard_count = max((size_t) 1, min(shard_count, capacity));
+    entries_per_shard = max((size_t) 1, (capacity + shard_count - 1) / shard_count);
+    shards.resize(shard_count);
+    for (auto& shard : shards) {
+        omp_init_lock(&shard.lock);
+    }
+}
+
+template <typename Shard>
+ShardedCache<Shard>::~ShardedCache(void) {
+    for (auto& shard : shards) {
+        omp_destroy_lock(&shard.lock);
+    }
+}
+
+template <typename Shard>
+Shard& ShardedCache<Shard>::shard_of(size_t hash) {
+    return shards[hash % shards.size()];
+}
+
+template <typename Shard>
+size_t ShardedCache<Shard>::shard_capacity(void) const {
+    return entries_per_shard;
+}
+
+template <typename Shard>
+size_t ShardedCache<Shard>::capacity(void) const {
+    return shards.size() * entries_per_shard;
+}
+
+template <typename Shard>
+size_t ShardedCache<Shard>::total(size_t CacheShard::*counter) {
+    size_t sum = 0;
+    for (auto& shard : shards) {
+        omp_set_lock(&shard.lock);
+        sum += shard.*counter;
+        omp_unset_lock(&shard.lock);
+    }
+    return sum;
+}
+
+template <typename Shard>
+size_t ShardedCache<Shard>::hits(void) {
+    return total(&CacheShard::hits);
+}
+
+template <typename Shard>
+size_t ShardedCache<Shard>::misses(void) {
+    return total(&CacheShard::misses);
+}
+
+template <typename Shard>
+typename vector<Shard>::iterator ShardedCache<Shard>::begin(void) {
+    return shards.begin();
+}
+
+template <typename Shard>
+typename vector<Shard>::iterator ShardedCache<Shard>::end(void) {
+    return shards.end();
+}
+
+}
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef VG_SIMD_OPS_HPP
+#define VG_SIMD_OPS_HPP
+// simd_ops.hpp: saturating vector operations on 8- and 16-bit scores for the SIMD alignment
+// kernels, as 128-bit SSE4.1 vectors (which we always build with) and as 256-bit AVX2 vectors
+// (which are only used if have_avx2() says the CPU has them)
+
+#include <immintrin.h>
+#include <cstdint>
+
+namespace vg {
+
+// the vector operations for each width of score, as a 128-bit vector
+template <class IntType>
+struct Sse41Ops;
+
+template <>
+struct Sse41Ops<int8_t> {
+    static const int lanes = 16;
+    static inline __m128i set1(int8_t x) { return _mm_set1_epi8(x); }
+    static inline __m128i adds(__m128i a, __m128i b) { return _mm_adds_epi8(a, b); }
+    static inline __m128i subs(__m128i a, __m128i b) { return _mm_subs_epi8(a, b); }
+    static inline __m128i max(__m128i a, __m128i b) { return _mm_max_epi8(a, b); }
+    static inline __m128i set_first(__m128i x, int8_t first) { return _mm_insert_epi8(x, first, 0); }
+};
+
+template <>
+struct Sse41Ops<int16_t> {
+    static const int lanes = 8;
+    static inline __m128i set1(int16_t x) { return _mm_set1_epi16(x); }
+    static inline __m128i adds(__m128i a, __m128i b) { return _mm_adds_epi16(a, b); }
+    static inline __m128i subs(__m128i a, __m128i b) { return _mm_subs_epi16(a, b); }
+    static inline __m128i max(__m128i a, __m128i b) { return _mm_max_epi16(a, b); }
+    static inline __m128i set_first(__m128i x, int16_t first) { return _mm_insert_epi16(x, first, 0); }
+};
+
+// the same for 256-bit vectors
+template <class IntType>
+struct Avx2Ops;
+
+template <>
+struct Avx2Ops<int8_t> {
+    static const int lanes = 32;
+    __attribute__((target("avx2"))) static inline __m256i set1(int8_t x) { return _mm256_set1_epi8(x); }
+    __attribute__((target("avx2"))) static inline __m256i adds(__m256i a, __m256i b) { return _mm256_adds_epi8(a, b); }
+    __attribute__((target("avx2"))) static inline __m256i subs(__m256i a, __m256i b) { return _mm256_subs_epi8(a, b); }
+    __attribute__((target("avx2"))) static inline __m256i max(__m256i a, __m256i b) { return _mm256_max_epi8(a, b); }
+    __attribute__((target("avx2"))) static inline __m256i set_first(__m256i x, int8_t first) { return _mm256_insert_epi8(x, first, 0); }
+};
+
+template <>
+struct Avx2Ops<int16_t> {
+    static const int lanes = 16;
+    __attribute__((target("avx2"))) static inline __m256i set1(int16_t x) { return _mm256_set1_epi16(x); }
+    __attribute__((target("avx2"))) static inline __m256i adds(__m256i a, __m256i b) { return _mm256_adds_epi16(a, b); }
+    __attribute__((target("avx2"))) static inline __m256i subs(__m256i a, __m256i b) { return _mm256_subs_epi16(a, b); }
+    __attribute__((target("avx2"))) static inline __m256i max(__m256i a, __m256i b) { return _mm256_max_epi16(a, b); }
+    __attribute__((target("avx2"))) static inline __m256i set_first(__m256i x, int16_t first) { return _mm256_insert_epi16(x, first, 0); }
+};
+
+inline bool have_avx2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+
+}
+
+#endif
@@ -4,36 +4,150 @@
 // from http://www.mail-archive.com/protobuf@googlegroups.com/msg03417.html
 
 #include <cassert>
+#include <cstring>
 #include <iostream>
 #include <fstream>
 #include <functional>
 #include <vector>
 #include <list>
+#include <map>
+#include <omp.h>
+#include <zlib.h>
 #include "google/protobuf/stubs/common.h"
 #include "google/protobuf/io/zero_copy_stream.h"
 #include "google/protobuf/io/zero_copy_stream_impl.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
 #include "google/protobuf/io/gzip_stream.h"
 #include "google/protobuf/io/coded_stream.h"
 
 namespace stream {
 
-// write objects
-// count should be equal to the number of objects to write
+// each chunk of objects is written as its own gzip member (a "block"), in the
+// manner of BGZF. the gzip header carries an extra subfield 'V' 'G' holding the
+// total compressed size of the block, so readers can step from block to block
+// and hand them to different threads for inflation without decompressing
+// anything. plain gzip readers see an ordinary multi-member gzip file.
+// as each block counts only its own objects, a writer that knows how many
+// objects the whole stream will hold can start it with an empty block whose
+// header has a second subfield 'V' 'N' holding that total, so readers can size
+// things for it up front.
+
+// bytes of the gzip header up to and including our size field
+const size_t BLOCK_HEADER_SIZE = 24;
+// offset of the 64-bit little-endian block size within the header
+const size_t BLOCK_SIZE_OFFSET = 16;
+// and of a block that announces the total, up to and including the total
+const size_t TOTAL_HEADER_SIZE = 36;
+const size_t TOTAL_OFFSET = 28;
+
+// read a 64-bit little-endian number from a header
+inline uint64_t header_field(const char* h, size_t offset) {
+    const unsigned char* u = (const unsigned char*) h + offset;
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; --i) {
+        value = (value << 8) | u[i];
+    }
+    return value;
+}
+
+// the total size of the block, given its header
+inline uint64_t block_size(const char* h) {
+    return header_field(h, BLOCK_SIZE_OFFSET);
+}
+
+// is this the header of a block we wrote?
+inline bool is_block_header(const char* h, size_t len) {
+    const unsigned char* u = (const unsigned char*) h;
+    return len >= BLOCK_HEADER_SIZE
+        && u[0] == 31 && u[1] == 139 && u[2] == 8 && (u[3] & 4) // gzip, deflate, FEXTRA
+        && u[12] == 'V' && u[13] == 'G' && u[14] == 8 && u[15] == 0
+        && block_size(h) >= BLOCK_HEADER_SIZE;
+}
+
+// does this header announce the total number of objects in the stream?
+inline bool is_total_header(const char* h, size_t len, uint64_t& total) {
+    const unsigned char* u = (const unsigned char*) h;
+    if (len < TOTAL_HEADER_SIZE || !is_block_header(h, len)
+        || u[10] != 24 || u[11] != 0 // both subfields
+        || u[24] != 'V' || u[25] != 'N' || u[26] != 8 || u[27] != 0) {
+        return false;
+    }
+    total = header_field(h, TOTAL_OFFSET);
+    return true;
+}
+
+// compress data into a single block, announcing the total number of objects
+// in the stream in its header if total isn't 0
+inline std::string compress_block(const std::string& data, uint64_t total = 0) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        std::cerr << "[stream] error: could not initialize zlib" << std::endl;
+        exit(1);
+    }
+    // subfield 'V' 'G' of length 8, filled in with the block size once we know
+    // it, and perhaps 'V' 'N' of length 8 with the total
+    unsigned char extra[24] = { 'V', 'G', 8, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                'V', 'N', 8, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+    for (int i = 0; i < 8; ++i) {
+        extra[16 + i] = (unsigned char) ((total >> (8 * i)) & 0xff);
+    }
+    gz_header header;
+    memset(&header, 0, sizeof(header));
+    header.extra = extra;
+    header.extra_len = total ? 24 : 12;
+    header.os = 255; // unknown
+    deflateSetHeader(&zs, &header);
+
+    std::string block;
+    block.resize(deflateBound(&zs, data.size()));
+    zs.next_in = (Bytef*) data.data();
+    zs.avail_in = data.size();
+    zs.next_out = (Bytef*) &block[0];
+    zs.avail_out = block.size();
+    if (deflate(&zs, Z_FINISH) != Z_STREAM_END) {
+        std::cerr << "[stream] error: could not compress block" << std::endl;
+        exit(1);
+    }
+    block.resize(zs.total_out);
+    deflateEnd(&zs);
+
+    uint64_t size = block.size();
+    for (int i = 0; i < 8; ++i) {
+        block[BLOCK_SIZE_OFFSET + i] = (char) ((size >> (8 * i)) & 0xff);
+    }
+    return block;
+}
+
+// read the next block from the stream into block
+// returns false at the end of the stream, if the input isn't blocked, or if the
+// block is cut short; block then holds whatever was read, so it's empty only at
+// the end of the stream
+inline bool read_block(std::istream& in, std::string& block) {
+    block.resize(BLOCK_HEADER_SIZE);
+    in.read(&block[0], BLOCK_HEADER_SIZE);
+    block.resize(in.gcount());
+    if (!is_block_header(block.data(), block.size())) {
+        return false;
+    }
+    uint64_t size = block_size(block.data());
+    block.resize(size);
+    in.read(&block[BLOCK_HEADER_SIZE], size - BLOCK_HEADER_SIZE);
+    block.resize(BLOCK_HEADER_SIZE + in.gcount());
+    return block.size() == size;
+}
+
+// serialize objects into the uncompressed payload of a chunk
 // count is written before the objects, but if it is 0, it is not written
-// if not all objects are written, return false, otherwise true
+// returns the number of objects serialized
 template <typename T>
-bool write(std::ostream& out, uint64_t count, const std::function<T(uint64_t)>& lambda) {
-
-    ::google::protobuf::io::ZeroCopyOutputStream *raw_out =
-          new ::google::protobuf::io::OstreamOutputStream(&out);
-    ::google::protobuf::io::GzipOutputStream *gzip_out =
-          new ::google::protobuf::io::GzipOutputStream(raw_out);
-    ::google::protobuf::io::CodedOutputStream *coded_out =
-          new ::google::protobuf::io::CodedOutputStream(gzip_out);
+uint64_t serialize_chunk(std::string& data, uint64_t count, const std::function<T(uint64_t)>& lambda) {
+    ::google::protobuf::io::StringOutputStream string_out(&data);
+    ::google::protobuf::io::CodedOutputStream coded_out(&string_out);
 
     // prefix the chunk with the number of objects, if any objects are to be written
     if(count > 0) {
-        coded_out->WriteVarint64(count);
+        coded_out.WriteVarint64(count);
     }
 
     std::string s;
@@ -41,17 +155,33 @@ bool write(std::ostream& out, uint64_t count, const std::function<T(uint64_t)>&
     for (uint64_t n = 0; n < count; ++n, ++written) {
         lambda(n).SerializeToString(&s);
         // and prefix each object with its size
-        coded_out->WriteVarint32(s.size());
-        coded_out->WriteRaw(s.data(), s.size());
+        coded_out.WriteVarint32(s.size());
+        coded_out.WriteRaw(s.data(), s.size());
     }
+    return written;
+}
+
+// write objects
+// count should be equal to the number of objects to write
+// count is written before the objects, but if it is 0, it is not written
+// if not all objects are written, return false, otherwise true
+template <typename T>
+bool write(std::ostream& out, uint64_t count, const std::function<T(uint64_t)>& lambda) {
 
-    delete coded_out;
-    delete gzip_out;
-    delete raw_out;
+    std::string data;
+    uint64_t written = serialize_chunk(data, count, lambda);
+    std::string block = compress_block(data);
+    out.write(block.data(), block.size());
 
     return !count || written == count;
 }
 
+// start a stream by announcing how many objects it will hold in all
+inline void write_total(std::ostream& out, uint64_t total) {
+    std::string block = compress_block(std::string(), total);
+    out.write(block.data(), block.size());
+}
+
 template <typename T>
 bool write_buffered(std::ostream& out, std::vector<T>& buffer, uint64_t buffer_limit) {
     bool wrote = false;
@@ -64,17 +194,170 @@ bool write_buffered(std::ostream& out, std::vector<T>& buffer, uint64_t buffer_l
     return wrote;
 }
 
-// deserialize the input stream into the objects
+// collects objects from all the threads of a parallel loop and writes them out
+// in blocks. each thread serializes and compresses its own blocks, and the
+// threads only synchronize to hand finished blocks to the stream, so the
+// compression is spread over all threads rather than done under a lock.
+// if ordered, each call to write carries the number of the input that produced
+// the objects (every number from 0 up must be written exactly once, possibly
+// with no objects), and the output follows the input order regardless of which
+// thread finished first. the destructor flushes everything that's left.
+template <typename T>
+class ParallelWriter {
+public:
+
+    ParallelWriter(std::ostream& out, uint64_t buffer_size = 100, bool ordered = false)
+        : out(out), buffer_size(buffer_size), ordered(ordered),
+          thread_buffers(omp_get_max_threads()) { }
+
+    ~ParallelWriter() {
+        flush();
+    }
+
+    // announce how many objects the stream will hold; must come before any
+    // of them are written
+    void write_total(uint64_t total) {
+#pragma omp critical (stream_out)
+        stream::write_total(out, total);
+    }
+
+    // write objects from an unordered source, taking them from the vector
+    void write(std::vector<T>& objects) {
+        if (ordered) {
+            std::cerr << "[stream] error: ParallelWriter in ordered mode needs input numbers" << std::endl;
+            exit(1);
+        }
+        auto& buffer = thread_buffers[omp_get_thread_num()];
+        for (auto& object : objects) {
+            buffer.emplace_back(std::move(object));
+        }
+        objects.clear();
+        if (buffer.size() >= buffer_size) {
+            std::vector<T> batch;
+            batch.swap(buffer);
+            write_block(compress_batch(batch));
+        }
+    }
+
+    // write the objects produced by input number n, taking them from the vector
+    void write(uint64_t n, std::vector<T>& objects) {
+        if (!ordered) {
+            write(objects);
+            return;
+        }
+        std::vector<T> batch;
+        uint64_t block_number = 0;
+#pragma omp critical (stream_writer_pending)
+        {
+            pending[n].swap(objects);
+            // move everything that's now in order into the output buffer
+            auto it = pending.begin();
+            while (it != pending.end() && it->first == next_input) {
+                for (auto& object : it->second) {
+                    ordered_buffer.emplace_back(std::move(object));
+                }
+                it = pending.erase(it);
+                ++next_input;
+            }
+            if (ordered_buffer.size() >= buffer_size) {
+                batch.swap(ordered_buffer);
+                block_number = next_block++;
+            }
+        }
+        objects.clear();
+        if (!batch.empty()) {
+            write_block(block_number, compress_batch(batch));
+        }
+    }
+
+    // write out everything buffered; must not be called concurrently with write
+    void flush() {
+        for (auto& buffer : thread_buffers) {
+            if (!buffer.empty()) {
+                write_block(compress_batch(buffer));
+                buffer.clear();
+            }
+        }
+        if (ordered) {
+            // anything still pending is missing an earlier input; write it anyway
+            for (auto& p : pending) {
+                for (auto& object : p.second) {
+                    ordered_buffer.emplace_back(std::move(object));
+                }
+            }
+            pending.clear();
+            if (!ordered_buffer.empty()) {
+                write_block(next_block++, compress_batch(ordered_buffer));
+                ordered_buffer.clear();
+            }
+        }
+        out.flush();
+    }
+
+private:
+
+    std::ostream& out;
+    uint64_t buffer_size;
+    bool ordered;
+
+    // per-thread buffers for unordered output
+    std::vector<std::vector<T> > thread_buffers;
+
+    // ordered output: objects waiting on earlier inputs, by input number
+    std::map<uint64_t, std::vector<T> > pending;
+    uint64_t next_input = 0;
+    // objects in order, not yet in a block
+    std::vector<T> ordered_buffer;
+    // compressed blocks waiting on earlier blocks, by block number
+    std::map<uint64_t, std::string> blocks;
+    uint64_t next_block = 0;
+    uint64_t next_block_to_write = 0;
+
+    std::string compress_batch(const std::vector<T>& batch) {
+        std::string data;
+        {
+            ::google::protobuf::io::StringOutputStream string_out(&data);
+            ::google::protobuf::io::CodedOutputStream coded_out(&string_out);
+            // same framing as serialize_chunk, without copying the objects
+            coded_out.WriteVarint64(batch.size());
+            std::string s;
+            for (auto& object : batch) {
+                object.SerializeToString(&s);
+                coded_out.WriteVarint32(s.size());
+                coded_out.WriteRaw(s.data(), s.size());
+            }
+        }
+        return compress_block(data);
+    }
+
+    void write_block(const std::string& block) {
+#pragma omp critical (stream_out)
+        out.write(block.data(), block.size());
+    }
+
+    void write_block(uint64_t block_number, std::string&& block) {
+#pragma omp critical (stream_out)
+        {
+            blocks[block_number] = std::move(block);
+            auto it = blocks.begin();
+            while (it != blocks.end() && it->first == next_block_to_write) {
+                out.write(it->second.data(), it->second.size());
+                it = blocks.erase(it);
+                ++next_block_to_write;
+            }
+        }
+    }
+};
+
+// deserialize the (gzipped) input stream into the objects
 // skips over groups of objects with count 0
 // takes a callback function to be called on the objects, and another to be called per object group.
 
 template <typename T>
-void for_each(std::istream& in,
-              const std::function<void(T&)>& lambda,
-              const std::function<void(uint64_t)>& handle_count) {
+void for_each_in_zero_copy_stream(::google::protobuf::io::ZeroCopyInputStream* raw_in,
+                                  const std::function<void(T&)>& lambda,
+                                  const std::function<void(uint64_t)>& handle_count) {
 
-    ::google::protobuf::io::ZeroCopyInputStream *raw_in =
-          new ::google::protobuf::io::IstreamInputStream(&in);
     ::google::protobuf::io::GzipInputStream *gzip_in =
           new ::google::protobuf::io::GzipInputStream(raw_in);
     ::google::protobuf::io::CodedInputStream *coded_in =
@@ -105,7 +388,14 @@ void for_each(std::istream& in,
 
     delete coded_in;
     delete gzip_in;
-    delete raw_in;
+}
+
+template <typename T>
+void for_each(std::istream& in,
+              const std::function<void(T&)>& lambda,
+              const std::function<void(uint64_t)>& handle_count) {
+    ::google::protobuf::io::IstreamInputStream raw_in(&in);
+    for_each_in_zero_copy_stream(&raw_in, lambda, handle_count);
 }
 
 template <typename T>
@@ -115,81 +405,251 @@ void for_each(std::istream& in,
     for_each(in, lambda, noop);
 }
 
+// as above, but if the stream starts by announcing how many objects it holds
+// (see write_total), handle_total is first called with that number
 template <typename T>
-void for_each_parallel(std::istream& in,
+void for_each(std::istream& in,
+              const std::function<void(T&)>& lambda,
+              const std::function<void(uint64_t)>& handle_count,
+              const std::function<void(uint64_t)>& handle_total) {
+    std::string header(TOTAL_HEADER_SIZE, '\0');
+    in.read(&header[0], TOTAL_HEADER_SIZE);
+    header.resize(in.gcount());
+    uint64_t total;
+    if (is_total_header(header.data(), header.size(), total)) {
+        handle_total(total);
+    }
+    // put back what we sniffed ahead of the rest of the stream
+    ::google::protobuf::io::ArrayInputStream header_in(header.data(), header.size());
+    ::google::protobuf::io::IstreamInputStream rest_in(&in);
+    ::google::protobuf::io::ZeroCopyInputStream* parts[2] = { &header_in, &rest_in };
+    ::google::protobuf::io::ConcatenatingInputStream raw_in(parts, 2);
+    for_each_in_zero_copy_stream(&raw_in, lambda, handle_count);
+}
+
+// deserialize the objects in a single block, as read by read_block
+template <typename T>
+void for_each_in_block(const std::string& block,
                        const std::function<void(T&)>& lambda,
                        const std::function<void(uint64_t)>& handle_count) {
+    ::google::protobuf::io::ArrayInputStream raw_in(block.data(), block.size());
+    for_each_in_zero_copy_stream(&raw_in, lambda, handle_count);
+}
 
-    ::google::protobuf::io::ZeroCopyInputStream *raw_in =
-          new ::google::protobuf::io::IstreamInputStream(&in);
-    ::google::protobuf::io::GzipInputStream *gzip_in =
-          new ::google::protobuf::io::GzipInputStream(raw_in);
-    ::google::protobuf::io::CodedInputStream *coded_in =
-          new ::google::protobuf::io::CodedInputStream(gzip_in);
+template <typename T>
+void for_each_in_block(const std::string& block,
+                       const std::function<void(T&)>& lambda) {
+    std::function<void(uint64_t)> noop = [](uint64_t) { };
+    for_each_in_block(block, lambda, noop);
+}
 
-    uint64_t count;
-    bool more_input = coded_in->ReadVarint64((::google::protobuf::uint64*) &count);
-    bool more_objects = false;
-    // this loop handles a chunked file with many pieces
-    // such as we might write in a multithreaded process
-    std::list<T> objects;
-    int64_t object_count = 0;
-    int64_t read_threshold = 5000;
-#pragma omp parallel shared(more_input, more_objects, objects, count, in, lambda, handle_count, raw_in, gzip_in, coded_in)
-    while (more_input || more_objects) {
-
-        bool has_object = false;
-        T object;
-#pragma omp critical (objects)
-        {
-            if (!objects.empty()) {
-                object = objects.back();
-                objects.pop_back();
-                --object_count;
-                has_object = true;
+// parallel deserialization
+// the calling thread only inflates the stream and splits it into serialized
+// messages, which are handed off in batches to OpenMP tasks that parse the
+// objects and run the callback on them. batches are moved, never copied, and
+// the number of batches in flight is bounded so that a slow callback can't make
+// us buffer the whole input in memory.
+// if the stream is made of blocks the calling thread doesn't even inflate: each
+// task gets a whole compressed block, so decompression runs on all threads.
+// handle_count is then called from the tasks, though never concurrently.
+// if pairs is set, batches always hold an even number of objects and lambda_pair
+// is called on consecutive objects (e.g. interleaved paired reads). as pairs
+// may straddle blocks, this always inflates on the calling thread. an empty
+// object is skipped along with its mate, so later pairs stay together, and an
+// odd object at the end has no mate and is skipped with a warning.
+// the lambdas also get the number of the object (or pair) in the stream, but
+// only if numbered is set, in which case we also inflate on the calling thread
+// as that's where the numbers are known.
+
+template <typename T>
+void for_each_parallel_impl(std::istream& in,
+                            const std::function<void(T&, uint64_t)>& lambda,
+                            const std::function<void(T&, T&, uint64_t)>& lambda_pair,
+                            const std::function<void(uint64_t)>& handle_count,
+                            bool pairs,
+                            bool numbered) {
+
+    // objects are handed to worker threads in batches of this many
+    const uint64_t batch_size = 256;
+    // and we hold at most this many batches (or blocks) in memory at once
+    const uint64_t max_batches_outstanding = 256;
+    // batches that have been read but not yet fully processed
+    uint64_t batches_outstanding = 0;
+
+    // parse and process one batch of serialized objects, the first of which
+    // is object number first in the stream
+    auto process_batch = [&lambda, &lambda_pair, pairs](std::vector<std::string>& batch, uint64_t first) {
+        if (pairs) {
+            T obj1, obj2;
+            for (uint64_t i = 0; i + 1 < batch.size(); i += 2) {
+                if (batch[i].empty() || batch[i+1].empty()) {
+                    continue;
+                }
+                obj1.Clear();
+                obj2.Clear();
+                obj1.ParseFromString(batch[i]);
+                obj2.ParseFromString(batch[i+1]);
+                lambda_pair(obj1, obj2, (first + i) / 2);
+            }
+        } else {
+            T object;
+            for (uint64_t i = 0; i < batch.size(); ++i) {
+                object.Clear();
+                object.ParseFromString(batch[i]);
+                lambda(object, first + i);
             }
         }
-        if (has_object) {
-            lambda(object);
-        }
+    };
 
-#pragma omp master
-        {
-            while (more_input && object_count < read_threshold) {
+    // inflate and process one compressed block
+    std::function<void(T&)> unnumbered = [&lambda](T& object) { lambda(object, 0); };
+    std::function<void(uint64_t)> locked_handle_count = [&handle_count](uint64_t count) {
+#pragma omp critical (stream_handle_count)
+        handle_count(count);
+    };
+    auto process_block = [&unnumbered, &locked_handle_count](std::string& block) {
+        for_each_in_block(block, unnumbered, locked_handle_count);
+    };
+
+    // sniff the start of the stream to see if it's made of blocks
+    std::string header(BLOCK_HEADER_SIZE, '\0');
+    in.read(&header[0], BLOCK_HEADER_SIZE);
+    header.resize(in.gcount());
+    bool blocked = !pairs && !numbered && is_block_header(header.data(), header.size());
+
+#pragma omp parallel shared(in, header, blocked, handle_count, batches_outstanding, process_batch, process_block)
+#pragma omp single
+    {
+        if (blocked) {
+            std::string* block = nullptr;
+            while (header.size() == BLOCK_HEADER_SIZE && is_block_header(header.data(), header.size())) {
+                block = new std::string(std::move(header));
+                uint64_t size = block_size(block->data());
+                block->resize(size);
+                in.read(&(*block)[BLOCK_HEADER_SIZE], size - BLOCK_HEADER_SIZE);
+                if ((uint64_t) in.gcount() != size - BLOCK_HEADER_SIZE) {
+                    std::cerr << "[stream] error: last block is truncated" << std::endl;
+                    exit(1);
+                }
+
+                uint64_t b;
+#pragma omp atomic capture
+                b = ++batches_outstanding;
+                if (b >= max_batches_outstanding) {
+                    process_block(*block);
+                    delete block;
+#pragma omp atomic update
+                    --batches_outstanding;
+                } else {
+#pragma omp task default(none) firstprivate(block) shared(batches_outstanding, process_block)
+                    {
+                        process_block(*block);
+                        delete block;
+#pragma omp atomic update
+                        --batches_outstanding;
+                    }
+                }
+                block = nullptr;
+
+                header.assign(BLOCK_HEADER_SIZE, '\0');
+                in.read(&header[0], BLOCK_HEADER_SIZE);
+                header.resize(in.gcount());
+            }
+            if (!header.empty()) {
+                std::cerr << "[stream] error: data after the last block is not a block" << std::endl;
+                exit(1);
+            }
+        } else {
+            // put back what we sniffed ahead of the rest of the stream
+            ::google::protobuf::io::ArrayInputStream header_in(header.data(), header.size());
+            ::google::protobuf::io::IstreamInputStream rest_in(&in);
+            ::google::protobuf::io::ZeroCopyInputStream* parts[2] = { &header_in, &rest_in };
+            ::google::protobuf::io::ConcatenatingInputStream raw_in(parts, 2);
+            ::google::protobuf::io::GzipInputStream *gzip_in =
+                  new ::google::protobuf::io::GzipInputStream(&raw_in);
+            ::google::protobuf::io::CodedInputStream *coded_in =
+                  new ::google::protobuf::io::CodedInputStream(gzip_in);
+
+            std::vector<std::string>* batch = nullptr;
+            // the number of the first object in the current batch
+            uint64_t first = 0;
+            uint64_t count;
+            // this loop handles a chunked file with many pieces
+            // such as we might write in a multithreaded process
+            while (coded_in->ReadVarint64((::google::protobuf::uint64*) &count)) {
                 handle_count(count);
-                std::string s;
                 for (uint64_t i = 0; i < count; ++i) {
                     uint32_t msgSize = 0;
                     // the messages are prefixed by their size
                     delete coded_in;
                     coded_in = new ::google::protobuf::io::CodedInputStream(gzip_in);
                     coded_in->ReadVarint32(&msgSize);
-                    if ((msgSize > 0) &&
-                        (coded_in->ReadString(&s, msgSize))) {
-                        T object;
-                        object.ParseFromString(s);
-#pragma omp critical (objects)
+                    std::string s;
+                    if (!(msgSize > 0 && coded_in->ReadString(&s, msgSize))) {
+                        if (!pairs) {
+                            continue;
+                        }
+                        // hold its place, so that we don't pair its mate
+                        // with the next object
+                        s.clear();
+                    }
+                    if (batch == nullptr) {
+                        batch = new std::vector<std::string>();
+                        batch->reserve(batch_size);
+                    }
+                    batch->push_back(std::move(s));
+                    if (batch->size() < batch_size) {
+                        continue;
+                    }
+                    // the batch is full, hand it off
+                    uint64_t b;
+#pragma omp atomic capture
+                    b = ++batches_outstanding;
+                    if (b >= max_batches_outstanding) {
+                        // the workers are behind, so do this batch ourselves
+                        // rather than reading further ahead
+                        process_batch(*batch, first);
+                        delete batch;
+#pragma omp atomic update
+                        --batches_outstanding;
+                    } else {
+#pragma omp task default(none) firstprivate(batch, first) shared(batches_outstanding, process_batch)
                         {
-                            objects.push_front(object);
-                            ++object_count;
+                            process_batch(*batch, first);
+                            delete batch;
+#pragma omp atomic update
+                            --batches_outstanding;
                         }
                     }
+                    first += batch_size;
+                    batch = nullptr;
                 }
-                more_input = coded_in->ReadVarint64((::google::protobuf::uint64*) &count);
             }
-            
-            // TODO: Between when the master announces there is no more input,
-            // and when it says there are again more objects to process, the
-            // other threads can all quit out, leaving it alone to finish up.
-            
+
+            // the final partial batch
+            if (batch != nullptr) {
+                if (pairs && batch->size() % 2) {
+                    std::cerr << "[stream] warning: odd number of objects in an interleaved stream, "
+                              << "the last one has no mate and is skipped" << std::endl;
+                }
+                process_batch(*batch, first);
+                delete batch;
+            }
+
+            delete coded_in;
+            delete gzip_in;
         }
-#pragma omp critical (objects)
-        more_objects = (object_count > 0);
+#pragma omp taskwait
     }
+}
 
-    delete coded_in;
-    delete gzip_in;
-    delete raw_in;
+template <typename T>
+void for_each_parallel(std::istream& in,
+                       const std::function<void(T&)>& lambda,
+                       const std::function<void(uint64_t)>& handle_count) {
+    std::function<void(T&, uint64_t)> singles = [&lambda](T& object, uint64_t) { lambda(object); };
+    std::function<void(T&, T&, uint64_t)> no_pairs = [](T&, T&, uint64_t) { };
+    for_each_parallel_impl(in, singles, no_pairs, handle_count, false, false);
 }
 
 template <typename T>
@@ -199,6 +659,36 @@ void for_each_parallel(std::istream& in,
     for_each_parallel(in, lambda, noop);
 }
 
+// as above, but the lambda also gets the number of each object in the stream
+// if need_numbers is false the numbers may all be 0, but blocked input can then
+// be inflated in parallel
+template <typename T>
+void for_each_parallel_numbered(std::istream& in,
+                                const std::function<void(T&, uint64_t)>& lambda,
+                                bool need_numbers = true) {
+    std::function<void(T&, T&, uint64_t)> no_pairs = [](T&, T&, uint64_t) { };
+    std::function<void(uint64_t)> noop = [](uint64_t) { };
+    for_each_parallel_impl(in, lambda, no_pairs, noop, false, need_numbers);
+}
+
+template <typename T>
+void for_each_interleaved_pair_parallel(std::istream& in,
+                                        const std::function<void(T&, T&)>& lambda) {
+    std::function<void(T&, uint64_t)> no_singles = [](T&, uint64_t) { };
+    std::function<void(T&, T&, uint64_t)> pairs = [&lambda](T& obj1, T& obj2, uint64_t) { lambda(obj1, obj2); };
+    std::function<void(uint64_t)> noop = [](uint64_t) { };
+    for_each_parallel_impl(in, no_singles, pairs, noop, true, false);
+}
+
+// as above, but the lambda also gets the number of each pair in the stream
+template <typename T>
+void for_each_interleaved_pair_parallel_numbered(std::istream& in,
+                                                 const std::function<void(T&, T&, uint64_t)>& lambda) {
+    std::function<void(T&, uint64_t)> no_singles = [](T&, uint64_t) { };
+    std::function<void(uint64_t)> noop = [](uint64_t) { };
+    for_each_parallel_impl(in, no_singles, lambda, noop, true, true);
+}
+
 }
 
 #endif
@@ -1156,6 +1156,219 @@ namespace vg {
             }
         }
         
+        TEST_CASE( "Banded global aligner produces correct alignments of long reads",
+                  "[alignment][banded][mapping]" ) {
+
+            SECTION( "Banded global aligner produces correct alignment when the score is too high for 8 bits" ) {
+
+                VG graph;
+
+                Aligner aligner = Aligner();
+
+                string left_seq;
+                string right_seq;
+                for (int i = 0; i < 15; i++) {
+                    left_seq += "GATTACACGT";
+                    right_seq += "TTGCAGCATC";
+                }
+
+                Node* n0 = graph.create_node(left_seq);
+                Node* n1 = graph.create_node("A");
+                Node* n2 = graph.create_node("G");
+                Node* n3 = graph.create_node(right_seq);
+
+                graph.create_edge(n0, n1);
+                graph.create_edge(n0, n2);
+                graph.create_edge(n1, n3);
+                graph.create_edge(n2, n3);
+
+                // a mismatch partway into the last node
+                string read = left_seq + "G" + right_seq;
+                read[left_seq.size() + 1 + 50] = 'A';
+                Alignment aln;
+                aln.set_sequence(read);
+
+                int band_width = 5;
+                BandedGlobalAligner banded_aligner = BandedGlobalAligner(aln,
+                                                                         graph.graph,
+                                                                         band_width);
+
+
+                banded_aligner.align(aligner.score_matrix, aligner.nt_table, aligner.gap_open,
+                                     aligner.gap_extension);
+
+                const Path& path = aln.path();
+
+                REQUIRE(aln.score() == 300 * aligner.match - aligner.mismatch);
+
+                // follows correct path
+                REQUIRE(path.mapping_size() == 3);
+                REQUIRE(path.mapping(0).position().node_id() == 1);
+                REQUIRE(path.mapping(1).position().node_id() == 3);
+                REQUIRE(path.mapping(2).position().node_id() == 4);
+
+                // has corrects edits
+                REQUIRE(path.mapping(0).edit_size() == 1);
+                REQUIRE(path.mapping(0).edit(0).from_length() == 150);
+                REQUIRE(path.mapping(0).edit(0).to_length() == 150);
+
+                REQUIRE(path.mapping(2).edit_size() == 3);
+                REQUIRE(path.mapping(2).edit(0).from_length() == 50);
+                REQUIRE(path.mapping(2).edit(0).to_length() == 50);
+                REQUIRE(path.mapping(2).edit(1).sequence() == "A");
+                REQUIRE(path.mapping(2).edit(2).from_length() == 99);
+                REQUIRE(path.mapping(2).edit(2).to_length() == 99);
+            }
+
+            SECTION( "Banded global aligner produces correct alignment when the score is too high for 16 bits" ) {
+
+                VG graph;
+
+                // a large match score, so that the read can score more than 16 bits can hold
+                Aligner aligner = Aligner(100, 4, 6, 1);
+
+                string left_seq;
+                string right_seq;
+                for (int i = 0; i < 20; i++) {
+                    left_seq += "GATTACACGT";
+                    right_seq += "TTGCAGCATC";
+                }
+
+                Node* n0 = graph.create_node(left_seq);
+                Node* n1 = graph.create_node("A");
+                Node* n2 = graph.create_node("G");
+                Node* n3 = graph.create_node(right_seq);
+
+                graph.create_edge(n0, n1);
+                graph.create_edge(n0, n2);
+                graph.create_edge(n1, n3);
+                graph.create_edge(n2, n3);
+
+                // a mismatch partway into the last node
+                string read = left_seq + "G" + right_seq;
+                read[left_seq.size() + 1 + 50] = 'A';
+                Alignment aln;
+                aln.set_sequence(read);
+
+                int band_width = 5;
+                BandedGlobalAligner banded_aligner = BandedGlobalAligner(aln,
+                                                                         graph.graph,
+                                                                         band_width);
+
+
+                banded_aligner.align(aligner.score_matrix, aligner.nt_table, aligner.gap_open,
+                                     aligner.gap_extension);
+
+                const Path& path = aln.path();
+
+                REQUIRE(400 * aligner.match - aligner.mismatch > numeric_limits<int16_t>::max());
+                REQUIRE(aln.score() == 400 * aligner.match - aligner.mismatch);
+
+                // follows correct path
+                REQUIRE(path.mapping_size() == 3);
+                REQUIRE(path.mapping(0).position().node_id() == 1);
+                REQUIRE(path.mapping(1).position().node_id() == 3);
+                REQUIRE(path.mapping(2).position().node_id() == 4);
+
+                // has corrects edits
+                REQUIRE(path.mapping(0).edit_size() == 1);
+                REQUIRE(path.mapping(0).edit(0).from_length() == 200);
+                REQUIRE(path.mapping(0).edit(0).to_length() == 200);
+
+                REQUIRE(path.mapping(1).edit_size() == 1);
+                REQUIRE(path.mapping(1).edit(0).from_length() == 1);
+                REQUIRE(path.mapping(1).edit(0).to_length() == 1);
+                REQUIRE(path.mapping(1).edit(0).sequence().empty());
+
+                REQUIRE(path.mapping(2).edit_size() == 3);
+                REQUIRE(path.mapping(2).edit(0).from_length() == 50);
+                REQUIRE(path.mapping(2).edit(0).to_length() == 50);
+                REQUIRE(path.mapping(2).edit(1).sequence() == "A");
+                REQUIRE(path.mapping(2).edit(2).from_length() == 149);
+                REQUIRE(path.mapping(2).edit(2).to_length() == 149);
+
+                // and scores the same without the traceback
+                Alignment scored_aln;
+                scored_aln.set_sequence(read);
+                BandedGlobalAligner scoring_aligner = BandedGlobalAligner(scored_aln, graph.graph, band_width);
+                scoring_aligner.score(aligner.score_matrix, aligner.nt_table, aligner.gap_open,
+                                      aligner.gap_extension);
+
+                REQUIRE(scored_aln.score() == aln.score());
+            }
+        }
+
+        TEST_CASE( "Banded global aligner gives the same results when it saves memory",
+                  "[alignment][banded][mapping]" ) {
+
+            VG graph;
+
+            Aligner aligner = Aligner();
+
+            Node* n0 = graph.create_node("ATGGCTAG");
+            Node* n1 = graph.create_node("C");
+            Node* n2 = graph.create_node("GA");
+            Node* n3 = graph.create_node("TTGACCTAG");
+            Node* n4 = graph.create_node("A");
+            Node* n5 = graph.create_node("T");
+            Node* n6 = graph.create_node("CCGATA");
+
+            graph.create_edge(n0, n1);
+            graph.create_edge(n0, n2);
+            graph.create_edge(n1, n3);
+            graph.create_edge(n2, n3);
+            graph.create_edge(n3, n4);
+            graph.create_edge(n3, n5);
+            graph.create_edge(n4, n6);
+            graph.create_edge(n5, n6);
+
+            string read = string("ATGGCTAGGTTGCCCTAGACCGAAA");
+
+            int band_width = 3;
+            int max_multi_alns = 2;
+
+            Alignment aln;
+            aln.set_sequence(read);
+            vector<Alignment> multi_alns;
+            BandedGlobalAligner banded_aligner = BandedGlobalAligner(aln, graph.graph, multi_alns,
+                                                                     max_multi_alns, band_width);
+            banded_aligner.align(aligner.score_matrix, aligner.nt_table, aligner.gap_open,
+                                 aligner.gap_extension);
+
+            SECTION( "Banded global aligner produces the same alignments when it recomputes the bands for the traceback" ) {
+
+                Alignment recomputed_aln;
+                recomputed_aln.set_sequence(read);
+                vector<Alignment> recomputed_multi_alns;
+                BandedGlobalAligner recomputing_aligner = BandedGlobalAligner(recomputed_aln, graph.graph,
+                                                                              recomputed_multi_alns,
+                                                                              max_multi_alns, band_width);
+                recomputing_aligner.set_max_band_bytes(0);
+                recomputing_aligner.align(aligner.score_matrix, aligner.nt_table, aligner.gap_open,
+                                          aligner.gap_extension);
+
+                REQUIRE(recomputed_aln.score() == aln.score());
+                REQUIRE(hash_alignment(recomputed_aln) == hash_alignment(aln));
+                REQUIRE(recomputed_multi_alns.size() == multi_alns.size());
+                for (size_t i = 0; i < multi_alns.size(); i++) {
+                    REQUIRE(recomputed_multi_alns[i].score() == multi_alns[i].score());
+                    REQUIRE(hash_alignment(recomputed_multi_alns[i]) == hash_alignment(multi_alns[i]));
+                }
+            }
+
+            SECTION( "Banded global aligner produces the optimal score without a traceback" ) {
+
+                Alignment scored_aln;
+                scored_aln.set_sequence(read);
+                BandedGlobalAligner scoring_aligner = BandedGlobalAligner(scored_aln, graph.graph, band_width);
+                scoring_aligner.score(aligner.score_matrix, aligner.nt_table, aligner.gap_open,
+                                      aligner.gap_extension);
+
+                REQUIRE(scored_aln.score() == aln.score());
+                REQUIRE(scored_aln.path().mapping_size() == 0);
+            }
+        }
+
         TEST_CASE( "Banded global aligner produces correct alignments with permissive banding option",
                   "[alignment][banded][mapping]" ) {
             
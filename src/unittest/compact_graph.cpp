@@ -0,0 +1,174 @@
+/**
+ * unittest/compact_graph.cpp: test cases for vg::CompactGraph
+ */
+
+#include "catch.hpp"
+#include "compact_graph.hpp"
+#include "vg.hpp"
+#include "stream.hpp"
+#include "json2pb.h"
+
+namespace vg {
+namespace unittest {
+
+using namespace std;
+
+TEST_CASE("CompactGraph answers the same as VG", "[compact][vg]") {
+
+    const string graph_json = R"(
+
+    {
+        "node": [
+            {"id": 10, "sequence": "GATTACA"},
+            {"id": 3, "sequence": "CNNNT"},
+            {"id": 7, "sequence": "ra"},
+            {"id": 12, "sequence": "TTT"}
+        ],
+        "edge": [
+            {"from": 10, "to": 3},
+            {"from": 10, "to": 7},
+            {"from": 3, "to": 12},
+            {"from": 12, "to": 7, "from_start": true, "to_end": true},
+            {"from": 7, "to": 12, "to_end": true}
+        ]
+    }
+
+    )";
+
+    Graph chunk;
+    json2pb(chunk, graph_json.c_str(), graph_json.size());
+    VG graph;
+    graph.merge(chunk);
+    CompactGraph compact(chunk);
+
+    SECTION("sizes match") {
+        REQUIRE(compact.node_count() == graph.node_count());
+        REQUIRE(compact.edge_count() == graph.edge_count());
+        REQUIRE(compact.total_length_of_nodes() == graph.total_length_of_nodes());
+    }
+
+    SECTION("sequences are stored exactly, including non-ACGT characters") {
+        graph.for_each_node([&](Node* node) {
+            REQUIRE(compact.has_node(node->id()));
+            REQUIRE(compact.node_sequence(node->id()) == node->sequence());
+            REQUIRE(compact.node_length(node->id()) == node->sequence().size());
+        });
+        REQUIRE(!compact.has_node(1));
+    }
+
+    SECTION("edges and traversals match") {
+        graph.for_each_node([&](Node* node) {
+            vector<pair<id_t, bool>> start, end;
+            compact.edges_start(node->id(), start);
+            compact.edges_end(node->id(), end);
+            auto expected_start = graph.edges_start(node);
+            auto expected_end = graph.edges_end(node);
+            sort(start.begin(), start.end());
+            sort(end.begin(), end.end());
+            sort(expected_start.begin(), expected_start.end());
+            sort(expected_end.begin(), expected_end.end());
+            REQUIRE(start == expected_start);
+            REQUIRE(end == expected_end);
+
+            for (bool backward : {false, true}) {
+                vector<pair<id_t, bool>> next, prev, expected_next, expected_prev;
+                compact.nodes_next(node->id(), backward, next);
+                compact.nodes_prev(node->id(), backward, prev);
+                for (auto& trav : graph.nodes_next(NodeTraversal(node, backward))) {
+                    expected_next.emplace_back(trav.node->id(), trav.backward);
+                }
+                for (auto& trav : graph.nodes_prev(NodeTraversal(node, backward))) {
+                    expected_prev.emplace_back(trav.node->id(), trav.backward);
+                }
+                sort(next.begin(), next.end());
+                sort(prev.begin(), prev.end());
+                sort(expected_next.begin(), expected_next.end());
+                sort(expected_prev.begin(), expected_prev.end());
+                REQUIRE(next == expected_next);
+                REQUIRE(prev == expected_prev);
+            }
+        });
+    }
+
+    SECTION("heads, tails and acyclicity match") {
+        vector<id_t> heads, tails, expected_heads, expected_tails;
+        compact.head_nodes(heads);
+        compact.tail_nodes(tails);
+        for (auto* node : graph.head_nodes()) {
+            expected_heads.push_back(node->id());
+        }
+        for (auto* node : graph.tail_nodes()) {
+            expected_tails.push_back(node->id());
+        }
+        sort(expected_heads.begin(), expected_heads.end());
+        sort(expected_tails.begin(), expected_tails.end());
+        REQUIRE(heads == expected_heads);
+        REQUIRE(tails == expected_tails);
+        REQUIRE(compact.is_acyclic() == graph.is_acyclic());
+    }
+
+    SECTION("the DFS visits every oriented node once") {
+        set<pair<id_t, bool>> begun, ended;
+        compact.dfs([&](id_t id, bool backward) {
+                REQUIRE(begun.insert(make_pair(id, backward)).second);
+            },
+            [&](id_t id, bool backward) {
+                REQUIRE(ended.insert(make_pair(id, backward)).second);
+            },
+            [](void) { return false; });
+        REQUIRE(begun.size() == 2 * graph.node_count());
+        REQUIRE(ended == begun);
+    }
+
+    SECTION("loading from a stream gives the same graph") {
+        stringstream serialized;
+        graph.serialize_to_ostream(serialized);
+        CompactGraph loaded(serialized);
+        REQUIRE(loaded.node_count() == compact.node_count());
+        REQUIRE(loaded.edge_count() == compact.edge_count());
+        REQUIRE(loaded.node_sequence(3) == "CNNNT");
+        REQUIRE(loaded.node_sequence(7) == "ra");
+    }
+}
+
+TEST_CASE("CompactGraph detects cycles", "[compact][cycles]") {
+
+    const string graph_json = R"(
+
+    {
+        "node": [
+            {"id": 1, "sequence": "G"},
+            {"id": 2, "sequence": "A"},
+            {"id": 3, "sequence": "T"}
+        ],
+        "edge": [
+            {"from": 1, "to": 2},
+            {"from": 2, "to": 3},
+            {"from": 3, "to": 1}
+        ]
+    }
+
+    )";
+
+    Graph chunk;
+    json2pb(chunk, graph_json.c_str(), graph_json.size());
+
+    SECTION("a cycle through several nodes is found") {
+        REQUIRE(CompactGraph(chunk).is_acyclic() == false);
+    }
+
+    SECTION("a self loop is a cycle") {
+        chunk.mutable_edge(2)->set_from(3);
+        chunk.mutable_edge(2)->set_to(3);
+        chunk.mutable_edge(2)->set_to_end(true);
+        REQUIRE(CompactGraph(chunk).is_acyclic() == false);
+    }
+
+    SECTION("without the back edge the graph is acyclic") {
+        chunk.mutable_edge()->RemoveLast();
+        REQUIRE(CompactGraph(chunk).is_acyclic() == true);
+    }
+}
+
+}
+}
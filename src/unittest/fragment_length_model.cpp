@@ -0,0 +1,64 @@
+/**
+ * unittest/fragment_length_model.cpp: test cases for vg::FragmentLengthModel
+ */
+
+#include <sstream>
+#include <cmath>
+#include "catch.hpp"
+#include "fragment_length_model.hpp"
+
+namespace vg {
+namespace unittest {
+
+using namespace std;
+
+TEST_CASE("FragmentLengthModel estimates the moments of the lengths it sees", "[fragment]") {
+
+    FragmentLengthModel model(1000);
+    REQUIRE(model.count() == 0);
+    REQUIRE(model.mean() == 0);
+
+    for (int64_t length : {290, 300, 300, 310}) {
+        model.record(length);
+    }
+    // too long to count
+    model.record(5000);
+
+    REQUIRE(model.count() == 4);
+    REQUIRE(model.mean() == Approx(300));
+    REQUIRE(model.stdev() == Approx(sqrt(50.0)));
+
+    SECTION("A saved model loads back the same") {
+        stringstream saved;
+        model.save(saved);
+        FragmentLengthModel loaded(1000);
+        REQUIRE(loaded.load(saved));
+        REQUIRE(loaded.count() == 4);
+        REQUIRE(loaded.mean() == Approx(model.mean()));
+        REQUIRE(loaded.stdev() == Approx(model.stdev()));
+    }
+
+    SECTION("Lengths recorded by many threads are all counted") {
+#pragma omp parallel for
+        for (int i = 0; i < 10000; ++i) {
+            model.record(300);
+        }
+        REQUIRE(model.count() == 10004);
+        REQUIRE(model.mean() == Approx(300));
+    }
+
+    SECTION("Bins count lengths at their middles") {
+        FragmentLengthModel binned(1000, 10);
+        binned.record(300);
+        binned.record(309);
+        REQUIRE(binned.mean() == Approx(304.5));
+    }
+
+    SECTION("Garbage isn't loaded") {
+        stringstream garbage("three hundred\n");
+        REQUIRE(!model.load(garbage));
+    }
+}
+
+}
+}
@@ -0,0 +1,79 @@
+/**
+ * unittest/mapper.cpp: test cases for vg::Mapper
+ */
+
+#include "catch.hpp"
+#include "mapper.hpp"
+#include "json2pb.h"
+
+namespace vg {
+namespace unittest {
+
+using namespace std;
+
+TEST_CASE("Mapper::cached_subgraph gives the same subgraph from the cache as from the xg index", "[mapping][cache][xg]") {
+
+    const string graph_json = R"(
+    {
+        "node": [
+            {"id": 1, "sequence": "GATTACA"},
+            {"id": 2, "sequence": "C"},
+            {"id": 3, "sequence": "T"},
+            {"id": 4, "sequence": "GGACCTA"},
+            {"id": 5, "sequence": "TTAG"},
+            {"id": 6, "sequence": "CATCAT"}
+        ],
+        "edge": [
+            {"from": 1, "to": 2},
+            {"from": 1, "to": 3},
+            {"from": 2, "to": 4},
+            {"from": 3, "to": 4},
+            {"from": 4, "to": 5},
+            {"from": 5, "to": 6}
+        ],
+        "path": [
+            {"name": "ref", "mapping": [
+                {"position": {"node_id": 1}, "rank": 1},
+                {"position": {"node_id": 2}, "rank": 2},
+                {"position": {"node_id": 4}, "rank": 3},
+                {"position": {"node_id": 5}, "rank": 4},
+                {"position": {"node_id": 6}, "rank": 5}
+            ]}
+        ]
+    }
+    )";
+
+    Graph chunk;
+    json2pb(chunk, graph_json.c_str(), graph_json.size());
+    xg::XG xg_index(chunk);
+
+    Mapper mapper;
+    mapper.xindex = &xg_index;
+
+    vector<pair<id_t, id_t>> id_ranges { make_pair(2, 3), make_pair(5, 5) };
+    for (bool use_steps : {false, true}) {
+        for (bool add_paths : {false, true}) {
+            size_t hits = mapper.subgraph_cache_hits;
+            size_t misses = mapper.subgraph_cache_misses;
+
+            Graph expected;
+            for (auto& range : id_ranges) {
+                xg_index.get_id_range(range.first, range.second, expected);
+            }
+            xg_index.expand_context(expected, 1, use_steps, add_paths);
+
+            Graph fresh;
+            mapper.cached_subgraph(id_ranges, 1, use_steps, add_paths, fresh);
+            REQUIRE(mapper.subgraph_cache_misses == misses + 1);
+            REQUIRE(pb2json(fresh) == pb2json(expected));
+
+            Graph cached;
+            mapper.cached_subgraph(id_ranges, 1, use_steps, add_paths, cached);
+            REQUIRE(mapper.subgraph_cache_hits == hits + 1);
+            REQUIRE(pb2json(cached) == pb2json(expected));
+        }
+    }
+}
+
+}
+}
@@ -0,0 +1,122 @@
+/**
+ * unittest/mem_chainer.cpp: test cases for the colinear chaining of exact match hits
+ */
+
+#include <random>
+#include "catch.hpp"
+#include "mem_chainer.hpp"
+
+namespace vg {
+namespace unittest {
+
+using namespace std;
+
+ChainHit make_hit(size_t read_begin, size_t read_end, int64_t ref_begin, int64_t ref_group = 0) {
+    ChainHit hit;
+    hit.read_begin = read_begin;
+    hit.read_end = read_end;
+    hit.ref_begin = ref_begin;
+    hit.ref_group = ref_group;
+    return hit;
+}
+
+TEST_CASE("Colinear chaining puts hits together only when they advance together", "[chain][mapping]") {
+
+    SECTION("hits that advance together in the read and the reference make one chain") {
+        vector<ChainHit> hits{make_hit(20, 30, 120), make_hit(0, 10, 100), make_hit(40, 50, 140)};
+        auto chains = colinear_chains(hits, 100);
+
+        REQUIRE(chains.size() == 1);
+        // in read order
+        REQUIRE((chains[0].hits == vector<size_t>{1, 0, 2}));
+        REQUIRE(chains[0].score == 30);
+    }
+
+    SECTION("hits in opposite orders in the read and the reference aren't chained") {
+        vector<ChainHit> hits{make_hit(0, 10, 120), make_hit(20, 30, 100)};
+        auto chains = colinear_chains(hits, 100);
+
+        REQUIRE(chains.size() == 2);
+        REQUIRE(chains[0].hits.size() == 1);
+        REQUIRE(chains[1].hits.size() == 1);
+    }
+
+    SECTION("a gap between hits makes their chain score lower") {
+        vector<ChainHit> hits{make_hit(0, 10, 100), make_hit(20, 30, 125)};
+        auto chains = colinear_chains(hits, 100);
+
+        REQUIRE(chains.size() == 1);
+        REQUIRE(chains[0].hits.size() == 2);
+        REQUIRE(chains[0].score < 20);
+        REQUIRE(chains[0].score > 10);
+    }
+
+    SECTION("hits further apart than the max gap aren't chained") {
+        // colinear, but far apart in both the read and the reference
+        vector<ChainHit> far_in_reference{make_hit(0, 10, 100), make_hit(500, 510, 600)};
+        REQUIRE(colinear_chains(far_in_reference, 100).size() == 2);
+        REQUIRE(colinear_chains(far_in_reference, 1000).size() == 1);
+
+        // close in the reference, but the read and reference distances differ by too much
+        vector<ChainHit> different_distances{make_hit(0, 10, 100), make_hit(200, 210, 150)};
+        REQUIRE(colinear_chains(different_distances, 100).size() == 2);
+    }
+
+    SECTION("hits in different reference groups aren't chained") {
+        vector<ChainHit> hits{make_hit(0, 10, 100, 0), make_hit(20, 30, 120, 1), make_hit(40, 50, 140, 0)};
+        auto chains = colinear_chains(hits, 100);
+
+        REQUIRE(chains.size() == 2);
+        for (auto& chain : chains) {
+            for (auto i : chain.hits) {
+                REQUIRE(hits[i].ref_group == hits[chain.hits.front()].ref_group);
+            }
+        }
+        REQUIRE((chains[0].hits == vector<size_t>{0, 2}));
+    }
+
+    SECTION("there are no chains without hits") {
+        REQUIRE(colinear_chains(vector<ChainHit>(), 100).empty());
+    }
+}
+
+TEST_CASE("Colinear chaining puts every hit in exactly one chain", "[chain][mapping]") {
+
+    mt19937 rng(2718);
+    for (int trial = 0; trial < 100; trial++) {
+        vector<ChainHit> hits;
+        size_t hit_count = 1 + rng() % 60;
+        for (size_t i = 0; i < hit_count; i++) {
+            size_t read_begin = rng() % 200;
+            hits.push_back(make_hit(read_begin, read_begin + 1 + rng() % 30, rng() % 400, rng() % 3));
+        }
+        auto chains = colinear_chains(hits, 50, 10, 5);
+
+        vector<int> times_chained(hits.size(), 0);
+        for (size_t i = 0; i < chains.size(); i++) {
+            REQUIRE(!chains[i].hits.empty());
+            if (i > 0) {
+                // best first
+                REQUIRE(chains[i].score <= chains[i - 1].score);
+            }
+            for (size_t j = 0; j < chains[i].hits.size(); j++) {
+                size_t hit = chains[i].hits[j];
+                REQUIRE(hit < hits.size());
+                times_chained[hit]++;
+                if (j > 0) {
+                    // every step of a chain moves forward in the read and reference, in one group
+                    auto& prev = hits[chains[i].hits[j - 1]];
+                    REQUIRE(hits[hit].ref_group == prev.ref_group);
+                    REQUIRE(hits[hit].read_begin > prev.read_begin);
+                    REQUIRE(hits[hit].ref_begin > prev.ref_begin);
+                }
+            }
+        }
+        for (auto times : times_chained) {
+            REQUIRE(times == 1);
+        }
+    }
+}
+
+}
+}
@@ -0,0 +1,69 @@
+/**
+ * unittest/node_cache.cpp: test cases for vg::NodeCache
+ */
+
+#include "catch.hpp"
+#include "node_cache.hpp"
+#include "json2pb.h"
+
+namespace vg {
+namespace unittest {
+
+using namespace std;
+
+TEST_CASE("NodeCache answers the same as the xg index", "[cache][xg]") {
+
+    const string graph_json = R"(
+
+    {
+        "node": [
+            {"id": 1, "sequence": "GATTACA"},
+            {"id": 2, "sequence": "CNNT"},
+            {"id": 3, "sequence": "T"},
+            {"id": 4, "sequence": "GGAC"}
+        ],
+        "edge": [
+            {"from": 1, "to": 2},
+            {"from": 1, "to": 3},
+            {"from": 2, "to": 4},
+            {"from": 3, "to": 4, "to_end": true}
+        ]
+    }
+
+    )";
+
+    Graph graph;
+    json2pb(graph, graph_json.c_str(), graph_json.size());
+    xg::XG xg_index(graph);
+
+    // a cache too small to hold the graph makes sure we evict
+    for (size_t capacity : {1, 2, 100}) {
+        NodeCache cache(capacity, 2);
+        LRUCache<id_t, Node> lru_cache(100);
+
+        for (int round = 0; round < 2; ++round) {
+            for (id_t id = 1; id <= 4; ++id) {
+                string sequence = xg_index.node_sequence(id);
+                REQUIRE(cache.node_length(id, &xg_index) == sequence.size());
+                for (bool rev : {false, true}) {
+                    for (size_t off = 0; off < sequence.size(); ++off) {
+                        pos_t pos = make_pos_t(id, rev, off);
+                        REQUIRE(cache.pos_char(pos, &xg_index) == xg_cached_pos_char(pos, &xg_index, lru_cache));
+                        REQUIRE(cache.next_pos_chars(pos, &xg_index) == xg_cached_next_pos_chars(pos, &xg_index, lru_cache));
+                    }
+                }
+            }
+        }
+
+        REQUIRE(cache.capacity() >= capacity);
+        REQUIRE(cache.misses() >= 4);
+        if (capacity >= 4) {
+            // after the first time we see each node, it stays cached
+            REQUIRE(cache.misses() == 4);
+        }
+        REQUIRE(cache.hits() > 0);
+    }
+}
+
+}
+}
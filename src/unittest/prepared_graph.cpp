@@ -0,0 +1,117 @@
+/**
+ * unittest/prepared_graph.cpp: test cases for vg::PreparedGraph
+ */
+
+#include "catch.hpp"
+#include "prepared_graph.hpp"
+#include "json2pb.h"
+
+namespace vg {
+namespace unittest {
+
+using namespace std;
+
+TEST_CASE("PreparedGraph aligns reads the same as VG::align", "[alignment][prepared]") {
+
+    // one graph without cycles and one with, which has to be unrolled
+    const string dag_json = R"(
+    {
+        "node": [
+            {"id": 1, "sequence": "GATTACA"},
+            {"id": 2, "sequence": "C"},
+            {"id": 3, "sequence": "T"},
+            {"id": 4, "sequence": "GGACCTA"}
+        ],
+        "edge": [
+            {"from": 1, "to": 2},
+            {"from": 1, "to": 3},
+            {"from": 2, "to": 4},
+            {"from": 3, "to": 4}
+        ]
+    }
+    )";
+
+    const string cyclic_json = R"(
+    {
+        "node": [
+            {"id": 1, "sequence": "GATTACA"},
+            {"id": 2, "sequence": "CT"},
+            {"id": 3, "sequence": "GGACCTA"}
+        ],
+        "edge": [
+            {"from": 1, "to": 2},
+            {"from": 2, "to": 2},
+            {"from": 2, "to": 3}
+        ]
+    }
+    )";
+
+    // reads of the same length, so that VG::align unrolls as far as we do
+    vector<Alignment> reads(4);
+    reads[0].set_sequence("GATTACATGGACC");
+    reads[1].set_sequence("ATTACACGGACCT");
+    reads[2].set_sequence("ACACTCTGGACCT");
+    reads[3].set_sequence("TTACACTGCACCT");
+
+    for (const string* graph_json : {&dag_json, &cyclic_json}) {
+        Graph chunk;
+        json2pb(chunk, graph_json->c_str(), graph_json->size());
+        VG graph;
+        graph.merge(chunk);
+
+        Aligner aligner;
+        PreparedGraph prepared_graph(graph, reads.front().sequence().size());
+
+        // one read at a time
+        for (auto& read : reads) {
+            // VG::align changes the graph's order, so give it a copy
+            VG copy(graph);
+            Alignment expected = copy.align(read, aligner);
+            Alignment aligned = prepared_graph.align(read, aligner);
+
+            REQUIRE(aligned.score() == expected.score());
+            REQUIRE(hash_alignment(aligned) == hash_alignment(expected));
+        }
+
+        // in a batch over several threads
+        Aligner other_aligner;
+        vector<Alignment> aligned = prepared_graph.align(reads, vector<Aligner*>{&aligner, &other_aligner});
+
+        REQUIRE(aligned.size() == reads.size());
+        for (size_t i = 0; i < reads.size(); i++) {
+            VG copy(graph);
+            Alignment expected = copy.align(reads[i], aligner);
+
+            REQUIRE(aligned[i].score() == expected.score());
+            REQUIRE(hash_alignment(aligned[i]) == hash_alignment(expected));
+        }
+
+        // just the scores, of reads short enough for 8-bit scores
+        vector<int32_t> scores = prepared_graph.score(reads, aligner);
+
+        REQUIRE(scores.size() == reads.size());
+        for (size_t i = 0; i < reads.size(); i++) {
+            REQUIRE(scores[i] == prepared_graph.align(reads[i], aligner).score());
+        }
+
+        // and after a read too long for 8-bit scores, with enough short reads
+        // that they don't all fit in its batch
+        vector<Alignment> to_score;
+        to_score.emplace_back();
+        for (size_t i = 0; i < 20; i++) {
+            to_score.back().mutable_sequence()->append("GATTACA");
+        }
+        for (size_t i = 0; i < 10; i++) {
+            to_score.insert(to_score.end(), reads.begin(), reads.end());
+        }
+        scores = prepared_graph.score(to_score, aligner);
+
+        REQUIRE(scores.size() == to_score.size());
+        for (size_t i = 0; i < to_score.size(); i++) {
+            REQUIRE(scores[i] == prepared_graph.align(to_score[i], aligner).score());
+        }
+    }
+}
+
+}
+}
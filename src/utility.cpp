@@ -119,6 +119,16 @@ bool allATGC(const string& s) {
     return true;
 }
 
+bool allATGCN(const string& s) {
+    for (string::const_iterator c = s.begin(); c != s.end(); ++c) {
+        char b = *c;
+        if (b != 'A' && b != 'T' && b != 'G' && b != 'C' && b != 'N') {
+            return false;
+        }
+    }
+    return true;
+}
+
 string nonATGCNtoN(const string& s) {
     auto n = s;
     for (string::iterator c = n.begin(); c != n.end(); ++c) {
@@ -30,6 +30,7 @@ const std::string sha1sum(const std::string& data);
 const std::string sha1head(const std::string& data, size_t head);
 
 bool allATGC(const string& s);
+bool allATGCN(const string& s);
 string nonATGCNtoN(const string& s);
 double median(std::vector<int> &v);
 double stdev(const std::vector<double>& v);
@@ -15,20 +15,64 @@ VG::VG(istream& in, bool showp) {
     // set up uninitialized values
     init();
     show_progress = showp;
-    // and if we should show progress
-    function<void(uint64_t)> handle_count = [this](uint64_t count) {
-        create_progress("loading graph", count);
+    load_from_stream(in, numeric_limits<id_t>::min(), numeric_limits<id_t>::max());
+
+}
+
+// construct from the part of a stream of protobufs in an id range
+VG::VG(istream& in, id_t min_id, id_t max_id, bool showp) {
+
+    init();
+    show_progress = showp;
+    load_from_stream(in, min_id, max_id);
+
+}
+
+void VG::load_from_stream(istream& in, id_t min_id, id_t max_id) {
+
+    // the chunk counts come in ahead of the chunks, so once we have seen a
+    // chunk we can guess how big the graph will be and size the indexes for it
+    // rather than letting them grow (and rehash) over and over; when loading
+    // an id range we can't tell how much we'll keep, so we let them grow
+    bool whole_graph = min_id == numeric_limits<id_t>::min() && max_id == numeric_limits<id_t>::max();
+    // the number of chunks in the whole stream, if it tells us up front
+    uint64_t chunks_total = 0;
+    uint64_t chunks_expected = 0;
+    uint64_t chunks_loaded = 0;
+    size_t nodes_seen = 0;
+    size_t edges_seen = 0;
+    size_t nodes_sized_for = 0;
+    function<void(uint64_t)> handle_total = [&chunks_total](uint64_t total) {
+        chunks_total = total;
+    };
+    function<void(uint64_t)> handle_count = [this, &chunks_total, &chunks_expected](uint64_t count) {
+        if (chunks_expected == 0) {
+            create_progress("loading graph", chunks_total ? chunks_total : count);
+        }
+        chunks_expected += count;
     };
 
-    // the graph is read in chunks, which are attached to this graph
-    uint64_t i = 0;
-    function<void(Graph&)> lambda = [this, &i](Graph& g) {
-        update_progress(++i);
+    // the graph is read in chunks, which are moved into this graph
+    function<void(Graph&)> lambda = [&](Graph& g) {
+        update_progress(++chunks_loaded);
+        nodes_seen += g.node_size();
+        edges_seen += g.edge_size();
+        if (whole_graph) {
+            // a stream without a total may be made of blocks that announce
+            // their chunks a few at a time, so we only size up again when the
+            // estimate has doubled, which keeps the rehashing geometric
+            double scale = (double) max(chunks_total, chunks_expected) / chunks_loaded;
+            size_t nodes = nodes_seen * scale;
+            if (nodes_sized_for == 0 || nodes >= 2 * nodes_sized_for) {
+                reserve_indexes(nodes, edges_seen * scale);
+                nodes_sized_for = max(nodes, (size_t) 1);
+            }
+        }
         // We expect these to not overlap in nodes or edges, so complain if they do.
-        extend(g, true);
+        extend_by_moving(g, min_id, max_id);
     };
 
-    stream::for_each(in, lambda, handle_count);
+    stream::for_each(in, lambda, handle_count, handle_total);
 
     // Collate all the path mappings we got from all the different chunks. A
     // mapping from any chunk might fall anywhere in a path (because paths may
@@ -43,6 +87,17 @@ VG::VG(istream& in, bool showp) {
 
 }
 
+void VG::reserve_indexes(size_t nodes, size_t edges) {
+    graph.mutable_node()->Reserve(nodes);
+    graph.mutable_edge()->Reserve(edges);
+    node_by_id.resize(nodes);
+    node_index.resize(nodes);
+    edges_on_start.resize(nodes);
+    edges_on_end.resize(nodes);
+    edge_by_sides.resize(edges);
+    edge_index.resize(edges);
+}
+
 // construct from an arbitrary source of Graph protobuf messages
 VG::VG(function<bool(Graph&)>& get_next_graph, bool showp) {
     // set up uninitialized values
@@ -91,6 +146,8 @@ void VG::serialize_to_ostream(ostream& out, id_t chunk_size) {
     create_progress("saving graph", count);
     // partition the graph into a number of chunks (required by format)
     // constructing subgraphs and writing them to the stream
+    // this only reads from the graph and its indexes, so it's safe to run on
+    // many chunks at once
     function<Graph(uint64_t)> lambda =
         [this, chunk_size](uint64_t i) -> Graph {
         VG g;
@@ -102,6 +159,11 @@ void VG::serialize_to_ostream(ostream& out, id_t chunk_size) {
             // Grab the node and only the edges where it has the lower ID.
             // This prevents duplication of edges in the serialized output.
             nonoverlapping_node_context_without_paths(node, g);
+            // (get_node_mapping would insert an empty entry for a node with
+            // no mappings, which we can't do from many threads)
+            if (!paths.has_node_mapping(node)) {
+                continue;
+            }
             auto& mappings = paths.get_node_mapping(node);
             //cerr << "getting node mappings for " << node->id() << endl;
             for (auto m : mappings) {
@@ -130,11 +192,31 @@ void VG::serialize_to_ostream(ostream& out, id_t chunk_size) {
         // the nodes they cross are stored in graph.nodes
         g.paths.to_graph(g.graph);
 
-        update_progress(i);
         return g.graph;
     };
 
-    stream::write(out, count, lambda);
+    // chunks are built on all threads, and whichever thread completes a run
+    // of chunks_per_block consecutive chunks compresses them into a block; the
+    // writer puts the blocks back in chunk order
+    const uint64_t chunks_per_block = 16;
+    uint64_t completed = 0;
+    {
+        stream::ParallelWriter<Graph> writer(out, chunks_per_block, true);
+        // each block only counts its own chunks, so tell the loader how many
+        // there are in all
+        writer.write_total(count);
+#pragma omp parallel for schedule(dynamic, 1)
+        for (uint64_t i = 0; i < count; ++i) {
+            Graph built = lambda(i);
+            vector<Graph> chunk(1);
+            chunk.front().Swap(&built);
+            writer.write(i, chunk);
+            uint64_t done;
+#pragma omp atomic capture
+            done = ++completed;
+            update_progress(done);
+        }
+    }
 
     destroy_progress();
 }
@@ -1880,6 +1962,56 @@ void VG::extend(Graph& graph, bool warn_on_duplicates) {
     paths.append(graph);
 }
 
+void VG::extend_by_moving(Graph& chunk, id_t min_id, id_t max_id) {
+    auto in_range = [&](id_t id) {
+        return id >= min_id && id <= max_id;
+    };
+    for (size_t i = 0; i < chunk.node_size(); ++i) {
+        Node* n = chunk.mutable_node(i);
+        if (n->id() == 0) {
+            cerr << "[vg] warning: node ID 0 is not allowed. Skipping." << endl;
+        } else if (!in_range(n->id())) {
+            continue;
+        } else if (!has_node(n->id())) {
+            // take the node's sequence and name rather than copying them
+            Node* new_node = graph.add_node();
+            new_node->Swap(n);
+            node_by_id[new_node->id()] = new_node;
+            node_index[new_node] = graph.node_size()-1;
+        } else {
+            cerr << "[vg] warning: node ID " << n->id() << " appears multiple times. Skipping." << endl;
+        }
+    }
+    for (size_t i = 0; i < chunk.edge_size(); ++i) {
+        Edge* e = chunk.mutable_edge(i);
+        if (!in_range(e->from()) || !in_range(e->to())) {
+            // we only keep edges between nodes we keep
+            continue;
+        } else if (!has_edge(e)) {
+            Edge* new_edge = graph.add_edge();
+            new_edge->Swap(e);
+            index_edge_by_node_sides(new_edge);
+            edge_index[new_edge] = graph.edge_size()-1;
+        } else {
+            cerr << "[vg] warning: edge " << e->from() << (e->from_start() ? " start" : " end") << " <-> "
+                 << e->to() << (e->to_end() ? " end" : " start") << " appears multiple times. Skipping." << endl;
+        }
+    }
+    // Append the path mappings on the nodes we kept, but don't sort by rank
+    for (size_t i = 0; i < chunk.path_size(); ++i) {
+        const Path& p = chunk.path(i);
+        for (size_t j = 0; j < p.mapping_size(); ++j) {
+            const Mapping& m = p.mapping(j);
+            if (in_range(m.position().node_id())) {
+                paths.append_mapping(p.name(), m);
+            }
+        }
+        if (p.is_circular()) {
+            paths.make_circular(p.name());
+        }
+    }
+}
+
 // extend this graph by g, connecting the tails of this graph to the heads of the other
 // the ids of the second graph are modified for compact representation
 void VG::append(VG& g) {
@@ -2112,6 +2244,16 @@ void VG::vcf_records_to_alleles(vector<vcflib::Variant>& records,
     cerr << "Processing " << records.size() << " vcf records..." << endl;
 #endif
 
+    // Naming each record, decomposing it into alleles (which aligns each alt
+    // to the ref) and parsing its genotypes doesn't depend on any other
+    // record, and is most of the work, so we do that in parallel. Then we
+    // fold the results into the maps in record order, so the allele numbering
+    // is the same no matter how many threads we use.
+    vector<string> var_names(records.size());
+    vector<map<string, vector<vcflib::VariantAllele> > > record_alternates(records.size());
+    vector<map<int, vector<bool>>> record_alt_usages(records.size());
+
+#pragma omp parallel for schedule(dynamic, 16)
     for (int i = 0; i < records.size(); ++i) {
         vcflib::Variant& var = records.at(i);
 
@@ -2119,12 +2261,12 @@ void VG::vcf_records_to_alleles(vector<vcflib::Variant>& records,
         // unique, even if there are multiple variant records at the same
         // position in the VCF. Also, we don't necessarily have every variant in
         // the VCF in our records vector.
-        string var_name = get_or_make_variant_id(var);
+        var_names[i] = get_or_make_variant_id(var);
 
         // decompose to alts
         // This holds a map from alt or ref allele sequence to a series of VariantAlleles describing an alignment.
-        map<string, vector<vcflib::VariantAllele> > alternates
-            = (flat_input_vcf ? var.flatAlternates() : var.parsedAlternates());
+        map<string, vector<vcflib::VariantAllele> >& alternates = record_alternates[i];
+        alternates = (flat_input_vcf ? var.flatAlternates() : var.parsedAlternates());
 
         if(!alternates.count(var.ref)) {
             // Ref is missing, as can happen with flat construction.
@@ -2134,7 +2276,7 @@ void VG::vcf_records_to_alleles(vector<vcflib::Variant>& records,
 
         // This holds a map from alt index (0 for ref) to the phase sets
         // visiting it as a bool vector. No bit vector means no visits.
-        map<int, vector<bool>> alt_usages;
+        map<int, vector<bool>>& alt_usages = record_alt_usages[i];
 
         if(phase_visits != nullptr) {
 
@@ -2184,8 +2326,14 @@ void VG::vcf_records_to_alleles(vector<vcflib::Variant>& records,
                 alt_usages[alt2index][j * 2 + 1] = true;
             }
         }
+    }
 
-        for (auto& alleles : alternates) {
+    for (int i = 0; i < records.size(); ++i) {
+        vcflib::Variant& var = records.at(i);
+        string& var_name = var_names[i];
+        map<int, vector<bool>>& alt_usages = record_alt_usages[i];
+
+        for (auto& alleles : record_alternates[i]) {
 
             // We'll point this to a vector flagging all the phase visits to
             // this alt (which may be the ref alt), if we want to record those.
@@ -3608,18 +3756,6 @@ VG::VG(vcflib::VariantCallFile& variantCallFile,
 
         // store our construction plans
         deque<Plan*> construction;
-        // so we can check which graphs we can safely append
-        set<VG*> graph_completed;
-        // we add and remove from graph_completed, so track count for logging
-        int graphs_completed = 0;
-        int final_completed = -1; // hm
-        // the construction queue
-        list<VG*> graphq;
-        int graphq_size = 0; // for efficiency
-        // ^^^^ (we need to insert/remove things in the middle of the list,
-        // but we also need to be able to quickly determine its size)
-        // for tracking progress through the chromosome
-        map<VG*, unsigned long> graph_end;
 
         create_progress("planning construction", stop_pos-start_pos);
         // break into chunks
@@ -3698,7 +3834,7 @@ VG::VG(vcflib::VariantCallFile& variantCallFile,
 
             // we set the head graph to be this one, so we aren't obligated to copy the result into this object
             // make a construction plan
-            Plan* plan = new Plan(graphq.empty() && targets.size() == 1 ? this : new VG,
+            Plan* plan = new Plan(construction.empty() && targets.size() == 1 ? this : new VG,
                                   std::move(new_alleles),
                                   std::move(new_phase_visits),
                                   std::move(new_variant_alts),
@@ -3707,18 +3843,12 @@ VG::VG(vcflib::VariantCallFile& variantCallFile,
                                                            chunk_end - chunk_start),
                                   seq_name);
             chunk_start = chunk_end;
-#pragma omp critical (graphq)
-            {
-                graphq.push_back(plan->graph);
-                construction.push_back(plan);
-                if (show_progress) graph_end[plan->graph] = chunk_end;
-                update_progress(chunk_end);
-            }
+            construction.push_back(plan);
+            update_progress(chunk_end);
         }
 #ifdef debug
-        cerr << omp_get_thread_num() << ": graphq size " << graphq.size() << endl;
+        cerr << omp_get_thread_num() << ": " << construction.size() << " regions planned" << endl;
 #endif
-        graphq_size = graphq.size();
         destroy_progress();
 
         // this system is not entirely general
@@ -3726,55 +3856,17 @@ VG::VG(vcflib::VariantCallFile& variantCallFile,
         // then the inter-dependence of each region will make parallel construction in this way difficult
         // because the chunks will get too large
 
-        // use this function to merge graphs both during and after the construction iteration
-        auto merge_first_two_completed_graphs =
-            [this, start_pos, &graph_completed, &graphq, &graphq_size, &graph_end, &final_completed](void) {
-            // find the first two consecutive graphs which are completed
-            VG* first = NULL;
-            VG* second = NULL;
-//#pragma omp critical (cerr)
-//            cerr << omp_get_thread_num() << ": merging" << endl;
-#pragma omp critical (graphq)
-            {
-                auto itp = graphq.begin(); // previous
-                auto itn = itp; if (itp != graphq.end()) ++itn; // next
-                // scan the graphq to find consecutive entries that are both completed
-                while (itp != itn // there is > 1 entry
-                       && itn != graphq.end() // we aren't yet at the end
-                       && !(graph_completed.count(*itp) // the two we're looking at aren't completed
-                            && graph_completed.count(*itn))) {
-                    ++itp; ++itn;
-                }
-
-                if (itn != graphq.end()) {
-                    // we have two consecutive graphs to merge!
-                    first = *itp;
-                    second = *itn;
-                    // unset graph completed for both
-                    graph_completed.erase(first);
-                    graph_completed.erase(second);
-                    graphq.erase(itn);
-                    --graphq_size;
-                }
-            }
-
-            if (first && second) {
-                // combine graphs
-                first->append(*second);
-#pragma omp critical (graphq)
-                {
-                    if (final_completed != -1) update_progress(final_completed++);
-                    graph_completed.insert(first);
-                    graph_end.erase(second);
-                }
-                delete second;
-            }
-        };
-
         create_progress("constructing graph", construction.size());
 
-        // (in parallel) construct each component of the graph
-#pragma omp parallel for
+        // (in parallel) construct each component of the graph, noting its
+        // largest id and its heads and tails, which is all we need to know to
+        // stitch it to its neighbors
+        vector<VG*> region_graphs(construction.size());
+        vector<id_t> region_max_ids(construction.size());
+        vector<vector<id_t>> region_heads(construction.size());
+        vector<vector<id_t>> region_tails(construction.size());
+        int graphs_completed = 0;
+#pragma omp parallel for schedule(dynamic, 1)
         for (int i = 0; i < construction.size(); ++i) {
 
             int tid = omp_get_thread_num();
@@ -3799,46 +3891,88 @@ VG::VG(vcflib::VariantCallFile& variantCallFile,
                 plan->graph->dice_nodes(max_node_size);
             }
 
-#pragma omp critical (graphq)
-            {
-                update_progress(++graphs_completed);
-                graph_completed.insert(plan->graph);
+            VG* region = plan->graph;
+            region_graphs[i] = region;
+            region_max_ids[i] = region->max_node_id();
+            // The heads and tails are guaranteed to be forward-oriented.
+            for (Node* n : region->head_nodes()) {
+                region_heads[i].push_back(n->id());
+            }
+            for (Node* n : region->tail_nodes()) {
+                region_tails[i].push_back(n->id());
+            }
+
+            int completed;
+#pragma omp atomic capture
+            completed = ++graphs_completed;
+            update_progress(completed);
 #ifdef debug
 #pragma omp critical (cerr)
-                cerr << tid << ": " << "constructed graph " << plan->graph << endl;
+            cerr << tid << ": " << "constructed graph " << plan->graph << endl;
 #endif
-            }
             // clean up
             delete plan;
-
-            // concatenate chunks of the result graph together
-            merge_first_two_completed_graphs();
-
         }
         destroy_progress();
 
-        // merge remaining graphs
-        final_completed = 0;
-        create_progress("merging remaining graphs", graphq.size());
-#pragma omp parallel
-        {
-            bool more_to_merge = true;
-            while (more_to_merge) {
-                merge_first_two_completed_graphs();
-                usleep(10);
-#pragma omp critical (graphq)
-                more_to_merge = graphq_size > 1;
+        // Concatenate the regions in order. Each region's ids are moved past
+        // those of all the regions before it, and the tails of what we have so
+        // far are joined to its heads, just as appending the regions one at a
+        // time would, but we move the nodes and edges over and index the
+        // result once, rather than re-indexing the growing graph for every
+        // region.
+        create_progress("joining regions", region_graphs.size());
+        VG* target_graph = region_graphs.front();
+        id_t offset = region_max_ids.front();
+        vector<id_t> tails = region_tails.front();
+        target_graph->paths.clear_mapping_ranks();
+        for (size_t i = 1; i < region_graphs.size(); ++i) {
+            VG* region = region_graphs[i];
+            Graph& g = region->graph;
+            for (size_t j = 0; j < g.node_size(); ++j) {
+                Node* node = target_graph->graph.add_node();
+                node->Swap(g.mutable_node(j));
+                node->set_id(node->id() + offset);
+            }
+            for (size_t j = 0; j < g.edge_size(); ++j) {
+                Edge* edge = target_graph->graph.add_edge();
+                edge->Swap(g.mutable_edge(j));
+                edge->set_from(edge->from() + offset);
+                edge->set_to(edge->to() + offset);
+            }
+            // a region without heads leaves the tails before it as tails
+            if (!region_heads[i].empty()) {
+                for (id_t tail : tails) {
+                    for (id_t head : region_heads[i]) {
+                        // Connect the tail to the head with a left to right edge.
+                        Edge* edge = target_graph->graph.add_edge();
+                        edge->set_from(tail);
+                        edge->set_to(head + offset);
+                    }
+                }
+                tails.clear();
             }
+            for (id_t tail : region_tails[i]) {
+                tails.push_back(tail + offset);
+            }
+            // and join paths that are embedded in the graph, where path names
+            // are the same; ranks are reassigned once we're done
+            region->paths.for_each_name([&](const string& name) {
+                for (auto& m : region->paths.get_path(name)) {
+                    Mapping mapping = m;
+                    mapping.set_rank(0);
+                    mapping.mutable_position()->set_node_id(m.position().node_id() + offset);
+                    target_graph->paths.append_mapping(name, mapping);
+                }
+            });
+            offset += region_max_ids[i];
+            delete region;
+            update_progress(i);
         }
+        target_graph->rebuild_indexes();
+        target_graph->paths.rebuild_mapping_aux();
         destroy_progress();
 
-        // parallel end
-        // finalize target
-
-        // our target graph should be the only entry in the graphq
-        assert(graphq.size() == 1);
-        VG* target_graph = graphq.front();
-
         // store it in our results
         refseq_graph[target] = target_graph;
 
@@ -154,6 +154,10 @@ public:
     // construct from protobufs
     VG(istream& in, bool showp = false);
 
+    // construct from protobufs, keeping only the nodes with ids in [min_id,
+    // max_id], the edges between them, and the path mappings on them
+    VG(istream& in, id_t min_id, id_t max_id, bool showp = false);
+
     // construct from an arbitrary source of Graph protobuf messages (which
     // populates the given Graph and returns a flag for whether it's valid).
     VG(function<bool(Graph&)>& get_next_graph, bool showp = false);
@@ -1119,6 +1123,13 @@ public:
 private:
 
     void init(void); // setup, ensures that gssw == NULL on startup
+    // load the chunks of a stream in one pass, keeping the nodes in the id range
+    void load_from_stream(istream& in, id_t min_id, id_t max_id);
+    // size the graph and indexes to hold this many nodes and edges
+    void reserve_indexes(size_t nodes, size_t edges);
+    // like extend, but takes the nodes and edges out of the chunk rather than
+    // copying them, and skips those outside the id range
+    void extend_by_moving(Graph& chunk, id_t min_id, id_t max_id);
     // placeholders for empty
     vector<id_t> empty_ids;
     vector<pair<id_t, bool>> empty_edge_ends;
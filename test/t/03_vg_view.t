@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 13
+plan tests 15
 
 is $(vg construct -r small/x.fa -v small/x.vcf.gz | vg view -d - | wc -l) 505 "view produces the expected number of lines of dot output"
 is $(vg construct -r small/x.fa -v small/x.vcf.gz | vg view -g - | wc -l) 641 "view produces the expected number of lines of GFA output"
@@ -36,4 +36,6 @@ is $(vg view -d ./cyclic/all.vg | wc -l) 23 "view produces the expected number o
 
 vg construct -r small/x.fa -v small/x.vcf.gz >x.vg
 is $(cat x.vg x.vg x.vg x.vg | vg view -c - | wc -l) 4 "streaming JSON output produces the expected number of chunks"
+is $(vg view -R 10:20 -j x.vg | jq '.node | length') 11 "view can load only an id range of a graph"
+is $(vg view -R 10:20 -j x.vg | jq '[.edge[] | select(.from < 10 or .from > 20 or .to < 10 or .to > 20)] | length') 0 "loading an id range keeps only the edges inside it"
 rm x.vg
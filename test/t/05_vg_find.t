@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 31
+plan tests 35
 
 vg construct -r small/x.fa -v small/x.vcf.gz >x.vg
 is $? 0 "construction"
@@ -90,5 +90,13 @@ rm -rf x.db x.gam x.reads
 vg sim -s 1337 -n 1 -x x.xg -a >x.gam
 is $(vg find -G x.gam -x x.xg | vg view - | grep ATTAGCCATGTGACTTTGAACAAGTTAGTTAATCTCTCTGAACTTCAGTT | wc -l) 1 "the index can be queried using GAM alignments"
 
-rm -rf x.vg x.xg x.gcsa x.gam
+vg sim -s 1337 -n 100 -x x.xg -a >x.gam
+vg index -B x.gam
+is $? 0 "a block index can be built for a GAM"
+is $(vg find -G x.gam -R 1:100000 -x x.xg | vg view - | md5sum | cut -f 1 -d\ ) $(vg find -G x.gam -x x.xg | vg view - | md5sum | cut -f 1 -d\ ) "the block index finds the alignments in a node range"
+vg view -a x.gam | jq -c 'select([.path.mapping[].position.node_id | select(. >= 50 and . <= 52)] | length > 0)' | vg view -JGa - >x.sub.gam
+is $(vg view -a x.sub.gam | wc -l | awk '{print ($1 > 0 && $1 < 100)}') 1 "a narrow node range is touched by some of the alignments, each in a block of its own"
+is $(vg find -G x.gam -R 50:52 -x x.xg | vg view - | md5sum | cut -f 1 -d\ ) $(vg find -G x.sub.gam -x x.xg | vg view - | md5sum | cut -f 1 -d\ ) "the block index finds exactly the alignments touching a narrow node range"
+
+rm -rf x.vg x.xg x.gcsa x.gam x.gam.bi x.sub.gam
 
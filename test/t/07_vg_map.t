@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 31
+plan tests 45
 
 vg construct -r small/x.fa -v small/x.vcf.gz >x.vg
 vg index -x x.xg -g x.gcsa -k 11 x.vg
@@ -127,4 +127,61 @@ is $(vg map -x graphs/refonly-lrc_kir.vg.xg -g graphs/refonly-lrc_kir.vg.gcsa -f
 
 is $(vg map -x graphs/refonly-lrc_kir.vg.xg -g graphs/refonly-lrc_kir.vg.gcsa -f reads/grch38_lrc_kir_paired.fq -i -W 300 -u 0 -U -W 750 -J | jq -r 'select(.name == "ERR194147.679985061/1") | .path.mapping[0].position.node_id') 8121 "rescue can replace extra multimappings"
 
-rm -f x.vg.idx x.vg.gcsa x.vg.gcsa.lcp x.vg x.reads x.xg x.gcsa graphs/refonly-lrc_kir.vg.xg graphs/refonly-lrc_kir.vg.gcsa graphs/refonly-lrc_kir.vg.gcsa.lcp
+vg sim -s 1337 -n 2000 -l 100 -e 0.01 -x x.xg >x.reads
+is $(vg map -r x.reads -x x.xg -g x.gcsa -t 4 -3 | vg view -a - | jq -r '.sequence' | md5sum | awk '{print $1}') \
+   $(vg map -r x.reads -x x.xg -g x.gcsa -t 1 | vg view -a - | jq -r '.sequence' | md5sum | awk '{print $1}') \
+   "multithreaded mapping keeps the input order when asked to"
+
+is $(vg map -r x.reads -x x.xg -g x.gcsa -4 8 | vg view -a - | jq -c '[.score, .path]' | md5sum | awk '{print $1}') \
+   $(vg map -r x.reads -x x.xg -g x.gcsa | vg view -a - | jq -c '[.score, .path]' | md5sum | awk '{print $1}') \
+   "a k-mer range table does not change MEM mapping results"
+
+is $(vg map -r x.reads -x x.xg -g x.gcsa | vg view -a - | jq -c '.score' | md5sum | awk '{print $1}') \
+   $(vg map -r x.reads -x x.xg -g x.gcsa -6 | vg view -a - | jq -c '.score' | md5sum | awk '{print $1}') \
+   "ungapped extension of MEMs scores reads the same as DP"
+
+cat x.reads x.reads >x.dup.reads
+is $(vg map -r x.dup.reads -x x.xg -g x.gcsa --dup-cache 10000 | vg view -a - | jq -c '[.score, .path]' | md5sum | awk '{print $1}') \
+   $(vg map -r x.dup.reads -x x.xg -g x.gcsa | vg view -a - | jq -c '[.score, .path]' | md5sum | awk '{print $1}') \
+   "reusing the alignments of duplicate reads does not change mapping results"
+is $(vg map -r <(printf "$seq\n$seq\n") -x x.xg -g x.gcsa -t 1 -6 -D 2>&1 >/dev/null | grep "subgraphs reused" | awk '{print ($6 > 0)}') 1 \
+   "the subgraph of a repeated read is reused from the cache"
+
+ref=$(grep -v "^>" small/x.fa | tr -d '\n')
+mate1=${ref:100:100}
+mate2=$(echo ${ref:300:100} | rev | tr ACGT TGCA)
+quals=$(printf 'I%.0s' $(seq 100))
+for i in 1 2 3; do printf "@dup/1\n$mate1\n+\n$quals\n@dup/2\n$mate2\n+\n$quals\n"; done >x.dup.fq
+printf "300\t100\n" >x.model
+vg map -x x.xg -g x.gcsa -f x.dup.fq -i -t 1 -9 x.model -0 x.cached.model --dup-cache 100 | vg view -a - | jq -c '[.score, .path, .fragment]' >x.cached.json
+vg map -x x.xg -g x.gcsa -f x.dup.fq -i -t 1 -9 x.model -0 x.uncached.model | vg view -a - | jq -c '[.score, .path, .fragment]' >x.uncached.json
+is $(cat x.cached.json x.cached.model | md5sum | awk '{print $1}') $(cat x.uncached.json x.uncached.model | md5sum | awk '{print $1}') \
+   "reusing the alignments of duplicate pairs does not change mapping results or the fragment length distribution"
+rm -f x.dup.fq x.model x.cached.model x.uncached.model x.cached.json x.uncached.json
+
+is $(vg map -x graphs/refonly-lrc_kir.vg.xg -g graphs/refonly-lrc_kir.vg.gcsa -f <(gzip -c reads/grch38_lrc_kir_paired.fq) -i -t 1 | vg view -a - | jq -c '[.name, .score]' | md5sum | awk '{print $1}') \
+   $(vg map -x graphs/refonly-lrc_kir.vg.xg -g graphs/refonly-lrc_kir.vg.gcsa -f reads/grch38_lrc_kir_paired.fq -i -t 1 | vg view -a - | jq -c '[.name, .score]' | md5sum | awk '{print $1}') \
+   "gzipped fastq input is read in batches the same as plain text"
+
+is $(vg map -x graphs/refonly-lrc_kir.vg.xg -g graphs/refonly-lrc_kir.vg.gcsa -f <(cat reads/grch38_lrc_kir_paired.fq; head -4 reads/grch38_lrc_kir_paired.fq) -i 2>&1 >/dev/null | grep -c "odd number of reads") 1 \
+   "an interleaved fastq file with an odd number of reads is warned about"
+
+vg construct -r mem/repeats.fa >r.vg
+vg index -x r.xg -g r.gcsa -k 16 r.vg
+unit=GTTGTCTATGCCAGGGCGACGACATTGCGGGTAGTTCGAG
+is $(vg map -s $unit -x r.xg -g r.gcsa -8 10 -D 2>&1 >/dev/null | grep "reads over budget" | awk '{print $5}') 1 "a read whose MEM has more hits than the budget is counted as over budget"
+is $(vg map -s $unit -x r.xg -g r.gcsa -8 30 -D 2>&1 >/dev/null | grep "reads over budget" | awk '{print $5}') 0 "a read whose MEM hits all fit in the budget is not counted as over budget"
+is $(vg map -s $unit -x r.xg -g r.gcsa -8 10 -J | jq '.score') 40 "a read over the MEM hit budget still aligns to a sampled hit"
+
+decoy=AAGCTCGGGTTACTATTATATATACCTGAATGTACGAAACATAAATCGCC
+is $(vg map -s $decoy -x r.xg -g r.gcsa -M 3 | vg surject -x r.xg -s - | grep -v "^@" | cut -f 3 | grep -c target) 1 "reseeding a repeated MEM finds a hit that differs from the repeat by one base"
+is $(vg map -s $decoy -x r.xg -g r.gcsa -M 3 -7 0 | vg surject -x r.xg -s - | grep -v "^@" | cut -f 3 | grep -c target) 0 "without reseeding the hit that differs from the repeat is not found"
+
+vg construct -r mem/rescue.fa >w.vg
+vg index -x w.xg -g w.gcsa -k 16 w.vg
+printf "400\t100\n" >w.model
+is $(vg map -x w.xg -g w.gcsa -f reads/rescue_paired.fq -i -L 20 -9 w.model -J | jq -c 'select(.name == "pair/2") | [.score, .path.mapping[0].position]') \
+   '[55,{"node_id":1,"offset":250,"is_reverse":true}]' \
+   "a mate with no MEM hits is rescued within the path window given by the fragment length model"
+
+rm -f x.vg.idx x.vg.gcsa x.vg.gcsa.lcp x.vg x.reads x.dup.reads x.xg x.gcsa graphs/refonly-lrc_kir.vg.xg graphs/refonly-lrc_kir.vg.gcsa graphs/refonly-lrc_kir.vg.gcsa.lcp r.vg r.xg r.gcsa r.gcsa.lcp w.vg w.xg w.gcsa w.gcsa.lcp w.model
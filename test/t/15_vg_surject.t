@@ -6,7 +6,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 PATH=../bin:$PATH # for vg
 
 
-plan tests 11
+plan tests 12
 
 vg construct -r small/x.fa >j.vg
 vg index -x j.xg j.vg
@@ -37,10 +37,14 @@ is "$(vg map -s $SEQ -g x.gcsa -x x.xg | vg surject -p x -x x.xg - -s | cut -f1,
 is $(vg map -G <(vg sim -a -s 1337 -n 100 -x x.xg) -g x.gcsa -x x.xg | vg surject -p x -x x.xg -b - | samtools view - | wc -l) \
     100 "vg surject produces valid BAM output"
 
+vg map -G <(vg sim -a -s 1337 -n 100 -x j.xg) -g x.gcsa -x x.xg >x.gam
+is "$(vg surject -p x -x x.xg -t 1 -s x.gam | grep -v ^@ | cut -f3,4,6)" "$(vg surject -p x -x x.xg -t 1 -s -R x.gam | grep -v ^@ | cut -f3,4,6)" \
+    "following alignments along the path places reads the same as realigning them"
+
 #is $(vg map -G <(vg sim -a -s 1337 -n 100 x.vg) x.vg | vg surject -p x -g x.gcsa -x x.xg -c - | samtools view - | wc -l) \
 #    100 "vg surject produces valid CRAM output"
 
-rm -rf j.vg x.vg x.idx j.xg x.xg x.gcsa
+rm -rf j.vg x.vg x.idx j.xg x.xg x.gcsa x.gam
 
 vg index -k 11 -e 5 -g f.gcsa -x f.xg graphs/fail.vg
 